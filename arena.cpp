@@ -0,0 +1,150 @@
+#include "arena.h"
+
+#include <mutex>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        constexpr size_t BLOCK_SIZE = 64U * 1024U;
+        // Объекты крупнее получают отдельный блок, не прерывая заполнение текущего
+        constexpr size_t LARGE_OBJECT_SIZE = BLOCK_SIZE / 4;
+        // Перед каждым объектом хранится указатель на арену-владельца (nullptr для кучи).
+        // Размер заголовка сохраняет выравнивание объекта
+        constexpr size_t HEADER_SIZE = alignof(max_align_t);
+
+        // Сколько освобождённых блоков хранить для следующих арен. Пакетный запуск программ
+        // в одном процессе разбирает их в блоках, оставшихся от предыдущих программ
+        constexpr size_t MAX_POOLED_BLOCKS = 64;
+
+        thread_local Arena* current_arena = nullptr;
+
+        // Пул свободных блоков размера BLOCK_SIZE, общий для всех потоков: арена может быть
+        // освобождена не тем потоком, который её создал. Пул намеренно не уничтожается,
+        // чтобы арены, освобождаемые при завершении программы, могли вернуть в него блоки
+        class BlockPool {
+        public:
+            static BlockPool& Instance() {
+                static auto* pool = new BlockPool;
+                return *pool;
+            }
+
+            byte* Take() {
+                {
+                    lock_guard guard(mutex_);
+                    if (!blocks_.empty()) {
+                        byte* block = blocks_.back();
+                        blocks_.pop_back();
+                        return block;
+                    }
+                }
+                return static_cast<byte*>(::operator new(BLOCK_SIZE));
+            }
+
+            void Put(byte* block) noexcept {
+                {
+                    lock_guard guard(mutex_);
+                    if (blocks_.size() < MAX_POOLED_BLOCKS) {
+                        blocks_.push_back(block);
+                        return;
+                    }
+                }
+                ::operator delete(block);
+            }
+
+        private:
+            BlockPool() {
+                blocks_.reserve(MAX_POOLED_BLOCKS);
+            }
+
+            mutex mutex_;
+            vector<byte*> blocks_;
+        };
+
+        size_t AlignUp(size_t size) {
+            return (size + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+        }
+
+        Arena* Owner(const void* pointer) {
+            const auto* header = static_cast<const byte*>(pointer) - HEADER_SIZE;
+            return *reinterpret_cast<Arena* const*>(header);
+        }
+    }
+
+    void* Arena::Allocate(size_t size) {
+        const size_t total = HEADER_SIZE + AlignUp(size);
+        Arena* arena = current_arena;
+        byte* memory = nullptr;
+        if (arena == nullptr) {
+            memory = static_cast<byte*>(::operator new(total));
+        } else {
+            memory = static_cast<byte*>(arena->AllocateBlock(total));
+            arena->live_count_.fetch_add(1, memory_order_relaxed);
+        }
+        new (memory) Arena*(arena);
+        return memory + HEADER_SIZE;
+    }
+
+    void Arena::Deallocate(void* pointer) noexcept {
+        if (pointer == nullptr) {
+            return;
+        }
+        Arena* owner = Owner(pointer);
+        if (owner == nullptr) {
+            ::operator delete(static_cast<byte*>(pointer) - HEADER_SIZE);
+            return;
+        }
+        owner->Release();
+    }
+
+    bool Arena::IsArenaAllocated(const void* pointer) noexcept {
+        return Owner(pointer) != nullptr;
+    }
+
+    Arena::~Arena() {
+        BlockPool& pool = BlockPool::Instance();
+        for (byte* block : blocks_) {
+            pool.Put(block);
+        }
+        for (byte* block : large_blocks_) {
+            ::operator delete(block);
+        }
+    }
+
+    void* Arena::AllocateBlock(size_t size) {
+        if (size > LARGE_OBJECT_SIZE) {
+            auto* block = static_cast<byte*>(::operator new(size));
+            large_blocks_.push_back(block);
+            return block;
+        }
+        if (size > available_) {
+            current_ = BlockPool::Instance().Take();
+            blocks_.push_back(current_);
+            available_ = BLOCK_SIZE;
+        }
+        byte* result = current_;
+        current_ += size;
+        available_ -= size;
+        return result;
+    }
+
+    void Arena::Release() noexcept {
+        if (live_count_.fetch_sub(1, memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    ArenaScope::ArenaScope()
+        : arena_(new Arena)
+        , outer_(exchange(current_arena, arena_)) {
+    }
+
+    ArenaScope::~ArenaScope() {
+        current_arena = outer_;
+        arena_->Release();
+    }
+
+}  // namespace runtime
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace runtime {
+
+    // Арена для узлов дерева программы. Выделение памяти сводится к сдвигу указателя внутри
+    // крупного блока, а освобождение отдельных узлов - к уменьшению счётчика.
+    // Блоки арены освобождаются разом, когда закрыта область ArenaScope, в которой арена
+    // создана, и уничтожен последний выделенный в ней узел. Поэтому узлы могут пережить
+    // область: например, методы классов, сохранённых в Closure после выполнения программы.
+    // Освобождённые блоки переиспользуются следующими аренами
+    class Arena {
+    public:
+        // Выделяет size байт в текущей арене либо в куче, если арена не активна
+        static void* Allocate(std::size_t size);
+        // Освобождает память, выделенную Allocate
+        static void Deallocate(void* pointer) noexcept;
+
+        // Возвращает true, если pointer выделен методом Allocate в арене
+        [[nodiscard]] static bool IsArenaAllocated(const void* pointer) noexcept;
+
+    private:
+        friend class ArenaScope;
+
+        Arena() = default;
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* AllocateBlock(std::size_t size);
+        // Уменьшает счётчик live_count_ и освобождает арену, когда он обнуляется
+        void Release() noexcept;
+
+        // Блоки стандартного размера, после освобождения арены возвращаются в общий пул
+        std::vector<std::byte*> blocks_;
+        // Отдельные блоки крупных объектов
+        std::vector<std::byte*> large_blocks_;
+        std::byte* current_ = nullptr;
+        std::size_t available_ = 0;
+        // Живые узлы и открытая область, создавшая арену. Узлы одной программы могут
+        // освобождаться в другом потоке, поэтому счётчик атомарный
+        std::atomic<std::size_t> live_count_ = 1;
+    };
+
+    // Делает новую арену текущей на время своего существования.
+    // Области могут быть вложенными; арена действует в потоке, создавшем область
+    class ArenaScope {
+    public:
+        ArenaScope();
+        ~ArenaScope();
+
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+    private:
+        Arena* arena_;
+        Arena* outer_;
+    };
+
+}  // namespace runtime
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace ast {
+    class NewInstance;
+}
+
+namespace bytecode {
+
+    // Коды операций регистровой машины.
+    // В комментариях r[x] - регистр текущего кадра, bc - 32-битный операнд, собранный из b и c
+#define BYTECODE_OPCODES(X)                                                                    \
+    X(LoadConst)      /* r[a] = constants[bc] */                                               \
+    X(LoadNone)       /* r[a] = None */                                                        \
+    X(Move)           /* r[a] = r[b] */                                                        \
+    X(LoadGlobal)     /* r[a] = closure[names[b]], либо runtime_error, если имени нет */       \
+    X(StoreGlobal)    /* closure[names[b]] = r[a] */                                           \
+    X(DefineGlobal)   /* closure.emplace(names[b], r[a]), имя не перезаписывается */           \
+    X(DefineLocal)    /* r[a] = r[b], если r[a] ещё не присвоен */                             \
+    X(CheckBound)     /* runtime_error, если переменной r[a] (имя names[b]) нет значения */    \
+    X(GetField)       /* r[a] = r[b].names[c] */                                               \
+    X(SetField)       /* r[a].names[b] = r[c] */                                               \
+    X(Add)            /* r[a] = r[b] + r[c] */                                                 \
+    X(Sub)            /* r[a] = r[b] - r[c] */                                                 \
+    X(Mult)           /* r[a] = r[b] * r[c] */                                                 \
+    X(Div)            /* r[a] = r[b] / r[c] */                                                 \
+    X(ToBool)         /* r[a] = Bool(IsTrue(r[b])), для or и and с ленивым правым операндом */ \
+    X(Not)            /* r[a] = Bool(!IsTrue(r[b])) */                                         \
+    X(Equal)          /* r[a] = Bool(r[b] == r[c]) */                                          \
+    X(NotEqual)       /* r[a] = Bool(r[b] != r[c]) */                                          \
+    X(Less)           /* r[a] = Bool(r[b] < r[c]) */                                           \
+    X(Greater)        /* r[a] = Bool(r[b] > r[c]) */                                           \
+    X(LessOrEqual)    /* r[a] = Bool(r[b] <= r[c]) */                                          \
+    X(GreaterOrEqual) /* r[a] = Bool(r[b] >= r[c]) */                                          \
+    X(Stringify)      /* r[a] = str(r[b]) */                                                   \
+    X(Print)          /* выводит r[a], затем пробел (b == 0) или перевод строки (b != 0) */    \
+    X(PrintNewline)   /* выводит перевод строки (команда print без аргументов) */              \
+    X(Call)           /* r[a] = r[a].names[b](r[a + 1], ..., r[a + c]) */                      \
+    X(NewInstance)    /* r[a] = new_instances[b](r[a + 1], ..., r[a + c]) */                   \
+    X(Native)         /* r[a] = natives[b]->Execute(closure, context) */                       \
+    X(Jump)           /* переход на инструкцию bc */                                           \
+    X(JumpIfFalse)    /* переход на инструкцию bc, если !IsTrue(r[a]) */                       \
+    X(JumpIfTrue)     /* переход на инструкцию bc, если IsTrue(r[a]) */                        \
+    X(Return)         /* завершает функцию, возвращая r[a] */                                  \
+    X(ReturnNone)     /* завершает функцию, возвращая None */
+
+    enum class OpCode : uint8_t {
+#define BYTECODE_OPCODE_ENUM(name) name,
+        BYTECODE_OPCODES(BYTECODE_OPCODE_ENUM)
+#undef BYTECODE_OPCODE_ENUM
+    };
+
+    // Количество кодов операций, используется для построения таблицы переходов
+    inline constexpr size_t OPCODE_COUNT = 0
+#define BYTECODE_OPCODE_COUNT(name) + 1
+        BYTECODE_OPCODES(BYTECODE_OPCODE_COUNT)
+#undef BYTECODE_OPCODE_COUNT
+        ;
+
+    // Инструкция фиксированного размера: код операции и три 16-битных операнда
+    struct Instruction {
+        OpCode op;
+        uint16_t a = 0;
+        uint16_t b = 0;
+        uint16_t c = 0;
+
+        [[nodiscard]] uint32_t BC() const {
+            return static_cast<uint32_t>(b) | (static_cast<uint32_t>(c) << 16);
+        }
+    };
+
+    static_assert(sizeof(Instruction) == 8);
+
+    // Предельное значение 16-битного операнда
+    inline constexpr uint32_t MAX_OPERAND = std::numeric_limits<uint16_t>::max();
+
+    // Скомпилированная функция: тело метода либо программа верхнего уровня.
+    // В методе регистр 0 - self, регистры 1..param_count - параметры, далее локальные
+    // переменные и временные значения. Вызов метода размещает кадр вызываемого прямо поверх
+    // регистров получателя и аргументов, поэтому аргументы не копируются
+    struct Function {
+        std::string name;
+        std::vector<Instruction> code;
+        std::vector<runtime::ObjectHolder> constants;
+        std::vector<runtime::Symbol> names;
+        // Кэши поиска методов, по одному на каждое имя из names: вызовы одноимённых методов
+        // внутри функции делят кэш. Заполняются во время выполнения
+        mutable std::vector<runtime::MethodCache> method_caches;
+        // Кэши доступа к полям, устроенные так же, как method_caches
+        mutable std::vector<runtime::FieldCache> field_caches;
+        // Узлы создания экземпляров: хранят класс и реализуют вызов __init__
+        std::vector<ast::NewInstance*> new_instances;
+        // Инструкции, не поддерживаемые компилятором, исполняются обходом дерева
+        std::vector<runtime::Executable*> natives;
+        // Локальные переменные, которые могут быть прочитаны до присваивания
+        std::vector<uint16_t> unbound_registers;
+        uint16_t param_count = 0;
+        uint16_t register_count = 1;
+        // true для программы верхнего уровня: её переменные хранятся в Closure
+        bool is_global = false;
+    };
+
+    // Выводит в os листинг функции, используется при отладке и в тестах
+    void Disassemble(std::ostream& os, const Function& function);
+
+}  // namespace bytecode
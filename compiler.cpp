@@ -0,0 +1,703 @@
+#include "compiler.h"
+
+#include "bytecode.h"
+#include "statement.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace bytecode {
+
+    namespace {
+        using runtime::ObjectHolder;
+
+        // Признак того, что значение выражения не нужно сохранять
+        constexpr uint32_t NO_REGISTER = numeric_limits<uint32_t>::max();
+
+        OpCode ComparisonOpCode(runtime::Comparator cmp) {
+            switch (cmp) {
+                case runtime::Comparator::Equal:
+                    return OpCode::Equal;
+                case runtime::Comparator::NotEqual:
+                    return OpCode::NotEqual;
+                case runtime::Comparator::Less:
+                    return OpCode::Less;
+                case runtime::Comparator::Greater:
+                    return OpCode::Greater;
+                case runtime::Comparator::LessOrEqual:
+                    return OpCode::LessOrEqual;
+                case runtime::Comparator::GreaterOrEqual:
+                    return OpCode::GreaterOrEqual;
+            }
+            throw CompileError("Unknown comparison"s);
+        }
+
+        uint16_t ToOperand(size_t value) {
+            if (value > MAX_OPERAND) {
+                throw CompileError("Bytecode operand is out of range"s);
+            }
+            return static_cast<uint16_t>(value);
+        }
+
+        // Восстанавливает вершину временных регистров при выходе из области видимости
+        class TempScope {
+        public:
+            explicit TempScope(uint32_t& next_register)
+                : next_register_(next_register)
+                , mark_(next_register) {
+            }
+
+            TempScope(const TempScope&) = delete;
+            TempScope& operator=(const TempScope&) = delete;
+
+            ~TempScope() {
+                next_register_ = mark_;
+            }
+
+        private:
+            uint32_t& next_register_;
+            uint32_t mark_;
+        };
+
+        // Компилятор одной функции: программы верхнего уровня либо тела метода
+        class FunctionCompiler {
+        public:
+            // Классы, объявленные внутри функции, добавляются в classes
+            FunctionCompiler(Function& function, vector<runtime::Class*>& classes)
+                : function_(function)
+                , classes_(classes) {
+            }
+
+            void CompileProgram(const runtime::Executable& program) {
+                function_.is_global = true;
+                function_.name = "<program>"s;
+                const uint32_t result = AllocateRegister();
+                CompileNode(program, result);
+                Emit(OpCode::Return, result);
+                Finish();
+            }
+
+            void CompileMethod(const runtime::Method& method) {
+                function_.name = method.name.Str();
+                function_.param_count = ToOperand(method.formal_params.size());
+
+                // Как и в ClassInstance::Call, при совпадении имён побеждает первое
+                locals_.emplace("self"s, 0);
+                for (size_t i = 0; i < method.formal_params.size(); ++i) {
+                    locals_.emplace(method.formal_params[i], ToOperand(i + 1));
+                }
+                next_register_ = function_.param_count + 1U;
+                CollectLocals(*method.body);
+                assigned_.assign(next_register_, false);
+                fill_n(assigned_.begin(), function_.param_count + 1U, true);
+                max_register_ = next_register_;
+
+                if (const auto* body = dynamic_cast<const ast::MethodBody*>(method.body.get())) {
+                    CompileNode(body->GetBody(), NO_REGISTER);
+                    Emit(OpCode::ReturnNone);
+                } else {
+                    // Тело без MethodBody возвращает значение самой инструкции
+                    TempScope scope(next_register_);
+                    Emit(OpCode::Return, CompileOperand(*method.body));
+                }
+                Finish();
+            }
+
+        private:
+            [[nodiscard]] bool IsGlobal() const {
+                return function_.is_global;
+            }
+
+            // Назначает регистры всем именам, встречающимся в теле метода, и запоминает узлы,
+            // внутри которых есть присваивание локальной переменной.
+            // Возвращает true, если такое присваивание есть внутри node
+            bool CollectLocals(const runtime::Executable& node) {
+                bool has_stores = false;
+                auto declare = [this](runtime::Symbol name) {
+                    if (locals_.emplace(name, ToOperand(next_register_)).second) {
+                        ++next_register_;
+                    }
+                };
+                auto visit = [this, &has_stores](const runtime::Executable& child) {
+                    has_stores = CollectLocals(child) || has_stores;
+                };
+                auto visit_all = [&visit](const vector<unique_ptr<ast::Statement>>& children) {
+                    for (const auto& child : children) {
+                        visit(*child);
+                    }
+                };
+
+                if (const auto* var = dynamic_cast<const ast::VariableValue*>(&node)) {
+                    declare(var->GetDottedIds().front());
+                } else if (const auto* assign = dynamic_cast<const ast::Assignment*>(&node)) {
+                    declare(assign->GetVarName());
+                    visit(assign->GetRightValue());
+                    has_stores = true;
+                } else if (const auto* field = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+                    visit(field->GetObject());
+                    visit(field->GetRightValue());
+                } else if (const auto* call = dynamic_cast<const ast::MethodCall*>(&node)) {
+                    visit(call->GetObject());
+                    visit_all(call->GetArgs());
+                } else if (const auto* binary = dynamic_cast<const ast::BinaryOperation*>(&node)) {
+                    visit(binary->GetLhs());
+                    visit(binary->GetRhs());
+                } else if (const auto* unary = dynamic_cast<const ast::UnaryOperation*>(&node)) {
+                    visit(unary->GetArgument());
+                } else if (const auto* compound = dynamic_cast<const ast::Compound*>(&node)) {
+                    visit_all(compound->GetStatements());
+                } else if (const auto* if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+                    visit(if_else->GetCondition());
+                    visit(if_else->GetIfBody());
+                    if (if_else->GetElseBody() != nullptr) {
+                        visit(*if_else->GetElseBody());
+                    }
+                } else if (const auto* ret = dynamic_cast<const ast::Return*>(&node)) {
+                    visit(ret->GetStatement());
+                } else if (const auto* print = dynamic_cast<const ast::Print*>(&node)) {
+                    visit_all(print->GetArgs());
+                } else if (const auto* instance = dynamic_cast<const ast::NewInstance*>(&node)) {
+                    visit_all(instance->GetArgs());
+                } else if (const auto* body = dynamic_cast<const ast::MethodBody*>(&node)) {
+                    visit(body->GetBody());
+                } else if (const auto* cls = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+                    declare(cls->GetClass().TryAs<runtime::Class>()->GetName());
+                    has_stores = true;
+                } else if (!IsConstant(node) && dynamic_cast<const ast::None*>(&node) == nullptr) {
+                    throw CompileError("Unsupported statement in method body"s);
+                }
+
+                if (has_stores) {
+                    nodes_with_stores_.insert(&node);
+                }
+                return has_stores;
+            }
+
+            static bool IsConstant(const runtime::Executable& node) {
+                return dynamic_cast<const ast::NumericConst*>(&node) != nullptr
+                       || dynamic_cast<const ast::StringConst*>(&node) != nullptr
+                       || dynamic_cast<const ast::BoolConst*>(&node) != nullptr;
+            }
+
+            // Вычисляет node и, если dst != NO_REGISTER, записывает его значение в регистр dst.
+            // Регистр dst изменяется только последней инструкцией вычисления
+            void CompileNode(const runtime::Executable& node, uint32_t dst) {
+                if (const auto* var = dynamic_cast<const ast::VariableValue*>(&node)) {
+                    CompileVariable(*var, dst);
+                } else if (const auto* num = dynamic_cast<const ast::NumericConst*>(&node)) {
+                    CompileConstant(NumberConstant(num->GetValue().GetValue()), dst);
+                } else if (const auto* str = dynamic_cast<const ast::StringConst*>(&node)) {
+                    CompileConstant(StringConstant(str->GetValue().GetValue()), dst);
+                } else if (const auto* boolean = dynamic_cast<const ast::BoolConst*>(&node)) {
+                    CompileConstant(BoolConstant(boolean->GetValue().GetValue()), dst);
+                } else if (const auto* assign = dynamic_cast<const ast::Assignment*>(&node)) {
+                    CompileAssignment(*assign, dst);
+                } else if (const auto* field = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+                    CompileFieldAssignment(*field, dst);
+                } else if (const auto* call = dynamic_cast<const ast::MethodCall*>(&node)) {
+                    CompileMethodCall(*call, dst);
+                } else if (const auto* compound = dynamic_cast<const ast::Compound*>(&node)) {
+                    CompileCompound(*compound, dst);
+                } else if (const auto* if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+                    CompileIfElse(*if_else, dst);
+                } else if (const auto* ret = dynamic_cast<const ast::Return*>(&node)) {
+                    CompileReturn(*ret);
+                } else if (const auto* print = dynamic_cast<const ast::Print*>(&node)) {
+                    CompilePrint(*print, dst);
+                } else if (const auto* cmp = dynamic_cast<const ast::Comparison*>(&node)) {
+                    CompileComparison(*cmp, dst);
+                } else if (const auto* instance = dynamic_cast<const ast::NewInstance*>(&node)) {
+                    CompileNewInstance(*instance, dst);
+                } else if (const auto* cls = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+                    CompileClassDefinition(*cls, dst);
+                } else if (dynamic_cast<const ast::None*>(&node) != nullptr) {
+                    if (dst != NO_REGISTER) {
+                        Emit(OpCode::LoadNone, dst);
+                    }
+                } else if (!TryCompileOperation(node, dst)) {
+                    CompileNative(node, dst);
+                }
+            }
+
+            // Арифметические и логические операции
+            bool TryCompileOperation(const runtime::Executable& node, uint32_t dst) {
+                if (const auto* binary = dynamic_cast<const ast::BinaryOperation*>(&node)) {
+                    OpCode op;
+                    if (dynamic_cast<const ast::Add*>(&node) != nullptr) {
+                        op = OpCode::Add;
+                    } else if (dynamic_cast<const ast::Sub*>(&node) != nullptr) {
+                        op = OpCode::Sub;
+                    } else if (dynamic_cast<const ast::Mult*>(&node) != nullptr) {
+                        op = OpCode::Mult;
+                    } else if (dynamic_cast<const ast::Div*>(&node) != nullptr) {
+                        op = OpCode::Div;
+                    } else if (dynamic_cast<const ast::Or*>(&node) != nullptr) {
+                        CompileShortCircuit(OpCode::JumpIfTrue, *binary, dst);
+                        return true;
+                    } else if (dynamic_cast<const ast::And*>(&node) != nullptr) {
+                        CompileShortCircuit(OpCode::JumpIfFalse, *binary, dst);
+                        return true;
+                    } else {
+                        return false;
+                    }
+                    CompileBinary(op, binary->GetLhs(), binary->GetRhs(), dst);
+                    return true;
+                }
+                if (const auto* unary = dynamic_cast<const ast::UnaryOperation*>(&node)) {
+                    OpCode op;
+                    if (dynamic_cast<const ast::Stringify*>(&node) != nullptr) {
+                        op = OpCode::Stringify;
+                    } else if (dynamic_cast<const ast::Not*>(&node) != nullptr) {
+                        op = OpCode::Not;
+                    } else {
+                        return false;
+                    }
+                    TempScope scope(next_register_);
+                    const uint32_t arg = CompileOperand(unary->GetArgument());
+                    Emit(op, ResultRegister(dst), arg);
+                    return true;
+                }
+                return false;
+            }
+
+            // Возвращает регистр со значением node: регистр локальной переменной либо временный
+            uint32_t CompileOperand(const runtime::Executable& node) {
+                if (const auto* var = dynamic_cast<const ast::VariableValue*>(&node)) {
+                    if (const auto local = FindLocal(*var)) {
+                        CheckBound(*local, var->GetDottedIds().front());
+                        return *local;
+                    }
+                }
+                return CompileToTemp(node);
+            }
+
+            uint32_t CompileToTemp(const runtime::Executable& node) {
+                const uint32_t result = AllocateRegister();
+                CompileNode(node, result);
+                return result;
+            }
+
+            // Регистр для результата операции, который нужно вычислить даже без получателя
+            uint32_t ResultRegister(uint32_t dst) {
+                return dst != NO_REGISTER ? dst : AllocateRegister();
+            }
+
+            // Возвращает регистр переменной var, если это локальная переменная метода без
+            // обращения к полям
+            optional<uint32_t> FindLocal(const ast::VariableValue& var) const {
+                if (IsGlobal() || var.GetDottedIds().size() != 1) {
+                    return nullopt;
+                }
+                return locals_.at(var.GetDottedIds().front());
+            }
+
+            void CompileVariable(const ast::VariableValue& var, uint32_t dst) {
+                const auto& ids = var.GetDottedIds();
+                const uint32_t result = ResultRegister(dst);
+                uint32_t object;
+                if (IsGlobal()) {
+                    Emit(OpCode::LoadGlobal, result, Name(ids.front()));
+                    object = result;
+                } else {
+                    object = locals_.at(ids.front());
+                    CheckBound(object, ids.front());
+                    if (ids.size() == 1 && object != result) {
+                        Emit(OpCode::Move, result, object);
+                    }
+                }
+                for (size_t i = 1; i < ids.size(); ++i) {
+                    Emit(OpCode::GetField, result, object, Name(ids[i]));
+                    object = result;
+                }
+            }
+
+            void CompileConstant(uint32_t index, uint32_t dst) {
+                if (dst != NO_REGISTER) {
+                    EmitWide(OpCode::LoadConst, dst, index);
+                }
+            }
+
+            void CompileAssignment(const ast::Assignment& assign, uint32_t dst) {
+                if (IsGlobal()) {
+                    TempScope scope(next_register_);
+                    const uint32_t value = dst != NO_REGISTER ? dst : AllocateRegister();
+                    CompileNode(assign.GetRightValue(), value);
+                    Emit(OpCode::StoreGlobal, value, Name(assign.GetVarName()));
+                    return;
+                }
+                const uint32_t local = locals_.at(assign.GetVarName());
+                CompileNode(assign.GetRightValue(), local);
+                assigned_[local] = true;
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, local);
+                }
+            }
+
+            void CompileFieldAssignment(const ast::FieldAssignment& field, uint32_t dst) {
+                TempScope scope(next_register_);
+                const uint32_t object = HasStores(field.GetRightValue())
+                                            ? CompileToTemp(field.GetObject())
+                                            : CompileOperand(field.GetObject());
+                const uint32_t value = CompileOperand(field.GetRightValue());
+                Emit(OpCode::SetField, object, Name(field.GetFieldName()), value);
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, value);
+                }
+            }
+
+            // Размещает аргументы подряд после регистра base, чтобы кадр вызываемого метода
+            // начинался прямо с получателя
+            void CompileArguments(const vector<unique_ptr<ast::Statement>>& args) {
+                for (const auto& arg : args) {
+                    const uint32_t reg = AllocateRegister();
+                    TempScope scope(next_register_);
+                    CompileNode(*arg, reg);
+                }
+            }
+
+            void CompileMethodCall(const ast::MethodCall& call, uint32_t dst) {
+                TempScope scope(next_register_);
+                const uint32_t base = AllocateRegister();
+                {
+                    TempScope object_scope(next_register_);
+                    CompileNode(call.GetObject(), base);
+                }
+                CompileArguments(call.GetArgs());
+                Emit(OpCode::Call, base, Name(call.GetMethodName()), ToOperand(call.GetArgs().size()));
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, base);
+                }
+            }
+
+            void CompileNewInstance(const ast::NewInstance& instance, uint32_t dst) {
+                TempScope scope(next_register_);
+                const uint32_t base = AllocateRegister();
+                CompileArguments(instance.GetArgs());
+                // Дерево принадлежит компилируемой программе, узел изменяется при вызове __init__
+                function_.new_instances.push_back(const_cast<ast::NewInstance*>(&instance));
+                Emit(OpCode::NewInstance, base, ToOperand(function_.new_instances.size() - 1),
+                     ToOperand(instance.GetArgs().size()));
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, base);
+                }
+            }
+
+            void CompileBinary(OpCode op, const runtime::Executable& lhs,
+                               const runtime::Executable& rhs, uint32_t dst) {
+                TempScope scope(next_register_);
+                // Если правый операнд присваивает переменную, левый нужно запомнить до этого
+                const uint32_t lhs_reg = HasStores(rhs) ? CompileToTemp(lhs) : CompileOperand(lhs);
+                const uint32_t rhs_reg = CompileOperand(rhs);
+                Emit(op, ResultRegister(dst), lhs_reg, rhs_reg);
+            }
+
+            // or (skip = JumpIfTrue) и and (skip = JumpIfFalse): правый операнд вычисляется,
+            // только если левый не определил результат
+            void CompileShortCircuit(OpCode skip, const ast::BinaryOperation& operation,
+                                     uint32_t dst) {
+                TempScope scope(next_register_);
+                // dst может быть переменной из правого операнда, поэтому результат
+                // накапливается во временном регистре
+                const uint32_t result = AllocateRegister();
+                {
+                    TempScope lhs_scope(next_register_);
+                    Emit(OpCode::ToBool, result, CompileOperand(operation.GetLhs()));
+                }
+                const size_t to_end = EmitJump(skip, result);
+                {
+                    // Присваивания и проверки внутри правого операнда выполняются не всегда
+                    const vector<bool> assigned_before = assigned_;
+                    TempScope rhs_scope(next_register_);
+                    Emit(OpCode::ToBool, result, CompileOperand(operation.GetRhs()));
+                    assigned_ = assigned_before;
+                }
+                PatchJump(to_end);
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, result);
+                }
+            }
+
+            void CompileComparison(const ast::Comparison& cmp, uint32_t dst) {
+                CompileBinary(ComparisonOpCode(cmp.GetComparator()), cmp.GetLhs(), cmp.GetRhs(),
+                              dst);
+            }
+
+            void CompileCompound(const ast::Compound& compound, uint32_t dst) {
+                for (const auto& stmt : compound.GetStatements()) {
+                    TempScope scope(next_register_);
+                    CompileNode(*stmt, NO_REGISTER);
+                }
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::LoadNone, dst);
+                }
+            }
+
+            void CompileIfElse(const ast::IfElse& if_else, uint32_t dst) {
+                size_t to_else;
+                {
+                    TempScope scope(next_register_);
+                    const uint32_t condition = CompileOperand(if_else.GetCondition());
+                    to_else = EmitJump(OpCode::JumpIfFalse, condition);
+                }
+
+                const vector<bool> assigned_before = assigned_;
+                const bool reachable_before = reachable_;
+                CompileNode(if_else.GetIfBody(), dst);
+                const vector<bool> if_assigned = std::move(assigned_);
+                const bool if_reachable = reachable_;
+
+                assigned_ = assigned_before;
+                reachable_ = reachable_before;
+                if (if_else.GetElseBody() != nullptr || dst != NO_REGISTER) {
+                    const size_t to_end = EmitJump(OpCode::Jump);
+                    PatchJump(to_else);
+                    if (if_else.GetElseBody() != nullptr) {
+                        CompileNode(*if_else.GetElseBody(), dst);
+                    } else {
+                        Emit(OpCode::LoadNone, dst);
+                    }
+                    PatchJump(to_end);
+                } else {
+                    PatchJump(to_else);
+                }
+
+                // Переменная присвоена после if, если она присвоена во всех достижимых ветках
+                if (!if_reachable) {
+                    return;
+                }
+                if (reachable_) {
+                    for (size_t i = 0; i < assigned_.size(); ++i) {
+                        assigned_[i] = assigned_[i] && if_assigned[i];
+                    }
+                } else {
+                    assigned_ = if_assigned;
+                    reachable_ = true;
+                }
+            }
+
+            void CompileReturn(const ast::Return& ret) {
+                TempScope scope(next_register_);
+                Emit(OpCode::Return, CompileOperand(ret.GetStatement()));
+                reachable_ = false;
+            }
+
+            void CompilePrint(const ast::Print& print, uint32_t dst) {
+                const auto& args = print.GetArgs();
+                if (args.empty()) {
+                    Emit(OpCode::PrintNewline);
+                }
+                // Как и при обходе дерева, каждый аргумент выводится сразу после вычисления
+                for (size_t i = 0; i < args.size(); ++i) {
+                    TempScope scope(next_register_);
+                    Emit(OpCode::Print, CompileOperand(*args[i]), i + 1 == args.size() ? 1 : 0);
+                }
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::LoadNone, dst);
+                }
+            }
+
+            void CompileClassDefinition(const ast::ClassDefinition& definition, uint32_t dst) {
+                auto* cls = definition.GetClass().TryAs<runtime::Class>();
+                classes_.push_back(cls);
+
+                TempScope scope(next_register_);
+                const uint32_t value = AllocateRegister();
+                EmitWide(OpCode::LoadConst, value, AddConstant(definition.GetClass()));
+                if (IsGlobal()) {
+                    Emit(OpCode::DefineGlobal, value, Name(cls->GetName()));
+                    if (dst != NO_REGISTER) {
+                        Emit(OpCode::LoadGlobal, dst, Name(cls->GetName()));
+                    }
+                    return;
+                }
+                const uint32_t local = locals_.at(cls->GetName());
+                if (!assigned_[local]) {
+                    RequireUnbound(local);
+                    Emit(OpCode::DefineLocal, local, value);
+                    assigned_[local] = true;
+                }
+                if (dst != NO_REGISTER) {
+                    Emit(OpCode::Move, dst, local);
+                }
+            }
+
+            // Инструкцию, неизвестную компилятору, выполняет обход дерева. Это возможно только
+            // на верхнем уровне, где переменные хранятся в Closure
+            void CompileNative(const runtime::Executable& node, uint32_t dst) {
+                if (!IsGlobal()) {
+                    throw CompileError("Unsupported statement in method body"s);
+                }
+                function_.natives.push_back(const_cast<runtime::Executable*>(&node));
+                TempScope scope(next_register_);
+                Emit(OpCode::Native, ResultRegister(dst), ToOperand(function_.natives.size() - 1));
+            }
+
+            void CheckBound(uint32_t local, runtime::Symbol name) {
+                if (!assigned_[local]) {
+                    RequireUnbound(local);
+                    Emit(OpCode::CheckBound, local, Name(name));
+                    assigned_[local] = true;
+                }
+            }
+
+            void RequireUnbound(uint32_t local) {
+                if (unbound_.insert(local).second) {
+                    function_.unbound_registers.push_back(ToOperand(local));
+                }
+            }
+
+            [[nodiscard]] bool HasStores(const runtime::Executable& node) const {
+                return nodes_with_stores_.count(&node) != 0;
+            }
+
+            uint32_t AllocateRegister() {
+                const uint32_t result = ToOperand(next_register_++);
+                max_register_ = max(max_register_, next_register_);
+                return result;
+            }
+
+            uint16_t Name(runtime::Symbol name) {
+                auto [it, inserted] = name_indices_.emplace(name, function_.names.size());
+                if (inserted) {
+                    function_.names.push_back(name);
+                    function_.method_caches.emplace_back();
+                    function_.field_caches.emplace_back();
+                }
+                return ToOperand(it->second);
+            }
+
+            uint32_t AddConstant(ObjectHolder value) {
+                function_.constants.push_back(std::move(value));
+                return static_cast<uint32_t>(function_.constants.size() - 1);
+            }
+
+            uint32_t NumberConstant(int value) {
+                auto [it, inserted] = numbers_.emplace(value, 0);
+                if (inserted) {
+                    it->second = AddConstant(ObjectHolder::Own(runtime::Number{value}));
+                }
+                return it->second;
+            }
+
+            uint32_t StringConstant(const string& value) {
+                auto [it, inserted] = strings_.emplace(value, 0);
+                if (inserted) {
+                    it->second = AddConstant(ObjectHolder::Own(runtime::String{value}));
+                }
+                return it->second;
+            }
+
+            uint32_t BoolConstant(bool value) {
+                auto& index = value ? true_constant_ : false_constant_;
+                if (!index) {
+                    index = AddConstant(ObjectHolder::Own(runtime::Bool{value}));
+                }
+                return *index;
+            }
+
+            void Emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+                function_.code.push_back({op, ToOperand(a), ToOperand(b), ToOperand(c)});
+            }
+
+            void EmitWide(OpCode op, uint32_t a, uint32_t bc) {
+                function_.code.push_back({op, ToOperand(a), static_cast<uint16_t>(bc & MAX_OPERAND),
+                                          static_cast<uint16_t>(bc >> 16)});
+            }
+
+            size_t EmitJump(OpCode op, uint32_t a = 0) {
+                EmitWide(op, a, 0);
+                return function_.code.size() - 1;
+            }
+
+            // Направляет переход jump на следующую инструкцию
+            void PatchJump(size_t jump) {
+                const auto target = static_cast<uint32_t>(function_.code.size());
+                function_.code[jump].b = static_cast<uint16_t>(target & MAX_OPERAND);
+                function_.code[jump].c = static_cast<uint16_t>(target >> 16);
+            }
+
+            void Finish() {
+                function_.register_count = ToOperand(max(max_register_, next_register_));
+            }
+
+            Function& function_;
+            vector<runtime::Class*>& classes_;
+            unordered_map<runtime::Symbol, uint32_t> locals_;
+            unordered_set<const runtime::Executable*> nodes_with_stores_;
+            // Для каждой локальной переменной: присвоено ли ей значение на всех путях
+            vector<bool> assigned_;
+            bool reachable_ = true;
+            unordered_set<uint32_t> unbound_;
+            uint32_t next_register_ = 0;
+            uint32_t max_register_ = 0;
+            unordered_map<runtime::Symbol, size_t> name_indices_;
+            unordered_map<int, uint32_t> numbers_;
+            unordered_map<string, uint32_t> strings_;
+            optional<uint32_t> true_constant_;
+            optional<uint32_t> false_constant_;
+        };
+
+        // Переводит в байт-код методы классов, объявленных в программе
+        void CompileClasses(vector<runtime::Class*> pending, uint32_t jit_threshold) {
+            unordered_set<const runtime::Class*> compiled;
+            while (!pending.empty()) {
+                runtime::Class* cls = pending.back();
+                pending.pop_back();
+                if (!compiled.insert(cls).second) {
+                    continue;
+                }
+                for (auto& method : cls->Methods()) {
+                    if (dynamic_cast<const CompiledMethod*>(method.body.get()) != nullptr) {
+                        continue;
+                    }
+                    auto function = make_unique<Function>();
+                    vector<runtime::Class*> nested;
+                    try {
+                        FunctionCompiler(*function, nested).CompileMethod(method);
+                    } catch (const CompileError&) {
+                        continue;
+                    }
+                    function->name = cls->GetName() + "."s + method.name.Str();
+                    pending.insert(pending.end(), nested.begin(), nested.end());
+                    method.body =
+                        make_unique<CompiledMethod>(std::move(method.body), std::move(function),
+                                                    method.formal_params, jit_threshold);
+                }
+            }
+        }
+
+        const char* OpCodeName(OpCode op) {
+            static const char* const NAMES[] = {
+#define BYTECODE_OPCODE_NAME(name) #name,
+                BYTECODE_OPCODES(BYTECODE_OPCODE_NAME)
+#undef BYTECODE_OPCODE_NAME
+            };
+            return NAMES[static_cast<size_t>(op)];
+        }
+    }  // namespace
+
+    unique_ptr<runtime::Executable> Compile(unique_ptr<runtime::Executable> program,
+                                            uint32_t jit_threshold) {
+        auto function = make_unique<Function>();
+        vector<runtime::Class*> classes;
+        FunctionCompiler(*function, classes).CompileProgram(*program);
+        CompileClasses(std::move(classes), jit_threshold);
+        return make_unique<CompiledProgram>(std::move(program), std::move(function));
+    }
+
+    void Disassemble(ostream& os, const Function& function) {
+        os << function.name << ": params "sv << function.param_count << ", registers "sv
+           << function.register_count << '\n';
+        for (size_t i = 0; i < function.code.size(); ++i) {
+            const Instruction& instr = function.code[i];
+            os << setw(4) << i << ' ' << OpCodeName(instr.op) << ' ' << instr.a << ' ' << instr.b
+               << ' ' << instr.c << '\n';
+        }
+    }
+
+}  // namespace bytecode
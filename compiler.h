@@ -0,0 +1,28 @@
+#pragma once
+
+#include "jit.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace runtime {
+    class Executable;
+}
+
+namespace bytecode {
+
+    struct CompileError : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // Компилирует дерево, построенное ParseProgram, в байт-код регистровой машины.
+    // Методы объявленных в программе классов также переводятся в байт-код; метод, содержащий
+    // неизвестные компилятору инструкции, остаётся исполняться обходом дерева.
+    // Возвращённый объект владеет program и выполняет её с тем же результатом, что и обход дерева.
+    // Метод, вызванный jit_threshold раз, компилируется в машинный код, 0 - не компилируется
+    std::unique_ptr<runtime::Executable> Compile(
+        std::unique_ptr<runtime::Executable> program,
+        std::uint32_t jit_threshold = jit::DEFAULT_THRESHOLD);
+
+}  // namespace bytecode
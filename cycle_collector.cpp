@@ -0,0 +1,201 @@
+#include "cycle_collector.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        thread_local CycleCollector* current_collector = nullptr;
+    }
+
+    CycleCollector::CycleCollector()
+        : CycleCollector(Options{}) {
+    }
+
+    CycleCollector::CycleCollector(Options options)
+        : options_(options) {
+    }
+
+    CycleCollector::~CycleCollector() {
+        CollectAll();
+        for (auto* generation : {&young_, &old_}) {
+            for (ClassInstance* instance : *generation) {
+                instance->collector_ = nullptr;
+            }
+        }
+        if (current_collector == this) {
+            current_collector = nullptr;
+        }
+    }
+
+    CycleCollector* CycleCollector::Current() noexcept {
+        return current_collector;
+    }
+
+    void CycleCollector::Track(ClassInstance& instance) {
+        instance.collector_ = this;
+        instance.gc_index_ = static_cast<uint32_t>(young_.size());
+        young_.push_back(&instance);
+        if (options_.threshold != 0 && young_.size() >= options_.threshold && !collecting_) {
+            Collect();
+        }
+    }
+
+    void CycleCollector::Untrack(ClassInstance& instance) noexcept {
+        auto& generation = (instance.gc_index_ & OLD_BIT) != 0 ? old_ : young_;
+        const uint32_t index = instance.gc_index_ & ~OLD_BIT;
+        ClassInstance* last = generation.back();
+        generation[index] = last;
+        last->gc_index_ = (last->gc_index_ & OLD_BIT) | index;
+        generation.pop_back();
+        instance.collector_ = nullptr;
+    }
+
+    void CycleCollector::AddToScan(ClassInstance& instance) {
+        if (instance.gc_scan_ == 0) {
+            scan_.push_back(&instance);
+            instance.gc_scan_ = static_cast<uint32_t>(scan_.size());
+        }
+    }
+
+    size_t CycleCollector::Collect() {
+        const auto start = Clock::now();
+        scan_.clear();
+        for (ClassInstance* instance : young_) {
+            AddToScan(*instance);
+        }
+        if (cursor_ >= old_.size()) {
+            cursor_ = 0;
+        }
+        const size_t slice = min(options_.increment, old_.size());
+        for (size_t i = 0; i < slice; ++i) {
+            AddToScan(*old_[(cursor_ + i) % old_.size()]);
+        }
+        cursor_ += slice;
+
+        // Цикл, который начинается в порции, часто продолжается за её пределами
+        const size_t limit = young_.size() + 2 * options_.increment;
+        for (size_t i = 0; i < scan_.size() && scan_.size() < limit; ++i) {
+            for (const ObjectHolder& field : scan_[i]->values_) {
+                ClassInstance* target = ClassInstance::OwnedInstance(field);
+                if (target != nullptr && target->collector_ == this) {
+                    AddToScan(*target);
+                }
+            }
+        }
+        return CollectScanned(start, false);
+    }
+
+    size_t CycleCollector::CollectAll() {
+        const auto start = Clock::now();
+        scan_.clear();
+        for (auto* generation : {&young_, &old_}) {
+            for (ClassInstance* instance : *generation) {
+                AddToScan(*instance);
+            }
+        }
+        return CollectScanned(start, true);
+    }
+
+    void CycleCollector::Promote() {
+        for (ClassInstance* instance : young_) {
+            instance->gc_index_ = static_cast<uint32_t>(old_.size()) | OLD_BIT;
+            old_.push_back(instance);
+        }
+        young_.clear();
+    }
+
+    size_t CycleCollector::CollectScanned(Clock::time_point start, bool full) {
+        collecting_ = true;
+        // Владельцы каждого экземпляра за вычетом ссылок из полей просматриваемых
+        refs_.resize(scan_.size());
+        for (size_t i = 0; i < scan_.size(); ++i) {
+            refs_[i] = scan_[i]->GetRefCount();
+        }
+        for (ClassInstance* instance : scan_) {
+            for (const ObjectHolder& field : instance->values_) {
+                ClassInstance* target = ClassInstance::OwnedInstance(field);
+                if (target != nullptr && target->gc_scan_ != 0) {
+                    --refs_[target->gc_scan_ - 1];
+                }
+            }
+        }
+
+        // Достижимые экземпляры отмечаются отрицательным значением
+        pending_.clear();
+        for (size_t i = 0; i < scan_.size(); ++i) {
+            if (refs_[i] > 0) {
+                refs_[i] = -1;
+                pending_.push_back(i);
+            }
+        }
+        while (!pending_.empty()) {
+            ClassInstance* instance = scan_[pending_.back()];
+            pending_.pop_back();
+            for (const ObjectHolder& field : instance->values_) {
+                ClassInstance* target = ClassInstance::OwnedInstance(field);
+                if (target == nullptr || target->gc_scan_ == 0) {
+                    continue;
+                }
+                const size_t index = target->gc_scan_ - 1;
+                if (refs_[index] >= 0) {
+                    refs_[index] = -1;
+                    pending_.push_back(index);
+                }
+            }
+        }
+
+        // Недостижимые экземпляры удерживаются до очистки полей всех остальных, чтобы
+        // освобождение одного не уничтожило другой, пока его поля перебираются
+        vector<ObjectHolder> garbage;
+        for (size_t i = 0; i < scan_.size(); ++i) {
+            if (refs_[i] >= 0) {
+                garbage.push_back(scan_[i]->Self());
+            }
+            scan_[i]->gc_scan_ = 0;
+        }
+        const size_t scanned = scan_.size();
+        scan_.clear();
+        Promote();
+
+        vector<ObjectHolder> fields;
+        for (const ObjectHolder& instance : garbage) {
+            for (ObjectHolder& field : instance.TryAs<ClassInstance>()->values_) {
+                fields.push_back(std::move(field));
+            }
+        }
+        fields.clear();
+        const size_t freed = garbage.size();
+        garbage.clear();
+        collecting_ = false;
+
+        const auto pause = Clock::now() - start;
+        ++stats_.collections;
+        stats_.scanned += scanned;
+        stats_.freed += freed;
+        stats_.total += pause;
+        if (full) {
+            ++stats_.full_collections;
+            stats_.full_total += pause;
+        } else {
+            stats_.max_scanned = max<uint64_t>(stats_.max_scanned, scanned);
+            stats_.last_pause = pause;
+            stats_.max_pause = max(stats_.max_pause, pause);
+        }
+        return freed;
+    }
+
+    CollectorScope::CollectorScope(CycleCollector* collector) noexcept
+        : outer_(exchange(current_collector, collector)) {
+    }
+
+    CollectorScope::~CollectorScope() {
+        current_collector = outer_;
+    }
+
+}  // namespace runtime
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace runtime {
+
+    class ClassInstance;
+
+    // Сборщик циклов между экземплярами классов. Экземпляры ссылаются друг на друга через
+    // поля владеющими ссылками, поэтому цикл (self.next = other, other.prev = self) не
+    // освобождается подсчётом ссылок. Сборщик находит такие циклы пробным удалением: из числа
+    // владельцев каждого экземпляра вычитаются ссылки из полей просматриваемых экземпляров.
+    // Экземпляр, у которого остались другие владельцы (переменные, кадры, регистры), достижим,
+    // как и всё, что достижимо из него по полям. Поля остальных экземпляров очищаются,
+    // и циклы освобождаются обычным подсчётом ссылок.
+    //
+    // Учитываются экземпляры, созданные в потоке при открытой области CollectorScope.
+    // Сборка запускается, когда с прошлой сборки создано threshold экземпляров, и
+    // просматривает новые экземпляры и очередную порцию из increment старых, а также
+    // экземпляры, на которые они ссылаются, но не больше increment сверх новых. Поэтому пауза
+    // ограничена и на очень больших кучах, а цикл длиннее порции находит только CollectAll.
+    // Разные порции старых экземпляров просматриваются по кругу.
+    //
+    // Сборщик принадлежит одному потоку, как и состояние выполнения: учтённые экземпляры
+    // должны уничтожаться в этом потоке. Сборщик должен пережить учтённые экземпляры либо
+    // освободить их при уничтожении (см. ~CycleCollector)
+    class CycleCollector {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr std::size_t DEFAULT_THRESHOLD = 1000;
+        static constexpr std::size_t DEFAULT_INCREMENT = 10000;
+
+        struct Options {
+            // Сколько новых экземпляров запускают сборку, 0 - только явные вызовы Collect
+            std::size_t threshold = DEFAULT_THRESHOLD;
+            // Сколько старых экземпляров просматривает одна сборка
+            std::size_t increment = DEFAULT_INCREMENT;
+        };
+
+        struct Stats {
+            // Сборки Collect и CollectAll
+            std::uint64_t collections = 0;
+            // Просмотрено и освобождено экземпляров за все сборки
+            std::uint64_t scanned = 0;
+            std::uint64_t freed = 0;
+            Clock::duration total{};
+            // Паузы сборок Collect: наибольшее число экземпляров, просмотренных одной сборкой,
+            // последняя и наибольшая паузы
+            std::uint64_t max_scanned = 0;
+            Clock::duration last_pause{};
+            Clock::duration max_pause{};
+            // Полные сборки CollectAll просматривают всю кучу, поэтому их время учитывается
+            // отдельно от пауз
+            std::uint64_t full_collections = 0;
+            Clock::duration full_total{};
+        };
+
+        CycleCollector();
+        explicit CycleCollector(Options options);
+
+        CycleCollector(const CycleCollector&) = delete;
+        CycleCollector& operator=(const CycleCollector&) = delete;
+
+        // Освобождает недостижимые циклы (CollectAll) и перестаёт учитывать остальные
+        // экземпляры
+        ~CycleCollector();
+
+        // Возвращает сборщик открытой в потоке области либо nullptr
+        [[nodiscard]] static CycleCollector* Current() noexcept;
+
+        // Выполняет одну сборку с ограниченной паузой и возвращает число освобождённых
+        // экземпляров
+        std::size_t Collect();
+
+        // Просматривает все учтённые экземпляры и возвращает число освобождённых
+        std::size_t CollectAll();
+
+        [[nodiscard]] const Stats& GetStats() const {
+            return stats_;
+        }
+
+        // Возвращает число учтённых живых экземпляров
+        [[nodiscard]] std::size_t Tracked() const {
+            return young_.size() + old_.size();
+        }
+
+    private:
+        friend class ClassInstance;
+        friend class ObjectHolder;
+        friend class CollectorScope;
+
+        // Старший бит номера экземпляра отмечает старое поколение
+        static constexpr std::uint32_t OLD_BIT = std::uint32_t{1} << 31;
+
+        // Начинает учитывать созданный экземпляр и при необходимости запускает сборку
+        void Track(ClassInstance& instance);
+        // Перестаёт учитывать уничтожаемый экземпляр
+        void Untrack(ClassInstance& instance) noexcept;
+
+        // Добавляет экземпляр в просматриваемое множество, если его там ещё нет
+        void AddToScan(ClassInstance& instance);
+        // Пробное удаление просматриваемого множества. Возвращает число освобождённых.
+        // full - полная сборка CollectAll
+        std::size_t CollectScanned(Clock::time_point start, bool full);
+        void Promote();
+
+        Options options_;
+        Stats stats_;
+        // Экземпляры, созданные после прошлой сборки, и пережившие сборку
+        std::vector<ClassInstance*> young_;
+        std::vector<ClassInstance*> old_;
+        // Начало следующей порции старых экземпляров
+        std::size_t cursor_ = 0;
+        bool collecting_ = false;
+
+        // Рабочие массивы сборки: просматриваемые экземпляры и их внешние ссылки
+        std::vector<ClassInstance*> scan_;
+        std::vector<long> refs_;
+        std::vector<std::size_t> pending_;
+    };
+
+    // Делает collector текущим сборщиком потока на время своего существования.
+    // Области могут быть вложенными; nullptr отключает учёт новых экземпляров
+    class CollectorScope {
+    public:
+        explicit CollectorScope(CycleCollector* collector) noexcept;
+        ~CollectorScope();
+
+        CollectorScope(const CollectorScope&) = delete;
+        CollectorScope& operator=(const CollectorScope&) = delete;
+
+    private:
+        CycleCollector* outer_;
+    };
+
+}  // namespace runtime
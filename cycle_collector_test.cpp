@@ -0,0 +1,236 @@
+#include "cycle_collector.h"
+#include "memory_stats.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+constexpr auto CLASS_INSTANCE = static_cast<size_t>(Object::Kind::ClassInstance);
+
+uint64_t LiveInstances(const MemoryStats& stats) {
+    return stats.GetUsage().objects[CLASS_INSTANCE].live.current;
+}
+
+void Link(const ObjectHolder& from, const string& field, const ObjectHolder& to) {
+    from.TryAs<ClassInstance>()->Fields()[field] = to;
+}
+
+// Создаёт count экземпляров, замкнутых в кольцо полями next
+vector<ObjectHolder> MakeRing(const Class& cls, size_t count) {
+    vector<ObjectHolder> ring;
+    for (size_t i = 0; i < count; ++i) {
+        ring.push_back(ObjectHolder::Own(ClassInstance(cls)));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Link(ring[i], "next"s, ring[(i + 1) % count]);
+    }
+    return ring;
+}
+
+CycleCollector::Options Manual(size_t increment = CycleCollector::DEFAULT_INCREMENT) {
+    return CycleCollector::Options{0, increment};
+}
+
+void TestCycleFreed() {
+    Class cls("Node"s, {}, nullptr);
+    MemoryStats stats;
+    MemoryScope accounting(&stats);
+    CycleCollector collector(Manual());
+    CollectorScope collecting(&collector);
+    ASSERT_EQUAL(CycleCollector::Current(), &collector);
+    {
+        auto first = ObjectHolder::Own(ClassInstance(cls));
+        auto second = ObjectHolder::Own(ClassInstance(cls));
+        Link(first, "next"s, second);
+        Link(second, "prev"s, first);
+        ASSERT_EQUAL(collector.Tracked(), 2U);
+    }
+    // Подсчёт ссылок цикл не освобождает
+    ASSERT_EQUAL(LiveInstances(stats), 2U);
+    ASSERT_EQUAL(collector.Collect(), 2U);
+    ASSERT_EQUAL(LiveInstances(stats), 0U);
+    ASSERT_EQUAL(collector.Tracked(), 0U);
+
+    const auto& gc = collector.GetStats();
+    ASSERT_EQUAL(gc.collections, 1U);
+    ASSERT_EQUAL(gc.scanned, 2U);
+    ASSERT_EQUAL(gc.freed, 2U);
+    ASSERT(gc.last_pause <= gc.max_pause);
+    ASSERT(gc.max_pause <= gc.total);
+
+    // Экземпляр без сборщика не учитывается
+    {
+        CollectorScope disabled(nullptr);
+        auto alone = ObjectHolder::Own(ClassInstance(cls));
+        ASSERT_EQUAL(collector.Tracked(), 0U);
+    }
+}
+
+void TestReachableKept() {
+    Class cls("Node"s, {}, nullptr);
+    MemoryStats stats;
+    MemoryScope accounting(&stats);
+    CycleCollector collector(Manual());
+    CollectorScope collecting(&collector);
+
+    auto ring = MakeRing(cls, 3);
+    ObjectHolder kept = ring[0];
+    ring.clear();
+    auto shared = ObjectHolder::Own(ClassInstance(cls));
+    {
+        // Недостижимый цикл ссылается на достижимый экземпляр
+        auto garbage = MakeRing(cls, 2);
+        Link(garbage[0], "shared"s, shared);
+        // Не владеющая ссылка не делает экземпляр достижимым
+        auto self = ObjectHolder::Own(ClassInstance(cls));
+        Link(self, "self"s, self);
+        Link(self, "borrowed"s, ObjectHolder::Share(*shared));
+    }
+    ASSERT_EQUAL(LiveInstances(stats), 7U);
+    ASSERT_EQUAL(collector.Collect(), 3U);
+    ASSERT_EQUAL(LiveInstances(stats), 4U);
+
+    // Кольцо достижимо через kept и сохраняет поля
+    const auto* first = kept.TryAs<ClassInstance>();
+    const auto* third = first->Fields().at("next"s).TryAs<ClassInstance>()
+                            ->Fields().at("next"s).TryAs<ClassInstance>();
+    ASSERT(third->Fields().at("next"s).Get() == first);
+
+    kept = ObjectHolder::None();
+    ASSERT_EQUAL(collector.Collect(), 3U);
+    ASSERT_EQUAL(LiveInstances(stats), 1U);
+    ASSERT_EQUAL(collector.Tracked(), 1U);
+}
+
+void TestThreshold() {
+    Class cls("Node"s, {}, nullptr);
+    CycleCollector collector(CycleCollector::Options{10, CycleCollector::DEFAULT_INCREMENT});
+    CollectorScope collecting(&collector);
+    for (int i = 0; i < 9; ++i) {
+        auto self = ObjectHolder::Own(ClassInstance(cls));
+        Link(self, "self"s, self);
+    }
+    ASSERT_EQUAL(collector.GetStats().collections, 0U);
+    // Десятый экземпляр запускает сборку и сам переживает её
+    auto last = ObjectHolder::Own(ClassInstance(cls));
+    ASSERT_EQUAL(collector.GetStats().collections, 1U);
+    ASSERT_EQUAL(collector.GetStats().freed, 9U);
+    ASSERT_EQUAL(collector.Tracked(), 1U);
+
+    for (int i = 0; i < 25; ++i) {
+        auto self = ObjectHolder::Own(ClassInstance(cls));
+        Link(self, "self"s, self);
+    }
+    // Экземпляр, запустивший сборку, всегда переживает её
+    ASSERT_EQUAL(collector.GetStats().collections, 3U);
+    ASSERT_EQUAL(collector.GetStats().freed, 28U);
+    ASSERT_EQUAL(collector.Tracked(), 7U);
+}
+
+void TestIncrement() {
+    Class cls("Node"s, {}, nullptr);
+    MemoryStats stats;
+    MemoryScope accounting(&stats);
+    CycleCollector collector(Manual(4));
+    CollectorScope collecting(&collector);
+
+    vector<ObjectHolder> holders;
+    for (int i = 0; i < 20; ++i) {
+        holders.push_back(ObjectHolder::Own(ClassInstance(cls)));
+        Link(holders.back(), "self"s, holders.back());
+    }
+    // Новые экземпляры просматриваются все, а старые - порциями по 4
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ASSERT_EQUAL(collector.GetStats().scanned, 20U);
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ASSERT_EQUAL(collector.GetStats().scanned, 24U);
+
+    holders.clear();
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQUAL(collector.Collect(), 4U);
+    }
+    ASSERT_EQUAL(LiveInstances(stats), 0U);
+
+    // Кольцо длиннее порции находит только полная сборка
+    auto ring = MakeRing(cls, 20);
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ring.clear();
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ASSERT_EQUAL(LiveInstances(stats), 20U);
+    ASSERT_EQUAL(collector.CollectAll(), 20U);
+    ASSERT_EQUAL(LiveInstances(stats), 0U);
+}
+
+void TestBoundedPause() {
+    Class cls("Node"s, {}, nullptr);
+    constexpr size_t THRESHOLD = 100;
+    constexpr size_t INCREMENT = 50;
+    for (size_t size : {1000U, 20000U}) {
+        CycleCollector collector(CycleCollector::Options{THRESHOLD, INCREMENT});
+        CollectorScope collecting(&collector);
+        // Каждый новый экземпляр ссылается на все старые через цепочку полей prev
+        ObjectHolder head = ObjectHolder::Own(ClassInstance(cls));
+        for (size_t i = 1; i < size; ++i) {
+            auto node = ObjectHolder::Own(ClassInstance(cls));
+            Link(node, "prev"s, head);
+            head = std::move(node);
+            auto garbage = ObjectHolder::Own(ClassInstance(cls));
+            Link(garbage, "self"s, garbage);
+        }
+        const auto& gc = collector.GetStats();
+        ASSERT(gc.collections >= 2 * size / THRESHOLD - 1);
+        ASSERT_EQUAL(gc.full_collections, 0U);
+        // Сборка просматривает новые экземпляры, порцию старых и ссылки не дальше порции
+        ASSERT(gc.max_scanned <= THRESHOLD + 2 * INCREMENT + 1);
+
+        // Полная сборка просматривает всю кучу, но паузой порционных сборок не считается
+        const auto max_pause = gc.max_pause;
+        ASSERT(collector.CollectAll() > 0U);
+        ASSERT_EQUAL(gc.full_collections, 1U);
+        ASSERT(gc.max_scanned <= THRESHOLD + 2 * INCREMENT + 1);
+        ASSERT(gc.max_pause == max_pause);
+        ASSERT(gc.full_total <= gc.total);
+        head = ObjectHolder::None();
+    }
+}
+
+void TestCollectorDestroyed() {
+    Class cls("Node"s, {}, nullptr);
+    MemoryStats stats;
+    MemoryScope accounting(&stats);
+    ObjectHolder survivor;
+    {
+        CycleCollector collector(Manual());
+        CollectorScope collecting(&collector);
+        MakeRing(cls, 100);
+        survivor = ObjectHolder::Own(ClassInstance(cls));
+        Link(survivor, "self"s, survivor);
+        Link(survivor, "other"s, ObjectHolder::Own(ClassInstance(cls)));
+    }
+    ASSERT(CycleCollector::Current() == nullptr);
+    // Недостижимые циклы освобождены, а достижимые экземпляры больше не учитываются
+    ASSERT_EQUAL(LiveInstances(stats), 2U);
+    survivor.TryAs<ClassInstance>()->Fields()["self"s] = ObjectHolder::None();
+    survivor = ObjectHolder::None();
+    ASSERT_EQUAL(LiveInstances(stats), 0U);
+}
+
+}  // namespace
+
+void RunCycleCollectorTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestCycleFreed);
+    RUN_TEST(tr, runtime::TestReachableKept);
+    RUN_TEST(tr, runtime::TestThreshold);
+    RUN_TEST(tr, runtime::TestIncrement);
+    RUN_TEST(tr, runtime::TestBoundedPause);
+    RUN_TEST(tr, runtime::TestCollectorDestroyed);
+}
+
+}  // namespace runtime
@@ -0,0 +1,571 @@
+#include "driver.h"
+
+#include "compiler.h"
+#include "cycle_collector.h"
+#include "executor.h"
+#include "instrument.h"
+#include "jit.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "repl.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+
+using namespace std;
+
+namespace driver {
+
+    namespace {
+        // Способ исполнения программы
+        enum class Backend {
+            TreeWalker,  // обход дерева разбора
+            Bytecode,    // компиляция в байт-код и исполнение регистровой машиной
+        };
+
+        struct Options {
+            bool time = false;
+            bool cache = false;
+            bool help = false;
+            bool memory = false;
+            // Интерактивный сеанс со стандартного ввода
+            bool interactive = false;
+            Backend backend = Backend::TreeWalker;
+            parse::Lexer::Mode lexer = parse::Lexer::Mode::OnDemand;
+            // Число потоков для параллельного выполнения, 0 - выполнять по очереди
+            size_t jobs = 0;
+            runtime::OutputBuffer::FlushPolicy flush = runtime::OutputBuffer::FlushPolicy::Chunked;
+            // Файл для стеков профилировщика, пустой - без профилирования
+            string profile;
+            // Порог сборщика циклов, 0 - без сборки
+            size_t gc = runtime::CycleCollector::DEFAULT_THRESHOLD;
+            // Порог вызовов метода для компиляции в машинный код, 0 - без компиляции
+            uint32_t jit = jit::DEFAULT_THRESHOLD;
+            // Пути программ, "-" - стандартный ввод
+            vector<string> scripts;
+        };
+
+        const char USAGE[] =
+            "Usage: mython [OPTION]... [FILE]...\n"
+            "Run Mython programs from FILEs one after another in a single process.\n"
+            "With no FILE, or when FILE is -, read the program from standard input.\n"
+            "\n"
+            "  --time                  print lex, parse, compile and execute times to stderr\n"
+            "                          (parse includes lexing and optimization)\n"
+            "  --backend=tree|bytecode execute by walking the tree (default) or as bytecode\n"
+            "  --lexer=MODE            tokenize on demand (on-demand, default), the whole\n"
+            "                          program before parsing (pretokenized), or on a separate\n"
+            "                          thread running ahead of the parser (pipelined)\n"
+            "  --cache                 keep parsed programs in FILE.myc images\n"
+            "  --batch=LIST            also run the programs listed in LIST, one path per line\n"
+            "  --jobs=N                run the programs in parallel on N threads; their output\n"
+            "                          is still printed in order, each program after the previous\n"
+            "  --flush=chunk|line|exit pass program output on in large chunks (default), after\n"
+            "                          every line, or only when the program ends\n"
+            "  --profile=FILE          profile the programs: write method call stacks in\n"
+            "                          flamegraph collapsed format to FILE and a table of\n"
+            "                          method (and, with the tree backend, node) times to\n"
+            "                          stderr; cannot be combined with --jobs\n"
+            "  --memory                print the objects, strings, fields and call frames\n"
+            "                          each program allocated to stderr\n"
+            "  --gc=N                  collect reference cycles between instances after every\n"
+            "                          N new instances (default 1000); 0 disables collection.\n"
+            "                          With --time, also print the collection times\n"
+            "  --jit=N                 with the bytecode backend, compile a method to machine\n"
+            "                          code after N calls (default 1000); 0 disables it\n"
+            "  -i, --interactive       read the program from standard input block by block,\n"
+            "                          running each block as soon as it is complete; a\n"
+            "                          compound statement ends with an empty line. Prompts\n"
+            "                          go to stderr. Takes no FILE and combines only with\n"
+            "                          --backend, --flush, --gc and --jit\n"
+            "  --help                  print this help\n";
+
+        constexpr string_view STDIN_NAME = "-";
+
+        // Имя программы в сообщениях
+        string_view DisplayName(const string& path) {
+            return path == STDIN_NAME ? "<stdin>"sv : string_view(path);
+        }
+
+        // Время этапов выполнения программы в миллисекундах
+        struct Timings {
+            double lex = 0;
+            double parse = 0;
+            // Загрузка из образа либо разбор с записью образа, при --cache вместо lex и parse
+            double load = 0;
+            double compile = 0;
+            double execute = 0;
+        };
+
+        using Clock = chrono::steady_clock;
+
+        double MillisecondsSince(Clock::time_point start) {
+            return chrono::duration<double, milli>(Clock::now() - start).count();
+        }
+
+        bool ReadList(const string& path, istream& input, vector<string>& scripts,
+                      ostream& errors) {
+            ifstream file;
+            if (path != STDIN_NAME) {
+                file.open(path);
+                if (!file) {
+                    errors << "mython: cannot open "sv << path << '\n';
+                    return false;
+                }
+            }
+            istream& list = path == STDIN_NAME ? input : file;
+            for (string line; getline(list, line);) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    scripts.push_back(std::move(line));
+                }
+            }
+            return true;
+        }
+
+        optional<Options> ParseArgs(const vector<string>& args, istream& input, ostream& errors) {
+            constexpr string_view BACKEND = "--backend="sv;
+            constexpr string_view BATCH = "--batch="sv;
+            constexpr string_view JOBS = "--jobs="sv;
+            constexpr string_view FLUSH = "--flush="sv;
+            constexpr string_view PROFILE = "--profile="sv;
+            constexpr string_view GC = "--gc="sv;
+            constexpr string_view JIT = "--jit="sv;
+            constexpr string_view LEXER = "--lexer="sv;
+
+            Options options;
+            bool batch = false;
+            for (const string& arg : args) {
+                const string_view view = arg;
+                if (view == "--time"sv) {
+                    options.time = true;
+                } else if (view == "--cache"sv) {
+                    options.cache = true;
+                } else if (view == "--memory"sv) {
+                    options.memory = true;
+                } else if (view == "-i"sv || view == "--interactive"sv) {
+                    options.interactive = true;
+                } else if (view == "--help"sv) {
+                    options.help = true;
+                } else if (view.substr(0, BACKEND.size()) == BACKEND) {
+                    const auto backend = view.substr(BACKEND.size());
+                    if (backend == "tree"sv) {
+                        options.backend = Backend::TreeWalker;
+                    } else if (backend == "bytecode"sv) {
+                        options.backend = Backend::Bytecode;
+                    } else {
+                        errors << "mython: unknown backend "sv << backend << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, LEXER.size()) == LEXER) {
+                    using Mode = parse::Lexer::Mode;
+                    const auto lexer = view.substr(LEXER.size());
+                    if (lexer == "on-demand"sv) {
+                        options.lexer = Mode::OnDemand;
+                    } else if (lexer == "pretokenized"sv) {
+                        options.lexer = Mode::Pretokenized;
+                    } else if (lexer == "pipelined"sv) {
+                        options.lexer = Mode::Pipelined;
+                    } else {
+                        errors << "mython: unknown lexer mode "sv << lexer << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, FLUSH.size()) == FLUSH) {
+                    using FlushPolicy = runtime::OutputBuffer::FlushPolicy;
+                    const auto flush = view.substr(FLUSH.size());
+                    if (flush == "chunk"sv) {
+                        options.flush = FlushPolicy::Chunked;
+                    } else if (flush == "line"sv) {
+                        options.flush = FlushPolicy::Line;
+                    } else if (flush == "exit"sv) {
+                        options.flush = FlushPolicy::AtExit;
+                    } else {
+                        errors << "mython: unknown flush policy "sv << flush << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, JOBS.size()) == JOBS) {
+                    const auto jobs = view.substr(JOBS.size());
+                    const auto [end, error] =
+                        from_chars(jobs.data(), jobs.data() + jobs.size(), options.jobs);
+                    if (error != errc{} || end != jobs.data() + jobs.size() || options.jobs == 0) {
+                        errors << "mython: invalid job count "sv << jobs << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, GC.size()) == GC) {
+                    const auto gc = view.substr(GC.size());
+                    const auto [end, error] =
+                        from_chars(gc.data(), gc.data() + gc.size(), options.gc);
+                    if (error != errc{} || end != gc.data() + gc.size() || gc.empty()) {
+                        errors << "mython: invalid gc threshold "sv << gc << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, JIT.size()) == JIT) {
+                    const auto jit = view.substr(JIT.size());
+                    const auto [end, error] =
+                        from_chars(jit.data(), jit.data() + jit.size(), options.jit);
+                    if (error != errc{} || end != jit.data() + jit.size() || jit.empty()) {
+                        errors << "mython: invalid jit threshold "sv << jit << '\n';
+                        return nullopt;
+                    }
+                } else if (view.substr(0, PROFILE.size()) == PROFILE) {
+                    options.profile = view.substr(PROFILE.size());
+                    if (options.profile.empty()) {
+                        errors << "mython: missing profile file name\n"sv;
+                        return nullopt;
+                    }
+                } else if (view.substr(0, BATCH.size()) == BATCH) {
+                    batch = true;
+                    if (!ReadList(string(view.substr(BATCH.size())), input, options.scripts,
+                                  errors)) {
+                        return nullopt;
+                    }
+                } else if (view.size() > 1 && view[0] == '-') {
+                    errors << "mython: unknown option "sv << view << '\n';
+                    return nullopt;
+                } else {
+                    options.scripts.push_back(arg);
+                }
+            }
+            // Профилировщик не потокобезопасен
+            if (!options.profile.empty() && options.jobs != 0) {
+                errors << "mython: --profile cannot be combined with --jobs\n"sv;
+                return nullopt;
+            }
+            if (options.interactive
+                && (!options.scripts.empty() || batch || options.jobs != 0 || options.time
+                    || options.cache || options.memory || !options.profile.empty())) {
+                errors << "mython: --interactive takes no FILE and combines only with "
+                          "--backend, --flush, --gc and --jit\n"sv;
+                return nullopt;
+            }
+            if (options.scripts.empty() && !batch && !options.interactive) {
+                options.scripts.emplace_back(STDIN_NAME);
+            }
+            return options;
+        }
+
+        bool ReadSource(const string& path, istream& input, string& source) {
+            if (path == STDIN_NAME) {
+                source.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+                return true;
+            }
+            ifstream file(path, ios::binary);
+            if (!file) {
+                return false;
+            }
+            source.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            return true;
+        }
+
+        // Строит программу, готовую к выполнению: загружает образ либо разбирает текст
+        // и при необходимости компилирует. Ошибки разбора передаются исключениями
+        unique_ptr<runtime::Executable> BuildProgram(const string& path, string_view source,
+                                                     const Options& options, Timings& timings) {
+            unique_ptr<runtime::Executable> program;
+            if (options.cache && path != STDIN_NAME) {
+                const auto start = Clock::now();
+                program = cache::LoadProgram(source, path + ".myc"s);
+                timings.load = MillisecondsSince(start);
+            } else {
+                if (options.time) {
+                    // Лексер работает по требованию парсера, поэтому время лексического
+                    // анализа измеряется отдельным проходом по тексту
+                    const auto start = Clock::now();
+                    parse::Lexer lexer(source, options.lexer);
+                    while (!lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+                        lexer.NextToken();
+                    }
+                    timings.lex = MillisecondsSince(start);
+                }
+                const auto start = Clock::now();
+                parse::Lexer lexer(source, options.lexer);
+                program = ast::Optimize(ParseProgram(lexer));
+                timings.parse = MillisecondsSince(start);
+            }
+
+            if (options.backend == Backend::Bytecode) {
+                const auto start = Clock::now();
+                program = bytecode::Compile(std::move(program), options.jit);
+                timings.compile = MillisecondsSince(start);
+            } else if (!options.profile.empty()) {
+                program = ast::Instrument(std::move(program));
+            }
+            return program;
+        }
+
+        // Разбирает и выполняет программу. Если задан profiler, выполнение учитывается в нём
+        // под именем программы, а с флагом --memory память выполнения учитывается в memory.
+        // Созданные экземпляры учитываются сборщиком collector, если он задан.
+        // Ошибки программы передаются исключениями
+        Timings RunScript(const string& path, string_view source, const Options& options,
+                          ostream& output, runtime::Profiler* profiler,
+                          runtime::MemoryStats& memory, runtime::CycleCollector* collector) {
+            Timings timings;
+            const auto program = BuildProgram(path, source, options, timings);
+
+            const auto start = Clock::now();
+            runtime::CollectorScope collecting(collector);
+            optional<runtime::MemoryScope> accounting;
+            runtime::SimpleContext context{output, options.flush};
+            if (options.memory) {
+                accounting.emplace(&memory);
+                context.SetMemoryStats(&memory);
+            }
+            runtime::Closure closure;
+            if (profiler != nullptr) {
+                context.SetProfiler(profiler);
+                runtime::Profiler::Scope scope(*profiler, DisplayName(path));
+                program->Execute(closure, context);
+            } else {
+                program->Execute(closure, context);
+            }
+            context.Flush();
+            timings.execute = MillisecondsSince(start);
+            return timings;
+        }
+
+        void PrintTimings(ostream& errors, const string& path, const Options& options,
+                          const Timings& timings) {
+            errors << DisplayName(path) << ':' << fixed << setprecision(3);
+            if (options.cache && path != STDIN_NAME) {
+                errors << " load "sv << timings.load << " ms,"sv;
+            } else {
+                errors << " lex "sv << timings.lex << " ms, parse "sv << timings.parse << " ms,"sv;
+            }
+            if (options.backend == Backend::Bytecode) {
+                errors << " compile "sv << timings.compile << " ms,"sv;
+            }
+            errors << " execute "sv << timings.execute << " ms\n"sv;
+        }
+
+        void PrintCollections(ostream& errors, const string& path,
+                              const runtime::CycleCollector::Stats& stats) {
+            using Milliseconds = chrono::duration<double, milli>;
+            errors << DisplayName(path) << ": gc "sv << stats.collections << " collections, "sv
+                   << stats.freed << " instances freed, "sv << fixed << setprecision(3)
+                   << Milliseconds(stats.total).count() << " ms total, "sv
+                   << Milliseconds(stats.max_pause).count() << " ms max pause, "sv
+                   << stats.full_collections << " full "sv
+                   << Milliseconds(stats.full_total).count() << " ms\n"sv;
+        }
+
+        void PrintMemory(ostream& errors, const string& path, const runtime::MemoryUsage& memory) {
+            errors << DisplayName(path) << ": memory\n"sv;
+            runtime::WriteMemoryUsage(errors, memory);
+        }
+
+        void PrintError(ostream& output, ostream& errors, const string& path,
+                        const string& message) {
+            // Вывод программы до ошибки должен предшествовать сообщению о ней
+            output.flush();
+            errors << DisplayName(path) << ": error: "sv << message << '\n';
+        }
+
+        // Записывает стеки профилировщика в файл options.profile, а таблицы - в errors
+        bool WriteProfile(const runtime::Profiler& profiler, const Options& options,
+                          ostream& errors) {
+            ofstream file(options.profile);
+            profiler.WriteCollapsedStacks(file);
+            file.flush();
+            profiler.WriteReport(errors);
+            if (!file) {
+                errors << "mython: cannot write "sv << options.profile << '\n';
+                return false;
+            }
+            return true;
+        }
+
+        // Выполняет программы по очереди
+        int RunSequential(const Options& options, istream& input, ostream& output,
+                          ostream& errors) {
+            optional<runtime::Profiler> profiler;
+            if (!options.profile.empty()) {
+                profiler.emplace();
+            }
+            int status = EXIT_OK;
+            string source;
+            for (const string& path : options.scripts) {
+                if (!ReadSource(path, input, source)) {
+                    errors << "mython: cannot open "sv << path << '\n';
+                    status = EXIT_FAILED;
+                    continue;
+                }
+                // Учтённые объекты программы уничтожаются раньше счётчиков и сборщика
+                runtime::MemoryStats memory;
+                optional<runtime::CycleCollector> collector;
+                if (options.gc != 0) {
+                    collector.emplace(runtime::CycleCollector::Options{options.gc});
+                }
+                bool succeeded = false;
+                try {
+                    const Timings timings =
+                        RunScript(path, source, options, output, profiler ? &*profiler : nullptr,
+                                  memory, collector ? &*collector : nullptr);
+                    if (options.time) {
+                        PrintTimings(errors, path, options, timings);
+                    }
+                    succeeded = true;
+                } catch (const exception& e) {
+                    PrintError(output, errors, path, e.what());
+                    status = EXIT_FAILED;
+                }
+                if (collector) {
+                    // Переменные программы уничтожены, остались только циклы
+                    collector->CollectAll();
+                    if (options.time && succeeded) {
+                        PrintCollections(errors, path, collector->GetStats());
+                    }
+                }
+                if (options.memory) {
+                    PrintMemory(errors, path, memory.GetUsage());
+                }
+            }
+            if (profiler && !WriteProfile(*profiler, options, errors)) {
+                status = EXIT_FAILED;
+            }
+            return status;
+        }
+
+        // Выполняет интерактивный сеанс: читает строки из input, пока он не закончится.
+        // Приглашения и ошибки блоков выводятся в errors
+        int RunInteractive(const Options& options, istream& input, ostream& output,
+                           ostream& errors) {
+            constexpr string_view PROMPT = ">>> "sv;
+            constexpr string_view CONTINUATION = "... "sv;
+
+            repl::Session::Options session_options;
+            session_options.bytecode = options.backend == Backend::Bytecode;
+            session_options.flush = options.flush;
+            session_options.gc = options.gc;
+            session_options.jit = options.jit;
+            repl::Session session(output, session_options);
+
+            const string path(STDIN_NAME);
+            int status = EXIT_OK;
+            auto feed = [&](string_view line) {
+                try {
+                    session.Feed(line);
+                } catch (const exception& e) {
+                    PrintError(output, errors, path, e.what());
+                    status = EXIT_FAILED;
+                }
+            };
+            errors << PROMPT << flush;
+            for (string line; getline(input, line);) {
+                feed(line);
+                output.flush();
+                errors << (session.InBlock() ? CONTINUATION : PROMPT) << flush;
+            }
+            // Конец ввода завершает последний блок
+            if (session.InBlock()) {
+                feed(""sv);
+                output.flush();
+            }
+            errors << '\n';
+            return status;
+        }
+
+        // Строит все программы по очереди, выполняет их в пуле из options.jobs потоков
+        // и выводит результаты в порядке программ
+        int RunParallel(const Options& options, istream& input, ostream& output,
+                        ostream& errors) {
+            struct Script {
+                bool opened = false;
+                unique_ptr<runtime::Executable> program;
+                string error;
+                Timings timings;
+            };
+
+            vector<Script> scripts(options.scripts.size());
+            vector<runtime::Executable*> programs;
+            string source;
+            for (size_t i = 0; i < scripts.size(); ++i) {
+                Script& script = scripts[i];
+                script.opened = ReadSource(options.scripts[i], input, source);
+                if (!script.opened) {
+                    continue;
+                }
+                try {
+                    script.program = BuildProgram(options.scripts[i], source, options,
+                                                  script.timings);
+                    programs.push_back(script.program.get());
+                } catch (const exception& e) {
+                    script.error = e.what();
+                }
+            }
+
+            executor::ThreadPool pool(min(options.jobs, max<size_t>(programs.size(), 1)));
+            const auto results = executor::RunPrograms(programs, pool, options.memory, options.gc);
+
+            int status = EXIT_OK;
+            auto result = results.begin();
+            for (size_t i = 0; i < scripts.size(); ++i) {
+                const string& path = options.scripts[i];
+                Script& script = scripts[i];
+                if (!script.opened) {
+                    errors << "mython: cannot open "sv << path << '\n';
+                    status = EXIT_FAILED;
+                    continue;
+                }
+                if (script.program == nullptr) {
+                    PrintError(output, errors, path, script.error);
+                    status = EXIT_FAILED;
+                    continue;
+                }
+                output << result->output;
+                if (result->failed) {
+                    PrintError(output, errors, path, result->error);
+                    status = EXIT_FAILED;
+                } else if (options.time) {
+                    script.timings.execute = result->milliseconds;
+                    PrintTimings(errors, path, options, script.timings);
+                    if (options.gc != 0) {
+                        PrintCollections(errors, path, result->gc);
+                    }
+                }
+                if (options.memory) {
+                    PrintMemory(errors, path, result->memory);
+                }
+                ++result;
+            }
+            return status;
+        }
+    }  // namespace
+
+    int Run(const vector<string>& args, istream& input, ostream& output, ostream& errors) {
+        const auto options = ParseArgs(args, input, errors);
+        if (!options) {
+            errors << USAGE;
+            return EXIT_USAGE;
+        }
+        if (options->help) {
+            output << USAGE;
+            return EXIT_OK;
+        }
+
+        if (options->interactive) {
+            return RunInteractive(*options, input, output, errors);
+        }
+
+        const auto batch_start = Clock::now();
+        const int status = options->jobs != 0 ? RunParallel(*options, input, output, errors)
+                                              : RunSequential(*options, input, output, errors);
+        if (options->time && options->scripts.size() > 1) {
+            errors << "total: "sv << options->scripts.size() << " scripts, "sv << fixed
+                   << setprecision(3) << MillisecondsSince(batch_start) << " ms\n"sv;
+        }
+        return status;
+    }
+
+}  // namespace driver
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace driver {
+
+    // Коды завершения Run
+    inline constexpr int EXIT_OK = 0;
+    // Хотя бы одна программа завершилась ошибкой
+    inline constexpr int EXIT_FAILED = 1;
+    // Неверные аргументы командной строки
+    inline constexpr int EXIT_USAGE = 2;
+
+    // Выполняет команду mython с аргументами args (без имени самой команды):
+    //   mython [--time] [--backend=tree|bytecode] [--lexer=MODE] [--cache] [--batch=LIST]
+    //          [--jobs=N] [--flush=chunk|line|exit] [--profile=FILE]
+    //          [--memory] [--gc=N] [--jit=N] [FILE...]
+    //   mython --interactive [--backend=tree|bytecode] [--flush=chunk|line|exit] [--gc=N]
+    //          [--jit=N]
+    // Программы из FILE и из списка LIST (по одному пути в строке) выполняются по очереди
+    // в одном процессе с общим выводом output. Если программы не заданы либо FILE равен "-",
+    // программа читается из input. Ошибка программы выводится в errors и не прерывает
+    // выполнение следующих. С флагом --time в errors выводится время этапов каждой программы.
+    // С флагом --jobs программы строятся по очереди, а выполняются параллельно в N потоках;
+    // вывод и ошибки каждой программы всё равно выводятся в порядке программ.
+    // Флаг --lexer выбирает режим лексера (см. parse::Lexer::Mode).
+    // Флаг --flush задаёт, когда накопленный вывод программы передаётся в output.
+    // С флагом --profile стеки вызовов методов всех программ записываются в FILE в свёрнутом
+    // формате flamegraph, а таблица времени методов и видов узлов выводится в errors.
+    // С флагом --memory после каждой программы в errors выводятся счётчики памяти её выполнения.
+    // Циклы экземпляров каждой программы собирает сборщик с порогом N из --gc (0 - без сборки);
+    // с флагом --time в errors выводятся и число и время его сборок, причём наибольшая пауза
+    // порционных сборок выводится отдельно от полной сборки в конце программы.
+    // Флаг --jit задаёт порог вызовов, после которого метод байт-кода компилируется
+    // в машинный код (см. jit.h), 0 - методы исполняет только интерпретатор.
+    // С флагом --interactive (-i) строки читаются из input, и каждый завершённый блок сразу
+    // выполняется; переменные и классы сохраняются между блоками (см. repl::Session).
+    // Приглашения и ошибки блоков выводятся в errors
+    int Run(const std::vector<std::string>& args, std::istream& input, std::ostream& output,
+            std::ostream& errors);
+
+}  // namespace driver
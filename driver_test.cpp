@@ -0,0 +1,289 @@
+#include "driver.h"
+#include "test_runner_p.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace driver {
+
+namespace {
+
+// Временный файл, удаляемый в деструкторе
+class TempFile {
+public:
+    TempFile(const string& name, const string& contents)
+        : path_((filesystem::temp_directory_path() / name).string()) {
+        ofstream(path_, ios::binary) << contents;
+    }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    ~TempFile() {
+        remove(path_.c_str());
+    }
+
+    [[nodiscard]] const string& Path() const {
+        return path_;
+    }
+
+private:
+    string path_;
+};
+
+struct Result {
+    int status;
+    string output;
+    string errors;
+};
+
+Result RunDriver(const vector<string>& args, const string& input = {}) {
+    istringstream in(input);
+    ostringstream out;
+    ostringstream err;
+    const int status = Run(args, in, out, err);
+    return {status, out.str(), err.str()};
+}
+
+void TestStdin() {
+    for (const auto& backend : {"--backend=tree"s, "--backend=bytecode"s}) {
+        const auto result = RunDriver({backend}, "x = 2\nprint x * 21\n"s);
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "42\n"s);
+        ASSERT(result.errors.empty());
+    }
+
+    for (const auto& lexer : {"--lexer=pretokenized"s, "--lexer=pipelined"s}) {
+        const auto result = RunDriver({lexer}, "x = 2\nprint x * 21\n"s);
+        ASSERT_EQUAL(result.output, "42\n"s);
+        ASSERT_EQUAL(RunDriver({lexer}, "print 'a\n"s).errors,
+                     "<stdin>: error: Unterminated string literal\n"s);
+    }
+    ASSERT_EQUAL(RunDriver({"--lexer=eager"s}).status, EXIT_USAGE);
+
+    const auto result = RunDriver({"-"s}, "print 'dash'\n"s);
+    ASSERT_EQUAL(result.output, "dash\n"s);
+}
+
+void TestBatch() {
+    TempFile first(
+        "mython_driver_first.my", "class A:\n  def f():\n    return 1\na = A()\nprint a.f()\n");
+    TempFile failing("mython_driver_failing.my", "print 'before'\nprint 1 / 0\n");
+    TempFile second("mython_driver_second.my", "print 'second'\n");
+    TempFile list("mython_driver_list.txt", second.Path() + "\n\n"s + first.Path() + "\n"s);
+
+    const auto result = RunDriver({first.Path(), failing.Path(), "--batch="s + list.Path()});
+    ASSERT_EQUAL(result.status, EXIT_FAILED);
+    ASSERT_EQUAL(result.output, "1\nbefore\nsecond\n1\n"s);
+    ASSERT_EQUAL(result.errors, failing.Path() + ": error: Division by zero\n"s);
+
+    const auto missing = RunDriver({"/nonexistent/mython_script.my"s, first.Path()});
+    ASSERT_EQUAL(missing.status, EXIT_FAILED);
+    ASSERT_EQUAL(missing.output, "1\n"s);
+    ASSERT_EQUAL(missing.errors, "mython: cannot open /nonexistent/mython_script.my\n"s);
+}
+
+void TestJobs() {
+    TempFile first("mython_driver_jobs_first.my",
+                   "class A:\n  def f():\n    return 1\na = A()\nprint a.f()\n");
+    TempFile failing("mython_driver_jobs_failing.my", "print 'before'\nprint 1 / 0\n");
+    TempFile broken("mython_driver_jobs_broken.my", "print (\n");
+    TempFile second("mython_driver_jobs_second.my", "print 'second'\n");
+
+    for (const auto& backend : {"--backend=tree"s, "--backend=bytecode"s}) {
+        const auto result =
+            RunDriver({"--jobs=3"s, backend, first.Path(), failing.Path(), broken.Path(),
+                       second.Path(), first.Path(), "/nonexistent/mython_script.my"s});
+        ASSERT_EQUAL(result.status, EXIT_FAILED);
+        ASSERT_EQUAL(result.output, "1\nbefore\nsecond\n1\n"s);
+        ASSERT(result.errors.find(failing.Path() + ": error: Division by zero\n"s) == 0);
+        ASSERT(result.errors.find(broken.Path() + ": error: "s) != string::npos);
+        ASSERT(result.errors.find("mython: cannot open /nonexistent/mython_script.my\n"s)
+               != string::npos);
+    }
+
+    const auto timed = RunDriver({"--jobs=2"s, "--time"s, second.Path(), second.Path()});
+    ASSERT_EQUAL(timed.status, EXIT_OK);
+    ASSERT_EQUAL(timed.output, "second\nsecond\n"s);
+    ASSERT(timed.errors.find(" ms, execute "s) != string::npos);
+    ASSERT(timed.errors.find("total: 2 scripts, "s) != string::npos);
+
+    for (const auto& jobs : {"--jobs=0"s, "--jobs=two"s, "--jobs="s, "--jobs=2x"s}) {
+        const auto result = RunDriver({jobs, second.Path()});
+        ASSERT_EQUAL(result.status, EXIT_USAGE);
+        ASSERT(result.errors.find("mython: invalid job count "s) == 0);
+    }
+}
+
+void TestTimeAndCache() {
+    TempFile script("mython_driver_cached.my", "print 'cached'\n");
+    const string image = script.Path() + ".myc"s;
+    remove(image.c_str());
+
+    auto result = RunDriver({"--time"s, "--backend=bytecode"s, script.Path()});
+    ASSERT_EQUAL(result.output, "cached\n"s);
+    ASSERT(result.errors.find(script.Path() + ": lex "s) == 0);
+    ASSERT(result.errors.find(" ms, parse "s) != string::npos);
+    ASSERT(result.errors.find(" ms, compile "s) != string::npos);
+    ASSERT(result.errors.find(" ms, execute "s) != string::npos);
+
+    for (int run = 0; run < 2; ++run) {
+        result = RunDriver({"--cache"s, "--time"s, script.Path(), script.Path()});
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "cached\ncached\n"s);
+        ASSERT(result.errors.find(script.Path() + ": load "s) == 0);
+        ASSERT(result.errors.find("total: 2 scripts, "s) != string::npos);
+        ASSERT(ifstream(image).good());
+    }
+    remove(image.c_str());
+}
+
+void TestUsage() {
+    auto result = RunDriver({"--help"s});
+    ASSERT_EQUAL(result.status, EXIT_OK);
+    ASSERT(result.output.find("Usage: mython"s) == 0);
+
+    result = RunDriver({"--frobnicate"s});
+    ASSERT_EQUAL(result.status, EXIT_USAGE);
+    ASSERT(result.errors.find("mython: unknown option --frobnicate\n"s) == 0);
+
+    result = RunDriver({"--flush=never"s});
+    ASSERT_EQUAL(result.status, EXIT_USAGE);
+    ASSERT(result.errors.find("mython: unknown flush policy never\n"s) == 0);
+
+    for (const auto& flush : {"--flush=chunk"s, "--flush=line"s, "--flush=exit"s}) {
+        result = RunDriver({flush}, "print 1, 'a'\nprint 1 / 0\n"s);
+        ASSERT_EQUAL(result.status, EXIT_FAILED);
+        ASSERT_EQUAL(result.output, "1 a\n"s);
+        ASSERT_EQUAL(result.errors, "<stdin>: error: Division by zero\n"s);
+    }
+
+    result = RunDriver({"--profile=out.folded"s, "--jobs=2"s});
+    ASSERT_EQUAL(result.status, EXIT_USAGE);
+    ASSERT(result.errors.find("mython: --profile cannot be combined with --jobs\n"s) == 0);
+
+    result = RunDriver({"--backend=jit"s});
+    ASSERT_EQUAL(result.status, EXIT_USAGE);
+    ASSERT(result.errors.find("mython: unknown backend jit\n"s) == 0);
+}
+
+void TestProfile() {
+    const string program = "class A:\n  def __init__():\n    self.n = 1\n\n"
+                           "  def f(n):\n    return n + self.n\n\na = A()\nprint a.f(1)\n"s;
+    TempFile script("mython_driver_profile.my"s, program);
+    const string stacks = script.Path() + ".folded"s;
+    for (const auto& backend : {"--backend=tree"s, "--backend=bytecode"s}) {
+        const auto result = RunDriver({"--profile="s + stacks, backend, script.Path()});
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "2\n"s);
+        ASSERT(result.errors.find("A.f"s) != string::npos);
+        // Виды узлов учитываются только при обходе дерева
+        ASSERT_EQUAL(result.errors.find("MethodCall"s) != string::npos,
+                     backend == "--backend=tree"s);
+
+        ifstream file(stacks);
+        const string contents{istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+        ASSERT(contents.find(script.Path() + ";A.f "s) != string::npos);
+        ASSERT(contents.find(script.Path() + ";A.__init__ "s) != string::npos);
+    }
+    remove(stacks.c_str());
+
+    // Методы каждой программы пакета называются по её классам
+    TempFile first("mython_driver_profile1.my"s,
+                   "class K1:\n  def m1():\n    return 1\n\nk = K1()\nprint k.m1()\n"s);
+    TempFile second("mython_driver_profile2.my"s,
+                    "class K2:\n  def m2():\n    return 2\n\nk = K2()\nprint k.m2()\n"s);
+    for (const auto& backend : {"--backend=tree"s, "--backend=bytecode"s}) {
+        const auto result = RunDriver(
+            {"--profile="s + stacks, backend, first.Path(), second.Path()});
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "1\n2\n"s);
+        ifstream file(stacks);
+        const string contents{istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+        ASSERT(contents.find(first.Path() + ";K1.m1 "s) != string::npos);
+        ASSERT(contents.find(second.Path() + ";K2.m2 "s) != string::npos);
+        ASSERT(contents.find(second.Path() + ";K1.m1 "s) == string::npos);
+    }
+    remove(stacks.c_str());
+
+    const auto result = RunDriver({"--profile=/nonexistent/dir/out.folded"s}, "print 1\n"s);
+    ASSERT_EQUAL(result.status, EXIT_FAILED);
+    ASSERT_EQUAL(result.output, "1\n"s);
+    ASSERT(result.errors.find("mython: cannot write /nonexistent/dir/out.folded\n"s)
+           != string::npos);
+}
+
+void TestMemory() {
+    const string program = "class A:\n  def __init__():\n    self.x = 'a'\n\na = A()\nprint 1\n"s;
+    for (const auto& jobs : {"--jobs=1"s, "--time"s}) {
+        const auto result = RunDriver({"--memory"s, jobs}, program);
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "1\n"s);
+        ASSERT(result.errors.find("<stdin>: memory\nkind "s) != string::npos);
+        ASSERT(result.errors.find("\nClassInstance "s) != string::npos);
+        ASSERT(result.errors.find("\nfields: 0 bytes live, "s) != string::npos);
+    }
+    const auto failed = RunDriver({"--memory"s}, "print 1 / 0\n"s);
+    ASSERT_EQUAL(failed.status, EXIT_FAILED);
+    ASSERT(failed.errors.find("<stdin>: error: Division by zero\n<stdin>: memory\n"s) == 0);
+}
+
+void TestCollector() {
+    const string program = "class A:\n  def __init__():\n    self.self = self\n\n"s
+                           "a = A()\nb = A()\nprint 1\n"s;
+    for (const auto& jobs : {"--jobs=1"s, "--gc=1"s}) {
+        const auto result = RunDriver({"--time"s, "--memory"s, jobs}, program);
+        ASSERT_EQUAL(result.status, EXIT_OK);
+        ASSERT_EQUAL(result.output, "1\n"s);
+        ASSERT(result.errors.find("<stdin>: gc "s) != string::npos);
+        ASSERT(result.errors.find(" collections, 2 instances freed, "s) != string::npos);
+        ASSERT(result.errors.find(" ms max pause, 1 full "s) != string::npos);
+        ASSERT(result.errors.find("\nClassInstance "s) != string::npos);
+    }
+    for (const auto& gc : {"--gc="s, "--gc=-1"s, "--gc=x"s}) {
+        const auto result = RunDriver({gc}, program);
+        ASSERT_EQUAL(result.status, EXIT_USAGE);
+        ASSERT(result.errors.find("mython: invalid gc threshold "s) == 0);
+    }
+}
+
+void TestInteractive() {
+    const string session = "x = 2\nclass A:\n  def f(n):\n    return n * 21\n\n"s
+                           "print 1 / 0\na = A()\nif x > 1:\n  print a.f(x)\n"s;
+    for (const auto& backend : {"--backend=tree"s, "--backend=bytecode"s}) {
+        const auto result = RunDriver({"-i"s, backend}, session);
+        ASSERT_EQUAL(result.status, EXIT_FAILED);
+        // Конец ввода завершает последний блок
+        ASSERT_EQUAL(result.output, "42\n"s);
+        ASSERT_EQUAL(result.errors, ">>> >>> ... ... ... >>> <stdin>: error: Division by zero\n"
+                                    ">>> >>> ... ... \n"s);
+    }
+
+    const auto result = RunDriver({"--interactive"s, "--gc=0"s}, "print 'ok'\n"s);
+    ASSERT_EQUAL(result.status, EXIT_OK);
+    ASSERT_EQUAL(result.output, "ok\n"s);
+    for (const auto& option : {"--time"s, "--jobs=2"s, "script.my"s}) {
+        const auto failed = RunDriver({"-i"s, option});
+        ASSERT_EQUAL(failed.status, EXIT_USAGE);
+        ASSERT(failed.errors.find("mython: --interactive takes no FILE"s) == 0);
+    }
+}
+
+}  // namespace
+
+void RunDriverTests(TestRunner& tr) {
+    RUN_TEST(tr, driver::TestStdin);
+    RUN_TEST(tr, driver::TestBatch);
+    RUN_TEST(tr, driver::TestJobs);
+    RUN_TEST(tr, driver::TestTimeAndCache);
+    RUN_TEST(tr, driver::TestUsage);
+    RUN_TEST(tr, driver::TestProfile);
+    RUN_TEST(tr, driver::TestMemory);
+    RUN_TEST(tr, driver::TestCollector);
+    RUN_TEST(tr, driver::TestInteractive);
+}
+
+}  // namespace driver
@@ -0,0 +1,178 @@
+#include "executor.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <sstream>
+
+using namespace std;
+
+namespace executor {
+
+    ThreadPool::ThreadPool(size_t thread_count) {
+        thread_count = max<size_t>(thread_count, 1);
+        queues_.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i) {
+            queues_.push_back(make_unique<Queue>());
+        }
+        threads_.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads_.emplace_back([this, i] {
+                WorkerLoop(i);
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Submit(Task task) {
+        size_t index;
+        {
+            // Счётчики увеличиваются раньше, чем задача попадает в очередь, чтобы поток,
+            // взявший задачу, никогда не уменьшил их первым
+            lock_guard lock(mutex_);
+            ++queued_;
+            ++pending_;
+            index = next_queue_;
+            next_queue_ = (next_queue_ + 1) % queues_.size();
+        }
+        {
+            Queue& queue = *queues_[index];
+            lock_guard lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        wake_.notify_one();
+    }
+
+    void ThreadPool::Wait() {
+        unique_lock lock(mutex_);
+        done_.wait(lock, [this] {
+            return pending_ == 0;
+        });
+        if (error_) {
+            rethrow_exception(exchange(error_, nullptr));
+        }
+    }
+
+    bool ThreadPool::TryPop(size_t index, Task& task) {
+        Queue& queue = *queues_[index];
+        lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool ThreadPool::TrySteal(size_t thief, Task& task) {
+        for (size_t offset = 1; offset < queues_.size(); ++offset) {
+            Queue& queue = *queues_[(thief + offset) % queues_.size()];
+            lock_guard lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::WorkerLoop(size_t index) {
+        Task task;
+        while (true) {
+            if (TryPop(index, task) || TrySteal(index, task)) {
+                {
+                    lock_guard lock(mutex_);
+                    --queued_;
+                }
+                exception_ptr error;
+                try {
+                    task();
+                } catch (...) {
+                    error = current_exception();
+                }
+                task = nullptr;
+
+                lock_guard lock(mutex_);
+                if (error && !error_) {
+                    error_ = std::move(error);
+                }
+                if (--pending_ == 0) {
+                    done_.notify_all();
+                }
+                continue;
+            }
+
+            // Задача может быть уже учтена в queued_, но ещё не положена в очередь:
+            // тогда поток не засыпает и повторяет поиск
+            unique_lock lock(mutex_);
+            wake_.wait(lock, [this] {
+                return stopping_ || queued_ > 0;
+            });
+            if (stopping_ && queued_ == 0) {
+                return;
+            }
+        }
+    }
+
+    vector<JobResult> RunPrograms(const vector<runtime::Executable*>& programs, ThreadPool& pool,
+                                  bool track_memory, size_t gc_threshold) {
+        vector<JobResult> results(programs.size());
+        for (size_t i = 0; i < programs.size(); ++i) {
+            auto job = [program = programs[i], &result = results[i], track_memory,
+                        gc_threshold] {
+                const auto start = chrono::steady_clock::now();
+                ostringstream output;
+                // Счётчики и сборщик объявлены раньше переменных программы и переживают их
+                runtime::MemoryStats memory;
+                optional<runtime::CycleCollector> collector;
+                if (gc_threshold != 0) {
+                    collector.emplace(runtime::CycleCollector::Options{gc_threshold});
+                }
+                try {
+                    runtime::CollectorScope collecting(collector ? &*collector : nullptr);
+                    optional<runtime::MemoryScope> accounting;
+                    runtime::SimpleContext context{output};
+                    if (track_memory) {
+                        accounting.emplace(&memory);
+                        context.SetMemoryStats(&memory);
+                    }
+                    runtime::Closure closure;
+                    program->Execute(closure, context);
+                } catch (const exception& e) {
+                    result.failed = true;
+                    result.error = e.what();
+                }
+                if (collector) {
+                    // Переменные программы уничтожены, остались только циклы
+                    collector->CollectAll();
+                    result.gc = collector->GetStats();
+                }
+                result.memory = memory.GetUsage();
+                result.output = output.str();
+                result.milliseconds =
+                    chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            };
+#ifdef MYTHON_SINGLE_THREADED
+            job();
+#else
+            pool.Submit(std::move(job));
+#endif
+        }
+        pool.Wait();
+        return results;
+    }
+
+}  // namespace executor
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "cycle_collector.h"
+#include "memory_stats.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace runtime {
+    class Executable;
+}
+
+// Параллельное выполнение программ Mython.
+//
+// Модель потокобезопасности:
+//  - Дерево разбора, байт-код и объявленные в программе классы после построения не меняются.
+//    Их можно выполнять в нескольких потоках одновременно. Исключения - кэши в узлах
+//    (MethodCache, FieldCache, Quickening) и таблица переходов Shape: кэши хранят атомарные
+//    слова и перепроверяют запомненное при каждом попадании, а переходы защищены мьютексом.
+//  - Состояние выполнения принадлежит одному потоку: Closure с переменными программы, Context
+//    с потоком вывода, экземпляры классов и строки, созданные программой. Каждое выполнение
+//    создаёт свои экземпляры, поэтому разные выполнения не видят объектов друг друга.
+//  - Таблица символов общая и защищена мьютексом, а уже найденные символы поток берёт из
+//    своего кэша. Регистровая машина байт-кода у каждого потока своя.
+//  - Счётчики ссылок объектов атомарны, так как классы и константы программы разделяются её
+//    выполнениями. В однопоточной сборке (MYTHON_SINGLE_THREADED) они не атомарны,
+//    и RunPrograms выполняет программы по очереди.
+//  - Строить программы (разбор, оптимизация, компиляция, загрузка образа) нужно до запуска
+//    выполнений: построение меняет классы и дерево. Программа должна пережить все выполнения
+namespace executor {
+
+    // Пул потоков с очередью задач у каждого потока. Поток берёт задачи из конца своей
+    // очереди, а опустевший поток забирает задачи из начала очередей других потоков
+    class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+
+        // Запускает thread_count потоков, но не меньше одного
+        explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency());
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Дожидается уже поставленных задач и останавливает потоки
+        ~ThreadPool();
+
+        // Ставит задачу в очередь очередного потока по кругу
+        void Submit(Task task);
+
+        // Дожидается завершения всех поставленных задач. Если какая-то задача выбросила
+        // исключение, выбрасывает первое из них
+        void Wait();
+
+        [[nodiscard]] std::size_t Size() const {
+            return threads_.size();
+        }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void WorkerLoop(std::size_t index);
+        bool TryPop(std::size_t index, Task& task);
+        bool TrySteal(std::size_t thief, Task& task);
+
+        std::vector<std::unique_ptr<Queue>> queues_;
+        std::vector<std::thread> threads_;
+
+        // Защищает счётчики, флаг остановки и исключение
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        // Задачи, поставленные в очереди, но ещё не взятые потоками
+        std::size_t queued_ = 0;
+        // Задачи, поставленные, но ещё не завершённые
+        std::size_t pending_ = 0;
+        std::size_t next_queue_ = 0;
+        bool stopping_ = false;
+        std::exception_ptr error_;
+    };
+
+    // Результат одного выполнения программы
+    struct JobResult {
+        // Всё, что программа вывела, в том числе до ошибки
+        std::string output;
+        // Сообщение об ошибке, пустое при успешном выполнении
+        std::string error;
+        bool failed = false;
+        double milliseconds = 0;
+        // Память выполнения, если она учитывалась
+        runtime::MemoryUsage memory;
+        // Сборки циклов выполнения, включая завершающую
+        runtime::CycleCollector::Stats gc;
+    };
+
+    // Выполняет программы в пуле pool, каждую со своими Closure, Context и выводом.
+    // В однопоточной сборке программы выполняются по очереди в вызывающем потоке.
+    // Одна программа может встречаться в programs несколько раз.
+    // С флагом track_memory память каждого выполнения учитывается в JobResult::memory.
+    // Циклы экземпляров собирает свой у каждого выполнения CycleCollector с порогом
+    // gc_threshold; 0 отключает сборку. Результаты возвращаются в порядке programs
+    std::vector<JobResult> RunPrograms(
+        const std::vector<runtime::Executable*>& programs, ThreadPool& pool,
+        bool track_memory = false,
+        std::size_t gc_threshold = runtime::CycleCollector::DEFAULT_THRESHOLD);
+
+}  // namespace executor
@@ -0,0 +1,200 @@
+#include "compiler.h"
+#include "executor.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <atomic>
+
+using namespace std;
+
+namespace executor {
+
+namespace {
+
+// Программа задействует кэши методов и полей, переходы форм, специализацию операций
+// и склеивание строк, то есть всё разделяемое состояние дерева и байт-кода
+const string PROGRAM = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+  def repeat(text, n):
+    if n == 0:
+      return ''
+    return text + self.repeat(text, n - 1)
+
+class Labeled(Counter):
+  def __init__(start, label):
+    self.value = start
+    self.label = label
+
+  def __str__():
+    return self.label + ':' + str(self.value)
+
+c = Counter(1)
+l = Labeled(2, 'l')
+l.extra = c
+print c.fib(15), l.fib(10), l
+print c.repeat('ab', 20)
+l.value = l.value + c.value
+print l, l.extra.value
+print 1 / 0
+)";
+
+const string EXPECTED = "610 55 l:2\nabababababababababababababababababababab\nl:3 1\n"s;
+
+unique_ptr<runtime::Executable> Build(bool compiled) {
+    parse::Lexer lexer{string_view(PROGRAM)};
+    auto program = ast::Optimize(ParseProgram(lexer));
+    return compiled ? bytecode::Compile(std::move(program)) : std::move(program);
+}
+
+void TestThreadPool() {
+    atomic<int> sum = 0;
+    {
+        ThreadPool pool(4);
+        ASSERT_EQUAL(pool.Size(), 4u);
+        for (int i = 1; i <= 1000; ++i) {
+            pool.Submit([&sum, i] {
+                sum += i;
+            });
+        }
+        pool.Wait();
+        ASSERT_EQUAL(sum.load(), 500500);
+
+        // Пул пригоден для повторного использования, в том числе после исключения
+        pool.Submit([] {
+            throw runtime_error("first"s);
+        });
+        pool.Submit([&sum] {
+            ++sum;
+        });
+        ASSERT_THROWS(pool.Wait(), runtime_error);
+        ASSERT_EQUAL(sum.load(), 500501);
+        pool.Wait();
+
+        // Задачи, оставшиеся в очередях, выполняются до остановки пула
+        for (int i = 0; i < 100; ++i) {
+            pool.Submit([&sum] {
+                ++sum;
+            });
+        }
+    }
+    ASSERT_EQUAL(sum.load(), 500601);
+
+    ThreadPool single(0);
+    ASSERT_EQUAL(single.Size(), 1u);
+}
+
+void TestSharedProgram() {
+    for (bool compiled : {false, true}) {
+        // Одна программа, выполняемая одновременно во многих потоках
+        const auto program = Build(compiled);
+        const vector<runtime::Executable*> programs(32, program.get());
+        ThreadPool pool(4);
+        for (int round = 0; round < 2; ++round) {
+            const auto results = RunPrograms(programs, pool);
+            ASSERT_EQUAL(results.size(), programs.size());
+            for (const auto& result : results) {
+                ASSERT_EQUAL(result.output, EXPECTED);
+                ASSERT(result.failed);
+                ASSERT_EQUAL(result.error, "Division by zero"s);
+            }
+        }
+    }
+}
+
+void TestDifferentPrograms() {
+    vector<unique_ptr<runtime::Executable>> owned;
+    vector<runtime::Executable*> programs;
+    for (int i = 0; i < 8; ++i) {
+        const string source = "x = "s + to_string(i) + "\nprint x * x\n"s;
+        parse::Lexer lexer{string_view(source)};
+        owned.push_back(bytecode::Compile(ParseProgram(lexer)));
+        programs.push_back(owned.back().get());
+    }
+    ThreadPool pool(3);
+    const auto results = RunPrograms(programs, pool);
+    for (int i = 0; i < 8; ++i) {
+        ASSERT_EQUAL(results[i].output, to_string(i * i) + "\n"s);
+        ASSERT(!results[i].failed);
+        ASSERT(results[i].error.empty());
+    }
+}
+
+void TestMemory() {
+    for (bool compiled : {false, true}) {
+        const auto program = Build(compiled);
+        const vector<runtime::Executable*> programs(4, program.get());
+        ThreadPool pool(2);
+        constexpr auto INSTANCE = static_cast<size_t>(runtime::Object::Kind::ClassInstance);
+        for (const auto& result : RunPrograms(programs, pool, true)) {
+            ASSERT_EQUAL(result.output, EXPECTED);
+            // Каждое выполнение учитывает только свои объекты и все их освобождает
+            ASSERT_EQUAL(result.memory.objects[INSTANCE].created, 2U);
+            ASSERT_EQUAL(result.memory.objects[INSTANCE].live.current, 0U);
+            ASSERT_EQUAL(result.memory.heap_bytes.current, 0U);
+            ASSERT(result.memory.string_bytes.peak > 0U);
+        }
+        for (const auto& result : RunPrograms(programs, pool)) {
+            ASSERT_EQUAL(result.memory.objects[INSTANCE].created, 0U);
+        }
+    }
+}
+
+void TestCycles() {
+    const string source = R"(
+class Node:
+  def __init__():
+    self.other = None
+
+class Builder:
+  def build(n):
+    if n > 0:
+      a = Node()
+      b = Node()
+      a.other = b
+      b.other = a
+      self.build(n - 1)
+
+kept = Node()
+kept.other = kept
+builder = Builder()
+builder.build(50)
+print 'built'
+)"s;
+    for (bool compiled : {false, true}) {
+        parse::Lexer lexer{string_view(source)};
+        auto tree = ParseProgram(lexer);
+        const auto program = compiled ? bytecode::Compile(std::move(tree)) : std::move(tree);
+        const vector<runtime::Executable*> programs(3, program.get());
+        ThreadPool pool(2);
+        constexpr auto INSTANCE = static_cast<size_t>(runtime::Object::Kind::ClassInstance);
+        for (const auto& result : RunPrograms(programs, pool, true, 16)) {
+            ASSERT_EQUAL(result.output, "built\n"s);
+            ASSERT_EQUAL(result.memory.objects[INSTANCE].live.current, 0U);
+            ASSERT(result.gc.collections > 1U);
+            ASSERT_EQUAL(result.gc.freed, 101U);
+        }
+    }
+}
+
+}  // namespace
+
+void RunExecutorTests(TestRunner& tr) {
+    RUN_TEST(tr, executor::TestThreadPool);
+    RUN_TEST(tr, executor::TestSharedProgram);
+    RUN_TEST(tr, executor::TestDifferentPrograms);
+    RUN_TEST(tr, executor::TestMemory);
+    RUN_TEST(tr, executor::TestCycles);
+}
+
+}  // namespace executor
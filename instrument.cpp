@@ -0,0 +1,168 @@
+#include "instrument.h"
+
+#include "profiler.h"
+#include "statement.h"
+
+#include <utility>
+
+using namespace std;
+
+namespace ast {
+
+    namespace {
+        // Возвращает вид узла. Производные классы проверяются раньше базовых
+        const char* KindOf(const Statement& node) {
+            if (dynamic_cast<const NumericConst*>(&node) != nullptr) {
+                return "NumericConst";
+            }
+            if (dynamic_cast<const StringConst*>(&node) != nullptr) {
+                return "StringConst";
+            }
+            if (dynamic_cast<const BoolConst*>(&node) != nullptr) {
+                return "BoolConst";
+            }
+            if (dynamic_cast<const None*>(&node) != nullptr) {
+                return "None";
+            }
+            if (dynamic_cast<const VariableValue*>(&node) != nullptr) {
+                return "VariableValue";
+            }
+            if (dynamic_cast<const Assignment*>(&node) != nullptr) {
+                return "Assignment";
+            }
+            if (dynamic_cast<const FieldAssignment*>(&node) != nullptr) {
+                return "FieldAssignment";
+            }
+            if (dynamic_cast<const Print*>(&node) != nullptr) {
+                return "Print";
+            }
+            if (dynamic_cast<const MethodCall*>(&node) != nullptr) {
+                return "MethodCall";
+            }
+            if (dynamic_cast<const NewInstance*>(&node) != nullptr) {
+                return "NewInstance";
+            }
+            if (dynamic_cast<const Stringify*>(&node) != nullptr) {
+                return "Stringify";
+            }
+            if (dynamic_cast<const Not*>(&node) != nullptr) {
+                return "Not";
+            }
+            if (dynamic_cast<const Add*>(&node) != nullptr) {
+                return "Add";
+            }
+            if (dynamic_cast<const Sub*>(&node) != nullptr) {
+                return "Sub";
+            }
+            if (dynamic_cast<const Mult*>(&node) != nullptr) {
+                return "Mult";
+            }
+            if (dynamic_cast<const Div*>(&node) != nullptr) {
+                return "Div";
+            }
+            if (dynamic_cast<const Or*>(&node) != nullptr) {
+                return "Or";
+            }
+            if (dynamic_cast<const And*>(&node) != nullptr) {
+                return "And";
+            }
+            if (dynamic_cast<const Comparison*>(&node) != nullptr) {
+                return "Comparison";
+            }
+            if (dynamic_cast<const Compound*>(&node) != nullptr) {
+                return "Compound";
+            }
+            if (dynamic_cast<const MethodBody*>(&node) != nullptr) {
+                return "MethodBody";
+            }
+            if (dynamic_cast<const Return*>(&node) != nullptr) {
+                return "Return";
+            }
+            if (dynamic_cast<const ClassDefinition*>(&node) != nullptr) {
+                return "ClassDefinition";
+            }
+            if (dynamic_cast<const IfElse*>(&node) != nullptr) {
+                return "IfElse";
+            }
+            return "Other";
+        }
+
+        // Выполняет обёрнутый узел, учитывая его время в профилировщике контекста
+        class ProfiledNode : public Statement {
+        public:
+            explicit ProfiledNode(unique_ptr<Statement> node)
+                : kind_(KindOf(*node))
+                , node_(std::move(node)) {
+            }
+
+            runtime::ObjectHolder Execute(runtime::Closure& closure,
+                                          runtime::Context& context) override {
+                if (runtime::Profiler* profiler = context.GetProfiler(); profiler != nullptr) {
+                    runtime::Profiler::NodeScope scope(*profiler, kind_);
+                    return node_->Execute(closure, context);
+                }
+                return node_->Execute(closure, context);
+            }
+
+        private:
+            const char* kind_;
+            unique_ptr<Statement> node_;
+        };
+
+        class Instrumenter {
+        public:
+            unique_ptr<Statement> Wrap(unique_ptr<Statement> node) {
+                if (auto* binary = dynamic_cast<BinaryOperation*>(node.get())) {
+                    WrapChild(binary->MutableLhs());
+                    WrapChild(binary->MutableRhs());
+                } else if (auto* unary = dynamic_cast<UnaryOperation*>(node.get())) {
+                    WrapChild(unary->MutableArgument());
+                } else if (auto* if_else = dynamic_cast<IfElse*>(node.get())) {
+                    WrapChild(if_else->MutableCondition());
+                    WrapChild(if_else->MutableIfBody());
+                    if (if_else->GetElseBody() != nullptr) {
+                        WrapChild(if_else->MutableElseBody());
+                    }
+                } else if (auto* compound = dynamic_cast<Compound*>(node.get())) {
+                    WrapChildren(compound->MutableStatements());
+                } else if (auto* assign = dynamic_cast<Assignment*>(node.get())) {
+                    WrapChild(assign->MutableRightValue());
+                } else if (auto* field = dynamic_cast<FieldAssignment*>(node.get())) {
+                    WrapChild(field->MutableRightValue());
+                } else if (auto* print = dynamic_cast<Print*>(node.get())) {
+                    WrapChildren(print->MutableArgs());
+                } else if (auto* call = dynamic_cast<MethodCall*>(node.get())) {
+                    WrapChild(call->MutableObject());
+                    WrapChildren(call->MutableArgs());
+                } else if (auto* instance = dynamic_cast<NewInstance*>(node.get())) {
+                    WrapChildren(instance->MutableArgs());
+                } else if (auto* body = dynamic_cast<MethodBody*>(node.get())) {
+                    WrapChild(body->MutableBody());
+                } else if (auto* ret = dynamic_cast<Return*>(node.get())) {
+                    WrapChild(ret->MutableStatement());
+                } else if (auto* cls = dynamic_cast<ClassDefinition*>(node.get())) {
+                    for (auto& method : cls->GetClass().TryAs<runtime::Class>()->Methods()) {
+                        WrapChild(method.body);
+                    }
+                }
+                return make_unique<ProfiledNode>(std::move(node));
+            }
+
+        private:
+            void WrapChild(unique_ptr<Statement>& child) {
+                child = Wrap(std::move(child));
+            }
+
+            void WrapChildren(vector<unique_ptr<Statement>>& children) {
+                for (auto& child : children) {
+                    WrapChild(child);
+                }
+            }
+        };
+    }
+
+    unique_ptr<runtime::Executable> Instrument(unique_ptr<runtime::Executable> program) {
+        return Instrumenter().Wrap(std::move(program));
+    }
+
+}  // namespace ast
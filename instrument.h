@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+
+namespace runtime {
+    class Executable;
+}
+
+namespace ast {
+
+    // Оборачивает каждый узел дерева, построенного ParseProgram, включая тела методов
+    // объявленных в программе классов, в узел, который при включённом профилировщике контекста
+    // (Context::SetProfiler) учитывает выполнение обёрнутого узла по его виду: "Add",
+    // "MethodCall", "Print" и т.д. Без профилировщика результат выполнения не меняется.
+    // Обёрнутое дерево нельзя компилировать в байт-код и сохранять в образ, поэтому
+    // инструментирование выполняется последним
+    std::unique_ptr<runtime::Executable> Instrument(std::unique_ptr<runtime::Executable> program);
+
+}  // namespace ast
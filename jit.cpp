@@ -0,0 +1,1333 @@
+#include "jit.h"
+
+#include "vm.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace jit {
+
+    using bytecode::CompiledMethod;
+    using bytecode::Function;
+    using bytecode::Instruction;
+    using bytecode::Machine;
+    using bytecode::OpCode;
+    using runtime::ObjectHolder;
+
+    // Выведенный тип регистра в точке функции
+    enum class Type : uint8_t {
+        Unknown,   // точка ещё не достигнута
+        Int,       // число, хранится в ячейке кадра
+        Bool,      // логическое значение, хранится в ячейке кадра как 0 или 1
+        None,      // None
+        Self,      // получатель вызова, общий для всех функций одного машинного кода
+        Unbound,   // локальная переменная без значения
+        Conflict,  // на разных путях разные типы: значение не используется
+    };
+
+    // Чем завершилась машинная функция. Int и Bool оставляют значение в ячейке 0 кадра,
+    // Object - в NativeContext::object, Error - исключение в NativeContext::error
+    enum class Status : uint32_t {
+        Int,
+        Bool,
+        None,
+        Self,
+        Object,
+        Error,
+    };
+
+    // Контекст одного входа в машинный код из интерпретатора. Машинный код читает только
+    // limit, он должен оставаться первым полем
+    struct NativeContext {
+        const int64_t* limit;
+        Machine* machine;
+        runtime::Context* context;
+        runtime::ClassInstance* self;
+        ObjectHolder object;
+        exception_ptr error;
+    };
+
+    static_assert(offsetof(NativeContext, limit) == 0);
+
+    // Точка деоптимизации: функция, инструкция, с которой её продолжает интерпретатор,
+    // и типы регистров в этой точке
+    struct DeoptPoint {
+        const Function* function = nullptr;
+        uint32_t ip = 0;
+        // Регистр, в который записывается результат вызова, если точка следует за вызовом
+        int32_t call_result = -1;
+        vector<Type> types;
+        const Code* code = nullptr;
+    };
+
+    // Чтение или запись поля self
+    struct FieldSite {
+        runtime::FieldCache* cache;
+        runtime::Symbol name;
+        uint16_t reg;
+        Type type;
+    };
+
+    // Вызов метода self, который исполняет интерпретатор
+    struct CallSite {
+        const runtime::Method* method;
+        const CompiledMethod* compiled;
+        uint16_t base;
+        uint16_t frame_size;
+        vector<Type> args;
+    };
+
+    // Точка входа в машинный код метода для экземпляров класса class_id
+    struct Entry {
+        const CompiledMethod* method;
+        uint32_t class_id;
+        uint16_t param_count;
+        uint16_t register_count;
+        const void* address;
+        const Code* code;
+    };
+
+    // Исполняемая память одного скомпилированного набора методов с описаниями точек,
+    // на которые ссылается машинный код. Адреса элементов deque не меняются при добавлении
+    class Code {
+    public:
+        Code() = default;
+        ~Code();
+
+        Code(const Code&) = delete;
+        Code& operator=(const Code&) = delete;
+
+        // Копирует машинный код в исполняемую память. Возвращает false, если система
+        // не выделила память
+        bool Load(const vector<uint8_t>& bytes);
+
+        [[nodiscard]] const uint8_t* GetAddress() const {
+            return static_cast<const uint8_t*>(memory_);
+        }
+
+        deque<DeoptPoint> points;
+        deque<FieldSite> fields;
+        deque<CallSite> calls;
+        deque<Entry> entries;
+        // Число деоптимизаций. Код, который слишком часто возвращается в интерпретатор,
+        // больше не используется
+        mutable atomic<uint32_t> deopts = 0;
+
+    private:
+        void* memory_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    namespace {
+        using NativeFunction = uint32_t (*)(NativeContext*, int64_t*);
+
+        // Ячеек в стеке машинного кода одного потока
+        constexpr size_t STACK_SLOTS = 1U << 16;
+        constexpr uint32_t DEOPT_LIMIT = 1000;
+        // Функций в одном наборе и инструкций в одной функции
+        constexpr size_t MAX_UNIT_FUNCTIONS = 64;
+        constexpr size_t MAX_FUNCTION_SIZE = 4096;
+
+        // Метод, который не удалось скомпилировать
+        const Entry UNSUPPORTED{};
+
+        // Стек ячеек кадров машинного кода. Кадр вызываемого метода лежит поверх регистров
+        // аргументов вызывающего, как и в стеке машины
+        struct NativeStack {
+            unique_ptr<int64_t[]> slots = make_unique<int64_t[]>(STACK_SLOTS);
+            int64_t* top = slots.get();
+            const int64_t* limit = slots.get() + STACK_SLOTS;
+
+            static NativeStack& ForCurrentThread() {
+                thread_local NativeStack stack;
+                return stack;
+            }
+        };
+
+        // Поднимает вершину стека над кадром frame на время вызова интерпретатора,
+        // чтобы вложенные входы в машинный код не затёрли кадры, которые ещё выполняются
+        class StackTop {
+        public:
+            StackTop(int64_t* frame, size_t size)
+                : stack_(NativeStack::ForCurrentThread())
+                , saved_(stack_.top) {
+                stack_.top = frame + size;
+            }
+
+            StackTop(const StackTop&) = delete;
+            StackTop& operator=(const StackTop&) = delete;
+
+            ~StackTop() {
+                stack_.top = saved_;
+            }
+
+        private:
+            NativeStack& stack_;
+            int64_t* saved_;
+        };
+
+        mutex& CompileMutex() {
+            static mutex compile_mutex;
+            return compile_mutex;
+        }
+
+        int32_t IntAt(const int64_t* frame, size_t reg) {
+            return static_cast<int32_t>(frame[reg]);
+        }
+
+        ObjectHolder Box(Type type, const int64_t* frame, size_t reg, const NativeContext& ctx) {
+            switch (type) {
+                case Type::Int:
+                    return ObjectHolder::Own(runtime::Number{IntAt(frame, reg)});
+                case Type::Bool:
+                    return ObjectHolder::Own(runtime::Bool{IntAt(frame, reg) != 0});
+                case Type::Self:
+                    return ctx.self->Self();
+                case Type::Unbound:
+                    return ctx.machine->GetUnbound();
+                default:
+                    return ObjectHolder::None();
+            }
+        }
+
+#ifdef JIT_X86_64
+        // Передаёт результат интерпретатора машинному коду: число - в ячейку slot
+        Status Unbox(NativeContext& ctx, int64_t* slot, ObjectHolder value) {
+            if (const auto* number = value.TryAs<runtime::Number>()) {
+                *slot = number->GetValue();
+                return Status::Int;
+            }
+            ctx.object = std::move(value);
+            return Status::Object;
+        }
+
+        Status Fail(NativeContext& ctx) {
+            ctx.error = current_exception();
+            return Status::Error;
+        }
+
+        // Вспомогательные функции машинного кода. Исключения не должны проходить через кадры
+        // машинного кода, поэтому функции перехватывают их и возвращают Status::Error
+
+        uint32_t GetField(NativeContext* ctx, int64_t* frame, const FieldSite* site) noexcept {
+            const ObjectHolder* field = site->cache->Find(*ctx->self, site->name);
+            if (field == nullptr) {
+                return 1;
+            }
+            const auto* number = field->TryAs<runtime::Number>();
+            if (number == nullptr) {
+                return 1;
+            }
+            frame[site->reg] = number->GetValue();
+            return 0;
+        }
+
+        uint32_t SetField(NativeContext* ctx, int64_t* frame, const FieldSite* site) noexcept {
+            try {
+                site->cache->Assign(*ctx->self, site->name, Box(site->type, frame, site->reg, *ctx));
+                return 0;
+            } catch (...) {
+                // Интерпретатор повторит присваивание и сообщит об ошибке сам
+                return 1;
+            }
+        }
+
+        uint32_t CallMethod(NativeContext* ctx, int64_t* frame, const CallSite* site) noexcept {
+            try {
+                StackTop top(frame, site->frame_size);
+                const int64_t* args = frame + site->base + 1;
+                ObjectHolder result;
+                if (site->compiled != nullptr) {
+                    Machine& machine = *ctx->machine;
+                    const size_t base = machine.Top();
+                    machine.Reserve(base + site->compiled->GetFunction().register_count);
+                    machine.Register(base) = ctx->self->Self();
+                    for (size_t i = 0; i < site->args.size(); ++i) {
+                        machine.Register(base + i + 1) = Box(site->args[i], args, i, *ctx);
+                    }
+                    result = site->compiled->Invoke(machine, base, *ctx->context);
+                } else {
+                    vector<ObjectHolder> actual_args;
+                    actual_args.reserve(site->args.size());
+                    for (size_t i = 0; i < site->args.size(); ++i) {
+                        actual_args.push_back(Box(site->args[i], args, i, *ctx));
+                    }
+                    result = ctx->self->Call(*site->method, actual_args, *ctx->context);
+                }
+                return static_cast<uint32_t>(
+                    Unbox(*ctx, frame + site->base, std::move(result)));
+            } catch (...) {
+                return static_cast<uint32_t>(Fail(*ctx));
+            }
+        }
+
+        // Переносит кадр в регистры машины и продолжает функцию в интерпретаторе.
+        // status - чем завершился вызов, если точка следует за вызовом
+        uint32_t Deoptimize(NativeContext* ctx, int64_t* frame, const DeoptPoint* point,
+                            uint32_t status) noexcept {
+            point->code->deopts.fetch_add(1, memory_order_relaxed);
+            try {
+                const size_t size = point->types.size();
+                StackTop top(frame, size);
+                Machine& machine = *ctx->machine;
+                const size_t base = machine.Top();
+                machine.Reserve(base + size);
+                for (size_t reg = 0; reg < size; ++reg) {
+                    machine.Register(base + reg) = Box(point->types[reg], frame, reg, *ctx);
+                }
+                if (point->call_result >= 0) {
+                    const auto reg = static_cast<size_t>(point->call_result);
+                    ObjectHolder& result = machine.Register(base + reg);
+                    switch (static_cast<Status>(status)) {
+                        case Status::Int:
+                            result = Box(Type::Int, frame, reg, *ctx);
+                            break;
+                        case Status::Bool:
+                            result = Box(Type::Bool, frame, reg, *ctx);
+                            break;
+                        case Status::Self:
+                            result = ctx->self->Self();
+                            break;
+                        case Status::Object:
+                            result = std::move(ctx->object);
+                            break;
+                        default:
+                            result = ObjectHolder::None();
+                            break;
+                    }
+                }
+                return static_cast<uint32_t>(Unbox(
+                    *ctx, frame,
+                    machine.Resume(*point->function, base, point->ip, nullptr, *ctx->context)));
+            } catch (...) {
+                return static_cast<uint32_t>(Fail(*ctx));
+            }
+        }
+
+        bool IsValue(Type type) {
+            return type == Type::Int || type == Type::Bool || type == Type::None
+                   || type == Type::Self;
+        }
+
+        bool IsUnboxed(Type type) {
+            return type == Type::Int || type == Type::Bool;
+        }
+
+        Type Join(Type lhs, Type rhs) {
+            if (lhs == rhs || rhs == Type::Unknown) {
+                return lhs;
+            }
+            return lhs == Type::Unknown ? rhs : Type::Conflict;
+        }
+
+        // Читает ли инструкция регистр reg. Неподдерживаемые инструкции до этой проверки
+        // не доходят: функция с ними не компилируется
+        bool Reads(const Instruction& instr, uint32_t reg) {
+            switch (instr.op) {
+                case OpCode::Move:
+                case OpCode::GetField:
+                case OpCode::ToBool:
+                case OpCode::Not:
+                    return instr.b == reg;
+                case OpCode::DefineLocal:
+                    return instr.a == reg || instr.b == reg;
+                case OpCode::CheckBound:
+                case OpCode::JumpIfFalse:
+                case OpCode::JumpIfTrue:
+                case OpCode::Return:
+                    return instr.a == reg;
+                case OpCode::SetField:
+                    return instr.a == reg || instr.c == reg;
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mult:
+                case OpCode::Div:
+                case OpCode::Equal:
+                case OpCode::NotEqual:
+                case OpCode::Less:
+                case OpCode::Greater:
+                case OpCode::LessOrEqual:
+                case OpCode::GreaterOrEqual:
+                    return instr.b == reg || instr.c == reg;
+                case OpCode::Call:
+                    return reg >= instr.a && reg <= static_cast<uint32_t>(instr.a) + instr.c;
+                case OpCode::LoadConst:
+                case OpCode::LoadNone:
+                case OpCode::Jump:
+                case OpCode::ReturnNone:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+        // Записывает ли инструкция регистр reg безусловно
+        bool Writes(const Instruction& instr, uint32_t reg) {
+            switch (instr.op) {
+                case OpCode::LoadConst:
+                case OpCode::LoadNone:
+                case OpCode::Move:
+                case OpCode::GetField:
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mult:
+                case OpCode::Div:
+                case OpCode::ToBool:
+                case OpCode::Not:
+                case OpCode::Equal:
+                case OpCode::NotEqual:
+                case OpCode::Less:
+                case OpCode::Greater:
+                case OpCode::LessOrEqual:
+                case OpCode::GreaterOrEqual:
+                case OpCode::Call:
+                    return instr.a == reg;
+                default:
+                    return false;
+            }
+        }
+
+        // Типы регистров функции в каждой точке для получателя класса cls
+        struct Analysis {
+            const CompiledMethod* method = nullptr;
+            const Function* function = nullptr;
+            // Типы на входе в каждую инструкцию, пусто - инструкция недостижима
+            vector<vector<Type>> states;
+            // Для вызовов: метод получателя либо nullptr, если его нет
+            vector<const runtime::Method*> targets;
+            // Для вызовов: используется ли результат
+            vector<bool> results_used;
+            bool supported = false;
+        };
+
+        class Analyzer {
+        public:
+            Analyzer(const runtime::Class& cls, Analysis& analysis)
+                : cls_(cls)
+                , analysis_(analysis)
+                , function_(*analysis.function)
+                , code_(function_.code) {
+            }
+
+            bool Run() {
+                if (code_.empty() || code_.size() > MAX_FUNCTION_SIZE) {
+                    return false;
+                }
+                analysis_.states.assign(code_.size(), {});
+                analysis_.targets.assign(code_.size(), nullptr);
+                analysis_.results_used.assign(code_.size(), false);
+
+                vector<Type> entry(function_.register_count, Type::None);
+                entry[0] = Type::Self;
+                for (size_t i = 1; i <= function_.param_count; ++i) {
+                    entry[i] = Type::Int;
+                }
+                for (uint16_t reg : function_.unbound_registers) {
+                    entry[reg] = Type::Unbound;
+                }
+                Merge(0, entry);
+
+                while (!pending_.empty()) {
+                    const size_t ip = pending_.back();
+                    pending_.pop_back();
+                    vector<Type> state = analysis_.states[ip];
+                    successors_.clear();
+                    if (!Step(ip, state)) {
+                        return false;
+                    }
+                    for (size_t next : successors_) {
+                        if (next >= code_.size()) {
+                            return false;
+                        }
+                        Merge(next, state);
+                    }
+                }
+                return true;
+            }
+
+        private:
+            void Merge(size_t ip, const vector<Type>& state) {
+                vector<Type>& target = analysis_.states[ip];
+                if (target.empty()) {
+                    target = state;
+                    pending_.push_back(ip);
+                    return;
+                }
+                bool changed = false;
+                for (size_t reg = 0; reg < target.size(); ++reg) {
+                    const Type joined = Join(target[reg], state[reg]);
+                    if (joined != target[reg]) {
+                        target[reg] = joined;
+                        changed = true;
+                    }
+                }
+                if (changed) {
+                    pending_.push_back(ip);
+                }
+            }
+
+            // Применяет инструкцию ip к типам state. Возвращает false, если инструкцию
+            // нельзя выполнить машинным кодом
+            bool Step(size_t ip, vector<Type>& state) {
+                const Instruction& instr = code_[ip];
+                auto has = [&state](uint32_t reg, Type type) {
+                    return reg < state.size() && state[reg] == type;
+                };
+                auto value = [&state](uint32_t reg) {
+                    return reg < state.size() && IsValue(state[reg]);
+                };
+                if (instr.a >= state.size()) {
+                    return false;
+                }
+                Type& result = state[instr.a];
+                switch (instr.op) {
+                    case OpCode::LoadConst: {
+                        const ObjectHolder& constant = function_.constants[instr.BC()];
+                        if (constant.TryAs<runtime::Number>() != nullptr) {
+                            result = Type::Int;
+                        } else if (constant.TryAs<runtime::Bool>() != nullptr) {
+                            result = Type::Bool;
+                        } else {
+                            return false;
+                        }
+                        break;
+                    }
+                    case OpCode::LoadNone:
+                        result = Type::None;
+                        break;
+                    case OpCode::Move:
+                        if (!value(instr.b)) {
+                            return false;
+                        }
+                        result = state[instr.b];
+                        break;
+                    case OpCode::DefineLocal:
+                        if (result == Type::Unbound) {
+                            if (!value(instr.b)) {
+                                return false;
+                            }
+                            result = state[instr.b];
+                        } else if (!IsValue(result)) {
+                            return false;
+                        }
+                        break;
+                    case OpCode::CheckBound:
+                        if (result == Type::Unbound) {
+                            // Ошибку сообщит интерпретатор
+                            return true;
+                        }
+                        if (!IsValue(result)) {
+                            return false;
+                        }
+                        break;
+                    case OpCode::GetField:
+                        if (!has(instr.b, Type::Self)) {
+                            return false;
+                        }
+                        result = Type::Int;
+                        break;
+                    case OpCode::SetField:
+                        if (result != Type::Self || !value(instr.c)) {
+                            return false;
+                        }
+                        break;
+                    case OpCode::Add:
+                    case OpCode::Sub:
+                    case OpCode::Mult:
+                    case OpCode::Div:
+                        if (!has(instr.b, Type::Int) || !has(instr.c, Type::Int)) {
+                            return false;
+                        }
+                        result = Type::Int;
+                        break;
+                    case OpCode::ToBool:
+                    case OpCode::Not:
+                        if (!value(instr.b)) {
+                            return false;
+                        }
+                        result = Type::Bool;
+                        break;
+                    case OpCode::Equal:
+                    case OpCode::NotEqual:
+                        if (!(has(instr.b, Type::Int) && has(instr.c, Type::Int))
+                            && !(has(instr.b, Type::Bool) && has(instr.c, Type::Bool))) {
+                            return false;
+                        }
+                        result = Type::Bool;
+                        break;
+                    case OpCode::Less:
+                    case OpCode::Greater:
+                    case OpCode::LessOrEqual:
+                    case OpCode::GreaterOrEqual:
+                        if (!has(instr.b, Type::Int) || !has(instr.c, Type::Int)) {
+                            return false;
+                        }
+                        result = Type::Bool;
+                        break;
+                    case OpCode::Call:
+                        return StepCall(ip, state);
+                    case OpCode::Jump:
+                        successors_.push_back(instr.BC());
+                        return true;
+                    case OpCode::JumpIfFalse:
+                    case OpCode::JumpIfTrue:
+                        if (!IsValue(result)) {
+                            return false;
+                        }
+                        successors_.push_back(instr.BC());
+                        break;
+                    case OpCode::Return:
+                        return IsValue(result);
+                    case OpCode::ReturnNone:
+                        return true;
+                    default:
+                        return false;
+                }
+                successors_.push_back(ip + 1);
+                return true;
+            }
+
+            bool StepCall(size_t ip, vector<Type>& state) {
+                const Instruction& instr = code_[ip];
+                if (state[instr.a] != Type::Self
+                    || static_cast<size_t>(instr.a) + instr.c >= state.size()) {
+                    return false;
+                }
+                for (size_t i = 1; i <= instr.c; ++i) {
+                    if (!IsValue(state[instr.a + i])) {
+                        return false;
+                    }
+                }
+                const runtime::Method* method = cls_.GetMethod(function_.names[instr.b]);
+                if (method == nullptr || method->formal_params.size() != instr.c) {
+                    // Ошибку сообщит интерпретатор
+                    return true;
+                }
+                analysis_.targets[ip] = method;
+                const bool used = IsResultUsed(ip);
+                analysis_.results_used[ip] = used;
+                // Неиспользуемый результат может быть любого типа
+                state[instr.a] = used ? Type::Int : Type::Conflict;
+                // Выходя из метода, интерпретатор очищает регистры его кадра
+                if (const auto* compiled = dynamic_cast<const CompiledMethod*>(method->body.get())) {
+                    const size_t end = min(state.size(),
+                                           instr.a + size_t{compiled->GetFunction().register_count});
+                    fill(state.begin() + instr.a + 1, state.begin() + end, Type::None);
+                }
+                successors_.push_back(ip + 1);
+                return true;
+            }
+
+            // Может ли результат вызова ip быть прочитан до того, как регистр перезаписан
+            bool IsResultUsed(size_t call) const {
+                const uint32_t reg = code_[call].a;
+                vector<bool> visited(code_.size(), false);
+                vector<size_t> pending{call + 1};
+                while (!pending.empty()) {
+                    const size_t ip = pending.back();
+                    pending.pop_back();
+                    if (ip >= code_.size()) {
+                        return true;
+                    }
+                    if (visited[ip]) {
+                        continue;
+                    }
+                    visited[ip] = true;
+                    const Instruction& instr = code_[ip];
+                    if (Reads(instr, reg)) {
+                        return true;
+                    }
+                    if (Writes(instr, reg)) {
+                        continue;
+                    }
+                    switch (instr.op) {
+                        case OpCode::Jump:
+                            pending.push_back(instr.BC());
+                            break;
+                        case OpCode::JumpIfFalse:
+                        case OpCode::JumpIfTrue:
+                            pending.push_back(instr.BC());
+                            pending.push_back(ip + 1);
+                            break;
+                        case OpCode::Return:
+                        case OpCode::ReturnNone:
+                            break;
+                        default:
+                            pending.push_back(ip + 1);
+                            break;
+                    }
+                }
+                return false;
+            }
+
+            const runtime::Class& cls_;
+            Analysis& analysis_;
+            const Function& function_;
+            const vector<Instruction>& code_;
+            vector<size_t> pending_;
+            vector<size_t> successors_;
+        };
+
+        // Собирает машинный код из шаблонов команд x86-64. Кадр функции адресуется через rbx,
+        // контекст - через r12; регистр кадра reg - ячейка [rbx + 8 * reg], число занимает
+        // её младшие 4 байта. Функция вызывается как uint32_t(NativeContext*, int64_t*)
+        class Assembler {
+        public:
+            using Label = size_t;
+
+            [[nodiscard]] Label NewLabel() {
+                labels_.push_back(NO_OFFSET);
+                return labels_.size() - 1;
+            }
+
+            void Bind(Label label) {
+                labels_[label] = bytes_.size();
+            }
+
+            void Bytes(initializer_list<uint8_t> bytes) {
+                bytes_.insert(bytes_.end(), bytes);
+            }
+
+            void Imm32(uint32_t value) {
+                for (int i = 0; i < 4; ++i) {
+                    bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+                }
+            }
+
+            void Imm64(uint64_t value) {
+                for (int i = 0; i < 8; ++i) {
+                    bytes_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+                }
+            }
+
+            // Команда opcode с 32-битным смещением до label
+            void Branch(initializer_list<uint8_t> opcode, Label label) {
+                Bytes(opcode);
+                fixups_.push_back({bytes_.size(), label});
+                Imm32(0);
+            }
+
+            // Команда opcode с операндом [rbx + 8 * reg]
+            void Slot(initializer_list<uint8_t> opcode, uint32_t reg) {
+                Bytes(opcode);
+                Imm32(8 * reg);
+            }
+
+            void Prologue(uint32_t frame_size, Label overflow) {
+                // push rbx; push r12; sub rsp, 8; mov r12, rdi; mov rbx, rsi
+                Bytes({0x53, 0x41, 0x54, 0x48, 0x83, 0xEC, 0x08, 0x49, 0x89, 0xFC, 0x48, 0x89, 0xF3});
+                // lea rax, [rbx + 8 * frame_size]; cmp rax, [r12]; ja overflow
+                Slot({0x48, 0x8D, 0x83}, frame_size);
+                Bytes({0x49, 0x3B, 0x04, 0x24});
+                Branch({0x0F, 0x87}, overflow);
+            }
+
+            void Epilogue() {
+                // add rsp, 8; pop r12; pop rbx; ret
+                Bytes({0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3});
+            }
+
+            void LoadEax(uint32_t reg) {
+                Slot({0x8B, 0x83}, reg);
+            }
+
+            void StoreEax(uint32_t reg) {
+                Slot({0x89, 0x83}, reg);
+            }
+
+            void StoreImm(uint32_t reg, uint32_t value) {
+                Slot({0xC7, 0x83}, reg);
+                Imm32(value);
+            }
+
+            void MoveEax(uint32_t value) {
+                if (value == 0) {
+                    Bytes({0x31, 0xC0});
+                } else {
+                    Bytes({0xB8});
+                    Imm32(value);
+                }
+            }
+
+            // cmp dword [rbx + 8 * reg], 0
+            void TestSlot(uint32_t reg) {
+                Slot({0x83, 0xBB}, reg);
+                Bytes({0x00});
+            }
+
+            // eax = (условие setcc) ? 1 : 0; r[reg] = eax
+            void StoreCondition(uint8_t setcc, uint32_t reg) {
+                Bytes({0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0});
+                StoreEax(reg);
+            }
+
+            // Вызов helper(ctx, frame, argument[, ecx]) по абсолютному адресу
+            void CallHelper(const void* helper, const void* argument) {
+                // mov rdi, r12; mov rsi, rbx; mov rdx, argument; mov rax, helper; call rax
+                Bytes({0x4C, 0x89, 0xE7, 0x48, 0x89, 0xDE, 0x48, 0xBA});
+                Imm64(reinterpret_cast<uint64_t>(argument));
+                Bytes({0x48, 0xB8});
+                Imm64(reinterpret_cast<uint64_t>(helper));
+                Bytes({0xFF, 0xD0});
+            }
+
+            // Прямой вызов машинной функции label с кадром [rbx + 8 * base]
+            void CallNative(Label label, uint32_t base) {
+                // mov rdi, r12; lea rsi, [rbx + 8 * base]; call label
+                Bytes({0x4C, 0x89, 0xE7});
+                Slot({0x48, 0x8D, 0xB3}, base);
+                Branch({0xE8}, label);
+            }
+
+            // Разрешает переходы. Возвращает готовый код
+            vector<uint8_t> Finish() {
+                for (const auto& [offset, label] : fixups_) {
+                    const auto rel = static_cast<int32_t>(static_cast<int64_t>(labels_[label])
+                                                          - static_cast<int64_t>(offset + 4));
+                    memcpy(bytes_.data() + offset, &rel, sizeof(rel));
+                }
+                return std::move(bytes_);
+            }
+
+            [[nodiscard]] size_t Offset(Label label) const {
+                return labels_[label];
+            }
+
+        private:
+            static constexpr size_t NO_OFFSET = numeric_limits<size_t>::max();
+
+            vector<uint8_t> bytes_;
+            vector<size_t> labels_;
+            vector<pair<size_t, Label>> fixups_;
+        };
+
+        constexpr uint8_t SETL = 0x9C;
+        constexpr uint8_t SETG = 0x9F;
+        constexpr uint8_t SETLE = 0x9E;
+        constexpr uint8_t SETGE = 0x9D;
+        constexpr uint8_t SETE = 0x94;
+        constexpr uint8_t SETNE = 0x95;
+
+        // Переводит функции набора в машинный код
+        class Emitter {
+        public:
+            Emitter(Code& code, const vector<unique_ptr<Analysis>>& unit,
+                    const unordered_map<const Function*, size_t>& natives)
+                : code_(code)
+                , unit_(unit)
+                , natives_(natives) {
+                for (size_t i = 0; i < unit_.size(); ++i) {
+                    entries_.push_back(assembler_.NewLabel());
+                }
+            }
+
+            vector<uint8_t> Emit() {
+                for (size_t i = 0; i < unit_.size(); ++i) {
+                    if (unit_[i]->supported) {
+                        EmitFunction(i);
+                    }
+                }
+                return assembler_.Finish();
+            }
+
+            [[nodiscard]] size_t EntryOffset(size_t index) const {
+                return assembler_.Offset(entries_[index]);
+            }
+
+        private:
+            struct Stub {
+                Assembler::Label label;
+                const DeoptPoint* point;
+                bool after_call;
+            };
+
+            void EmitFunction(size_t index) {
+                const Analysis& analysis = *unit_[index];
+                const Function& function = *analysis.function;
+                analysis_ = &analysis;
+                epilogue_ = assembler_.NewLabel();
+                stubs_.clear();
+                labels_.clear();
+                for (size_t ip = 0; ip < function.code.size(); ++ip) {
+                    labels_.push_back(assembler_.NewLabel());
+                }
+
+                assembler_.Bind(entries_[index]);
+                assembler_.Prologue(function.register_count, Deopt(0, analysis.states[0]));
+                for (size_t ip = 0; ip < function.code.size(); ++ip) {
+                    assembler_.Bind(labels_[ip]);
+                    if (!analysis.states[ip].empty()) {
+                        EmitInstruction(ip);
+                    }
+                }
+                assembler_.Bind(epilogue_);
+                assembler_.Epilogue();
+
+                for (const Stub& stub : stubs_) {
+                    assembler_.Bind(stub.label);
+                    if (stub.after_call) {
+                        // Ошибку передаёт выше, иначе status в ecx
+                        assembler_.Bytes({0x83, 0xF8, static_cast<uint8_t>(Status::Error)});
+                        assembler_.Branch({0x0F, 0x84}, epilogue_);
+                        assembler_.Bytes({0x89, 0xC1});
+                    } else {
+                        assembler_.Bytes({0x31, 0xC9});
+                    }
+                    assembler_.CallHelper(reinterpret_cast<const void*>(&Deoptimize), stub.point);
+                    assembler_.Branch({0xE9}, epilogue_);
+                }
+            }
+
+            Assembler::Label Deopt(size_t ip, const vector<Type>& types, int32_t call_result = -1) {
+                DeoptPoint& point = code_.points.emplace_back();
+                point.function = analysis_->function;
+                point.ip = static_cast<uint32_t>(ip);
+                point.call_result = call_result;
+                point.types = types;
+                point.code = &code_;
+                const Assembler::Label label = assembler_.NewLabel();
+                stubs_.push_back({label, &point, call_result >= 0});
+                return label;
+            }
+
+            void Copy(uint32_t dst, uint32_t src, Type type) {
+                if (dst != src && IsUnboxed(type)) {
+                    assembler_.LoadEax(src);
+                    assembler_.StoreEax(dst);
+                }
+            }
+
+            void EmitInstruction(size_t ip) {
+                const Function& function = *analysis_->function;
+                const Instruction& instr = function.code[ip];
+                const vector<Type>& types = analysis_->states[ip];
+                Assembler& as = assembler_;
+                switch (instr.op) {
+                    case OpCode::LoadConst: {
+                        const ObjectHolder& constant = function.constants[instr.BC()];
+                        if (const auto* number = constant.TryAs<runtime::Number>()) {
+                            as.StoreImm(instr.a, static_cast<uint32_t>(number->GetValue()));
+                        } else {
+                            as.StoreImm(instr.a, constant.TryAs<runtime::Bool>()->GetValue());
+                        }
+                        break;
+                    }
+                    case OpCode::LoadNone:
+                        break;
+                    case OpCode::Move:
+                        Copy(instr.a, instr.b, types[instr.b]);
+                        break;
+                    case OpCode::DefineLocal:
+                        if (types[instr.a] == Type::Unbound) {
+                            Copy(instr.a, instr.b, types[instr.b]);
+                        }
+                        break;
+                    case OpCode::CheckBound:
+                        if (types[instr.a] == Type::Unbound) {
+                            as.Branch({0xE9}, Deopt(ip, types));
+                        }
+                        break;
+                    case OpCode::GetField:
+                    case OpCode::SetField: {
+                        const bool get = instr.op == OpCode::GetField;
+                        const uint16_t name = get ? instr.c : instr.b;
+                        const uint16_t reg = get ? instr.a : instr.c;
+                        const FieldSite& site = code_.fields.emplace_back(
+                            FieldSite{&function.field_caches[name], function.names[name], reg,
+                                      types[reg]});
+                        as.CallHelper(get ? reinterpret_cast<const void*>(&GetField)
+                                          : reinterpret_cast<const void*>(&SetField),
+                                      &site);
+                        // test eax, eax; jnz deopt
+                        as.Bytes({0x85, 0xC0});
+                        as.Branch({0x0F, 0x85}, Deopt(ip, types));
+                        break;
+                    }
+                    case OpCode::Add:
+                        as.LoadEax(instr.b);
+                        as.Slot({0x03, 0x83}, instr.c);
+                        as.StoreEax(instr.a);
+                        break;
+                    case OpCode::Sub:
+                        as.LoadEax(instr.b);
+                        as.Slot({0x2B, 0x83}, instr.c);
+                        as.StoreEax(instr.a);
+                        break;
+                    case OpCode::Mult:
+                        as.LoadEax(instr.b);
+                        as.Slot({0x0F, 0xAF, 0x83}, instr.c);
+                        as.StoreEax(instr.a);
+                        break;
+                    case OpCode::Div:
+                        // mov eax, r[b]; mov ecx, r[c]; test ecx, ecx; jz deopt
+                        as.LoadEax(instr.b);
+                        as.Slot({0x8B, 0x8B}, instr.c);
+                        as.Bytes({0x85, 0xC9});
+                        as.Branch({0x0F, 0x84}, Deopt(ip, types));
+                        // cmp ecx, -1; jne idiv; neg eax; jmp done; idiv: cdq; idiv ecx
+                        as.Bytes({0x83, 0xF9, 0xFF, 0x75, 0x04, 0xF7, 0xD8, 0xEB, 0x03, 0x99, 0xF7,
+                                  0xF9});
+                        as.StoreEax(instr.a);
+                        break;
+                    case OpCode::ToBool:
+                    case OpCode::Not: {
+                        const bool negate = instr.op == OpCode::Not;
+                        if (IsUnboxed(types[instr.b])) {
+                            as.TestSlot(instr.b);
+                            as.StoreCondition(negate ? SETE : SETNE, instr.a);
+                        } else {
+                            // None и экземпляры классов ложны
+                            as.StoreImm(instr.a, negate ? 1 : 0);
+                        }
+                        break;
+                    }
+                    case OpCode::Equal:
+                        Compare(instr, SETE);
+                        break;
+                    case OpCode::NotEqual:
+                        Compare(instr, SETNE);
+                        break;
+                    case OpCode::Less:
+                        Compare(instr, SETL);
+                        break;
+                    case OpCode::Greater:
+                        Compare(instr, SETG);
+                        break;
+                    case OpCode::LessOrEqual:
+                        Compare(instr, SETLE);
+                        break;
+                    case OpCode::GreaterOrEqual:
+                        Compare(instr, SETGE);
+                        break;
+                    case OpCode::Call:
+                        EmitCall(ip);
+                        break;
+                    case OpCode::Jump:
+                        as.Branch({0xE9}, labels_[instr.BC()]);
+                        break;
+                    case OpCode::JumpIfFalse:
+                    case OpCode::JumpIfTrue: {
+                        const bool if_true = instr.op == OpCode::JumpIfTrue;
+                        if (IsUnboxed(types[instr.a])) {
+                            as.TestSlot(instr.a);
+                            as.Branch({0x0F, static_cast<uint8_t>(if_true ? 0x85 : 0x84)},
+                                      labels_[instr.BC()]);
+                        } else if (!if_true) {
+                            as.Branch({0xE9}, labels_[instr.BC()]);
+                        }
+                        break;
+                    }
+                    case OpCode::Return: {
+                        const Type type = types[instr.a];
+                        Copy(0, instr.a, type);
+                        as.MoveEax(static_cast<uint32_t>(type == Type::Int    ? Status::Int
+                                                         : type == Type::Bool ? Status::Bool
+                                                         : type == Type::Self ? Status::Self
+                                                                              : Status::None));
+                        as.Branch({0xE9}, epilogue_);
+                        break;
+                    }
+                    case OpCode::ReturnNone:
+                        as.MoveEax(static_cast<uint32_t>(Status::None));
+                        as.Branch({0xE9}, epilogue_);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            void Compare(const Instruction& instr, uint8_t setcc) {
+                // mov eax, r[b]; cmp eax, r[c]; setcc al; movzx eax, al; mov r[a], eax
+                assembler_.LoadEax(instr.b);
+                assembler_.Slot({0x3B, 0x83}, instr.c);
+                assembler_.StoreCondition(setcc, instr.a);
+            }
+
+            void EmitCall(size_t ip) {
+                const Function& function = *analysis_->function;
+                const Instruction& instr = function.code[ip];
+                const vector<Type>& types = analysis_->states[ip];
+                const runtime::Method* method = analysis_->targets[ip];
+                Assembler& as = assembler_;
+                if (method == nullptr) {
+                    as.Branch({0xE9}, Deopt(ip, types));
+                    return;
+                }
+                const Assembler::Label deopt = Deopt(ip + 1, StateAfterCall(ip), instr.a);
+
+                const auto* compiled = dynamic_cast<const CompiledMethod*>(method->body.get());
+                const vector<Type> args(types.begin() + instr.a + 1,
+                                        types.begin() + instr.a + 1 + instr.c);
+                const bool int_args = all_of(args.begin(), args.end(), [](Type type) {
+                    return type == Type::Int;
+                });
+                auto native = compiled != nullptr ? natives_.find(&compiled->GetFunction())
+                                                  : natives_.end();
+                if (native != natives_.end() && int_args) {
+                    as.CallNative(entries_[native->second], instr.a);
+                } else {
+                    const CallSite& site = code_.calls.emplace_back(
+                        CallSite{method, compiled, instr.a, function.register_count, args});
+                    as.CallHelper(reinterpret_cast<const void*>(&CallMethod), &site);
+                }
+                if (analysis_->results_used[ip]) {
+                    // test eax, eax; jnz deopt - результат не число
+                    as.Bytes({0x85, 0xC0});
+                    as.Branch({0x0F, 0x85}, deopt);
+                } else {
+                    // cmp eax, Error; je deopt - там ошибка передаётся выше
+                    as.Bytes({0x83, 0xF8, static_cast<uint8_t>(Status::Error)});
+                    as.Branch({0x0F, 0x84}, deopt);
+                }
+            }
+
+            // Типы сразу после вызова ip, а не объединённые в точке ip + 1
+            vector<Type> StateAfterCall(size_t ip) const {
+                vector<Type> state = analysis_->states[ip];
+                const Instruction& instr = analysis_->function->code[ip];
+                state[instr.a] = analysis_->results_used[ip] ? Type::Int : Type::Conflict;
+                const auto* compiled =
+                    dynamic_cast<const CompiledMethod*>(analysis_->targets[ip]->body.get());
+                if (compiled != nullptr) {
+                    const size_t end = min(state.size(),
+                                           instr.a + size_t{compiled->GetFunction().register_count});
+                    fill(state.begin() + instr.a + 1, state.begin() + end, Type::None);
+                }
+                return state;
+            }
+
+            Code& code_;
+            const vector<unique_ptr<Analysis>>& unit_;
+            const unordered_map<const Function*, size_t>& natives_;
+            Assembler assembler_;
+            vector<Assembler::Label> entries_;
+            const Analysis* analysis_ = nullptr;
+            Assembler::Label epilogue_ = 0;
+            vector<Assembler::Label> labels_;
+            vector<Stub> stubs_;
+        };
+
+        // Компилирует method для получателей класса cls вместе с методами self, которые он
+        // вызывает напрямую. Возвращает nullptr, если method нельзя выполнить машинным кодом
+        shared_ptr<Code> CompileUnit(const CompiledMethod& method, const runtime::Class& cls) {
+            vector<unique_ptr<Analysis>> unit;
+            unordered_map<const Function*, size_t> indices;
+            auto add = [&](const CompiledMethod& target) {
+                if (indices.count(&target.GetFunction()) != 0 || unit.size() >= MAX_UNIT_FUNCTIONS) {
+                    return;
+                }
+                indices.emplace(&target.GetFunction(), unit.size());
+                auto& analysis = unit.emplace_back(make_unique<Analysis>());
+                analysis->method = &target;
+                analysis->function = &target.GetFunction();
+            };
+            add(method);
+            for (size_t i = 0; i < unit.size(); ++i) {
+                Analysis& analysis = *unit[i];
+                analysis.supported = Analyzer(cls, analysis).Run();
+                if (i == 0 && !analysis.supported) {
+                    return nullptr;
+                }
+                if (!analysis.supported) {
+                    continue;
+                }
+                for (const runtime::Method* target : analysis.targets) {
+                    if (target == nullptr) {
+                        continue;
+                    }
+                    if (const auto* compiled =
+                            dynamic_cast<const CompiledMethod*>(target->body.get())) {
+                        add(*compiled);
+                    }
+                }
+            }
+
+            unordered_map<const Function*, size_t> natives;
+            for (const auto& [function, index] : indices) {
+                if (unit[index]->supported) {
+                    natives.emplace(function, index);
+                }
+            }
+
+            auto code = make_shared<Code>();
+            Emitter emitter(*code, unit, natives);
+            if (!code->Load(emitter.Emit())) {
+                return nullptr;
+            }
+            for (size_t i = 0; i < unit.size(); ++i) {
+                if (unit[i]->supported) {
+                    code->entries.push_back({unit[i]->method, cls.GetId(),
+                                             unit[i]->function->param_count,
+                                             unit[i]->function->register_count,
+                                             code->GetAddress() + emitter.EntryOffset(i),
+                                             code.get()});
+                }
+            }
+            return code;
+        }
+#endif
+    }  // namespace
+
+#ifdef JIT_X86_64
+    Code::~Code() {
+        if (memory_ != nullptr) {
+            munmap(memory_, size_);
+        }
+    }
+
+    bool Code::Load(const vector<uint8_t>& bytes) {
+        // Память сначала доступна для записи, затем только для исполнения
+        void* memory = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        memcpy(memory, bytes.data(), bytes.size());
+        if (mprotect(memory, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, bytes.size());
+            return false;
+        }
+        memory_ = memory;
+        size_ = bytes.size();
+        return true;
+    }
+
+    bool IsSupported() {
+        return true;
+    }
+#else
+    Code::~Code() = default;
+
+    bool Code::Load([[maybe_unused]] const vector<uint8_t>& bytes) {
+        return false;
+    }
+
+    bool IsSupported() {
+        return false;
+    }
+#endif
+
+    MethodState::MethodState(uint32_t threshold)
+        : threshold_(threshold) {
+    }
+
+    MethodState::~MethodState() = default;
+
+    bool MethodState::TryRun(const CompiledMethod& method, Machine& machine, size_t base,
+                             runtime::Context& context, ObjectHolder& result) {
+        const Entry* entry = entry_.load(memory_order_acquire);
+        if (entry == nullptr) {
+            if (threshold_ == 0) {
+                return false;
+            }
+            // Счётчик приблизителен: одновременные вызовы из разных потоков могут потерять
+            // увеличение, зато обычный вызов не платит за атомарную операцию
+            const uint32_t calls = calls_.load(memory_order_relaxed) + 1;
+            calls_.store(calls, memory_order_relaxed);
+            if (calls < threshold_) {
+                return false;
+            }
+            const auto* instance = machine.Register(base).TryAs<runtime::ClassInstance>();
+            if (instance == nullptr) {
+                return false;
+            }
+            entry = Prepare(method, instance->GetClass());
+        }
+        if (entry == &UNSUPPORTED || context.GetProfiler() != nullptr
+            || entry->code->deopts.load(memory_order_relaxed) >= DEOPT_LIMIT) {
+            return false;
+        }
+
+        auto* self = machine.Register(base).TryAs<runtime::ClassInstance>();
+        if (self == nullptr || self->GetClass().GetId() != entry->class_id) {
+            return false;
+        }
+        NativeStack& stack = NativeStack::ForCurrentThread();
+        int64_t* const frame = stack.top;
+        if (frame + entry->register_count > stack.limit) {
+            return false;
+        }
+        for (size_t i = 1; i <= entry->param_count; ++i) {
+            const auto* number = machine.Register(base + i).TryAs<runtime::Number>();
+            if (number == nullptr) {
+                return false;
+            }
+            frame[i] = number->GetValue();
+        }
+
+        NativeContext ctx{stack.limit, &machine, &context, self, {}, {}};
+        const auto status =
+            static_cast<Status>(reinterpret_cast<NativeFunction>(entry->address)(&ctx, frame));
+        switch (status) {
+            case Status::Int:
+                result = Box(Type::Int, frame, 0, ctx);
+                break;
+            case Status::Bool:
+                result = Box(Type::Bool, frame, 0, ctx);
+                break;
+            case Status::None:
+                result = ObjectHolder::None();
+                break;
+            case Status::Self:
+                result = self->Self();
+                break;
+            case Status::Object:
+                result = std::move(ctx.object);
+                break;
+            case Status::Error:
+                break;
+        }
+        for (size_t i = 0; i <= entry->param_count; ++i) {
+            machine.Register(base + i) = ObjectHolder::None();
+        }
+        if (status == Status::Error) {
+            rethrow_exception(ctx.error);
+        }
+        return true;
+    }
+
+    bool MethodState::IsCompiled() const {
+        const Entry* entry = entry_.load(memory_order_acquire);
+        return entry != nullptr && entry != &UNSUPPORTED;
+    }
+
+    const Entry* MethodState::Prepare([[maybe_unused]] const CompiledMethod& method,
+                                      [[maybe_unused]] const runtime::Class& cls) {
+        // Компиляция редка, поэтому одна блокировка на все методы: так набор методов
+        // устанавливается целиком, без взаимных блокировок между потоками
+        lock_guard lock(CompileMutex());
+        if (const Entry* entry = entry_.load(memory_order_relaxed)) {
+            return entry;
+        }
+#ifdef JIT_X86_64
+        if (const shared_ptr<Code> code = CompileUnit(method, cls)) {
+            for (const Entry& entry : code->entries) {
+                MethodState& state = entry.method->GetJitState();
+                if (state.entry_.load(memory_order_relaxed) == nullptr) {
+                    state.code_ = code;
+                    state.entry_.store(&entry, memory_order_release);
+                }
+            }
+            return entry_.load(memory_order_relaxed);
+        }
+#endif
+        entry_.store(&UNSUPPORTED, memory_order_release);
+        return &UNSUPPORTED;
+    }
+
+}  // namespace jit
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace bytecode {
+    class CompiledMethod;
+    class Machine;
+}  // namespace bytecode
+
+// Второй уровень выполнения байт-кода: машинный код часто вызываемых методов.
+// Код собирается из заранее подготовленных шаблонов машинных команд (copy-and-patch):
+// шаблон копируется в исполняемую память, а в его «дырки» вписываются смещения регистров,
+// константы, адреса переходов и вспомогательных функций.
+//
+// Метод специализируется под класс получателя, на котором был превышен порог вызовов.
+// Регистры кадра хранят целые числа и логические значения без упаковки в ObjectHolder,
+// тип каждого регистра в каждой точке метода выводится при компиляции. Если предположение
+// о типе не подтверждается (параметр или поле не число, деление на ноль, переполнение
+// стека машинного кода), выполнение переходит в интерпретатор с текущей инструкции
+// (деоптимизация), поэтому результат всегда совпадает с интерпретатором.
+//
+// Машинный код поддерживается на x86-64 в системах семейства Unix, на остальных
+// платформах методы всегда исполняет интерпретатор
+namespace jit {
+
+    // Число вызовов метода, после которого он компилируется в машинный код
+    inline constexpr std::uint32_t DEFAULT_THRESHOLD = 1000;
+
+    // Возвращает true, если на этой платформе методы компилируются в машинный код
+    [[nodiscard]] bool IsSupported();
+
+    class Code;
+    struct Entry;
+
+    // Состояние второго уровня одного метода: счётчик вызовов и точка входа машинного кода.
+    // Методы, вызываемые скомпилированным напрямую, компилируются вместе с ним и получают
+    // точки входа того же кода
+    class MethodState {
+    public:
+        // threshold - порог вызовов, 0 - метод всегда исполняет интерпретатор
+        explicit MethodState(std::uint32_t threshold);
+        ~MethodState();
+
+        MethodState(const MethodState&) = delete;
+        MethodState& operator=(const MethodState&) = delete;
+
+        // Выполняет method машинным кодом, если он скомпилирован для класса получателя и
+        // параметры - числа. Кадр метода начинается с регистра base машины, как в
+        // Machine::Run. Возвращает false, если метод должен выполнить интерпретатор.
+        // При успехе регистры self и параметров очищаются, как после Machine::Run
+        bool TryRun(const bytecode::CompiledMethod& method, bytecode::Machine& machine,
+                    std::size_t base, runtime::Context& context, runtime::ObjectHolder& result);
+
+        // Возвращает true, если для метода готов машинный код
+        [[nodiscard]] bool IsCompiled() const;
+
+    private:
+        // Компилирует method для класса cls, если это ещё не сделано
+        const Entry* Prepare(const bytecode::CompiledMethod& method, const runtime::Class& cls);
+
+        std::uint32_t threshold_;
+        std::atomic<std::uint32_t> calls_ = 0;
+        std::atomic<const Entry*> entry_ = nullptr;
+        std::shared_ptr<const Code> code_;
+    };
+
+}  // namespace jit
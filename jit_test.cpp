@@ -0,0 +1,302 @@
+#include "compiler.h"
+#include "jit.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace jit {
+
+using runtime::Closure;
+
+namespace {
+
+// Выполненная программа вместе с её переменными
+struct Execution {
+    unique_ptr<runtime::Executable> program;
+    Closure closure;
+    string output;
+};
+
+// threshold - порог компиляции в машинный код, nullopt - обход дерева
+Execution Execute(const string& text, optional<uint32_t> threshold) {
+    istringstream is(text);
+    parse::Lexer lexer(is);
+    Execution execution{ParseProgram(lexer), {}, {}};
+    if (threshold) {
+        execution.program = bytecode::Compile(std::move(execution.program), *threshold);
+    }
+    runtime::DummyContext context;
+    execution.program->Execute(execution.closure, context);
+    execution.output = context.output.str();
+    return execution;
+}
+
+// Проверяет, что обход дерева, интерпретатор байт-кода и машинный код, который
+// компилируется с первого вызова, выводят expected
+void AssertSameOutput(const string& program, const string& expected) {
+    ASSERT_EQUAL(Execute(program, nullopt).output, expected);
+    ASSERT_EQUAL(Execute(program, 0).output, expected);
+    ASSERT_EQUAL(Execute(program, 1).output, expected);
+}
+
+// Возвращает состояние метода method экземпляра из переменной variable
+const MethodState& StateOf(const Execution& execution, const string& variable,
+                           const string& method) {
+    const auto& instance = *execution.closure.at(variable).TryAs<runtime::ClassInstance>();
+    const runtime::Method* found = instance.GetClass().GetMethod(method);
+    return dynamic_cast<const bytecode::CompiledMethod&>(*found->body).GetJitState();
+}
+
+void TestArithmetic() {
+    AssertSameOutput(R"(
+class Loop:
+  def run(n, acc):
+    if n == 0:
+      return acc
+    x = acc * 3 + n - acc / 7
+    y = x - n * 2 + 5
+    if y > x or x < 0:
+      y = y - x
+    return self.run(n - 1, y) + self.run(n - 1, x - y)
+
+class Fib:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+class Math:
+  def div(a, b):
+    return a / b
+
+  def compare(a, b):
+    return not a < b and (a >= b or a == b) and a != b - 1 and a <= b * 2 and a > -100
+
+l = Loop()
+f = Fib()
+print l.run(10, 1), f.fib(20)
+m = Math()
+print m.div(7, 2), m.div(-7, 2), m.div(7, -1), m.div(0, 5)
+print m.compare(3, 2), m.compare(2, 3), m.compare(5, 3)
+)",
+                     "369517 6765\n3 -3 -7 0\nTrue False True\n");
+}
+
+void TestFieldsAndValues() {
+    AssertSameOutput(R"(
+class Point:
+  def __init__():
+    self.x = 1
+    self.y = 2
+    self.flag = None
+
+  def walk(n):
+    if n > 0:
+      self.x = self.x + self.y
+      self.y = self.x - self.y * 2
+      self.flag = n > 3
+      self.walk(n - 1)
+
+  def me():
+    return self
+
+  def nothing(n):
+    if n:
+      return None
+
+  def truth(n):
+    return n > 1 or not n
+
+p = Point()
+p.walk(8)
+q = p.me()
+print p.x, p.y, p.flag, q.x, p.nothing(1), p.truth(0), p.truth(1)
+)",
+                     "16 32 False 16 None True False\n");
+}
+
+void TestThreshold() {
+    const string program = R"(
+class Counter:
+  def count(n):
+    if n > 0:
+      return self.count(n - 1) + 1
+    return 0
+
+  def show(n):
+    print n
+
+c = Counter()
+x = c.count(4)
+c.show(x)
+c.show(x)
+)";
+    // Вызовы count: 5 за выполнение программы
+    ASSERT(!StateOf(Execute(program, 6), "c"s, "count"s).IsCompiled());
+    ASSERT_EQUAL(StateOf(Execute(program, 5), "c"s, "count"s).IsCompiled(), IsSupported());
+    ASSERT(!StateOf(Execute(program, 0), "c"s, "count"s).IsCompiled());
+    // Вывод машинный код не поддерживает
+    ASSERT(!StateOf(Execute(program, 1), "c"s, "show"s).IsCompiled());
+}
+
+void TestDeoptimization() {
+    // Поле перестаёт быть числом, параметр - не число, вызов возвращает строку
+    AssertSameOutput(R"(
+class Box:
+  def __init__():
+    self.value = 1
+
+  def get():
+    return self.value + 1
+
+  def twice(n):
+    return n + n
+
+  def name(n):
+    if n > 10:
+      return 'big'
+    return n
+
+  def describe(n):
+    x = self.name(n)
+    return x
+
+b = Box()
+print b.get(), b.twice(4), b.describe(5)
+b.value = 'text'
+print b.twice('ab'), b.describe(20)
+b.value = 10
+print b.get()
+)",
+                     "2 8 5\nabab big\n11\n");
+
+    // Ошибки после компиляции сообщает интерпретатор
+    const string division = R"(
+class Div:
+  def div(a, b):
+    return a / b
+
+  def run(b):
+    return self.div(10, b) + 1
+
+d = Div()
+x = d.run(5)
+d.run(0)
+)";
+    ASSERT_THROWS(Execute(division, nullopt), runtime_error);
+    ASSERT_THROWS(Execute(division, 1), runtime_error);
+
+    const string missing = R"(
+class Calls:
+  def call(n):
+    if n > 0:
+      return self.absent(n)
+    return 0
+
+c = Calls()
+x = c.call(0)
+c.call(1)
+)";
+    ASSERT_THROWS(Execute(missing, 1), runtime_error);
+}
+
+void TestInterpretedCallees() {
+    // Методы, которые машинный код не поддерживает, исполняет интерпретатор
+    AssertSameOutput(R"(
+class Base:
+  def show(n):
+    print 'show', n
+    return n + 1
+
+  def label(n):
+    return str(n) + '!'
+
+  def run(n):
+    if n > 0:
+      total = self.show(n) + self.run(n - 1)
+      return total
+    return 0
+
+class Derived(Base):
+  def show(n):
+    print 'derived', n
+    return n
+
+b = Base()
+d = Derived()
+print b.run(2), d.run(2), b.label(3)
+)",
+                     "show 2\nshow 1\n5 derived 2\nderived 1\n3 3!\n");
+}
+
+void TestDeepRecursion() {
+    // В кадре шестьсот локальных переменных: стек машинного кода заканчивается на глубине
+    // около сотни вызовов, дальше считает интерпретатор
+    string program = "class Deep:\n  def down(n):\n    if n == 0:\n      return 0\n"s;
+    for (int i = 0; i < 600; ++i) {
+        program += "    x"s + to_string(i) + " = n + "s + to_string(i) + "\n"s;
+    }
+    program += "    return self.down(n - 1) + x599 - n - 598\n\nd = Deep()\nprint d.down(200)\n"s;
+    AssertSameOutput(program, "200\n"s);
+}
+
+void TestThreads() {
+    istringstream is(R"(
+class Fib:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+f = Fib()
+print f.fib(18)
+)");
+    parse::Lexer lexer(is);
+    const auto program = bytecode::Compile(ParseProgram(lexer), 1);
+    vector<string> outputs(4);
+    auto run = [&program](string& output) {
+        runtime::DummyContext context;
+        Closure closure;
+        program->Execute(closure, context);
+        output = context.output.str();
+    };
+#ifdef MYTHON_SINGLE_THREADED
+    // Счётчики ссылок не атомарны: программа выполняется только в одном потоке
+    for (string& output : outputs) {
+        run(output);
+    }
+#else
+    vector<thread> threads;
+    for (string& output : outputs) {
+        threads.emplace_back(run, ref(output));
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+#endif
+    for (const string& output : outputs) {
+        ASSERT_EQUAL(output, "2584\n"s);
+    }
+}
+
+}  // namespace
+
+void RunJitTests(TestRunner& tr) {
+    RUN_TEST(tr, jit::TestArithmetic);
+    RUN_TEST(tr, jit::TestFieldsAndValues);
+    RUN_TEST(tr, jit::TestThreshold);
+    RUN_TEST(tr, jit::TestDeoptimization);
+    RUN_TEST(tr, jit::TestInterpretedCallees);
+    RUN_TEST(tr, jit::TestDeepRecursion);
+    RUN_TEST(tr, jit::TestThreads);
+}
+
+}  // namespace jit
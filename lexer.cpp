@@ -1,8 +1,23 @@
 #include "lexer.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MYTHON_LEXER_SIMD 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MYTHON_LEXER_SIMD 1
+#endif
 
 using namespace std;
 
@@ -24,7 +39,8 @@ namespace parse {
             return lhs.As<String>().value == rhs.As<String>().value;
         }
         if (lhs.Is<Id>()) {
-            return lhs.As<Id>().value == rhs.As<Id>().value;
+            return lhs.As<Id>().value == rhs.As<Id>().value
+                   && lhs.As<Id>().symbol == rhs.As<Id>().symbol;
         }
         return true;
     }
@@ -75,30 +91,384 @@ namespace parse {
         return os << "Unknown token :("sv;
     }
 
-    Lexer::Lexer(std::istream& input)
-            : input_(input) {
-        while (input_.peek() == '\n') {
-            input_.get();
+    namespace {
+        bool IsDigit(char ch) {
+            return ch >= '0' && ch <= '9';
+        }
+
+        bool IsIdentifierStart(char ch) {
+            return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+        }
+
+        bool IsIdentifierChar(char ch) {
+            return IsIdentifierStart(ch) || IsDigit(ch);
+        }
+
+        // Просмотр текста блоками по 16 байт. Для блока вычисляется маска байтов, на которых
+        // просмотр останавливается; остаток короче блока просматривается по одному байту
+#if defined(__SSE2__)
+        using StopMask = uint32_t;
+
+        __m128i LoadChunk(const char* pos) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        }
+
+        // Байты блока из диапазона [lo, hi]. Сдвиг переносит диапазон в начало знакового
+        // диапазона, где его проверяет одно знаковое сравнение
+        __m128i InRange(__m128i chunk, char lo, char hi) {
+            const auto shift = static_cast<char>(static_cast<unsigned char>(lo) + 128U);
+            const auto bound = static_cast<char>(hi - lo + 1 - 128);
+            return _mm_cmplt_epi8(_mm_sub_epi8(chunk, _mm_set1_epi8(shift)),
+                                  _mm_set1_epi8(bound));
+        }
+
+        StopMask ToStopMask(__m128i stop) {
+            return static_cast<StopMask>(_mm_movemask_epi8(stop));
+        }
+
+        StopMask NotIdentifierChars(const char* pos) {
+            const __m128i chunk = LoadChunk(pos);
+            const __m128i letter = InRange(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z');
+            const __m128i digit = InRange(chunk, '0', '9');
+            const __m128i underscore = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+            return ~ToStopMask(_mm_or_si128(letter, _mm_or_si128(digit, underscore))) & 0xFFFFU;
+        }
+
+        StopMask NotSpaces(const char* pos) {
+            return ~ToStopMask(_mm_cmpeq_epi8(LoadChunk(pos), _mm_set1_epi8(' '))) & 0xFFFFU;
+        }
+
+        StopMask QuotesOrBackslashes(const char* pos, char quote) {
+            const __m128i chunk = LoadChunk(pos);
+            return ToStopMask(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(quote)),
+                                           _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))));
+        }
+
+        size_t FirstStop(StopMask mask) {
+            return static_cast<size_t>(__builtin_ctz(mask));
+        }
+#elif defined(__ARM_NEON)
+        // Маска из четырёх бит на байт: в NEON нет аналога movemask
+        using StopMask = uint64_t;
+
+        uint8x16_t LoadChunk(const char* pos) {
+            return vld1q_u8(reinterpret_cast<const uint8_t*>(pos));
+        }
+
+        // Байты блока из диапазона [lo, hi]
+        uint8x16_t InRange(uint8x16_t chunk, char lo, char hi) {
+            return vcltq_u8(vsubq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(lo))),
+                            vdupq_n_u8(static_cast<uint8_t>(hi - lo + 1)));
+        }
+
+        StopMask ToStopMask(uint8x16_t stop) {
+            const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(stop), 4);
+            return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        }
+
+        StopMask NotIdentifierChars(const char* pos) {
+            const uint8x16_t chunk = LoadChunk(pos);
+            const uint8x16_t letter = InRange(vorrq_u8(chunk, vdupq_n_u8(0x20)), 'a', 'z');
+            const uint8x16_t digit = InRange(chunk, '0', '9');
+            const uint8x16_t underscore = vceqq_u8(chunk, vdupq_n_u8('_'));
+            return ToStopMask(vmvnq_u8(vorrq_u8(letter, vorrq_u8(digit, underscore))));
+        }
+
+        StopMask NotSpaces(const char* pos) {
+            return ToStopMask(vmvnq_u8(vceqq_u8(LoadChunk(pos), vdupq_n_u8(' '))));
+        }
+
+        StopMask QuotesOrBackslashes(const char* pos, char quote) {
+            const uint8x16_t chunk = LoadChunk(pos);
+            return ToStopMask(vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(quote))),
+                                       vceqq_u8(chunk, vdupq_n_u8('\\'))));
+        }
+
+        size_t FirstStop(StopMask mask) {
+            return static_cast<size_t>(__builtin_ctzll(mask)) / 4;
+        }
+#endif
+
+        // Возвращает первый байт из [pos, end), на котором выполняется условие stop.
+        // Блоки проверяет stop_mask, а остаток - stop
+        template <typename BlockStop, typename ByteStop>
+        const char* ScanUntil(const char* pos, const char* end,
+                              [[maybe_unused]] BlockStop stop_mask, ByteStop stop) {
+#ifdef MYTHON_LEXER_SIMD
+            constexpr ptrdiff_t CHUNK_SIZE = 16;
+            for (; end - pos >= CHUNK_SIZE; pos += CHUNK_SIZE) {
+                if (const StopMask mask = stop_mask(pos); mask != 0) {
+                    return pos + FirstStop(mask);
+                }
+            }
+#endif
+            while (pos != end && !stop(*pos)) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        const char* SkipIdentifierChars(const char* pos, const char* end) {
+            return ScanUntil(
+                pos, end,
+                [](const char* chunk) {
+                    return NotIdentifierChars(chunk);
+                },
+                [](char ch) {
+                    return !IsIdentifierChar(ch);
+                });
+        }
+
+        const char* SkipSpaces(const char* pos, const char* end) {
+            return ScanUntil(
+                pos, end,
+                [](const char* chunk) {
+                    return NotSpaces(chunk);
+                },
+                [](char ch) {
+                    return ch != ' ';
+                });
+        }
+
+        const char* FindQuoteOrBackslash(const char* pos, const char* end, char quote) {
+            return ScanUntil(
+                pos, end,
+                [quote](const char* chunk) {
+                    return QuotesOrBackslashes(chunk, quote);
+                },
+                [quote](char ch) {
+                    return ch == quote || ch == '\\';
+                });
+        }
+
+        // Лексемы ключевых слов, индексированные номерами символов. Имя идентификатора
+        // интернируется в любом случае, так что ключевое слово распознаётся без сравнения строк
+        class KeywordTable {
+        public:
+            KeywordTable() {
+                Add("class"sv, token_type::Class{});
+                Add("return"sv, token_type::Return{});
+                Add("if"sv, token_type::If{});
+                Add("else"sv, token_type::Else{});
+                Add("def"sv, token_type::Def{});
+                Add("print"sv, token_type::Print{});
+                Add("and"sv, token_type::And{});
+                Add("or"sv, token_type::Or{});
+                Add("not"sv, token_type::Not{});
+                Add("None"sv, token_type::None{});
+                Add("True"sv, token_type::True{});
+                Add("False"sv, token_type::False{});
+            }
+
+            // Возвращает лексему ключевого слова symbol либо nullptr
+            [[nodiscard]] const Token* Find(runtime::Symbol symbol) const {
+                const uint32_t id = symbol.Id();
+                return id < tokens_.size() && tokens_[id] ? &*tokens_[id] : nullptr;
+            }
+
+        private:
+            void Add(string_view name, Token token) {
+                const uint32_t id = runtime::Symbol(name).Id();
+                if (id >= tokens_.size()) {
+                    tokens_.resize(id + 1);
+                }
+                tokens_[id] = std::move(token);
+            }
+
+            vector<optional<Token>> tokens_;
+        };
+
+        const KeywordTable& Keywords() {
+            static const KeywordTable table;
+            return table;
+        }
+
+        // Ожидание другого потока конвейера: сначала короткие уступки процессора, затем сон
+        class Backoff {
+        public:
+            void Wait() {
+                if (++spins_ < SPIN_LIMIT) {
+                    this_thread::yield();
+                } else {
+                    this_thread::sleep_for(chrono::microseconds(20));
+                }
+            }
+
+        private:
+            static constexpr int SPIN_LIMIT = 64;
+            int spins_ = 0;
+        };
+    }
+
+    // Кольцевой буфер с одним писателем (поток лексера) и одним читателем (NextToken).
+    // Каждая сторона запоминает последнее прочитанное значение чужого счётчика и перечитывает
+    // его, только когда оно исчерпано, поэтому общие строки кэша затрагиваются редко
+    struct Lexer::Pipeline {
+        static constexpr size_t CAPACITY = 4096;
+
+        explicit Pipeline(Lexer& lexer) {
+            thread = std::thread([this, &lexer] {
+                lexer.Produce(*this);
+            });
         }
-        ParseToken();
+
+        ~Pipeline() {
+            stopping.store(true, memory_order_relaxed);
+            thread.join();
+        }
+
+        // Ждёт, пока поток лексера запишет лексему index. Если вместо этого разбор текста
+        // завершился ошибкой, передаёт её исключением
+        void WaitFor(size_t index) {
+            Backoff backoff;
+            while (index >= available) {
+                const bool done = finished.load(memory_order_acquire);
+                available = written.load(memory_order_acquire);
+                if (index < available) {
+                    break;
+                }
+                if (done) {
+                    rethrow_exception(error);
+                }
+                backoff.Wait();
+            }
+        }
+
+        array<Token, CAPACITY> ring;
+        // Записано лексем. Ячейку лексемы i можно перезаписать, когда current ушёл
+        // от неё на CAPACITY лексем
+        alignas(64) atomic<size_t> written{0};
+        // Номер текущей лексемы читателя
+        alignas(64) atomic<size_t> current{0};
+        atomic<bool> finished{false};
+        atomic<bool> stopping{false};
+        // Ошибка разбора, записывается до finished
+        exception_ptr error;
+        // Последнее прочитанное читателем значение written
+        size_t available = 0;
+        std::thread thread;
+    };
+
+    Lexer::Lexer(std::istream& input, Mode mode)
+            : buffer_(istreambuf_iterator<char>(input), istreambuf_iterator<char>())
+            , pos_(buffer_.data())
+            , end_(buffer_.data() + buffer_.size())
+            , mode_(mode) {
+        Start();
     }
 
-    const Token& Lexer::CurrentToken() const {
-        return current_token_;
+    Lexer::Lexer(std::string_view source, Mode mode)
+            : pos_(source.data())
+            , end_(source.data() + source.size())
+            , mode_(mode) {
+        Start();
     }
 
-    Token Lexer::NextToken() {
-        ParseToken();
-        return CurrentToken();
+    Lexer::~Lexer() = default;
+
+    void Lexer::Start() {
+        while (Peek() == '\n') {
+            ++pos_;
+        }
+        switch (mode_) {
+            case Mode::OnDemand:
+                ParseToken();
+                break;
+            case Mode::Pretokenized:
+                Tokenize();
+                if (tokens_.empty()) {
+                    rethrow_exception(error_);
+                }
+                current_ = &tokens_.front();
+                break;
+            case Mode::Pipelined:
+                pipeline_ = make_unique<Pipeline>(*this);
+                pipeline_->WaitFor(0);
+                current_ = &pipeline_->ring.front();
+                break;
+        }
+    }
+
+    void Lexer::Tokenize() {
+        // Обычно лексема приходится на несколько символов текста
+        tokens_.reserve(static_cast<size_t>(end_ - pos_) / 4 + 1);
+        try {
+            do {
+                ParseToken();
+                // Разбор следующей лексемы смотрит только на тип текущей, поэтому её значение
+                // можно забрать
+                tokens_.push_back(std::move(current_token_));
+            } while (!tokens_.back().Is<token_type::Eof>());
+        } catch (const LexerError&) {
+            error_ = current_exception();
+        }
+    }
+
+    void Lexer::Produce(Pipeline& pipeline) noexcept {
+        try {
+            size_t written = 0;
+            // Первая ячейка, которую нельзя перезаписать
+            size_t limit = Pipeline::CAPACITY;
+            bool eof = false;
+            while (!eof) {
+                ParseToken();
+                Backoff backoff;
+                while (written == limit) {
+                    if (pipeline.stopping.load(memory_order_relaxed)) {
+                        return;
+                    }
+                    limit = pipeline.current.load(memory_order_acquire) + Pipeline::CAPACITY;
+                    if (written == limit) {
+                        backoff.Wait();
+                    }
+                }
+                eof = current_token_.Is<token_type::Eof>();
+                pipeline.ring[written % Pipeline::CAPACITY] = std::move(current_token_);
+                pipeline.written.store(++written, memory_order_release);
+            }
+        } catch (...) {
+            pipeline.error = current_exception();
+        }
+        pipeline.finished.store(true, memory_order_release);
+    }
+
+    const Token& Lexer::NextToken() {
+        switch (mode_) {
+            case Mode::OnDemand:
+                ParseToken();
+                break;
+            case Mode::Pretokenized:
+                if (index_ + 1 < tokens_.size()) {
+                    current_ = &tokens_[++index_];
+                } else if (error_) {
+                    rethrow_exception(error_);
+                }
+                break;
+            case Mode::Pipelined:
+                return NextPipelined();
+        }
+        return *current_;
+    }
+
+    const Token& Lexer::NextPipelined() {
+        if (current_->Is<token_type::Eof>()) {
+            return *current_;
+        }
+        Pipeline& pipeline = *pipeline_;
+        const size_t next = pipeline.current.load(memory_order_relaxed) + 1;
+        pipeline.WaitFor(next);
+        current_ = &pipeline.ring[next % Pipeline::CAPACITY];
+        // Освобождает ячейку предыдущей лексемы
+        pipeline.current.store(next, memory_order_release);
+        return *current_;
     }
 
     void Lexer::ParseToken() {
         if (current_token_ == token_type::Eof{}) {
             return;
         }
-        if (input_.eof() || input_.peek() == EOF) {
+        if (AtEnd()) {
             if (count_indent_ > 0) {
-                current_token_ = token_type::Dedent{};
                 count_indent_ -= 2;
                 current_token_ = token_type::Dedent{};
             } else if (current_token_ != token_type::Newline{} && current_token_ != token_type::Dedent{}) {
@@ -115,10 +485,11 @@ namespace parse {
             current_token_ = token_type::Dedent{};
             return;
         }
-        char ch = static_cast<char>(input_.get());
+        const char ch = *pos_;
         if (ch == '#') {
-            std::string temp;
-            getline(input_, temp);
+            // Комментарий продолжается до конца строки включительно
+            const auto* line_end = static_cast<const char*>(memchr(pos_, '\n', end_ - pos_));
+            pos_ = line_end == nullptr ? end_ : line_end + 1;
             current_token_ = token_type::Newline{};
             if (is_start_line_) {
                 ParseToken();
@@ -126,164 +497,150 @@ namespace parse {
             return;
         }
         if (ch == '\n' && current_token_ == token_type::Newline{}) {
+            ++pos_;
             is_start_line_ = true;
             return ParseToken();
         }
         if (is_start_line_ && count_indent_ > 0 && ch != ' ' && !is_code_block_) {
-            input_.putback(ch);
             current_token_ = token_type::Dedent{};
             count_indent_ -= 2;
             return;
         }
         is_code_block_ = false;
         if (ch == '\n') {
+            ++pos_;
             current_token_ = token_type::Newline{};
             is_start_line_ = true;
             return;
         } else if (ch == '\'' || ch == '\"') {
+            ++pos_;
             ParseString(ch);
-        } else if (isdigit(ch)) {
-            input_.putback(ch);
+        } else if (IsDigit(ch)) {
             ParseNumber();
-        } else if (isalpha(ch) || ch == '_') {
-            input_.putback(ch);
+        } else if (IsIdentifierStart(ch)) {
             ParseIdentifier();
         } else if (ch == ' ') {
-            input_.putback(ch);
             ParseIndent();
         } else {
-            input_.putback(ch);
             ParseSymbol();
         }
         is_start_line_ = false;
     }
 
     void Lexer::ParseNumber() {
-        std::string parsed_num;
-        while (isdigit(input_.peek())) {
-            parsed_num += static_cast<char>(input_.get());
+        int value = 0;
+        const auto [ptr, error] = from_chars(pos_, end_, value);
+        if (error != errc{}) {
+            throw LexerError("Number is out of range: "s + string(pos_, ptr));
         }
-        current_token_ = token_type::Number{std::stoi(parsed_num)};
+        pos_ = ptr;
+        current_token_ = token_type::Number{value};
     }
 
     void Lexer::ParseString(char quote) {
         std::string s;
-        for (char ch; (ch = static_cast<char>(input_.get())) != quote;) {
-            if (ch == '\\') {
-                const char escaped_char = static_cast<char>(input_.get());
-                switch (escaped_char) {
-                    case 'n':
-                        s.push_back('\n');
-                        break;
-                    case 't':
-                        s.push_back('\t');
-                        break;
-                    case 'r':
-                        s.push_back('\r');
-                        break;
-                    case '"':
-                        s.push_back('"');
-                        break;
-                    case '\'':
-                        s.push_back('\'');
-                        break;
-                    case '\\':
-                        s.push_back('\\');
-                        break;
-                    default:
-                        s.push_back(ch);
-                }
-            } else {
-                s.push_back(ch);
+        while (true) {
+            // Участки без экранирования копируются целиком
+            const char* chunk_end = FindQuoteOrBackslash(pos_, end_, quote);
+            s.append(pos_, chunk_end);
+            pos_ = chunk_end;
+            if (AtEnd()) {
+                throw LexerError("Unterminated string literal"s);
+            }
+            const char ch = *pos_++;
+            if (ch == quote) {
+                break;
+            }
+            if (AtEnd()) {
+                throw LexerError("Unterminated string literal"s);
+            }
+            const char escaped_char = *pos_++;
+            switch (escaped_char) {
+                case 'n':
+                    s.push_back('\n');
+                    break;
+                case 't':
+                    s.push_back('\t');
+                    break;
+                case 'r':
+                    s.push_back('\r');
+                    break;
+                case '"':
+                    s.push_back('"');
+                    break;
+                case '\'':
+                    s.push_back('\'');
+                    break;
+                case '\\':
+                    s.push_back('\\');
+                    break;
+                default:
+                    s.push_back(ch);
             }
         }
-        current_token_ = token_type::String{s};
+        current_token_ = token_type::String{std::move(s)};
     }
 
     void Lexer::ParseIdentifier() {
-        std::string str;
-        while (isalnum(input_.peek()) || input_.peek() == '_') {
-            str += static_cast<char>(input_.get());
-        }
-        if(!ParseKeyword(str)) {
-            current_token_ = token_type::Id{str};
+        const char* begin = pos_;
+        pos_ = SkipIdentifierChars(pos_, end_);
+        const std::string_view str(begin, pos_ - begin);
+        const runtime::Symbol symbol(str);
+        if(!ParseKeyword(symbol)) {
+            current_token_ = token_type::Id{str, symbol};
         }
     }
 
     void Lexer::ParseSymbol() {
-        char ch = static_cast<char>(input_.get());
+        const char ch = *pos_++;
+        const bool followed_by_eq = Peek() == '=';
         if (ch == '=') {
-            if (input_.peek() == '=') {
+            if (followed_by_eq) {
                 current_token_ = token_type::Eq{};
-                input_.get();
+                ++pos_;
             } else {
                 current_token_ = token_type::Char{ch};
             }
         } else if (ch == '>') {
-            if (input_.peek() == '=') {
+            if (followed_by_eq) {
                 current_token_ = token_type::GreaterOrEq{};
-                input_.get();
+                ++pos_;
             } else {
                 current_token_ = token_type::Char{ch};
             }
         } else if (ch == '<') {
-            if (input_.peek() == '=') {
+            if (followed_by_eq) {
                 current_token_ = token_type::LessOrEq{};
-                input_.get();
+                ++pos_;
             } else {
                 current_token_ = token_type::Char{ch};
             }
         } else if (ch == '!') {
-            if (input_.peek() == '=') {
+            if (followed_by_eq) {
                 current_token_ = token_type::NotEq{};
-                input_.get();
+                ++pos_;
             }
         } else {
             current_token_ = token_type::Char{ch};
         }
     }
 
-    bool Lexer::ParseKeyword(const std::string& str) {
-        if (str == "class") {
-            current_token_ = token_type::Class{};
-        } else if (str == "return") {
-            current_token_ = token_type::Return{};
-        } else if (str == "if") {
-            current_token_ = token_type::If{};
-        } else if (str == "else") {
-            current_token_ = token_type::Else{};
-        } else if (str == "def") {
-            current_token_ = token_type::Def{};
-        } else if (str == "print") {
-            current_token_ = token_type::Print{};
-        } else if (str == "and") {
-            current_token_ = token_type::And{};
-        } else if (str == "or") {
-            current_token_ = token_type::Or{};
-        } else if (str == "not") {
-            current_token_ = token_type::Not{};
-        } else if (str == "None") {
-            current_token_ = token_type::None{};
-        } else if (str == "True") {
-            current_token_ = token_type::True{};
-        } else if (str == "False") {
-            current_token_ = token_type::False{};
-        } else {
-            return false;
+    bool Lexer::ParseKeyword(runtime::Symbol symbol) {
+        if (const Token* keyword = Keywords().Find(symbol)) {
+            current_token_ = *keyword;
+            return true;
         }
-        return true;
+        return false;
     }
 
     void Lexer::ParseIndent() {
+        const char* begin = pos_;
+        pos_ = SkipSpaces(pos_, end_);
+        // Пробелы внутри строки лишь разделяют лексемы
         if (!current_token_.Is<token_type::Newline>()) {
-            input_.get();
             return ParseToken();
         }
-        int count_spaces = 0;
-        while (input_.peek() == ' ') {
-            ++count_spaces;
-            input_.get();
-        }
+        const auto count_spaces = static_cast<int>(pos_ - begin);
         if (count_spaces == count_indent_) {
             is_code_block_ = true;
             return ParseToken();
@@ -302,4 +659,4 @@ namespace parse {
 
     }
 
-}  // namespace parse
\ No newline at end of file
+}  // namespace parse
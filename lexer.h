@@ -1,11 +1,17 @@
 #pragma once
 
+#include "symbol.h"
+
+#include <exception>
 #include <iosfwd>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 namespace parse {
 
@@ -14,8 +20,20 @@ namespace parse {
             int value;   // число
         };
 
-        struct Id {             // Лексема «идентификатор»
-            std::string value;  // Имя идентификатора
+        struct Id {  // Лексема «идентификатор»
+            Id() = default;
+            // Интернирует имя name
+            explicit Id(std::string_view name)
+                : value(name)
+                , symbol(name) {
+            }
+            Id(std::string_view name, runtime::Symbol interned)
+                : value(name)
+                , symbol(interned) {
+            }
+
+            std::string_view value;  // Имя идентификатора, ссылается на исходный текст программы
+            runtime::Symbol symbol;  // То же имя, интернированное в таблице символов
         };
 
         struct Char {    // Лексема «символ»
@@ -86,24 +104,50 @@ namespace parse {
         using std::runtime_error::runtime_error;
     };
 
+    // Лексический анализатор работает над непрерывным буфером с текстом программы.
+    // Идентификаторы ссылаются на участки этого буфера, поэтому лексемы действительны,
+    // пока жив лексер (или внешний буфер, переданный в конструктор)
     class Lexer {
     public:
-        explicit Lexer(std::istream& input);
+        // Способ, которым лексер разбирает текст
+        enum class Mode {
+            // Каждая лексема разбирается при вызове NextToken
+            OnDemand,
+            // Весь текст разбирается в вектор лексем при создании лексера
+            Pretokenized,
+            // Текст разбирает отдельный поток, опережая NextToken на размер кольцевого буфера,
+            // так что лексический анализ идёт одновременно с построением дерева
+            Pipelined,
+        };
+
+        // Считывает поток целиком во внутренний буфер
+        explicit Lexer(std::istream& input, Mode mode = Mode::OnDemand);
+        // Разбирает внешний буфер без копирования. Буфер должен пережить лексер и его лексемы
+        explicit Lexer(std::string_view source, Mode mode = Mode::OnDemand);
+        ~Lexer();
+
+        Lexer(const Lexer&) = delete;
+        Lexer& operator=(const Lexer&) = delete;
 
         // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
-        [[nodiscard]] const Token& CurrentToken() const;
+        [[nodiscard]] const Token& CurrentToken() const {
+            return *current_;
+        }
 
-        // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
-        Token NextToken();
+        // Переходит к следующему токену и возвращает ссылку на него, либо на token_type::Eof,
+        // если поток токенов закончился. Ссылка действительна до следующего вызова NextToken.
+        // Лексическая ошибка передаётся исключением LexerError, в режимах Pretokenized
+        // и Pipelined - когда парсер дойдёт до места ошибки
+        const Token& NextToken();
 
         // Если текущий токен имеет тип T, метод возвращает ссылку на него.
         // В противном случае метод выбрасывает исключение LexerError
         template <typename T>
         const T& Expect() const {
-            if (!current_token_.Is<T>()) {
+            if (!current_->Is<T>()) {
                 throw LexerError{"Type error"};
             }
-            return current_token_.As<T>();
+            return current_->As<T>();
         }
 
         // Метод проверяет, что текущий токен имеет тип T, а сам токен содержит значение value.
@@ -133,21 +177,53 @@ namespace parse {
         }
 
     private:
+        struct Pipeline;
+
+        // Пропускает пустые строки в начале текста и разбирает первую лексему
+        void Start();
+        // Разбирает весь текст в tokens_
+        void Tokenize();
+        // Тело потока режима Pipelined
+        void Produce(Pipeline& pipeline) noexcept;
+        const Token& NextPipelined();
+
         void ParseToken();
         void ParseNumber();
         void ParseString(char quote);
         void ParseIdentifier();
         void ParseSymbol();
-        bool ParseKeyword(const std::string& str);
+        bool ParseKeyword(runtime::Symbol symbol);
         void ParseIndent();
 
+        [[nodiscard]] bool AtEnd() const {
+            return pos_ == end_;
+        }
+
+        // Возвращает текущий символ, не извлекая его, либо '\0' в конце буфера
+        [[nodiscard]] char Peek() const {
+            return AtEnd() ? '\0' : *pos_;
+        }
+
     private:
-        std::istream& input_;
+        std::string buffer_;
+        const char* pos_ = nullptr;
+        const char* end_ = nullptr;
         Token current_token_{};
         int count_indent_{};
         int dedent_count_{};
         bool is_start_line_ = true;
         bool is_code_block_ = false;
+
+        Mode mode_;
+        // Текущая лексема: current_token_, элемент tokens_ либо ячейка кольцевого буфера
+        const Token* current_ = &current_token_;
+        // Лексемы режима Pretokenized и ошибка, на которой остановился разбор текста
+        std::vector<Token> tokens_;
+        std::size_t index_ = 0;
+        std::exception_ptr error_;
+        // Поток режима Pipelined. Объявлен последним, чтобы поток был остановлен раньше,
+        // чем будут уничтожены используемые им поля
+        std::unique_ptr<Pipeline> pipeline_;
     };
 
 }  // namespace parse
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -352,6 +353,113 @@ abc#
     }
 }
 
+void TestBufferSource() {
+    const string source = "value = 2147483647 # max int\nprint value_2, 'a\\tb'\n"s;
+    Lexer lexer(string_view{source});
+
+    // Идентификаторы ссылаются на исходный буфер без копирования
+    const auto& id = lexer.Expect<token_type::Id>();
+    ASSERT_EQUAL(id.value, "value"sv);
+    ASSERT(id.value.data() == source.data());
+    ASSERT(id.symbol == runtime::Symbol("value"s));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{2147483647}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"value_2"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"a\tb"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+    ASSERT_THROWS(Lexer("2147483648\n"sv), LexerError);
+    ASSERT_THROWS(Lexer("'unterminated\n"sv), LexerError);
+}
+
+void TestModes() {
+    using Mode = Lexer::Mode;
+    string source = "class A:\n  def f(x):\n    return 'text' + x\n\n\n# comment\n"s;
+    // Программа длиннее кольцевого буфера режима Pipelined
+    for (int i = 0; i < 2000; ++i) {
+        source += "x = "s + to_string(i) + " * y  # comment\n"s;
+    }
+    source += "if x:\n  print 'last'\n"s;
+
+    vector<Token> expected;
+    Lexer on_demand{string_view{source}};
+    for (; !on_demand.CurrentToken().Is<token_type::Eof>(); on_demand.NextToken()) {
+        expected.push_back(on_demand.CurrentToken());
+    }
+    for (Mode mode : {Mode::Pretokenized, Mode::Pipelined}) {
+        Lexer lexer(string_view{source}, mode);
+        for (const Token& token : expected) {
+            ASSERT_EQUAL(lexer.CurrentToken(), token);
+            lexer.NextToken();
+        }
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Eof{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+        // Ошибка сообщается, когда до неё доходит NextToken
+        Lexer failed("x = 1\ny = 'unterminated\n"sv, mode);
+        for (int i = 0; i < 5; ++i) {
+            failed.NextToken();
+        }
+        ASSERT_EQUAL(failed.CurrentToken(), Token(token_type::Char{'='}));
+        ASSERT_THROWS(failed.NextToken(), LexerError);
+        ASSERT_THROWS(Lexer("2147483648\n"sv, mode), LexerError);
+
+        // Лексер можно уничтожить, не дочитав текст
+        Lexer unfinished(string_view{source}, mode);
+        ASSERT_EQUAL(unfinished.NextToken(), Token(token_type::Id{"A"s}));
+    }
+}
+
+bool IsIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+void TestLongRuns() {
+    // Границы идентификаторов, строк и отступов приходятся на разные позиции блоков,
+    // которыми лексер просматривает текст
+    for (size_t length = 1; length <= 40; ++length) {
+        for (size_t offset = 0; offset < 16; ++offset) {
+            string name(length, 'a');
+            for (size_t i = 0; i < length; ++i) {
+                name[i] = "aZ_9b"[i % 5];
+            }
+            name[0] = 'x';
+            const string text(length, 'q');
+            const string escaped = text + "\\'"s + text;
+            const string source = string(offset, '\n') + name + "=" + string(length, ' ') + '\''
+                                  + escaped + "'+\"" + text + "\"\nif x:\n  y\n"s;
+
+            Lexer lexer{string_view{source}};
+            ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{name}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text + "'"s + text}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::If{}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+            ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+        }
+    }
+
+    // Все байты, кроме букв, цифр и '_', завершают идентификатор
+    for (int ch = 1; ch < 256; ++ch) {
+        const auto c = static_cast<char>(ch);
+        if (IsIdentifierChar(c) || c == '\n' || c == ' ') {
+            continue;
+        }
+        const string source = "abcdefghijklmno"s + c + "pqrstuvwxyz0123456789"s;
+        Lexer lexer{string_view{source}};
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"abcdefghijklmno"s}));
+    }
+}
+
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -368,6 +476,9 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestBufferSource);
+    RUN_TEST(tr, parse::TestModes);
+    RUN_TEST(tr, parse::TestLongRuns);
 }
 
 }  // namespace parse
\ No newline at end of file
@@ -1,4 +1,6 @@
+#include "compiler.h"
 #include "lexer.h"
+#include "optimizer.h"
 #include "parse.h"
 #include "runtime.h"
 #include "statement.h"
@@ -14,19 +16,57 @@ void RunOpenLexerTests(TestRunner& tr);
 
 namespace ast {
 void RunUnitTests(TestRunner& tr);
-}
+void RunOptimizerTests(TestRunner& tr);
+}  // namespace ast
 namespace runtime {
 void RunObjectHolderTests(TestRunner& tr);
 void RunObjectsTests(TestRunner& tr);
+void RunProfilerTests(TestRunner& tr);
+void RunMemoryStatsTests(TestRunner& tr);
+void RunCycleCollectorTests(TestRunner& tr);
 }  // namespace runtime
+namespace bytecode {
+void RunVmTests(TestRunner& tr);
+}  // namespace bytecode
+
+namespace cache {
+void RunProgramCacheTests(TestRunner& tr);
+}  // namespace cache
+
+namespace driver {
+void RunDriverTests(TestRunner& tr);
+}  // namespace driver
+
+namespace executor {
+void RunExecutorTests(TestRunner& tr);
+}  // namespace executor
+
+namespace repl {
+void RunReplTests(TestRunner& tr);
+}  // namespace repl
+
+namespace jit {
+void RunJitTests(TestRunner& tr);
+}  // namespace jit
 
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
-void RunMythonProgram(istream& input, ostream& output) {
+// Способ исполнения программы
+enum class Backend {
+    TreeWalker,  // обход дерева разбора
+    Bytecode,    // компиляция в байт-код и исполнение регистровой машиной
+};
+
+const Backend ALL_BACKENDS[] = {Backend::TreeWalker, Backend::Bytecode};
+
+void RunMythonProgram(istream& input, ostream& output, Backend backend = Backend::TreeWalker) {
     parse::Lexer lexer(input);
-    auto program = ParseProgram(lexer);
+    auto program = ast::Optimize(ParseProgram(lexer));
+    if (backend == Backend::Bytecode) {
+        program = bytecode::Compile(std::move(program));
+    }
 
     runtime::SimpleContext context{output};
     runtime::Closure closure;
@@ -34,7 +74,7 @@ void RunMythonProgram(istream& input, ostream& output) {
 }
 
 void TestSimplePrints() {
-    istringstream input(R"(
+    const string program = R"(
 print 57
 print 10, 24, -8
 print 'hello'
@@ -42,16 +82,19 @@ print "world"
 print True, False
 print
 print None
-)");
+)";
 
-    ostringstream output;
-    RunMythonProgram(input, output);
+    for (Backend backend : ALL_BACKENDS) {
+        istringstream input(program);
+        ostringstream output;
+        RunMythonProgram(input, output, backend);
 
-    ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
+        ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
+    }
 }
 
 void TestAssignments() {
-    istringstream input(R"(
+    const string program = R"(
 x = 57
 print x
 x = 'C++ black belt'
@@ -61,25 +104,29 @@ x = y
 print x
 x = None
 print x, y
-)");
+)";
 
-    ostringstream output;
-    RunMythonProgram(input, output);
+    for (Backend backend : ALL_BACKENDS) {
+        istringstream input(program);
+        ostringstream output;
+        RunMythonProgram(input, output, backend);
 
-    ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
+        ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
+    }
 }
 
 void TestArithmetics() {
-    istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
+    for (Backend backend : ALL_BACKENDS) {
+        istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
+        ostringstream output;
+        RunMythonProgram(input, output, backend);
 
-    ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
+        ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
+    }
 }
 
 void TestVariablesArePointers() {
-    istringstream input(R"(
+    const string program = R"(
 class Counter:
   def __init__():
     self.value = 0
@@ -103,12 +150,15 @@ d = Dummy()
 d.do_add(x)
 
 print y.value
-)");
+)";
 
-    ostringstream output;
-    RunMythonProgram(input, output);
+    for (Backend backend : ALL_BACKENDS) {
+        istringstream input(program);
+        ostringstream output;
+        RunMythonProgram(input, output, backend);
 
-    ASSERT_EQUAL(output.str(), "2\n3\n");
+        ASSERT_EQUAL(output.str(), "2\n3\n");
+    }
 }
 
 void TestAll() {
@@ -117,7 +167,17 @@ void TestAll() {
     runtime::RunObjectHolderTests(tr);
     runtime::RunObjectsTests(tr);
     ast::RunUnitTests(tr);
+    ast::RunOptimizerTests(tr);
     TestParseProgram(tr);
+    bytecode::RunVmTests(tr);
+    cache::RunProgramCacheTests(tr);
+    driver::RunDriverTests(tr);
+    executor::RunExecutorTests(tr);
+    runtime::RunProfilerTests(tr);
+    runtime::RunMemoryStatsTests(tr);
+    runtime::RunCycleCollectorTests(tr);
+    repl::RunReplTests(tr);
+    jit::RunJitTests(tr);
 
     RUN_TEST(tr, TestSimplePrints);
     RUN_TEST(tr, TestAssignments);
@@ -0,0 +1,76 @@
+#include "memory_stats.h"
+
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        // Имена видов объектов в порядке значений Object::Kind
+        constexpr array<string_view, OBJECT_KIND_COUNT> KIND_NAMES = {
+            "Other"sv, "Number"sv, "String"sv, "Bool"sv, "Class"sv, "ClassInstance"sv,
+        };
+
+        void WriteLevel(ostream& out, string_view name, const MemoryUsage::Level& level) {
+            out << name << ": "sv << level.current << " bytes live, "sv << level.peak
+                << " bytes peak\n"sv;
+        }
+    }
+
+    void MemoryStats::AllocateObject(size_t kind, size_t bytes) noexcept {
+        Objects& objects = objects_[kind];
+        Increment(objects.created);
+        objects.live.Add(1);
+        objects.bytes.Add(bytes);
+        heap_bytes_.Add(bytes);
+    }
+
+    void MemoryStats::FreeObject(size_t kind, size_t bytes) noexcept {
+        Objects& objects = objects_[kind];
+        objects.live.Sub(1);
+        objects.bytes.Sub(bytes);
+        heap_bytes_.Sub(bytes);
+    }
+
+    MemoryUsage::Level MemoryStats::Level::Get() const {
+        return {current.load(memory_order_relaxed), peak.load(memory_order_relaxed)};
+    }
+
+    MemoryUsage MemoryStats::GetUsage() const {
+        MemoryUsage usage;
+        for (size_t kind = 0; kind < OBJECT_KIND_COUNT; ++kind) {
+            const Objects& objects = objects_[kind];
+            usage.objects[kind] = {objects.created.load(memory_order_relaxed), objects.live.Get(),
+                                   objects.bytes.Get()};
+        }
+        usage.heap_bytes = heap_bytes_.Get();
+        usage.string_bytes = string_bytes_.Get();
+        usage.field_bytes = field_bytes_.Get();
+        usage.closures = closures_.load(memory_order_relaxed);
+        usage.frames = frames_.load(memory_order_relaxed);
+        return usage;
+    }
+
+    void WriteMemoryUsage(ostream& out, const MemoryUsage& usage) {
+        out << left << setw(14) << "kind"sv << right << setw(12) << "created"sv << setw(12)
+            << "live"sv << setw(12) << "peak"sv << setw(14) << "peak bytes"sv << '\n';
+        for (size_t kind = 0; kind < OBJECT_KIND_COUNT; ++kind) {
+            const MemoryUsage::Objects& objects = usage.objects[kind];
+            // Объекты, проверяемые через dynamic_cast, выводятся, только если они были
+            if (kind == 0 && objects.created == 0) {
+                continue;
+            }
+            out << left << setw(14) << KIND_NAMES[kind] << right << setw(12) << objects.created
+                << setw(12) << objects.live.current << setw(12) << objects.live.peak << setw(14)
+                << objects.bytes.peak << '\n';
+        }
+        WriteLevel(out, "objects"sv, usage.heap_bytes);
+        WriteLevel(out, "strings"sv, usage.string_bytes);
+        WriteLevel(out, "fields"sv, usage.field_bytes);
+        out << "calls: "sv << usage.closures << " closures, "sv << usage.frames << " frames\n"sv;
+    }
+
+}  // namespace runtime
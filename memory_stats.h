@@ -0,0 +1,210 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <utility>
+
+namespace runtime {
+
+    // Число видов объектов, совпадает с числом значений Object::Kind
+    inline constexpr std::size_t OBJECT_KIND_COUNT = 6;
+
+    // Снимок счётчиков памяти MemoryStats
+    struct MemoryUsage {
+        // Текущее и наибольшее значение величины
+        struct Level {
+            std::uint64_t current = 0;
+            std::uint64_t peak = 0;
+        };
+
+        struct Objects {
+            std::uint64_t created = 0;
+            Level live;
+            // Байты в куче вместе с хранимым в объекте распределителем
+            Level bytes;
+        };
+
+        // Объекты по видам: индекс - значение Object::Kind. Числа и логические значения
+        // хранятся внутри ObjectHolder, поэтому для них считается только число созданных
+        std::array<Objects, OBJECT_KIND_COUNT> objects{};
+        // Все объекты вместе
+        Level heap_bytes;
+        // Части строк вместе с символами
+        Level string_bytes;
+        // Массивы полей экземпляров классов
+        Level field_bytes;
+        // Таблицы переменных и кадры, созданные вызовами методов
+        std::uint64_t closures = 0;
+        std::uint64_t frames = 0;
+    };
+
+    // Выводит usage таблицей
+    void WriteMemoryUsage(std::ostream& out, const MemoryUsage& usage);
+
+    // Счётчики памяти выполнения программы. Учитывается всё, что создано в потоке
+    // при открытой области MemoryScope этих счётчиков. Область должна быть открыта не более
+    // чем в одном потоке одновременно, а освобождать учтённые объекты можно в любом потоке.
+    // Счётчики должны пережить все учтённые объекты
+    class MemoryStats {
+    public:
+        MemoryStats() = default;
+        MemoryStats(const MemoryStats&) = delete;
+        MemoryStats& operator=(const MemoryStats&) = delete;
+
+        // Возвращает счётчики открытой в потоке области либо nullptr
+        [[nodiscard]] static MemoryStats* Current() noexcept {
+            return current_;
+        }
+
+        // Учитывает создание объекта вида kind, хранимого без выделения памяти
+        void AddValue(std::size_t kind) noexcept {
+            Increment(objects_[kind].created);
+        }
+
+        void AllocateObject(std::size_t kind, std::size_t bytes) noexcept;
+        void FreeObject(std::size_t kind, std::size_t bytes) noexcept;
+
+        void AllocateString(std::size_t bytes) noexcept {
+            string_bytes_.Add(bytes);
+        }
+
+        void FreeString(std::size_t bytes) noexcept {
+            string_bytes_.Sub(bytes);
+        }
+
+        void AllocateFields(std::size_t bytes) noexcept {
+            field_bytes_.Add(bytes);
+        }
+
+        void FreeFields(std::size_t bytes) noexcept {
+            field_bytes_.Sub(bytes);
+        }
+
+        void AddClosure() noexcept {
+            Increment(closures_);
+        }
+
+        void AddFrame() noexcept {
+            Increment(frames_);
+        }
+
+        [[nodiscard]] MemoryUsage GetUsage() const;
+
+    private:
+        friend class MemoryScope;
+
+        // Величина, которая растёт в потоке области, а уменьшаться может в любом потоке.
+        // Наибольшее значение меняет только поток области
+        struct Level {
+            void Add(std::uint64_t amount) noexcept {
+                const std::uint64_t value =
+                    current.fetch_add(amount, std::memory_order_relaxed) + amount;
+                if (value > peak.load(std::memory_order_relaxed)) {
+                    peak.store(value, std::memory_order_relaxed);
+                }
+            }
+
+            void Sub(std::uint64_t amount) noexcept {
+                current.fetch_sub(amount, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] MemoryUsage::Level Get() const;
+
+            std::atomic<std::uint64_t> current = 0;
+            std::atomic<std::uint64_t> peak = 0;
+        };
+
+        struct Objects {
+            std::atomic<std::uint64_t> created = 0;
+            Level live;
+            Level bytes;
+        };
+
+        // Счётчик, который меняет только поток области
+        static void Increment(std::atomic<std::uint64_t>& counter) noexcept {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        inline static thread_local MemoryStats* current_ = nullptr;
+
+        std::array<Objects, OBJECT_KIND_COUNT> objects_;
+        Level heap_bytes_;
+        Level string_bytes_;
+        Level field_bytes_;
+        std::atomic<std::uint64_t> closures_ = 0;
+        std::atomic<std::uint64_t> frames_ = 0;
+    };
+
+    // Делает stats текущими счётчиками потока на время своего существования.
+    // Области могут быть вложенными. Область с nullptr отключает учёт, например для
+    // объектов, которые живут дольше выполнения
+    class MemoryScope {
+    public:
+        explicit MemoryScope(MemoryStats* stats) noexcept
+            : outer_(std::exchange(MemoryStats::current_, stats)) {
+        }
+
+        ~MemoryScope() {
+            MemoryStats::current_ = outer_;
+        }
+
+        MemoryScope(const MemoryScope&) = delete;
+        MemoryScope& operator=(const MemoryScope&) = delete;
+
+    private:
+        MemoryStats* outer_;
+    };
+
+    // Распределитель объектов в куче, учитывающий память объекта вида kind в stats.
+    // Распределитель хранится в самом объекте (см. runtime::Owned), поэтому объект,
+    // освобождённый в другом потоке или после закрытия области, учитывается в своих счётчиках
+    template <typename T>
+    class CountingAllocator {
+    public:
+        using value_type = T;
+
+        CountingAllocator(MemoryStats& stats, std::size_t kind) noexcept
+            : stats_(&stats)
+            , kind_(kind) {
+        }
+
+        template <typename U>
+        CountingAllocator(const CountingAllocator<U>& other) noexcept  // NOLINT
+            : stats_(other.stats_)
+            , kind_(other.kind_) {
+        }
+
+        T* allocate(std::size_t n) {
+            T* pointer = std::allocator<T>().allocate(n);
+            stats_->AllocateObject(kind_, n * sizeof(T));
+            return pointer;
+        }
+
+        void deallocate(T* pointer, std::size_t n) noexcept {
+            stats_->FreeObject(kind_, n * sizeof(T));
+            std::allocator<T>().deallocate(pointer, n);
+        }
+
+        template <typename U>
+        bool operator==(const CountingAllocator<U>& other) const noexcept {
+            return stats_ == other.stats_ && kind_ == other.kind_;
+        }
+
+        template <typename U>
+        bool operator!=(const CountingAllocator<U>& other) const noexcept {
+            return !(*this == other);
+        }
+
+    private:
+        template <typename U>
+        friend class CountingAllocator;
+
+        MemoryStats* stats_;
+        std::size_t kind_;
+    };
+
+}  // namespace runtime
@@ -0,0 +1,144 @@
+#include "compiler.h"
+#include "lexer.h"
+#include "memory_stats.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+constexpr auto NUMBER = static_cast<size_t>(Object::Kind::Number);
+constexpr auto STRING = static_cast<size_t>(Object::Kind::String);
+constexpr auto CLASS_INSTANCE = static_cast<size_t>(Object::Kind::ClassInstance);
+
+void TestObjects() {
+    MemoryStats stats;
+    ObjectHolder outside = ObjectHolder::Own(String("outside"s));
+    {
+        MemoryScope scope(&stats);
+        ASSERT_EQUAL(MemoryStats::Current(), &stats);
+        vector<ObjectHolder> values;
+        for (int i = 0; i < 10; ++i) {
+            values.push_back(ObjectHolder::Own(Number{i}));
+            values.push_back(ObjectHolder::Own(String(string(100, 'x'))));
+        }
+        {
+            MemoryScope unaccounted(nullptr);
+            values.push_back(ObjectHolder::Own(String("not counted"s)));
+        }
+        const auto usage = stats.GetUsage();
+        ASSERT_EQUAL(usage.objects[NUMBER].created, 10U);
+        ASSERT_EQUAL(usage.objects[NUMBER].live.peak, 0U);
+        ASSERT_EQUAL(usage.objects[STRING].created, 10U);
+        ASSERT_EQUAL(usage.objects[STRING].live.current, 10U);
+        ASSERT(usage.objects[STRING].bytes.current >= 10 * sizeof(String));
+        ASSERT_EQUAL(usage.heap_bytes.current, usage.objects[STRING].bytes.current);
+        ASSERT(usage.string_bytes.current >= 10 * 100U);
+    }
+    ASSERT(MemoryStats::Current() == nullptr);
+
+    const auto usage = stats.GetUsage();
+    ASSERT_EQUAL(usage.objects[STRING].live.current, 0U);
+    ASSERT_EQUAL(usage.objects[STRING].live.peak, 10U);
+    ASSERT_EQUAL(usage.heap_bytes.current, 0U);
+    ASSERT_EQUAL(usage.string_bytes.current, 0U);
+    ASSERT(usage.string_bytes.peak >= 10 * 100U);
+}
+
+void TestFreedInOtherThread() {
+    MemoryStats stats;
+    ObjectHolder value;
+    {
+        MemoryScope scope(&stats);
+        value = ObjectHolder::Own(String(string(1000, 'y')));
+    }
+    thread([moved = std::move(value)]() mutable {
+        moved = ObjectHolder::None();
+    }).join();
+    const auto usage = stats.GetUsage();
+    ASSERT_EQUAL(usage.objects[STRING].live.current, 0U);
+    ASSERT_EQUAL(usage.objects[STRING].live.peak, 1U);
+    ASSERT_EQUAL(usage.string_bytes.current, 0U);
+}
+
+const string PROGRAM = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+    self.label = 'point'
+
+  def sum(n):
+    if n == 0:
+      return 0
+    return self.x + self.y + self.sum(n - 1)
+
+p = Point(1, 2)
+q = Point(3, 4)
+print p.sum(9) + q.sum(0)
+)";
+
+void TestExecution() {
+    for (bool compiled : {false, true}) {
+        parse::Lexer lexer{string_view(PROGRAM)};
+        auto program = ast::Optimize(ParseProgram(lexer));
+        if (compiled) {
+            program = bytecode::Compile(std::move(program));
+        }
+
+        MemoryStats stats;
+        ostringstream output;
+        {
+            MemoryScope scope(&stats);
+            SimpleContext context{output};
+            context.SetMemoryStats(&stats);
+            ASSERT_EQUAL(context.GetMemoryStats(), &stats);
+            Closure closure;
+            program->Execute(closure, context);
+
+            const auto usage = stats.GetUsage();
+            ASSERT_EQUAL(usage.objects[CLASS_INSTANCE].created, 2U);
+            ASSERT_EQUAL(usage.objects[CLASS_INSTANCE].live.current, 2U);
+            // Три поля лежат в самих экземплярах
+            ASSERT_EQUAL(usage.field_bytes.current, 0U);
+            ASSERT(usage.heap_bytes.current >= 2 * sizeof(ClassInstance));
+        }
+        ASSERT_EQUAL(output.str(), "27\n"s);
+
+        const auto usage = stats.GetUsage();
+        ASSERT_EQUAL(usage.objects[CLASS_INSTANCE].live.current, 0U);
+        ASSERT_EQUAL(usage.heap_bytes.current, 0U);
+        ASSERT_EQUAL(usage.field_bytes.current, 0U);
+        if (compiled) {
+            // Регистровая машина вызывает методы, включая __init__, без Closure и кадров
+            ASSERT_EQUAL(usage.closures + usage.frames, 0U);
+        } else {
+            // __init__ дважды, sum десять и один раз
+            ASSERT_EQUAL(usage.closures + usage.frames, 13U);
+        }
+
+        ostringstream table;
+        WriteMemoryUsage(table, usage);
+        ASSERT(table.str().find("ClassInstance"s) != string::npos);
+        ASSERT(table.str().find("fields: 0 bytes live, "s) != string::npos);
+        ASSERT(table.str().find("Other"s) == string::npos);
+    }
+}
+
+}  // namespace
+
+void RunMemoryStatsTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestObjects);
+    RUN_TEST(tr, runtime::TestFreedInOtherThread);
+    RUN_TEST(tr, runtime::TestExecution);
+}
+
+}  // namespace runtime
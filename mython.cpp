@@ -0,0 +1,11 @@
+#include "driver.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    return driver::Run(std::vector<std::string>(argv + 1, argv + argc), std::cin, std::cout,
+                       std::cerr);
+}
@@ -0,0 +1,436 @@
+#include "compiler.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Счётчики выделений памяти. Глобальный operator new заменён версией, которая считает вызовы,
+// поэтому учитываются все выделения через new, в том числе внутри стандартной библиотеки
+namespace {
+    atomic<uint64_t> allocation_count{0};
+    atomic<uint64_t> allocated_bytes{0};
+
+    void* CountedAllocate(size_t size) {
+        allocation_count.fetch_add(1, memory_order_relaxed);
+        allocated_bytes.fetch_add(size, memory_order_relaxed);
+        if (void* memory = malloc(size != 0 ? size : 1)) {
+            return memory;
+        }
+        throw bad_alloc();
+    }
+}  // namespace
+
+void* operator new(size_t size) {
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return CountedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t /*size*/) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t /*size*/) noexcept {
+    free(memory);
+}
+
+namespace bench {
+
+    namespace {
+        using Clock = chrono::steady_clock;
+
+        // Одна операция замера. Подготовка (разбор, компиляция) выполняется заранее
+        struct Benchmark {
+            string name;
+            function<void()> run;
+        };
+
+        struct Result {
+            double ns_per_op = 0;
+            double allocations_per_op = 0;
+            double bytes_per_op = 0;
+            uint64_t iterations = 0;
+        };
+
+        struct Options {
+            string filter;
+            chrono::milliseconds min_time{200};
+            int repetitions = 5;
+            bool list = false;
+            bool help = false;
+        };
+
+        const char USAGE[] =
+            "Usage: mython_bench [OPTION]...\n"
+            "Run interpreter microbenchmarks and print one tab-separated line per benchmark:\n"
+            "name, ns/op, allocs/op, bytes/op and iterations of the median repetition.\n"
+            "\n"
+            "  --filter=TEXT       run only benchmarks whose name contains TEXT\n"
+            "  --min-time=MS       run each repetition for at least MS milliseconds (200)\n"
+            "  --repetitions=N     repeat each benchmark N times and report the median (5)\n"
+            "  --list              print benchmark names without running them\n"
+            "  --help              print this help\n";
+
+        // Поток вывода, отбрасывающий всё записанное
+        class NullBuffer : public streambuf {
+        protected:
+            int_type overflow(int_type c) override {
+                return traits_type::not_eof(c);
+            }
+
+            streamsize xsputn([[maybe_unused]] const char* s, streamsize count) override {
+                return count;
+            }
+        };
+
+        NullBuffer null_buffer;
+        ostream null_stream(&null_buffer);
+
+        // Программы для замеров выполнения. В Mython нет циклов, поэтому повторение
+        // выражено двоичной рекурсией: её глубина невелика, а число вызовов растёт как 2^n
+
+        const string ARITHMETIC = R"(
+class Loop:
+  def run(n, acc):
+    if n == 0:
+      return acc
+    x = acc * 3 + n - acc / 7
+    y = x - n * 2 + 5
+    if y > x or x < 0:
+      y = y - x
+    return self.run(n - 1, y) + self.run(n - 1, x - y)
+
+l = Loop()
+r = l.run(12, 1)
+)";
+
+        const string METHOD_CALLS = R"(
+class Fib:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+class Counter(Fib):
+  def count(n):
+    return self.fib(n)
+
+c = Counter()
+r = c.count(18)
+)";
+
+        const string FIELD_ACCESS = R"(
+class Point:
+  def __init__():
+    self.x = 1
+    self.y = 2
+    self.z = 3
+
+  def walk(n):
+    if n > 0:
+      self.x = self.x + self.y
+      self.y = self.z - self.x
+      self.z = self.x + self.y + self.z
+      self.walk(n - 1)
+      self.walk(n - 1)
+
+p = Point()
+p.walk(12)
+)";
+
+        const string STRING_CONCAT = R"(
+class Builder:
+  def build(n):
+    if n == 0:
+      return ''
+    return self.build(n - 1) + 'item' + str(n) + ', '
+
+  def tree(n):
+    if n == 0:
+      return 'leaf'
+    return '(' + self.tree(n - 1) + ' ' + self.tree(n - 1) + ')'
+
+b = Builder()
+s = b.build(400)
+t = b.tree(10)
+)";
+
+        const string NEW_INSTANCES = R"(
+class Vector:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+class Churn:
+  def add(a, b):
+    return Vector(a.x + b.x, a.y + b.y)
+
+  def run(n):
+    if n > 0:
+      a = self.add(Vector(n, 1), Vector(1, n))
+      self.run(n - 1)
+      self.run(n - 1)
+
+c = Churn()
+c.run(12)
+)";
+
+        const string PRINT_THROUGHPUT = R"(
+class Printer:
+  def run(n):
+    if n > 0:
+      print n, 'text', True, None, n * 1000
+      self.run(n - 1)
+      self.run(n - 1)
+
+p = Printer()
+p.run(11)
+)";
+
+        // Большой текст: программы выполнения, повторённые много раз. В каждой копии
+        // к именам классов добавляется номер, чтобы текст оставался корректной программой
+        string LargeSource() {
+            const string programs =
+                ARITHMETIC + METHOD_CALLS + FIELD_ACCESS + STRING_CONCAT + PRINT_THROUGHPUT;
+            const string_view classes[] = {"Loop", "Fib", "Counter", "Point", "Builder", "Printer"};
+            string source;
+            for (size_t copy = 0; copy < 300; ++copy) {
+                string text = programs;
+                for (string_view name : classes) {
+                    const string renamed = string(name) + to_string(copy);
+                    for (size_t pos = text.find(name); pos != string::npos;
+                         pos = text.find(name, pos + renamed.size())) {
+                        text.replace(pos, name.size(), renamed);
+                    }
+                }
+                source += text;
+            }
+            return source;
+        }
+
+        // Глубоко вложенные инструкции и выражения
+        string DeepSource() {
+            constexpr size_t DEPTH = 60;
+            string source = "x = 1\n"s;
+            for (size_t i = 0; i < DEPTH; ++i) {
+                source += string(i * 2, ' ') + "if x > "s + to_string(i) + ":\n"s;
+            }
+            source += string(DEPTH * 2, ' ') + "x = "s + string(200, '(') + "1"s;
+            for (size_t i = 0; i < 200; ++i) {
+                source += " + x)"s;
+            }
+            source += "\nprint x\n"s;
+            return source;
+        }
+
+        // Много классов, методов и инструкций на одном уровне
+        string WideSource() {
+            string source;
+            for (size_t c = 0; c < 50; ++c) {
+                source += "class C"s + to_string(c) + ":\n"s;
+                for (size_t m = 0; m < 20; ++m) {
+                    source += "  def m"s + to_string(m) + "(a, b):\n"s;
+                    source += "    self.f"s + to_string(m) + " = a + b * "s + to_string(m)
+                              + "\n"s;
+                    source += "    return self.f"s + to_string(m) + "\n"s;
+                }
+            }
+            for (size_t i = 0; i < 3000; ++i) {
+                source += "v"s + to_string(i % 100) + " = "s + to_string(i) + " * 2 + 1\n"s;
+            }
+            return source;
+        }
+
+        unique_ptr<runtime::Executable> Build(const string& source, bool compiled) {
+            parse::Lexer lexer{string_view(source)};
+            auto program = ast::Optimize(ParseProgram(lexer));
+            return compiled ? bytecode::Compile(std::move(program)) : std::move(program);
+        }
+
+        vector<Benchmark> MakeBenchmarks() {
+            vector<Benchmark> benchmarks;
+
+            auto large = make_shared<string>(LargeSource());
+            benchmarks.push_back({"lexer/large"s, [large] {
+                                      parse::Lexer lexer{string_view(*large)};
+                                      while (!lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+                                          lexer.NextToken();
+                                      }
+                                  }});
+
+            const pair<const char*, string> parse_inputs[] = {
+                {"parse/deep", DeepSource()},
+                {"parse/wide", WideSource()},
+                {"parse/large", *large},
+            };
+            for (const auto& [name, text] : parse_inputs) {
+                auto source = make_shared<string>(text);
+                benchmarks.push_back({name, [source] {
+                                          parse::Lexer lexer{string_view(*source)};
+                                          ParseProgram(lexer);
+                                      }});
+            }
+
+            const pair<const char*, const string*> programs[] = {
+                {"arithmetic", &ARITHMETIC},   {"method_calls", &METHOD_CALLS},
+                {"field_access", &FIELD_ACCESS}, {"string_concat", &STRING_CONCAT},
+                {"new_instances", &NEW_INSTANCES}, {"print", &PRINT_THROUGHPUT},
+            };
+            for (const auto& [name, source] : programs) {
+                for (bool compiled : {false, true}) {
+                    shared_ptr<runtime::Executable> program = Build(*source, compiled);
+                    benchmarks.push_back(
+                        {(compiled ? "bytecode/"s : "tree/"s) + name, [program] {
+                             runtime::SimpleContext context{null_stream};
+                             runtime::Closure closure;
+                             program->Execute(closure, context);
+                         }});
+                }
+            }
+            return benchmarks;
+        }
+
+        // Выполняет операцию, пока не пройдёт min_time, и возвращает средние показатели
+        Result RunOnce(const Benchmark& benchmark, chrono::nanoseconds min_time) {
+            Result result;
+            const uint64_t allocations = allocation_count.load(memory_order_relaxed);
+            const uint64_t bytes = allocated_bytes.load(memory_order_relaxed);
+            const auto start = Clock::now();
+            auto elapsed = Clock::duration::zero();
+            do {
+                benchmark.run();
+                ++result.iterations;
+                elapsed = Clock::now() - start;
+            } while (elapsed < min_time);
+
+            const auto iterations = static_cast<double>(result.iterations);
+            result.ns_per_op =
+                static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count())
+                / iterations;
+            result.allocations_per_op =
+                static_cast<double>(allocation_count.load(memory_order_relaxed) - allocations)
+                / iterations;
+            result.bytes_per_op =
+                static_cast<double>(allocated_bytes.load(memory_order_relaxed) - bytes)
+                / iterations;
+            return result;
+        }
+
+        Result Measure(const Benchmark& benchmark, const Options& options) {
+            // Прогрев: заполняет кэши узлов и специализирует операции
+            benchmark.run();
+            vector<Result> results;
+            for (int i = 0; i < options.repetitions; ++i) {
+                results.push_back(RunOnce(benchmark, options.min_time));
+            }
+            auto median = results.begin() + static_cast<ptrdiff_t>(results.size() / 2);
+            nth_element(results.begin(), median, results.end(),
+                        [](const Result& lhs, const Result& rhs) {
+                            return lhs.ns_per_op < rhs.ns_per_op;
+                        });
+            return *median;
+        }
+
+        bool ParsePositive(string_view text, long long& value) {
+            if (text.empty()
+                || !all_of(text.begin(), text.end(), [](char c) {
+                       return c >= '0' && c <= '9';
+                   })) {
+                return false;
+            }
+            value = stoll(string(text));
+            return value > 0;
+        }
+
+        bool ParseArgs(int argc, char* argv[], Options& options) {
+            constexpr string_view FILTER = "--filter="sv;
+            constexpr string_view MIN_TIME = "--min-time="sv;
+            constexpr string_view REPETITIONS = "--repetitions="sv;
+
+            for (int i = 1; i < argc; ++i) {
+                const string_view arg = argv[i];
+                long long value = 0;
+                if (arg == "--list"sv) {
+                    options.list = true;
+                } else if (arg == "--help"sv) {
+                    options.help = true;
+                } else if (arg.substr(0, FILTER.size()) == FILTER) {
+                    options.filter = string(arg.substr(FILTER.size()));
+                } else if (arg.substr(0, MIN_TIME.size()) == MIN_TIME
+                           && ParsePositive(arg.substr(MIN_TIME.size()), value)) {
+                    options.min_time = chrono::milliseconds(value);
+                } else if (arg.substr(0, REPETITIONS.size()) == REPETITIONS
+                           && ParsePositive(arg.substr(REPETITIONS.size()), value)) {
+                    options.repetitions = static_cast<int>(min(value, 1000LL));
+                } else {
+                    cerr << "mython_bench: invalid argument "sv << arg << '\n';
+                    return false;
+                }
+            }
+            return true;
+        }
+    }  // namespace
+
+    int Main(int argc, char* argv[]) {
+        Options options;
+        if (!ParseArgs(argc, argv, options)) {
+            cerr << USAGE;
+            return 2;
+        }
+        if (options.help) {
+            cout << USAGE;
+            return 0;
+        }
+
+        const auto benchmarks = MakeBenchmarks();
+        if (!options.list) {
+            cout << "benchmark\tns/op\tallocs/op\tbytes/op\titerations\n"sv;
+        }
+        for (const auto& benchmark : benchmarks) {
+            if (benchmark.name.find(options.filter) == string::npos) {
+                continue;
+            }
+            if (options.list) {
+                cout << benchmark.name << '\n';
+                continue;
+            }
+            const Result result = Measure(benchmark, options);
+            cout << benchmark.name << '\t' << fixed << setprecision(1) << result.ns_per_op
+                 << '\t' << result.allocations_per_op << '\t' << result.bytes_per_op << '\t'
+                 << result.iterations << endl;
+        }
+        return 0;
+    }
+
+}  // namespace bench
+
+int main(int argc, char* argv[]) {
+    return bench::Main(argc, argv);
+}
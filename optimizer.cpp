@@ -0,0 +1,184 @@
+#include "optimizer.h"
+
+#include "statement.h"
+
+#include <exception>
+#include <utility>
+
+using namespace std;
+
+namespace ast {
+
+    namespace {
+        using runtime::ObjectHolder;
+
+        bool IsConstant(const Statement& node) {
+            return dynamic_cast<const NumericConst*>(&node) != nullptr
+                   || dynamic_cast<const StringConst*>(&node) != nullptr
+                   || dynamic_cast<const BoolConst*>(&node) != nullptr
+                   || dynamic_cast<const None*>(&node) != nullptr;
+        }
+
+        // Возвращает узел-константу со значением value либо nullptr, если у значения нет
+        // записи в виде константы
+        unique_ptr<Statement> MakeConstant(const ObjectHolder& value) {
+            if (!value) {
+                return make_unique<None>();
+            }
+            if (const auto* number = value.TryAs<runtime::Number>()) {
+                return make_unique<NumericConst>(*number);
+            }
+            if (const auto* str = value.TryAs<runtime::String>()) {
+                return make_unique<StringConst>(*str);
+            }
+            if (const auto* boolean = value.TryAs<runtime::Bool>()) {
+                return make_unique<BoolConst>(*boolean);
+            }
+            return nullptr;
+        }
+
+        // Выполняет узел, аргументы которого - константы, и возвращает константу с его
+        // значением либо nullptr, если выполнение завершилось ошибкой
+        unique_ptr<Statement> Evaluate(Statement& node) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            try {
+                return MakeConstant(node.Execute(closure, context));
+            } catch (const exception&) {
+                return nullptr;
+            }
+        }
+
+        bool IsTrueConstant(Statement& node) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            return runtime::IsTrue(node.Execute(closure, context));
+        }
+
+        class Optimizer {
+        public:
+            unique_ptr<Statement> Simplify(unique_ptr<Statement> node) {
+                if (auto* binary = dynamic_cast<BinaryOperation*>(node.get())) {
+                    return SimplifyBinary(std::move(node), *binary);
+                }
+                if (auto* unary = dynamic_cast<UnaryOperation*>(node.get())) {
+                    SimplifyChild(unary->MutableArgument());
+                    return Fold(std::move(node), IsConstant(unary->GetArgument()));
+                }
+                if (auto* if_else = dynamic_cast<IfElse*>(node.get())) {
+                    return SimplifyIfElse(std::move(node), *if_else);
+                }
+                if (auto* compound = dynamic_cast<Compound*>(node.get())) {
+                    SimplifyCompound(*compound);
+                } else if (auto* assign = dynamic_cast<Assignment*>(node.get())) {
+                    SimplifyChild(assign->MutableRightValue());
+                } else if (auto* field = dynamic_cast<FieldAssignment*>(node.get())) {
+                    SimplifyChild(field->MutableRightValue());
+                } else if (auto* print = dynamic_cast<Print*>(node.get())) {
+                    SimplifyChildren(print->MutableArgs());
+                } else if (auto* call = dynamic_cast<MethodCall*>(node.get())) {
+                    SimplifyChild(call->MutableObject());
+                    SimplifyChildren(call->MutableArgs());
+                } else if (auto* instance = dynamic_cast<NewInstance*>(node.get())) {
+                    SimplifyChildren(instance->MutableArgs());
+                } else if (auto* body = dynamic_cast<MethodBody*>(node.get())) {
+                    SimplifyChild(body->MutableBody());
+                } else if (auto* ret = dynamic_cast<Return*>(node.get())) {
+                    SimplifyChild(ret->MutableStatement());
+                } else if (auto* cls = dynamic_cast<ClassDefinition*>(node.get())) {
+                    for (auto& method : cls->GetClass().TryAs<runtime::Class>()->Methods()) {
+                        SimplifyChild(method.body);
+                    }
+                }
+                return node;
+            }
+
+        private:
+            void SimplifyChild(unique_ptr<Statement>& child) {
+                child = Simplify(std::move(child));
+            }
+
+            void SimplifyChildren(vector<unique_ptr<Statement>>& children) {
+                for (auto& child : children) {
+                    SimplifyChild(child);
+                }
+            }
+
+            // Заменяет node константой, если его аргументы - константы и вычисление успешно
+            static unique_ptr<Statement> Fold(unique_ptr<Statement> node, bool constant_args) {
+                if (constant_args) {
+                    if (auto folded = Evaluate(*node)) {
+                        return folded;
+                    }
+                }
+                return node;
+            }
+
+            unique_ptr<Statement> SimplifyBinary(unique_ptr<Statement> node,
+                                                 BinaryOperation& binary) {
+                SimplifyChild(binary.MutableLhs());
+                SimplifyChild(binary.MutableRhs());
+                // Правый аргумент or и and не вычисляется, если левый определил результат
+                const bool is_or = dynamic_cast<const Or*>(&binary) != nullptr;
+                if (is_or || dynamic_cast<const And*>(&binary) != nullptr) {
+                    if (IsConstant(binary.GetLhs()) && IsTrueConstant(*binary.MutableLhs()) == is_or) {
+                        return make_unique<BoolConst>(runtime::Bool{is_or});
+                    }
+                }
+                const bool constant_args = IsConstant(binary.GetLhs()) && IsConstant(binary.GetRhs());
+                return Fold(std::move(node), constant_args);
+            }
+
+            unique_ptr<Statement> SimplifyIfElse(unique_ptr<Statement> node, IfElse& if_else) {
+                SimplifyChild(if_else.MutableCondition());
+                if (IsConstant(if_else.GetCondition())) {
+                    auto& branch = IsTrueConstant(*if_else.MutableCondition())
+                                       ? if_else.MutableIfBody()
+                                       : if_else.MutableElseBody();
+                    if (branch == nullptr) {
+                        return make_unique<None>();
+                    }
+                    return Simplify(std::move(branch));
+                }
+                SimplifyChild(if_else.MutableIfBody());
+                if (if_else.GetElseBody() != nullptr) {
+                    SimplifyChild(if_else.MutableElseBody());
+                }
+                return node;
+            }
+
+            void SimplifyCompound(Compound& compound) {
+                auto& statements = compound.MutableStatements();
+                vector<unique_ptr<Statement>> result;
+                result.reserve(statements.size());
+                auto append = [&result](unique_ptr<Statement> stmt) {
+                    if (!IsConstant(*stmt)) {
+                        result.push_back(std::move(stmt));
+                    }
+                };
+                for (auto& stmt : statements) {
+                    auto simplified = Simplify(std::move(stmt));
+                    // Вложенная составная инструкция, например выбранная ветка if, встраивается
+                    if (auto* nested = dynamic_cast<Compound*>(simplified.get())) {
+                        for (auto& nested_stmt : nested->MutableStatements()) {
+                            append(std::move(nested_stmt));
+                        }
+                    } else {
+                        append(std::move(simplified));
+                    }
+                    // Инструкции после return не выполняются
+                    if (!result.empty()
+                        && dynamic_cast<const Return*>(result.back().get()) != nullptr) {
+                        break;
+                    }
+                }
+                statements = std::move(result);
+            }
+        };
+    }
+
+    unique_ptr<runtime::Executable> Optimize(unique_ptr<runtime::Executable> program) {
+        return Optimizer().Simplify(std::move(program));
+    }
+
+}  // namespace ast
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+
+namespace runtime {
+    class Executable;
+}
+
+namespace ast {
+
+    // Упрощает дерево, построенное ParseProgram, не меняя результата его выполнения:
+    //  - заменяет константой операцию, все аргументы которой - константы (2 * 3, 'a' + 'b');
+    //  - заменяет if с константным условием выбранной веткой;
+    //  - заменяет константой or и and, результат которых определён левым аргументом;
+    //  - удаляет из составных инструкций константы и инструкции, следующие за return.
+    // Методы объявленных в программе классов упрощаются так же.
+    // Операция, вычисление которой завершается ошибкой (например, деление на 0), остаётся
+    // в дереве, чтобы ошибка возникла при выполнении
+    std::unique_ptr<runtime::Executable> Optimize(std::unique_ptr<runtime::Executable> program);
+
+}  // namespace ast
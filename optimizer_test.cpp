@@ -0,0 +1,122 @@
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace ast {
+
+namespace {
+
+unique_ptr<Statement> ParseAndOptimize(const string& program) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    return Optimize(ParseProgram(lexer));
+}
+
+const vector<unique_ptr<Statement>>& StatementsOf(const Statement& compound) {
+    return dynamic_cast<const Compound&>(compound).GetStatements();
+}
+
+const Statement& RightValueOf(const Statement& assignment) {
+    return dynamic_cast<const Assignment&>(assignment).GetRightValue();
+}
+
+template <typename T>
+bool IsConst(const Statement& node, const decltype(declval<T>().GetValue().GetValue())& value) {
+    const auto* constant = dynamic_cast<const T*>(&node);
+    return constant != nullptr && constant->GetValue().GetValue() == value;
+}
+
+string Run(Statement& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program.Execute(closure, context);
+    return context.output.str();
+}
+
+void TestConstantFolding() {
+    auto program = ParseAndOptimize(R"(
+a = 2 * 3 + 4
+b = 'ab' + 'cd'
+c = str(1 + 1) + '!'
+d = 1 < 2 and not False
+e = a * 2
+print a, b, c, d, e
+f = 10 / 0
+)"s);
+    const auto& statements = StatementsOf(*program);
+    ASSERT_EQUAL(statements.size(), 7U);
+    ASSERT(IsConst<NumericConst>(RightValueOf(*statements[0]), 10));
+    ASSERT(IsConst<StringConst>(RightValueOf(*statements[1]), "abcd"s));
+    ASSERT(IsConst<StringConst>(RightValueOf(*statements[2]), "2!"s));
+    ASSERT(IsConst<BoolConst>(RightValueOf(*statements[3]), true));
+    ASSERT(dynamic_cast<const Mult*>(&RightValueOf(*statements[4])) != nullptr);
+    // Ошибка вычисления возникает при выполнении, а не при оптимизации
+    ASSERT(dynamic_cast<const Div*>(&RightValueOf(*statements[6])) != nullptr);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ASSERT_THROWS(program->Execute(closure, context), std::runtime_error);
+    ASSERT_EQUAL(context.output.str(), "10 abcd 2! True 20\n"s);
+}
+
+void TestDeadBranches() {
+    auto program = ParseAndOptimize(R"(
+class Answer:
+  def get():
+    if 1 > 2:
+      print 'unreachable'
+    return 42
+    print 'after return'
+
+if True:
+  print 'then'
+else:
+  print 'else'
+if 'non-empty' == '':
+  print 'dropped'
+answer = Answer()
+print answer.get()
+)"s);
+    const auto& statements = StatementsOf(*program);
+    // class, print 'then', answer = ..., print answer.get()
+    ASSERT_EQUAL(statements.size(), 4U);
+    ASSERT(dynamic_cast<const Print*>(statements[1].get()) != nullptr);
+
+    const auto& definition = dynamic_cast<const ClassDefinition&>(*statements[0]);
+    const auto* cls = definition.GetClass().TryAs<runtime::Class>();
+    const auto& body = dynamic_cast<const MethodBody&>(*cls->GetMethod("get"s)->body);
+    const auto& method_statements = StatementsOf(body.GetBody());
+    ASSERT_EQUAL(method_statements.size(), 1U);
+    ASSERT(dynamic_cast<const Return*>(method_statements[0].get()) != nullptr);
+
+    ASSERT_EQUAL(Run(*program), "then\n42\n"s);
+}
+
+void TestShortCircuitFolding() {
+    auto program = ParseAndOptimize(R"(
+a = True or x.missing()
+b = 0 and x.missing()
+c = 1 and x
+d = x or True
+)"s);
+    const auto& statements = StatementsOf(*program);
+    ASSERT(IsConst<BoolConst>(RightValueOf(*statements[0]), true));
+    ASSERT(IsConst<BoolConst>(RightValueOf(*statements[1]), false));
+    // Левый аргумент не определяет результат: правый по-прежнему вычисляется
+    ASSERT(dynamic_cast<const And*>(&RightValueOf(*statements[2])) != nullptr);
+    ASSERT(dynamic_cast<const Or*>(&RightValueOf(*statements[3])) != nullptr);
+}
+
+}  // namespace
+
+void RunOptimizerTests(TestRunner& tr) {
+    RUN_TEST(tr, ast::TestConstantFolding);
+    RUN_TEST(tr, ast::TestDeadBranches);
+    RUN_TEST(tr, ast::TestShortCircuitFolding);
+}
+
+}  // namespace ast
@@ -0,0 +1,57 @@
+#include "output.h"
+
+#include <charconv>
+
+using namespace std;
+
+namespace runtime {
+
+    string_view FormatNumber(int value, NumberChars& chars) {
+        const auto result = to_chars(chars.data(), chars.data() + chars.size(), value);
+        return {chars.data(), static_cast<size_t>(result.ptr - chars.data())};
+    }
+
+    OutputBuffer::OutputBuffer(ostream& sink, FlushPolicy policy, size_t chunk_size)
+        : sink_(sink)
+        , policy_(policy)
+        , chunk_size_(chunk_size)
+        , stream_(this) {
+    }
+
+    OutputBuffer::~OutputBuffer() {
+        Flush();
+    }
+
+    void OutputBuffer::Flush() {
+        Spill();
+        sink_.flush();
+    }
+
+    void OutputBuffer::Spill() {
+        if (!data_.empty()) {
+            sink_.write(data_.data(), static_cast<streamsize>(data_.size()));
+            data_.clear();
+        }
+        if (policy_ == FlushPolicy::Line) {
+            sink_.flush();
+        }
+    }
+
+    OutputBuffer::int_type OutputBuffer::overflow(int_type c) {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            Put(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    streamsize OutputBuffer::xsputn(const char* s, streamsize count) {
+        Write({s, static_cast<size_t>(count)});
+        return count;
+    }
+
+    int OutputBuffer::sync() {
+        Flush();
+        return 0;
+    }
+
+}  // namespace runtime
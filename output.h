@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+namespace runtime {
+
+    // Наибольшая длина десятичной записи int вместе со знаком
+    inline constexpr std::size_t MAX_NUMBER_CHARS = std::numeric_limits<int>::digits10 + 2;
+
+    using NumberChars = std::array<char, MAX_NUMBER_CHARS>;
+
+    // Записывает в chars десятичное представление value без учёта локали
+    // и возвращает его. Результат действителен, пока жив chars
+    std::string_view FormatNumber(int value, NumberChars& chars);
+
+    // Буфер вывода программы. Накапливает текст в растущем массиве байтов и передаёт его
+    // в поток sink крупными порциями, избавляя команду print от накладных расходов ostream.
+    // Числа форматируются через to_chars. Объекты, которые умеют выводиться только в ostream,
+    // пишут через Stream() в тот же буфер, так что порядок вывода сохраняется
+    class OutputBuffer : private std::streambuf {
+    public:
+        // Когда содержимое буфера передаётся в sink
+        enum class FlushPolicy {
+            // Как только в буфере накопилось не меньше chunk_size байтов
+            Chunked,
+            // После каждого перевода строки, для интерактивной работы
+            Line,
+            // Только при вызове Flush и в деструкторе
+            AtExit,
+        };
+
+        static constexpr std::size_t DEFAULT_CHUNK_SIZE = 1U << 16;
+
+        explicit OutputBuffer(std::ostream& sink, FlushPolicy policy = FlushPolicy::Chunked,
+                              std::size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        // Передаёт в sink остаток буфера
+        ~OutputBuffer() override;
+
+        void Write(std::string_view text) {
+            data_.insert(data_.end(), text.begin(), text.end());
+            if (policy_ == FlushPolicy::Chunked
+                    ? data_.size() >= chunk_size_
+                    : policy_ == FlushPolicy::Line && text.find('\n') != std::string_view::npos) {
+                Spill();
+            }
+        }
+
+        void Put(char c) {
+            data_.push_back(c);
+            if (policy_ == FlushPolicy::Chunked ? data_.size() >= chunk_size_
+                                                : policy_ == FlushPolicy::Line && c == '\n') {
+                Spill();
+            }
+        }
+
+        void WriteNumber(int value) {
+            NumberChars chars;
+            Write(FormatNumber(value, chars));
+        }
+
+        // Возвращает поток, пишущий в этот буфер
+        [[nodiscard]] std::ostream& Stream() {
+            return stream_;
+        }
+
+        // Передаёт содержимое буфера в sink и сбрасывает сам sink
+        void Flush();
+
+        [[nodiscard]] FlushPolicy GetPolicy() const {
+            return policy_;
+        }
+
+        // Возвращает число байтов, ещё не переданных в sink
+        [[nodiscard]] std::size_t Pending() const {
+            return data_.size();
+        }
+
+    private:
+        // Передаёт содержимое буфера в sink. При построчной политике sink также сбрасывается
+        void Spill();
+
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* s, std::streamsize count) override;
+        int sync() override;
+
+        std::ostream& sink_;
+        FlushPolicy policy_;
+        std::size_t chunk_size_;
+        std::vector<char> data_;
+        std::ostream stream_;
+    };
+
+}  // namespace runtime
@@ -1,5 +1,6 @@
 #include "parse.h"
 
+#include "arena.h"
 #include "lexer.h"
 #include "statement.h"
 
@@ -8,6 +9,9 @@ using namespace std;
 namespace TokenType = parse::token_type;
 
 namespace {
+const runtime::Symbol SELF_NAME = "self"s;
+const runtime::Symbol STR_FUNCTION = "str"s;
+
 bool operator==(const parse::Token& token, char c) {
     const auto* p = token.TryAs<TokenType::Char>();
     return p != nullptr && p->value == c;
@@ -19,8 +23,9 @@ bool operator!=(const parse::Token& token, char c) {
 
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    Parser(parse::Lexer& lexer, runtime::Closure& declared_classes)
+        : lexer_(lexer)
+        , declared_classes_(declared_classes) {
     }
 
     // Program -> eps
@@ -34,6 +39,14 @@ public:
         return result;
     }
 
+    // Удаляет из таблицы классы, объявленные при разборе
+    void ForgetNewClasses() {
+        for (const auto& name : new_classes_) {
+            declared_classes_.erase(name);
+        }
+        new_classes_.clear();
+    }
+
 private:
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<ast::Statement> ParseSuite()  // NOLINT
@@ -61,14 +74,17 @@ private:
 
         while (lexer_.CurrentToken().Is<TokenType::Def>()) {
             runtime::Method m;
+            MethodScope& scope = scopes_.emplace_back();
+            scope.slots.emplace(SELF_NAME, 0);
+            scope.size = 1;
 
-            m.name = lexer_.ExpectNext<TokenType::Id>().value;
+            m.name = lexer_.ExpectNext<TokenType::Id>().symbol;
             lexer_.ExpectNext<TokenType::Char>('(');
 
             if (lexer_.NextToken().Is<TokenType::Id>()) {
-                m.formal_params.push_back(lexer_.Expect<TokenType::Id>().value);
+                m.formal_params.push_back(lexer_.Expect<TokenType::Id>().symbol);
                 while (lexer_.NextToken() == ',') {
-                    m.formal_params.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+                    m.formal_params.push_back(lexer_.ExpectNext<TokenType::Id>().symbol);
                 }
             }
 
@@ -76,7 +92,15 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
+            // Параметры занимают слоты 1..n. При повторе имени, как и при заполнении Closure,
+            // переменная ссылается на первый из одноимённых параметров
+            for (const auto& param : m.formal_params) {
+                scopes_.back().slots.emplace(param, scopes_.back().size++);
+            }
+
             m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            m.frame_size = scopes_.back().size;
+            scopes_.pop_back();
 
             result.push_back(std::move(m));
         }
@@ -86,13 +110,13 @@ private:
     // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
     unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
     {
-        string class_name = lexer_.Expect<TokenType::Id>().value;
+        string class_name{lexer_.Expect<TokenType::Id>().value};
 
         lexer_.NextToken();
 
         const runtime::Class* base_class = nullptr;
         if (lexer_.CurrentToken() == '(') {
-            auto name = lexer_.ExpectNext<TokenType::Id>().value;
+            string name{lexer_.ExpectNext<TokenType::Id>().value};
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
 
@@ -120,15 +144,17 @@ private:
         if (!inserted) {
             throw parse::ParseError("Class "s + class_name + " already exists"s);
         }
+        new_classes_.push_back(it->first);
 
         return make_unique<ast::ClassDefinition>(it->second);
     }
 
-    vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+    vector<runtime::Symbol> ParseDottedIds() {
+        vector<runtime::Symbol> result;
+        result.push_back(lexer_.Expect<TokenType::Id>().symbol);
 
         while (lexer_.NextToken() == '.') {
-            result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
+            result.push_back(lexer_.ExpectNext<TokenType::Id>().symbol);
         }
 
         return result;
@@ -139,24 +165,25 @@ private:
     unique_ptr<ast::Statement> ParseAssignmentOrCall() {
         lexer_.Expect<TokenType::Id>();
 
-        vector<string> id_list = ParseDottedIds();
-        string last_name = id_list.back();
+        vector<runtime::Symbol> id_list = ParseDottedIds();
+        const runtime::Symbol last_name = id_list.back();
         id_list.pop_back();
 
         if (lexer_.CurrentToken() == '=') {
             lexer_.NextToken();
 
             if (id_list.empty()) {
-                return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
+                const size_t slot = ResolveSlot(last_name);
+                return make_unique<ast::Assignment>(last_name, ParseTest(), slot);
             }
-            return make_unique<ast::FieldAssignment>(ast::VariableValue{std::move(id_list)},
-                                                     std::move(last_name), ParseTest());
+            return make_unique<ast::FieldAssignment>(MakeVariableValue(std::move(id_list)),
+                                                     last_name, ParseTest());
         }
         lexer_.Expect<TokenType::Char>('(');
         lexer_.NextToken();
 
         if (id_list.empty()) {
-            throw parse::ParseError("Mython doesn't support functions, only methods: "s + last_name);
+            throw parse::ParseError("Mython doesn't support functions, only methods: "s + last_name.Str());
         }
 
         vector<unique_ptr<ast::Statement>> args;
@@ -166,8 +193,9 @@ private:
         lexer_.Expect<TokenType::Char>(')');
         lexer_.NextToken();
 
-        return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                                            std::move(last_name), std::move(args));
+        return make_unique<ast::MethodCall>(
+            make_unique<ast::VariableValue>(MakeVariableValue(std::move(id_list))),
+            last_name, std::move(args));
     }
 
     // Expr -> Adder ['+'/'-' Adder]*
@@ -253,7 +281,7 @@ private:
     }
 
     std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-        vector<string> names = ParseDottedIds();
+        vector<runtime::Symbol> names = ParseDottedIds();
 
         if (lexer_.CurrentToken() == '(') {
             // various calls
@@ -264,27 +292,27 @@ private:
             lexer_.Expect<TokenType::Char>(')');
             lexer_.NextToken();
 
-            auto method_name = names.back();
+            const runtime::Symbol method_name = names.back();
             names.pop_back();
 
             if (!names.empty()) {
                 return make_unique<ast::MethodCall>(
-                    make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                    std::move(args));
+                    make_unique<ast::VariableValue>(MakeVariableValue(std::move(names))),
+                    method_name, std::move(args));
             }
             if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
                 return make_unique<ast::NewInstance>(
                     static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
             }
-            if (method_name == "str"sv) {
+            if (method_name == STR_FUNCTION) {
                 if (args.size() != 1) {
                     throw parse::ParseError("Function str takes exactly one argument"s);
                 }
                 return make_unique<ast::Stringify>(std::move(args.front()));
             }
-            throw parse::ParseError("Unknown call to "s + method_name + "()"s);
+            throw parse::ParseError("Unknown call to "s + method_name.Str() + "()"s);
         }
-        return make_unique<ast::VariableValue>(std::move(names));
+        return make_unique<ast::VariableValue>(MakeVariableValue(std::move(names)));
     }
 
     vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
@@ -365,33 +393,33 @@ private:
 
         if (tok == '<') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Less, std::move(result),
+            return make_unique<ast::Comparison>(runtime::Comparator::Less, std::move(result),
                                                 ParseExpression());
         }
         if (tok == '>') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
+            return make_unique<ast::Comparison>(runtime::Comparator::Greater, std::move(result),
                                                 ParseExpression());
         }
         if (tok.Is<TokenType::Eq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
+            return make_unique<ast::Comparison>(runtime::Comparator::Equal, std::move(result),
                                                 ParseExpression());
         }
         if (tok.Is<TokenType::NotEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                ParseExpression());
+            return make_unique<ast::Comparison>(runtime::Comparator::NotEqual,
+                                                std::move(result), ParseExpression());
         }
         if (tok.Is<TokenType::LessOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                ParseExpression());
+            return make_unique<ast::Comparison>(runtime::Comparator::LessOrEqual,
+                                                std::move(result), ParseExpression());
         }
         if (tok.Is<TokenType::GreaterOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                ParseExpression());
+            return make_unique<ast::Comparison>(runtime::Comparator::GreaterOrEqual,
+                                                std::move(result), ParseExpression());
         }
         return result;
     }
@@ -437,12 +465,59 @@ private:
         return ParseAssignmentOrCall();
     }
 
+    // Возвращает слот переменной name в разбираемом методе, назначая новый при первом
+    // упоминании. Переменные программы верхнего уровня слотов не получают
+    size_t ResolveSlot(runtime::Symbol name) {
+        if (scopes_.empty()) {
+            return ast::NO_SLOT;
+        }
+        MethodScope& scope = scopes_.back();
+        auto [it, inserted] = scope.slots.emplace(name, scope.size);
+        if (inserted) {
+            ++scope.size;
+        }
+        return it->second;
+    }
+
+    ast::VariableValue MakeVariableValue(vector<runtime::Symbol> dotted_ids) {
+        const size_t slot = ResolveSlot(dotted_ids.front());
+        return ast::VariableValue(std::move(dotted_ids), slot);
+    }
+
+    // Слоты переменных разбираемого метода
+    struct MethodScope {
+        unordered_map<runtime::Symbol, size_t> slots;
+        size_t size = 0;
+    };
+
     parse::Lexer& lexer_;
-    runtime::Closure declared_classes_;
+    runtime::Closure& declared_classes_;
+    // Классы, добавленные в declared_classes_ этим парсером
+    vector<runtime::Symbol> new_classes_;
+    // Методы классов, объявленных внутри метода, разбираются во вложенных областях
+    vector<MethodScope> scopes_;
 };
 
 }  // namespace
 
 unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
-}
\ No newline at end of file
+    // Узлы программы размещаются в арене и освобождаются вместе с последним из них
+    runtime::ArenaScope arena;
+    runtime::Closure declared_classes;
+    return Parser{lexer, declared_classes}.ParseProgram();
+}
+
+namespace parse {
+
+    unique_ptr<runtime::Executable> IncrementalParser::ParseChunk(Lexer& lexer) {
+        runtime::ArenaScope arena;
+        Parser parser{lexer, declared_classes_};
+        try {
+            return parser.ParseProgram();
+        } catch (...) {
+            parser.ForgetNewClasses();
+            throw;
+        }
+    }
+
+}  // namespace parse
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "runtime.h"
+
 #include <memory>
 #include <stdexcept>
 
@@ -9,10 +11,20 @@ namespace parse {
     struct ParseError : std::runtime_error {
         using std::runtime_error::runtime_error;
     };
-}
 
-namespace runtime {
-    class Executable;
+    // Разбирает программу по частям, например блоки интерактивного сеанса. Каждая часть
+    // разбирается своим лексером и выполняется сама по себе, а классы, объявленные в прежних
+    // частях, доступны следующим. Прежние части повторно не разбираются.
+    // Классы хранятся в парсере, поэтому он должен пережить программы всех частей
+    class IncrementalParser {
+    public:
+        // Разбирает очередную часть программы. Если разбор завершился ошибкой, классы,
+        // объявленные в этой части, забываются, и исправленную часть можно разобрать снова
+        std::unique_ptr<runtime::Executable> ParseChunk(Lexer& lexer);
+
+    private:
+        runtime::Closure declared_classes_;
+    };
 }
 
 std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
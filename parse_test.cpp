@@ -1,3 +1,4 @@
+#include "arena.h"
 #include "lexer.h"
 #include "parse.h"
 #include "statement.h"
@@ -244,6 +245,133 @@ print r, c, t1, t2
                  "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
 }
 
+void TestMethodSlots() {
+    const string program = R"(
+class Counter:
+  def __init__(start, start):
+    self.value = start
+
+  def add(step):
+    if step > 0:
+      total = self.value + step
+    self.value = total
+    return total
+
+c = Counter(1, 2)
+print c.add(2), c.value
+c.add(0)
+)"s;
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    ASSERT_THROWS(tree->Execute(closure, context), std::runtime_error);
+    ASSERT_EQUAL(context.output.str(), "3 3\n"s);
+    ASSERT(context.GetFrame() == nullptr);
+
+    const auto* cls = closure.at("Counter"s).TryAs<runtime::Class>();
+    ASSERT(cls != nullptr);
+    // self, два параметра start
+    ASSERT_EQUAL(cls->GetMethod("__init__"s)->frame_size, 3U);
+    // self, step, total
+    ASSERT_EQUAL(cls->GetMethod("add"s)->frame_size, 3U);
+    // Переменные верхнего уровня остаются в Closure
+    ASSERT(closure.count("c"s) == 1);
+}
+
+void TestFramesOnValueStack() {
+    const string program = R"(
+class Node:
+  def __init__(value, rest):
+    self.value = value
+    self.rest = rest
+
+class Builder:
+  def build(n, rest):
+    if n == 0:
+      return rest
+    return self.build(n - 1, Node(n, rest))
+
+  def sum(node, n, acc):
+    if n == 0:
+      return acc
+    return self.sum(node.rest, n - 1, acc + node.value)
+
+  def fail(n):
+    if n == 0:
+      return 1 / 0
+    return self.fail(n - 1)
+
+b = Builder()
+print b.sum(b.build(500, None), 500, 0)
+b.fail(100)
+)"s;
+
+    runtime::ValueStack& stack = runtime::ValueStack::ForCurrentThread();
+    const auto* top = &runtime::StackFrame(stack, 1)[0];
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    auto tree = ParseProgramFromString(program);
+    ASSERT_THROWS(tree->Execute(closure, context), std::runtime_error);
+    ASSERT_EQUAL(context.output.str(), "125250\n"s);
+    // Кадры всех вызовов, в том числе прерванных исключением, сняты со стека
+    runtime::StackFrame probe(stack, 1);
+    ASSERT(&probe[0] == top);
+    ASSERT(!probe[0].has_value());
+}
+
+void TestArenaOwnership() {
+    auto tree = ParseProgramFromString(R"(
+class Greeter:
+  def greet(name):
+    return 'Hello, ' + name
+
+g = Greeter()
+)"s);
+    ASSERT(runtime::Arena::IsArenaAllocated(tree.get()));
+    ASSERT(!runtime::Arena::IsArenaAllocated(make_unique<ast::None>().get()));
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    // Класс в closure переживает дерево программы, а вместе с ним и узлы своих методов
+    closure.erase("g"s);
+    tree.reset();
+    const auto* cls = closure.at("Greeter"s).TryAs<runtime::Class>();
+    ASSERT(cls != nullptr);
+    runtime::ClassInstance greeter(*cls);
+    auto result = greeter.Call("greet"s, {runtime::ObjectHolder::Own(runtime::String("Mython"s))},
+                               context);
+    ASSERT_EQUAL(result.TryAs<runtime::String>()->GetValue(), "Hello, Mython"s);
+
+    ASSERT_THROWS(ParseProgramFromString("x = Unknown(1)\n"s), ParseError);
+}
+
+void TestIncrementalParser() {
+    IncrementalParser parser;
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    auto run = [&](const string& chunk) {
+        istringstream is(chunk);
+        Lexer lexer(is);
+        parser.ParseChunk(lexer)->Execute(closure, context);
+    };
+
+    run("class Base:\n  def value():\n    return 1\n"s);
+    // Классы прежних частей доступны для наследования и создания экземпляров
+    run("class Derived(Base):\n  def twice():\n    return self.value() * 2\n"s);
+    run("d = Derived()\n"s);
+    run("print d.twice()\n"s);
+    ASSERT_EQUAL(context.output.str(), "2\n"s);
+
+    ASSERT_THROWS(run("class Base:\n  def other():\n    return 3\n"s), ParseError);
+    // Класс части с ошибкой забывается
+    ASSERT_THROWS(run("class Broken(Base):\n  def f():\n    return 3\nx = Unknown()\n"s),
+                  ParseError);
+    run("class Broken(Derived):\n  def f():\n    return 3\nb = Broken()\nprint b.f()\n"s);
+    ASSERT_EQUAL(context.output.str(), "2\n3\n"s);
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -255,4 +383,8 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestMethodSlots);
+    RUN_TEST(tr, parse::TestFramesOnValueStack);
+    RUN_TEST(tr, parse::TestArenaOwnership);
+    RUN_TEST(tr, parse::TestIncrementalParser);
 }
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "profiler.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+using namespace std;
+
+namespace runtime {
+
+    Profiler::Scope::Scope(Profiler& profiler, string_view name)
+        : profiler_(profiler) {
+        profiler_.Enter(profiler_.FunctionFor(name));
+    }
+
+    Profiler::Scope::Scope(Profiler& profiler, const Class& cls, const Method& method)
+        : profiler_(profiler) {
+        profiler_.Enter(profiler_.FunctionFor(cls, method));
+    }
+
+    Profiler::Scope::~Scope() {
+        profiler_.Exit();
+    }
+
+    Profiler::NodeScope::NodeScope(Profiler& profiler, const char* kind)
+        : profiler_(profiler) {
+        profiler_.EnterNode(kind);
+    }
+
+    Profiler::NodeScope::~NodeScope() {
+        profiler_.ExitNode();
+    }
+
+    size_t Profiler::AddFunction(string name) {
+        functions_.push_back(Function{std::move(name), {}, 0});
+        return functions_.size() - 1;
+    }
+
+    size_t Profiler::FunctionFor(const Class& cls, const Method& method) {
+        if (auto found = method_functions_.find(&method); found != method_functions_.end()) {
+            return found->second;
+        }
+        // Унаследованный метод называется по классу, в котором он объявлен
+        const Class* owner = &cls;
+        for (const Class* c = &cls; c != nullptr; c = c->GetParent()) {
+            const auto& methods = c->Methods();
+            if (!methods.empty() && &method >= methods.data()
+                && &method < methods.data() + methods.size()) {
+                owner = c;
+                break;
+            }
+        }
+        const size_t function = FunctionFor(owner->GetName() + "."s + method.name.Str());
+        method_functions_.emplace(&method, function);
+        return function;
+    }
+
+    size_t Profiler::FunctionFor(string_view name) {
+        string key(name);
+        if (auto found = named_functions_.find(key); found != named_functions_.end()) {
+            return found->second;
+        }
+        const size_t function = AddFunction(key);
+        named_functions_.emplace(std::move(key), function);
+        return function;
+    }
+
+    void Profiler::Enter(size_t function) {
+        const size_t parent = frames_.empty() ? ROOT : frames_.back().path;
+        const auto [found, inserted] = paths_[parent].children.try_emplace(function, paths_.size());
+        const size_t path = found->second;
+        if (inserted) {
+            paths_.push_back(CallPath{function, parent, {}, {}});
+        }
+        Function& entry = functions_[function];
+        ++entry.stats.calls;
+        ++entry.active;
+        frames_.push_back(Frame{path, Clock::now(), {}});
+    }
+
+    void Profiler::Exit() {
+        const auto elapsed = Clock::now() - frames_.back().start;
+        const Frame frame = frames_.back();
+        frames_.pop_back();
+
+        const auto exclusive = elapsed - frame.children;
+        CallPath& path = paths_[frame.path];
+        path.exclusive += exclusive;
+        Function& entry = functions_[path.function];
+        entry.stats.exclusive += exclusive;
+        if (--entry.active == 0) {
+            entry.stats.inclusive += elapsed;
+        }
+        if (!frames_.empty()) {
+            frames_.back().children += elapsed;
+        } else {
+            // Методы завершившейся программы могут быть освобождены, и их адреса достанутся
+            // методам следующей
+            method_functions_.clear();
+        }
+    }
+
+    void Profiler::EnterNode(const char* kind) {
+        const auto [found, inserted] = node_indices_.try_emplace(kind, node_kinds_.size());
+        if (inserted) {
+            node_kinds_.push_back(Function{kind, {}, 0});
+        }
+        Function& entry = node_kinds_[found->second];
+        ++entry.stats.calls;
+        ++entry.active;
+        node_frames_.push_back(NodeFrame{found->second, Clock::now(), {}});
+    }
+
+    void Profiler::ExitNode() {
+        const auto elapsed = Clock::now() - node_frames_.back().start;
+        const NodeFrame frame = node_frames_.back();
+        node_frames_.pop_back();
+
+        Function& entry = node_kinds_[frame.kind];
+        entry.stats.exclusive += elapsed - frame.children;
+        if (--entry.active == 0) {
+            entry.stats.inclusive += elapsed;
+        }
+        if (!node_frames_.empty()) {
+            node_frames_.back().children += elapsed;
+        }
+    }
+
+    vector<pair<string, Profiler::Stats>> Profiler::Sorted(const vector<Function>& functions) {
+        vector<pair<string, Stats>> result;
+        result.reserve(functions.size());
+        for (const Function& function : functions) {
+            result.emplace_back(function.name, function.stats);
+        }
+        stable_sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second.exclusive > rhs.second.exclusive;
+        });
+        return result;
+    }
+
+    vector<pair<string, Profiler::Stats>> Profiler::GetFunctionStats() const {
+        return Sorted(functions_);
+    }
+
+    vector<pair<string, Profiler::Stats>> Profiler::GetNodeStats() const {
+        return Sorted(node_kinds_);
+    }
+
+    namespace {
+        // Пробелы и ';' разделяют кадры и значение в свёрнутом формате
+        void WriteFrameName(ostream& out, const string& name) {
+            for (char c : name) {
+                out << (c == ';' || c == ' ' ? '_' : c);
+            }
+        }
+
+        double Milliseconds(Profiler::Clock::duration duration) {
+            return chrono::duration<double, milli>(duration).count();
+        }
+
+        void WriteTable(ostream& out, string_view title,
+                        const vector<pair<string, Profiler::Stats>>& stats) {
+            size_t width = title.size();
+            for (const auto& [name, _] : stats) {
+                width = max(width, name.size());
+            }
+            out << left << setw(static_cast<int>(width)) << title << right << setw(12) << "calls"
+                << setw(16) << "inclusive ms" << setw(16) << "exclusive ms" << '\n';
+            out << fixed << setprecision(3);
+            for (const auto& [name, stat] : stats) {
+                out << left << setw(static_cast<int>(width)) << name << right << setw(12)
+                    << stat.calls << setw(16) << Milliseconds(stat.inclusive) << setw(16)
+                    << Milliseconds(stat.exclusive) << '\n';
+            }
+        }
+    }  // namespace
+
+    void Profiler::WriteCollapsedStacks(ostream& out) const {
+        vector<size_t> stack;
+        for (size_t i = 1; i < paths_.size(); ++i) {
+            const auto exclusive = chrono::duration_cast<chrono::nanoseconds>(paths_[i].exclusive);
+            if (exclusive.count() <= 0) {
+                continue;
+            }
+            stack.clear();
+            for (size_t path = i; path != ROOT; path = paths_[path].parent) {
+                stack.push_back(paths_[path].function);
+            }
+            for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+                if (it != stack.rbegin()) {
+                    out << ';';
+                }
+                WriteFrameName(out, functions_[*it].name);
+            }
+            out << ' ' << exclusive.count() << '\n';
+        }
+    }
+
+    void Profiler::WriteReport(ostream& out) const {
+        WriteTable(out, "function"sv, GetFunctionStats());
+        if (!node_kinds_.empty()) {
+            out << '\n';
+            WriteTable(out, "node"sv, GetNodeStats());
+        }
+    }
+
+}  // namespace runtime
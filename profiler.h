@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace runtime {
+
+    class Class;
+    struct Method;
+
+    // Профилировщик выполнения. Подключается к контексту (Context::SetProfiler) и считает
+    // число вызовов, полное и собственное время методов классов и видов узлов дерева, а также
+    // собирает дерево стеков вызовов методов для flamegraph.
+    // Полное время рекурсивного метода учитывается один раз - по внешнему вызову.
+    // Собственное время метода не включает вложенные вызовы методов, а узла - вложенные узлы.
+    // Профилировщик не потокобезопасен: у каждого выполнения должен быть свой
+    class Profiler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Stats {
+            std::uint64_t calls = 0;
+            Clock::duration inclusive{};
+            Clock::duration exclusive{};
+        };
+
+        // Кадр стека вызовов: именованный участок верхнего уровня (например, программа)
+        // либо метод. Открыт от конструктора до деструктора
+        class Scope {
+        public:
+            Scope(Profiler& profiler, std::string_view name);
+            Scope(Profiler& profiler, const Class& cls, const Method& method);
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope();
+
+        private:
+            Profiler& profiler_;
+        };
+
+        // Выполнение узла вида kind. Строка kind должна жить не меньше профилировщика
+        class NodeScope {
+        public:
+            NodeScope(Profiler& profiler, const char* kind);
+
+            NodeScope(const NodeScope&) = delete;
+            NodeScope& operator=(const NodeScope&) = delete;
+
+            ~NodeScope();
+
+        private:
+            Profiler& profiler_;
+        };
+
+        // Возвращает статистику методов и именованных участков, упорядоченную по убыванию
+        // собственного времени. Методы называются "<класс>.<метод>" по классу, где объявлен метод
+        [[nodiscard]] std::vector<std::pair<std::string, Stats>> GetFunctionStats() const;
+
+        // Возвращает статистику видов узлов, упорядоченную по убыванию собственного времени
+        [[nodiscard]] std::vector<std::pair<std::string, Stats>> GetNodeStats() const;
+
+        // Выводит стеки в свёрнутом формате flamegraph: по строке на каждый путь в дереве
+        // вызовов, имена кадров через ';' и собственное время пути в наносекундах
+        void WriteCollapsedStacks(std::ostream& out) const;
+
+        // Выводит таблицы статистики методов и узлов
+        void WriteReport(std::ostream& out) const;
+
+    private:
+        struct Function {
+            std::string name;
+            Stats stats;
+            // Число незавершённых вызовов, нужно для учёта рекурсии
+            std::uint32_t active = 0;
+        };
+
+        // Узел дерева вызовов: путь от корня до функции
+        struct CallPath {
+            std::size_t function;
+            std::size_t parent;
+            Clock::duration exclusive{};
+            std::unordered_map<std::size_t, std::size_t> children;
+        };
+
+        struct Frame {
+            std::size_t path;
+            Clock::time_point start;
+            Clock::duration children{};
+        };
+
+        struct NodeFrame {
+            std::size_t kind;
+            Clock::time_point start;
+            Clock::duration children{};
+        };
+
+        static constexpr std::size_t ROOT = 0;
+
+        std::size_t FunctionFor(const Class& cls, const Method& method);
+        std::size_t FunctionFor(std::string_view name);
+        std::size_t AddFunction(std::string name);
+        void Enter(std::size_t function);
+        void Exit();
+        void EnterNode(const char* kind);
+        void ExitNode();
+        [[nodiscard]] static std::vector<std::pair<std::string, Stats>> Sorted(
+            const std::vector<Function>& functions);
+
+        std::vector<Function> functions_;
+        // Функции методов по адресу. Действительны, пока открыт хотя бы один кадр, а функции
+        // по имени "<класс>.<метод>" хранятся в named_functions_
+        std::unordered_map<const Method*, std::size_t> method_functions_;
+        std::unordered_map<std::string, std::size_t> named_functions_;
+        // Нулевой путь - корень без функции
+        std::vector<CallPath> paths_{CallPath{0, 0, {}, {}}};
+        std::vector<Frame> frames_;
+
+        std::vector<Function> node_kinds_;
+        std::unordered_map<const char*, std::size_t> node_indices_;
+        std::vector<NodeFrame> node_frames_;
+    };
+
+}  // namespace runtime
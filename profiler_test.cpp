@@ -0,0 +1,194 @@
+#include "compiler.h"
+#include "instrument.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "profiler.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+const string PROGRAM = R"(
+class Base:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+class Derived(Base):
+  def run():
+    return self.fib(10)
+
+d = Derived()
+print d.run()
+)";
+
+enum class Mode {
+    Tree,
+    Instrumented,
+    Bytecode,
+};
+
+// Выполняет PROGRAM с профилировщиком profiler (если он задан) и возвращает её вывод
+string Execute(Mode mode, Profiler* profiler) {
+    parse::Lexer lexer{string_view(PROGRAM)};
+    auto program = ast::Optimize(ParseProgram(lexer));
+    if (mode == Mode::Instrumented) {
+        program = ast::Instrument(std::move(program));
+    } else if (mode == Mode::Bytecode) {
+        program = bytecode::Compile(std::move(program));
+    }
+    ostringstream output;
+    SimpleContext context{output};
+    context.SetProfiler(profiler);
+    Closure closure;
+    if (profiler != nullptr) {
+        Profiler::Scope scope(*profiler, "program"sv);
+        program->Execute(closure, context);
+    } else {
+        program->Execute(closure, context);
+    }
+    context.Flush();
+    return output.str();
+}
+
+const Profiler::Stats* Find(const vector<pair<string, Profiler::Stats>>& stats,
+                            const string& name) {
+    auto found = find_if(stats.begin(), stats.end(), [&name](const auto& entry) {
+        return entry.first == name;
+    });
+    return found != stats.end() ? &found->second : nullptr;
+}
+
+void TestMethodCalls() {
+    for (Mode mode : {Mode::Tree, Mode::Instrumented, Mode::Bytecode}) {
+        Profiler profiler;
+        ASSERT_EQUAL(Execute(mode, &profiler), "55\n"s);
+
+        const auto stats = profiler.GetFunctionStats();
+        ASSERT_EQUAL(stats.size(), 3U);
+        // Унаследованный метод называется по классу, в котором объявлен
+        const auto* fib = Find(stats, "Base.fib"s);
+        ASSERT(fib != nullptr);
+        ASSERT_EQUAL(fib->calls, 177U);
+        const auto* run = Find(stats, "Derived.run"s);
+        ASSERT(run != nullptr);
+        ASSERT_EQUAL(run->calls, 1U);
+        const auto* program = Find(stats, "program"s);
+        ASSERT(program != nullptr);
+        ASSERT_EQUAL(program->calls, 1U);
+
+        // Рекурсия не удваивает полное время, а собственное время не превышает полного
+        ASSERT(fib->inclusive <= run->inclusive);
+        ASSERT(run->inclusive <= program->inclusive);
+        ASSERT(fib->exclusive <= fib->inclusive);
+        ASSERT(program->exclusive + run->exclusive + fib->exclusive <= program->inclusive);
+
+        ASSERT_EQUAL(profiler.GetNodeStats().empty(), mode != Mode::Instrumented);
+    }
+}
+
+void TestNodeStats() {
+    Profiler profiler;
+    Execute(Mode::Instrumented, &profiler);
+    const auto stats = profiler.GetNodeStats();
+
+    const auto* call = Find(stats, "MethodCall"s);
+    ASSERT(call != nullptr);
+    ASSERT_EQUAL(call->calls, 178U);
+    const auto* add = Find(stats, "Add"s);
+    ASSERT(add != nullptr);
+    ASSERT_EQUAL(add->calls, 88U);
+    const auto* print = Find(stats, "Print"s);
+    ASSERT(print != nullptr);
+    ASSERT_EQUAL(print->calls, 1U);
+    ASSERT(Find(stats, "Other"s) == nullptr);
+    for (size_t i = 1; i < stats.size(); ++i) {
+        ASSERT(stats[i - 1].second.exclusive >= stats[i].second.exclusive);
+    }
+
+    // Без профилировщика инструментированная программа выводит то же самое
+    ASSERT_EQUAL(Execute(Mode::Instrumented, nullptr), Execute(Mode::Tree, nullptr));
+}
+
+void TestCollapsedStacks() {
+    Profiler profiler;
+    Execute(Mode::Bytecode, &profiler);
+    ostringstream out;
+    profiler.WriteCollapsedStacks(out);
+
+    istringstream lines(out.str());
+    size_t count = 0;
+    bool nested = false;
+    for (string line; getline(lines, line); ++count) {
+        const size_t space = line.rfind(' ');
+        ASSERT(space != string::npos);
+        ASSERT(line.substr(space + 1).find_first_not_of("0123456789"s) == string::npos);
+        const string stack = line.substr(0, space);
+        ASSERT(stack.find("program"s) == 0);
+        nested = nested || stack == "program;Derived.run;Base.fib;Base.fib"s;
+    }
+    // Пути: program, run и цепочки fib длиной от 1 до 10
+    ASSERT(count <= 12U);
+    ASSERT(nested);
+
+    // Пробелы и ';' в именах заменяются, чтобы не нарушить формат
+    Profiler named;
+    {
+        Profiler::Scope scope(named, "a b;c"sv);
+        Profiler::Scope inner(named, "d"sv);
+        for (volatile int i = 0; i < 1000; ++i) {
+        }
+    }
+    ostringstream named_out;
+    named.WriteCollapsedStacks(named_out);
+    ASSERT(named_out.str().find("a_b_c;d "s) != string::npos);
+
+    ostringstream report;
+    named.WriteReport(report);
+    ASSERT(report.str().find("function"s) == 0);
+    ASSERT(report.str().find("a b;c"s) != string::npos);
+}
+
+void TestReusedMethods() {
+    Profiler profiler;
+    vector<Method> methods(1);
+    methods[0].name = "m1"s;
+    Class cls("K"s, std::move(methods), nullptr);
+    auto run = [&profiler, &cls](string_view program) {
+        Profiler::Scope scope(profiler, program);
+        Profiler::Scope call(profiler, cls, cls.Methods()[0]);
+    };
+    run("p1"sv);
+    // Метод следующей программы занимает память метода завершившейся
+    cls.Methods()[0].name = "m2"s;
+    run("p2"sv);
+    run("p3"sv);
+
+    const auto stats = profiler.GetFunctionStats();
+    ASSERT_EQUAL(Find(stats, "K.m1"s)->calls, 1U);
+    ASSERT_EQUAL(Find(stats, "K.m2"s)->calls, 2U);
+    ostringstream out;
+    profiler.WriteCollapsedStacks(out);
+    ASSERT(out.str().find("p2;K.m2 "s) != string::npos);
+    ASSERT(out.str().find("p2;K.m1 "s) == string::npos);
+}
+
+}  // namespace
+
+void RunProfilerTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestMethodCalls);
+    RUN_TEST(tr, runtime::TestNodeStats);
+    RUN_TEST(tr, runtime::TestCollapsedStacks);
+    RUN_TEST(tr, runtime::TestReusedMethods);
+}
+
+}  // namespace runtime
@@ -0,0 +1,689 @@
+#include "program_cache.h"
+
+#include "arena.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MYTHON_HAS_MMAP 1
+#endif
+
+using namespace std;
+
+namespace cache {
+
+    namespace {
+        using runtime::ObjectHolder;
+        using runtime::Symbol;
+
+        // Заголовок образа: MAGIC, версия формата, хеш исходника и хеш остальной части образа
+        constexpr char MAGIC[4] = {'M', 'Y', 'C', '\0'};
+        constexpr uint32_t FORMAT_VERSION = 2;
+        constexpr size_t SOURCE_HASH_OFFSET = sizeof(MAGIC) + sizeof(uint32_t);
+        constexpr size_t PAYLOAD_HASH_OFFSET = SOURCE_HASH_OFFSET + sizeof(uint64_t);
+        constexpr size_t HEADER_SIZE = PAYLOAD_HASH_OFFSET + sizeof(uint64_t);
+
+        // Виды узлов в образе
+        enum class Tag : uint8_t {
+            Absent,  // отсутствующий узел, например ветка else
+            None,
+            NumericConst,
+            StringConst,
+            BoolConst,
+            VariableValue,
+            Assignment,
+            FieldAssignment,
+            Print,
+            MethodCall,
+            NewInstance,
+            Stringify,
+            Add,
+            Sub,
+            Mult,
+            Div,
+            Or,
+            And,
+            Not,
+            Compound,
+            MethodBody,
+            Return,
+            ClassDefinition,
+            IfElse,
+            Comparison,
+        };
+
+        constexpr auto LAST_TAG = Tag::Comparison;
+        constexpr auto LAST_COMPARATOR = runtime::Comparator::GreaterOrEqual;
+
+        // Слот хранится со сдвигом на 1, чтобы NO_SLOT кодировался нулём
+        uint64_t EncodeSlot(size_t slot) {
+            return slot == ast::NO_SLOT ? 0 : slot + 1;
+        }
+
+        size_t DecodeSlot(uint64_t slot) {
+            return slot == 0 ? ast::NO_SLOT : static_cast<size_t>(slot - 1);
+        }
+
+        void AppendFixed(string& out, uint64_t value, size_t size) {
+            for (size_t i = 0; i < size; ++i) {
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        uint64_t ReadFixed(string_view image, size_t offset, size_t size) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < size; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(image[offset + i])) << (8 * i);
+            }
+            return value;
+        }
+
+        // Записывает дерево в образ. Целые числа хранятся в формате LEB128,
+        // имена - номерами в таблице имён, классы - номерами в порядке объявления
+        class Writer {
+        public:
+            string Write(const runtime::Executable& program, uint64_t source_hash) {
+                WriteNode(&program);
+
+                string image(MAGIC, sizeof(MAGIC));
+                AppendFixed(image, FORMAT_VERSION, sizeof(uint32_t));
+                AppendFixed(image, source_hash, sizeof(uint64_t));
+                string body = std::move(out_);
+                out_.clear();
+                WriteVarint(symbols_.size());
+                for (Symbol symbol : symbols_) {
+                    WriteString(symbol.Str());
+                }
+                out_ += body;
+                AppendFixed(image, HashSource(out_), sizeof(uint64_t));
+                image += out_;
+                return image;
+            }
+
+        private:
+            void WriteByte(uint8_t value) {
+                out_.push_back(static_cast<char>(value));
+            }
+
+            void WriteTag(Tag tag) {
+                WriteByte(static_cast<uint8_t>(tag));
+            }
+
+            void WriteVarint(uint64_t value) {
+                while (value >= 0x80) {
+                    WriteByte(static_cast<uint8_t>(value | 0x80));
+                    value >>= 7;
+                }
+                WriteByte(static_cast<uint8_t>(value));
+            }
+
+            // Знаковые числа кодируются зигзагом: малые по модулю значения занимают один байт
+            void WriteSigned(int64_t value) {
+                const auto sign = static_cast<uint64_t>(value >> 63);
+                WriteVarint((static_cast<uint64_t>(value) << 1) ^ sign);
+            }
+
+            void WriteString(string_view value) {
+                WriteVarint(value.size());
+                out_.append(value);
+            }
+
+            void WriteSymbol(Symbol symbol) {
+                auto [it, inserted] = symbol_indices_.emplace(symbol, symbols_.size());
+                if (inserted) {
+                    symbols_.push_back(symbol);
+                }
+                WriteVarint(it->second);
+            }
+
+            void WriteSymbols(const vector<Symbol>& symbols) {
+                WriteVarint(symbols.size());
+                for (Symbol symbol : symbols) {
+                    WriteSymbol(symbol);
+                }
+            }
+
+            void WriteNodes(const vector<unique_ptr<runtime::Executable>>& nodes) {
+                WriteVarint(nodes.size());
+                for (const auto& node : nodes) {
+                    WriteNode(node.get());
+                }
+            }
+
+            void WriteVariable(const ast::VariableValue& var) {
+                WriteSymbols(var.GetDottedIds());
+                WriteVarint(EncodeSlot(var.GetSlot()));
+            }
+
+            void WriteBinary(Tag tag, const ast::BinaryOperation& binary) {
+                WriteTag(tag);
+                WriteNode(&binary.GetLhs());
+                WriteNode(&binary.GetRhs());
+            }
+
+            void WriteClass(const runtime::Class& cls) {
+                WriteString(cls.GetName());
+                const runtime::Class* parent = cls.GetParent();
+                WriteVarint(parent == nullptr ? 0 : ClassIndex(*parent) + 1);
+                WriteVarint(cls.Methods().size());
+                for (const auto& method : cls.Methods()) {
+                    WriteSymbol(method.name);
+                    WriteSymbols(method.formal_params);
+                    WriteVarint(method.frame_size);
+                    WriteNode(method.body.get());
+                }
+                class_indices_.emplace(&cls, class_indices_.size());
+            }
+
+            size_t ClassIndex(const runtime::Class& cls) const {
+                auto it = class_indices_.find(&cls);
+                if (it == class_indices_.end()) {
+                    throw CacheError("Class "s + cls.GetName()
+                                     + " is not declared in the program"s);
+                }
+                return it->second;
+            }
+
+            void WriteNode(const runtime::Executable* node) {
+                if (node == nullptr) {
+                    WriteTag(Tag::Absent);
+                } else if (const auto* num = dynamic_cast<const ast::NumericConst*>(node)) {
+                    WriteTag(Tag::NumericConst);
+                    WriteSigned(num->GetValue().GetValue());
+                } else if (const auto* str = dynamic_cast<const ast::StringConst*>(node)) {
+                    WriteTag(Tag::StringConst);
+                    WriteString(str->GetValue().GetValue());
+                } else if (const auto* boolean = dynamic_cast<const ast::BoolConst*>(node)) {
+                    WriteTag(Tag::BoolConst);
+                    WriteByte(boolean->GetValue().GetValue() ? 1 : 0);
+                } else if (dynamic_cast<const ast::None*>(node) != nullptr) {
+                    WriteTag(Tag::None);
+                } else if (const auto* var = dynamic_cast<const ast::VariableValue*>(node)) {
+                    WriteTag(Tag::VariableValue);
+                    WriteVariable(*var);
+                } else if (const auto* assign = dynamic_cast<const ast::Assignment*>(node)) {
+                    WriteTag(Tag::Assignment);
+                    WriteSymbol(assign->GetVarName());
+                    WriteVarint(EncodeSlot(assign->GetSlot()));
+                    WriteNode(&assign->GetRightValue());
+                } else if (const auto* field = dynamic_cast<const ast::FieldAssignment*>(node)) {
+                    WriteTag(Tag::FieldAssignment);
+                    WriteVariable(field->GetObject());
+                    WriteSymbol(field->GetFieldName());
+                    WriteNode(&field->GetRightValue());
+                } else if (const auto* print = dynamic_cast<const ast::Print*>(node)) {
+                    WriteTag(Tag::Print);
+                    WriteNodes(print->GetArgs());
+                } else if (const auto* call = dynamic_cast<const ast::MethodCall*>(node)) {
+                    WriteTag(Tag::MethodCall);
+                    WriteNode(&call->GetObject());
+                    WriteSymbol(call->GetMethodName());
+                    WriteNodes(call->GetArgs());
+                } else if (const auto* instance = dynamic_cast<const ast::NewInstance*>(node)) {
+                    WriteTag(Tag::NewInstance);
+                    WriteVarint(ClassIndex(instance->GetClass()));
+                    WriteNodes(instance->GetArgs());
+                } else if (const auto* stringify = dynamic_cast<const ast::Stringify*>(node)) {
+                    WriteTag(Tag::Stringify);
+                    WriteNode(&stringify->GetArgument());
+                } else if (const auto* negation = dynamic_cast<const ast::Not*>(node)) {
+                    WriteTag(Tag::Not);
+                    WriteNode(&negation->GetArgument());
+                } else if (const auto* cmp = dynamic_cast<const ast::Comparison*>(node)) {
+                    WriteTag(Tag::Comparison);
+                    WriteByte(static_cast<uint8_t>(cmp->GetComparator()));
+                    WriteNode(&cmp->GetLhs());
+                    WriteNode(&cmp->GetRhs());
+                } else if (const auto* add = dynamic_cast<const ast::Add*>(node)) {
+                    WriteBinary(Tag::Add, *add);
+                } else if (const auto* sub = dynamic_cast<const ast::Sub*>(node)) {
+                    WriteBinary(Tag::Sub, *sub);
+                } else if (const auto* mult = dynamic_cast<const ast::Mult*>(node)) {
+                    WriteBinary(Tag::Mult, *mult);
+                } else if (const auto* div = dynamic_cast<const ast::Div*>(node)) {
+                    WriteBinary(Tag::Div, *div);
+                } else if (const auto* or_op = dynamic_cast<const ast::Or*>(node)) {
+                    WriteBinary(Tag::Or, *or_op);
+                } else if (const auto* and_op = dynamic_cast<const ast::And*>(node)) {
+                    WriteBinary(Tag::And, *and_op);
+                } else if (const auto* compound = dynamic_cast<const ast::Compound*>(node)) {
+                    WriteTag(Tag::Compound);
+                    WriteNodes(compound->GetStatements());
+                } else if (const auto* body = dynamic_cast<const ast::MethodBody*>(node)) {
+                    WriteTag(Tag::MethodBody);
+                    WriteNode(&body->GetBody());
+                } else if (const auto* ret = dynamic_cast<const ast::Return*>(node)) {
+                    WriteTag(Tag::Return);
+                    WriteNode(&ret->GetStatement());
+                } else if (const auto* cls = dynamic_cast<const ast::ClassDefinition*>(node)) {
+                    WriteTag(Tag::ClassDefinition);
+                    WriteClass(*cls->GetClass().TryAs<runtime::Class>());
+                } else if (const auto* if_else = dynamic_cast<const ast::IfElse*>(node)) {
+                    WriteTag(Tag::IfElse);
+                    WriteNode(&if_else->GetCondition());
+                    WriteNode(&if_else->GetIfBody());
+                    WriteNode(if_else->GetElseBody());
+                } else {
+                    throw CacheError("Unsupported statement in program"s);
+                }
+            }
+
+            string out_;
+            vector<Symbol> symbols_;
+            unordered_map<Symbol, size_t> symbol_indices_;
+            unordered_map<const runtime::Class*, size_t> class_indices_;
+        };
+
+        // Восстанавливает дерево из образа, проверяя каждое прочитанное значение
+        class Reader {
+        public:
+            explicit Reader(string_view image)
+                : pos_(image.data())
+                , end_(image.data() + image.size()) {
+            }
+
+            unique_ptr<runtime::Executable> Read() {
+                Skip(HEADER_SIZE);
+                const uint64_t symbol_count = ReadVarint();
+                if (symbol_count > static_cast<uint64_t>(end_ - pos_)) {
+                    throw CacheError("Program cache is truncated"s);
+                }
+                symbols_.reserve(symbol_count);
+                for (uint64_t i = 0; i < symbol_count; ++i) {
+                    symbols_.emplace_back(ReadString());
+                }
+                auto program = ReadNode();
+                if (pos_ != end_) {
+                    throw CacheError("Unexpected data at the end of program cache"s);
+                }
+                return program;
+            }
+
+        private:
+            void Skip(size_t size) {
+                if (static_cast<size_t>(end_ - pos_) < size) {
+                    throw CacheError("Program cache is truncated"s);
+                }
+                pos_ += size;
+            }
+
+            uint8_t ReadByte() {
+                if (pos_ == end_) {
+                    throw CacheError("Program cache is truncated"s);
+                }
+                return static_cast<uint8_t>(*pos_++);
+            }
+
+            uint64_t ReadVarint() {
+                uint64_t value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    const uint8_t byte = ReadByte();
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if ((byte & 0x80) == 0) {
+                        return value;
+                    }
+                }
+                throw CacheError("Malformed number in program cache"s);
+            }
+
+            int64_t ReadSigned() {
+                const uint64_t value = ReadVarint();
+                return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            }
+
+            string_view ReadString() {
+                const uint64_t size = ReadVarint();
+                const char* begin = pos_;
+                Skip(size);
+                return {begin, static_cast<size_t>(size)};
+            }
+
+            Symbol ReadSymbol() {
+                const uint64_t index = ReadVarint();
+                if (index >= symbols_.size()) {
+                    throw CacheError("Unknown name in program cache"s);
+                }
+                return symbols_[index];
+            }
+
+            vector<Symbol> ReadSymbols() {
+                vector<Symbol> symbols(ReadCount());
+                for (auto& symbol : symbols) {
+                    symbol = ReadSymbol();
+                }
+                return symbols;
+            }
+
+            // Число элементов не может превышать размер оставшейся части образа:
+            // каждый элемент занимает хотя бы один байт
+            size_t ReadCount() {
+                const uint64_t count = ReadVarint();
+                if (count > static_cast<uint64_t>(end_ - pos_)) {
+                    throw CacheError("Program cache is truncated"s);
+                }
+                return static_cast<size_t>(count);
+            }
+
+            vector<unique_ptr<runtime::Executable>> ReadNodes() {
+                vector<unique_ptr<runtime::Executable>> nodes(ReadCount());
+                for (auto& node : nodes) {
+                    node = ReadRequiredNode();
+                }
+                return nodes;
+            }
+
+            ast::VariableValue ReadVariable() {
+                auto dotted_ids = ReadSymbols();
+                if (dotted_ids.empty()) {
+                    throw CacheError("Empty variable name in program cache"s);
+                }
+                return ast::VariableValue(std::move(dotted_ids), ReadSlot());
+            }
+
+            // Слот переменной должен лежать в кадре метода, тело которого читается.
+            // На верхнем уровне программы кадра нет, и переменные слотов не имеют
+            size_t ReadSlot() {
+                const size_t slot = DecodeSlot(ReadVarint());
+                if (slot != ast::NO_SLOT && slot >= frame_size_) {
+                    throw CacheError("Invalid variable slot in program cache"s);
+                }
+                return slot;
+            }
+
+            // Кадр вмещает self и параметры, а каждый следующий слот принадлежит своему имени
+            size_t ReadFrameSize(size_t param_count) {
+                const uint64_t frame_size = ReadVarint();
+                if (frame_size != 0
+                    && (frame_size <= param_count || frame_size > symbols_.size() + 1)) {
+                    throw CacheError("Invalid frame size in program cache"s);
+                }
+                return static_cast<size_t>(frame_size);
+            }
+
+            const runtime::Class& ReadClassRef() {
+                const uint64_t index = ReadVarint();
+                if (index >= classes_.size()) {
+                    throw CacheError("Unknown class in program cache"s);
+                }
+                return *classes_[index];
+            }
+
+            unique_ptr<runtime::Executable> ReadClass() {
+                string name(ReadString());
+                const uint64_t parent_index = ReadVarint();
+                const runtime::Class* parent = nullptr;
+                if (parent_index != 0) {
+                    if (parent_index > classes_.size()) {
+                        throw CacheError("Unknown class in program cache"s);
+                    }
+                    parent = classes_[parent_index - 1];
+                }
+
+                vector<runtime::Method> methods(ReadCount());
+                for (auto& method : methods) {
+                    method.name = ReadSymbol();
+                    method.formal_params = ReadSymbols();
+                    method.frame_size = ReadFrameSize(method.formal_params.size());
+                    const size_t outer_frame_size = exchange(frame_size_, method.frame_size);
+                    method.body = ReadRequiredNode();
+                    frame_size_ = outer_frame_size;
+                }
+
+                auto cls = ObjectHolder::Own(
+                    runtime::Class(std::move(name), std::move(methods), parent));
+                classes_.push_back(cls.TryAs<runtime::Class>());
+                return make_unique<ast::ClassDefinition>(std::move(cls));
+            }
+
+            template <typename Operation>
+            unique_ptr<runtime::Executable> ReadBinary() {
+                auto lhs = ReadRequiredNode();
+                auto rhs = ReadRequiredNode();
+                return make_unique<Operation>(std::move(lhs), std::move(rhs));
+            }
+
+            unique_ptr<runtime::Executable> ReadRequiredNode() {
+                auto node = ReadNode();
+                if (node == nullptr) {
+                    throw CacheError("Missing statement in program cache"s);
+                }
+                return node;
+            }
+
+            unique_ptr<runtime::Executable> ReadNode() {
+                const uint8_t tag = ReadByte();
+                if (tag > static_cast<uint8_t>(LAST_TAG)) {
+                    throw CacheError("Unknown statement in program cache"s);
+                }
+                switch (static_cast<Tag>(tag)) {
+                    case Tag::Absent:
+                        return nullptr;
+                    case Tag::None:
+                        return make_unique<ast::None>();
+                    case Tag::NumericConst:
+                        return make_unique<ast::NumericConst>(static_cast<int>(ReadSigned()));
+                    case Tag::StringConst:
+                        return make_unique<ast::StringConst>(runtime::String(string(ReadString())));
+                    case Tag::BoolConst:
+                        return make_unique<ast::BoolConst>(runtime::Bool(ReadByte() != 0));
+                    case Tag::VariableValue:
+                        return make_unique<ast::VariableValue>(ReadVariable());
+                    case Tag::Assignment: {
+                        const Symbol var = ReadSymbol();
+                        const size_t slot = ReadSlot();
+                        return make_unique<ast::Assignment>(var, ReadRequiredNode(), slot);
+                    }
+                    case Tag::FieldAssignment: {
+                        auto object = ReadVariable();
+                        const Symbol field = ReadSymbol();
+                        return make_unique<ast::FieldAssignment>(std::move(object), field,
+                                                                 ReadRequiredNode());
+                    }
+                    case Tag::Print:
+                        return make_unique<ast::Print>(ReadNodes());
+                    case Tag::MethodCall: {
+                        auto object = ReadRequiredNode();
+                        const Symbol method = ReadSymbol();
+                        return make_unique<ast::MethodCall>(std::move(object), method, ReadNodes());
+                    }
+                    case Tag::NewInstance: {
+                        const runtime::Class& cls = ReadClassRef();
+                        return make_unique<ast::NewInstance>(cls, ReadNodes());
+                    }
+                    case Tag::Stringify:
+                        return make_unique<ast::Stringify>(ReadRequiredNode());
+                    case Tag::Add:
+                        return ReadBinary<ast::Add>();
+                    case Tag::Sub:
+                        return ReadBinary<ast::Sub>();
+                    case Tag::Mult:
+                        return ReadBinary<ast::Mult>();
+                    case Tag::Div:
+                        return ReadBinary<ast::Div>();
+                    case Tag::Or:
+                        return ReadBinary<ast::Or>();
+                    case Tag::And:
+                        return ReadBinary<ast::And>();
+                    case Tag::Not:
+                        return make_unique<ast::Not>(ReadRequiredNode());
+                    case Tag::Compound: {
+                        auto compound = make_unique<ast::Compound>();
+                        compound->MutableStatements() = ReadNodes();
+                        return compound;
+                    }
+                    case Tag::MethodBody:
+                        return make_unique<ast::MethodBody>(ReadRequiredNode());
+                    case Tag::Return:
+                        return make_unique<ast::Return>(ReadRequiredNode());
+                    case Tag::ClassDefinition:
+                        return ReadClass();
+                    case Tag::IfElse: {
+                        auto condition = ReadRequiredNode();
+                        auto if_body = ReadRequiredNode();
+                        return make_unique<ast::IfElse>(std::move(condition), std::move(if_body),
+                                                        ReadNode());
+                    }
+                    case Tag::Comparison: {
+                        const uint8_t cmp = ReadByte();
+                        if (cmp > static_cast<uint8_t>(LAST_COMPARATOR)) {
+                            throw CacheError("Unknown comparison in program cache"s);
+                        }
+                        auto lhs = ReadRequiredNode();
+                        auto rhs = ReadRequiredNode();
+                        return make_unique<ast::Comparison>(static_cast<runtime::Comparator>(cmp),
+                                                            std::move(lhs), std::move(rhs));
+                    }
+                }
+                throw CacheError("Unknown statement in program cache"s);
+            }
+
+            const char* pos_;
+            const char* end_;
+            vector<Symbol> symbols_;
+            vector<const runtime::Class*> classes_;
+            // Размер кадра метода, тело которого читается, 0 - верхний уровень программы
+            size_t frame_size_ = 0;
+        };
+
+        // Содержимое файла образа. Где возможно, файл отображается в память, а не читается
+        class MappedFile {
+        public:
+            explicit MappedFile(const string& path) {
+#ifdef MYTHON_HAS_MMAP
+                const int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return;
+                }
+                struct stat info {};
+                if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+                    void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                                        MAP_PRIVATE, fd, 0);
+                    if (data != MAP_FAILED) {
+                        data_ = static_cast<const char*>(data);
+                        size_ = static_cast<size_t>(info.st_size);
+                    }
+                }
+                ::close(fd);
+#else
+                ifstream input(path, ios::binary);
+                if (input) {
+                    contents_.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+                    data_ = contents_.data();
+                    size_ = contents_.size();
+                }
+#endif
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            ~MappedFile() {
+#ifdef MYTHON_HAS_MMAP
+                if (data_ != nullptr) {
+                    ::munmap(const_cast<char*>(data_), size_);
+                }
+#endif
+            }
+
+            // Возвращает пустую строку, если файл не удалось открыть
+            [[nodiscard]] string_view View() const {
+                return {data_, size_};
+            }
+
+        private:
+            const char* data_ = nullptr;
+            size_t size_ = 0;
+#ifndef MYTHON_HAS_MMAP
+            string contents_;
+#endif
+        };
+
+        // Записывает образ во временный файл и переименовывает его, чтобы одновременно
+        // запущенные программы не прочитали наполовину записанный образ
+        void WriteImage(const string& path, const string& image) {
+            const string temp_path = path + ".tmp"s + to_string(random_device{}());
+            {
+                ofstream output(temp_path, ios::binary | ios::trunc);
+                if (!output.write(image.data(), static_cast<streamsize>(image.size()))) {
+                    output.close();
+                    remove(temp_path.c_str());
+                    return;
+                }
+            }
+            if (rename(temp_path.c_str(), path.c_str()) != 0) {
+                remove(temp_path.c_str());
+            }
+        }
+    }  // namespace
+
+    uint64_t HashSource(string_view source) {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : source) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    string Serialize(const runtime::Executable& program, uint64_t source_hash) {
+        return Writer{}.Write(program, source_hash);
+    }
+
+    uint64_t ReadSourceHash(string_view image) {
+        if (image.size() < HEADER_SIZE || memcmp(image.data(), MAGIC, sizeof(MAGIC)) != 0) {
+            throw CacheError("Not a program cache"s);
+        }
+        if (ReadFixed(image, sizeof(MAGIC), sizeof(uint32_t)) != FORMAT_VERSION) {
+            throw CacheError("Unsupported program cache version"s);
+        }
+        return ReadFixed(image, SOURCE_HASH_OFFSET, sizeof(uint64_t));
+    }
+
+    unique_ptr<runtime::Executable> Deserialize(string_view image) {
+        ReadSourceHash(image);
+        // Изменённый байт констант или имён дал бы другую, но корректную на вид программу
+        if (ReadFixed(image, PAYLOAD_HASH_OFFSET, sizeof(uint64_t))
+            != HashSource(image.substr(HEADER_SIZE))) {
+            throw CacheError("Program cache is corrupted"s);
+        }
+        // Узлы размещаются в арене, как и при разборе
+        runtime::ArenaScope arena;
+        return Reader{image}.Read();
+    }
+
+    unique_ptr<runtime::Executable> LoadProgram(string_view source, const string& cache_path) {
+        const uint64_t source_hash = HashSource(source);
+        {
+            MappedFile file(cache_path);
+            if (!file.View().empty()) {
+                try {
+                    if (ReadSourceHash(file.View()) == source_hash) {
+                        return Deserialize(file.View());
+                    }
+                } catch (const CacheError&) {
+                    // Повреждённый или устаревший образ перезаписывается ниже
+                }
+            }
+        }
+
+        parse::Lexer lexer(source);
+        auto program = ast::Optimize(ParseProgram(lexer));
+        WriteImage(cache_path, Serialize(*program, source_hash));
+        return program;
+    }
+
+}  // namespace cache
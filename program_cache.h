@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+    class Executable;
+}
+
+namespace cache {
+
+    // Образ программы повреждён либо записан другой версией формата
+    struct CacheError : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    // Хеш текста программы, по которому образ сверяется с исходником
+    std::uint64_t HashSource(std::string_view source);
+
+    // Записывает дерево программы program в компактный двоичный образ. Образ содержит
+    // заголовок с хешем исходника source_hash и хешем остальной части образа, таблицу имён
+    // и узлы дерева вместе с объявленными в программе классами и телами их методов
+    std::string Serialize(const runtime::Executable& program, std::uint64_t source_hash);
+
+    // Возвращает хеш исходника из заголовка образа image
+    std::uint64_t ReadSourceHash(std::string_view image);
+
+    // Восстанавливает дерево программы из образа за один проход. Имена интернируются,
+    // а ссылки на классы разрешаются по мере чтения. Образ, не совпадающий со своим хешем,
+    // и слоты переменных вне кадра метода отвергаются исключением CacheError.
+    // Образ может быть освобождён сразу после возврата из функции
+    std::unique_ptr<runtime::Executable> Deserialize(std::string_view image);
+
+    // Возвращает дерево программы с текстом source. Если файл cache_path содержит образ,
+    // построенный по тому же тексту, файл отображается в память и дерево восстанавливается
+    // из него. Иначе текст разбирается и оптимизируется, а образ записывается в cache_path.
+    // Если записать образ не удалось, программа всё равно возвращается
+    std::unique_ptr<runtime::Executable> LoadProgram(std::string_view source,
+                                                     const std::string& cache_path);
+
+}  // namespace cache
@@ -0,0 +1,200 @@
+#include "compiler.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "program_cache.h"
+#include "runtime.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace cache {
+
+namespace {
+
+const string PROGRAM = R"(
+class Shape:
+  def __init__(name):
+    self.name = name
+  def __str__():
+    return 'Shape ' + self.name
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.name = 'rect'
+    self.w = w
+    self.h = h
+  def area():
+    return self.w * self.h
+  def __lt__(other):
+    return self.area() < other.area()
+  def __eq__(other):
+    return self.area() == other.area()
+
+class Printer:
+  def show(shape):
+    if shape.area() > 10 or not shape.area():
+      print shape, shape.area()
+    else:
+      print 'small', -shape.area() / 2
+
+a = Rect(3, 4)
+b = Rect(2, 2)
+p = Printer()
+p.show(a)
+p.show(b)
+p.show(Shape('empty'))
+print a > b, a <= b, a != b, str(1 + 2) + '!', None
+x = 1 < 2 and 'yes'
+print x
+)";
+
+string Run(runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program.Execute(closure, context);
+    return context.output.str();
+}
+
+unique_ptr<runtime::Executable> ParseAndOptimize(const string& source) {
+    parse::Lexer lexer{string_view(source)};
+    return ast::Optimize(ParseProgram(lexer));
+}
+
+void TestRoundTrip() {
+    auto program = ParseAndOptimize(PROGRAM);
+    const string image = Serialize(*program, HashSource(PROGRAM));
+    ASSERT_EQUAL(ReadSourceHash(image), HashSource(PROGRAM));
+
+    const string expected = Run(*program);
+    ASSERT_EQUAL(expected,
+                 "Shape rect 12\nsmall -2\nShape empty 0\nTrue False True 3! None\nTrue\n"s);
+    ASSERT_EQUAL(Run(*Deserialize(image)), expected);
+    ASSERT_EQUAL(Run(*bytecode::Compile(Deserialize(image))), expected);
+
+    // Образ восстановленного дерева совпадает с исходным
+    ASSERT_EQUAL(Serialize(*Deserialize(image), HashSource(PROGRAM)), image);
+}
+
+void TestCorruptedImage() {
+    auto program = ParseAndOptimize(PROGRAM);
+    const string image = Serialize(*program, HashSource(PROGRAM));
+
+    for (size_t size = 0; size < image.size(); ++size) {
+        ASSERT_THROWS(Deserialize(string_view(image.data(), size)), CacheError);
+    }
+    ASSERT_THROWS(Deserialize(image + '\0'), CacheError);
+    ASSERT_THROWS(ReadSourceHash("MYC"s), CacheError);
+
+    string other_version = image;
+    other_version[4] = '\x7F';
+    ASSERT_THROWS(Deserialize(other_version), CacheError);
+
+    // Изменение любого бита, кроме хеша исходника, обнаруживается при чтении образа
+    for (size_t i = 0; i < image.size(); ++i) {
+        if (i >= 8 && i < 16) {
+            continue;
+        }
+        for (int bit = 0; bit < 8; ++bit) {
+            string flipped = image;
+            flipped[i] = static_cast<char>(flipped[i] ^ (1 << bit));
+            ASSERT_THROWS(Deserialize(flipped), CacheError);
+        }
+    }
+}
+
+// Возвращает определение класса A с одним методом f(n) и телом return <variable>
+ast::ClassDefinition MakeClass(size_t frame_size, size_t slot) {
+    vector<runtime::Method> methods(1);
+    methods[0].name = "f"s;
+    methods[0].formal_params = {"n"s};
+    methods[0].frame_size = frame_size;
+    methods[0].body = make_unique<ast::MethodBody>(
+        make_unique<ast::Return>(make_unique<ast::VariableValue>(vector{"n"s}, slot)));
+    return ast::ClassDefinition(
+        runtime::ObjectHolder::Own(runtime::Class("A"s, std::move(methods), nullptr)));
+}
+
+void TestInvalidSlots() {
+    ASSERT(Deserialize(Serialize(MakeClass(2, 1), 0)) != nullptr);
+    ASSERT(Deserialize(Serialize(MakeClass(0, ast::NO_SLOT), 0)) != nullptr);
+
+    // Слот за пределами кадра метода
+    ASSERT_THROWS(Deserialize(Serialize(MakeClass(2, 2), 0)), CacheError);
+    ASSERT_THROWS(Deserialize(Serialize(MakeClass(0, 0), 0)), CacheError);
+    // Кадр не вмещает self и параметр
+    ASSERT_THROWS(Deserialize(Serialize(MakeClass(1, 0), 0)), CacheError);
+    // Кадр больше числа имён программы
+    ASSERT_THROWS(Deserialize(Serialize(MakeClass(100, 1), 0)), CacheError);
+    // На верхнем уровне программы кадра нет
+    const ast::VariableValue top_level(vector{"x"s}, 0);
+    ASSERT_THROWS(Deserialize(Serialize(top_level, 0)), CacheError);
+    const ast::Assignment assignment("x"s, make_unique<ast::None>(), 0);
+    ASSERT_THROWS(Deserialize(Serialize(assignment, 0)), CacheError);
+}
+
+void TestLoadProgram() {
+    const auto path =
+        (filesystem::temp_directory_path() / "mython_program_cache_test.myc").string();
+    remove(path.c_str());
+
+    const string expected = Run(*ParseAndOptimize(PROGRAM));
+    ASSERT_EQUAL(Run(*LoadProgram(PROGRAM, path)), expected);
+
+    // Образ записан и используется при следующей загрузке
+    string image;
+    {
+        ifstream input(path, ios::binary);
+        image.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    ASSERT_EQUAL(ReadSourceHash(image), HashSource(PROGRAM));
+    ASSERT_EQUAL(Run(*LoadProgram(PROGRAM, path)), expected);
+
+    // Изменённый текст разбирается заново, и образ перезаписывается
+    const string changed = "print 'changed'\n"s;
+    ASSERT_EQUAL(Run(*LoadProgram(changed, path)), "changed\n"s);
+    {
+        ifstream input(path, ios::binary);
+        image.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    ASSERT_EQUAL(ReadSourceHash(image), HashSource(changed));
+
+    // Повреждённый образ также заменяется
+    {
+        ofstream output(path, ios::binary | ios::trunc);
+        output << image.substr(0, image.size() / 2);
+    }
+    ASSERT_EQUAL(Run(*LoadProgram(changed, path)), "changed\n"s);
+
+    // Как и образ с изменённым байтом
+    {
+        ifstream input(path, ios::binary);
+        image.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    image.back() = static_cast<char>(image.back() ^ 1);
+    {
+        ofstream output(path, ios::binary | ios::trunc);
+        output << image;
+    }
+    ASSERT_EQUAL(Run(*LoadProgram(changed, path)), "changed\n"s);
+
+    remove(path.c_str());
+}
+
+}  // namespace
+
+void RunProgramCacheTests(TestRunner& tr) {
+    RUN_TEST(tr, cache::TestRoundTrip);
+    RUN_TEST(tr, cache::TestCorruptedImage);
+    RUN_TEST(tr, cache::TestInvalidSlots);
+    RUN_TEST(tr, cache::TestLoadProgram);
+}
+
+}  // namespace cache
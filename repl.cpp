@@ -0,0 +1,94 @@
+#include "repl.h"
+
+#include "compiler.h"
+#include "lexer.h"
+#include "optimizer.h"
+
+#include <utility>
+
+using namespace std;
+
+namespace repl {
+
+    Session::Session(ostream& output)
+        : Session(output, Options{}) {
+    }
+
+    Session::Session(ostream& output, const Options& options)
+        : options_(options)
+        , context_(output, options.flush) {
+        if (options_.gc != 0) {
+            collector_.emplace(runtime::CycleCollector::Options{options_.gc});
+        }
+    }
+
+    Session::~Session() {
+        // Экземпляры освобождаются раньше классов парсера, из пулов которых они выделены
+        closure_.clear();
+        if (collector_) {
+            collector_->CollectAll();
+        }
+    }
+
+    void Session::Feed(string_view line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        const size_t first = line.find_first_not_of(' ');
+        const bool blank_line = first == string_view::npos;
+        if (!blank_line) {
+            // Строка из одного комментария не завершает и не продолжает блок
+            if (line[first] == '#') {
+                return;
+            }
+            pending_.append(line);
+            pending_.push_back('\n');
+        }
+        if (!pending_.empty() && IsComplete(pending_, blank_line)) {
+            Execute(exchange(pending_, string{}));
+        }
+    }
+
+    void Session::Execute(string source) {
+        runtime::CollectorScope collecting(collector_ ? &*collector_ : nullptr);
+        parse::Lexer lexer(source);
+        auto program = ast::Optimize(parser_.ParseChunk(lexer));
+        if (options_.bytecode) {
+            program = bytecode::Compile(std::move(program), options_.jit);
+        }
+        try {
+            program->Execute(closure_, context_);
+        } catch (...) {
+            // Вывод блока до ошибки должен предшествовать сообщению о ней
+            context_.Flush();
+            throw;
+        }
+        context_.Flush();
+    }
+
+    bool IsComplete(string_view source, bool blank_line) {
+        namespace token_type = parse::token_type;
+
+        if (blank_line) {
+            return true;
+        }
+        try {
+            parse::Lexer lexer(source);
+            bool compound = false;
+            for (; !lexer.CurrentToken().Is<token_type::Eof>(); lexer.NextToken()) {
+                const parse::Token& token = lexer.CurrentToken();
+                if (token.Is<token_type::Indent>()) {
+                    compound = true;
+                } else if (!token.Is<token_type::Newline>() && !token.Is<token_type::Dedent>()) {
+                    // Строка, оканчивающаяся ':', начинает вложенный блок
+                    const auto* ch = token.TryAs<token_type::Char>();
+                    compound = compound || (ch != nullptr && ch->value == ':');
+                }
+            }
+            return !compound;
+        } catch (const parse::LexerError&) {
+            return true;
+        }
+    }
+
+}  // namespace repl
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "cycle_collector.h"
+#include "jit.h"
+#include "parse.h"
+#include "runtime.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Интерактивное выполнение программ Mython
+namespace repl {
+
+    // Интерактивный сеанс. Строки ввода накапливаются, пока не завершён очередной блок:
+    // простая инструкция завершается своей строкой, а составная (класс, if) - пустой строкой.
+    // Завершённый блок разбирается и выполняется сам по себе, прежний ввод не повторяется,
+    // поэтому время отклика не зависит от длины сеанса. Переменные, классы и вывод
+    // сохраняются между блоками
+    class Session {
+    public:
+        struct Options {
+            // Компилировать блоки в байт-код вместо обхода дерева
+            bool bytecode = false;
+            runtime::OutputBuffer::FlushPolicy flush = runtime::OutputBuffer::FlushPolicy::Chunked;
+            // Порог сборщика циклов, 0 - без сборки
+            std::size_t gc = runtime::CycleCollector::DEFAULT_THRESHOLD;
+            // Порог вызовов метода байт-кода для компиляции в машинный код
+            std::uint32_t jit = jit::DEFAULT_THRESHOLD;
+        };
+
+        explicit Session(std::ostream& output);
+        Session(std::ostream& output, const Options& options);
+        ~Session();
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        // Добавляет строку ввода line без перевода строки. Если она завершила блок, блок
+        // выполняется, а его вывод передаётся в output. Ошибки разбора и выполнения блока
+        // передаются исключениями; блок при этом отбрасывается, а сеанс можно продолжать
+        void Feed(std::string_view line);
+
+        // Возвращает true, если введено начало составной инструкции и сеанс ждёт её продолжения
+        [[nodiscard]] bool InBlock() const {
+            return !pending_.empty();
+        }
+
+        [[nodiscard]] const runtime::Closure& GetClosure() const {
+            return closure_;
+        }
+
+    private:
+        void Execute(std::string source);
+
+        Options options_;
+        // Текст незавершённого блока
+        std::string pending_;
+        // Сборщик объявлен первым: экземпляры в closure_ ссылаются на классы парсера,
+        // а мусорные циклы освобождаются в деструкторе раньше классов
+        std::optional<runtime::CycleCollector> collector_;
+        parse::IncrementalParser parser_;
+        runtime::SimpleContext context_;
+        runtime::Closure closure_;
+    };
+
+    // Возвращает true, если текст source - завершённый блок для Session. Составную
+    // инструкцию распознают лексемы Indent и ':' в конце строки, а завершает её пустая
+    // строка (blank_line). Текст с лексической ошибкой считается завершённым, чтобы
+    // ошибку сообщил разбор
+    [[nodiscard]] bool IsComplete(std::string_view source, bool blank_line);
+
+}  // namespace repl
@@ -0,0 +1,100 @@
+#include "repl.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace repl {
+
+namespace {
+
+// Передаёт в сеанс строки text по одной
+void FeedLines(Session& session, const string& text) {
+    istringstream input(text);
+    for (string line; getline(input, line);) {
+        session.Feed(line);
+    }
+}
+
+void TestBlocks() {
+    ASSERT(IsComplete("x = 1\n"sv, false));
+    ASSERT(IsComplete("print x, 'a:b'\n"sv, false));
+    ASSERT(!IsComplete("if x:\n"sv, false));
+    ASSERT(!IsComplete("class A:\n  def f():\n    return 1\n"sv, false));
+    ASSERT(IsComplete("class A:\n  def f():\n    return 1\n"sv, true));
+    // Лексическую ошибку сообщает разбор блока
+    ASSERT(IsComplete("print 'unterminated\n"sv, false));
+
+    for (bool bytecode : {false, true}) {
+        ostringstream output;
+        Session session(output, Session::Options{bytecode});
+        session.Feed("x = 20"sv);
+        ASSERT(!session.InBlock());
+        session.Feed("class Adder:"sv);
+        session.Feed("  def add(a, b):"sv);
+        session.Feed("    # комментарий внутри блока"sv);
+        session.Feed("    return a + b"sv);
+        ASSERT(session.InBlock());
+        ASSERT(output.str().empty());
+        session.Feed("  "sv);
+        ASSERT(!session.InBlock());
+        FeedLines(session, "adder = Adder()\nprint adder.add(x, 22)\nif x > 1:\n  print 'if'\n"
+                           "else:\n  print 'else'\n\n"s);
+        ASSERT_EQUAL(output.str(), "42\nif\n"s);
+        ASSERT_EQUAL(session.GetClosure().count("adder"s), 1U);
+    }
+}
+
+void TestStrings() {
+    // Строка из константы одного блока используется в следующих
+    for (bool bytecode : {false, true}) {
+        ostringstream output;
+        Session session(output, Session::Options{bytecode});
+        FeedLines(session, "x = 'abc'\nprint x\ny = x + 'def'\nprint y, x\n"s);
+        ASSERT_EQUAL(output.str(), "abc\nabcdef abc\n"s);
+    }
+}
+
+void TestErrors() {
+    ostringstream output;
+    Session session(output);
+    FeedLines(session, "class A:\n  def f():\n    return 1\n\n"s);
+    // Ошибка выполнения не отменяет уже выполненных инструкций блока
+    FeedLines(session, "if True:\n  print 'before'\n  y = 1\n  print 1 / 0\n"s);
+    ASSERT_THROWS(session.Feed(""sv), runtime_error);
+    ASSERT_EQUAL(output.str(), "before\n"s);
+    ASSERT(!session.InBlock());
+    session.Feed("print y"sv);
+    ASSERT_EQUAL(output.str(), "before\n1\n"s);
+
+    ASSERT_THROWS(FeedLines(session, "class A:\n  def g():\n    return 2\n\n"s), runtime_error);
+    // Класс из блока с ошибкой разбора забывается, и блок можно ввести заново
+    ASSERT_THROWS(FeedLines(session, "class B(A):\n  def g():\n    return +\n\n"s),
+                  runtime_error);
+    FeedLines(session, "class B(A):\n  def g():\n    return 2\n\nb = B()\nprint b.f(), b.g()\n"s);
+    ASSERT_EQUAL(output.str(), "before\n1\n1 2\n"s);
+}
+
+void TestCycles() {
+    ostringstream output;
+    Session session(output, Session::Options{false, runtime::OutputBuffer::FlushPolicy::Line, 1});
+    FeedLines(session, "class Node:\n  def __init__():\n    self.self = self\n\n"s);
+    for (int i = 0; i < 100; ++i) {
+        session.Feed("node = Node()"sv);
+    }
+    session.Feed("print 'done'"sv);
+    ASSERT_EQUAL(output.str(), "done\n"s);
+    // Последний экземпляр освобождает деструктор сеанса
+}
+
+}  // namespace
+
+void RunReplTests(TestRunner& tr) {
+    RUN_TEST(tr, repl::TestBlocks);
+    RUN_TEST(tr, repl::TestStrings);
+    RUN_TEST(tr, repl::TestErrors);
+    RUN_TEST(tr, repl::TestCycles);
+}
+
+}  // namespace repl
@@ -1,6 +1,10 @@
 #include "runtime.h"
 
-#include <algorithm>
+#include "arena.h"
+#include "cycle_collector.h"
+#include "profiler.h"
+
+#include <array>
 #include <cassert>
 #include <optional>
 #include <sstream>
@@ -10,17 +14,325 @@ using namespace std;
 
 namespace runtime {
 
-    ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
+    namespace {
+        // Имена особых методов в порядке значений SpecialMethod
+        const std::array<Symbol, SPECIAL_METHOD_COUNT> SPECIAL_METHOD_NAMES = {
+            "__init__"s, "__str__"s, "__eq__"s, "__lt__"s, "__add__"s,
+        };
+
+        const Symbol SELF_NAME = "self"s;
+
+        // Вызывает у instance особый метод special с одним аргументом. Если подходящего метода
+        // нет, вызов по имени выбрасывает обычное для Call исключение
+        ObjectHolder CallSpecial(ClassInstance& instance, SpecialMethod special,
+                                 const ObjectHolder& arg, Context& context) {
+            const Method* method = instance.GetClass().GetSpecialMethod(special);
+            if (method != nullptr && method->formal_params.size() == 1) {
+                return instance.Call(*method, {arg}, context);
+            }
+            return instance.Call(SPECIAL_METHOD_NAMES[static_cast<size_t>(special)], {arg}, context);
+        }
+    }
+
+    void* Executable::operator new(size_t size) {
+        return Arena::Allocate(size);
+    }
+
+    void Executable::operator delete(void* pointer) noexcept {
+        Arena::Deallocate(pointer);
+    }
+
+    ObjectHolder::ObjectHolder(Data data)
             : data_(std::move(data)) {
     }
 
+    namespace {
+        // Распределитель, размещающий экземпляр в пуле его класса
+        // и при необходимости учитывающий память в stats
+        template <typename T>
+        class InstanceAllocator {
+        public:
+            using value_type = T;
+
+            InstanceAllocator(InstancePool& pool, MemoryStats* stats) noexcept
+                : pool_(&pool)
+                , stats_(stats) {
+            }
+
+            template <typename U>
+            InstanceAllocator(const InstanceAllocator<U>& other) noexcept  // NOLINT
+                : pool_(other.pool_)
+                , stats_(other.stats_) {
+            }
+
+            T* allocate(size_t n) {
+                auto* pointer = static_cast<T*>(pool_->Allocate(n * sizeof(T)));
+                if (stats_ != nullptr) {
+                    stats_->AllocateObject(KIND, n * sizeof(T));
+                }
+                return pointer;
+            }
+
+            void deallocate(T* pointer, size_t n) noexcept {
+                if (stats_ != nullptr) {
+                    stats_->FreeObject(KIND, n * sizeof(T));
+                }
+                pool_->Deallocate(pointer, n * sizeof(T));
+            }
+
+            template <typename U>
+            bool operator==(const InstanceAllocator<U>& other) const noexcept {
+                return pool_ == other.pool_ && stats_ == other.stats_;
+            }
+
+            template <typename U>
+            bool operator!=(const InstanceAllocator<U>& other) const noexcept {
+                return !(*this == other);
+            }
+
+        private:
+            template <typename U>
+            friend class InstanceAllocator;
+
+            static constexpr auto KIND = static_cast<size_t>(Object::Kind::ClassInstance);
+
+            InstancePool* pool_;
+            MemoryStats* stats_;
+        };
+    }
+
+    ObjectHolder ObjectHolder::OwnInstance(ClassInstance&& instance, MemoryStats* stats) {
+        InstancePool& pool = instance.GetClass().GetInstancePool();
+        ObjectHolder holder = Allocate<ClassInstance>(InstanceAllocator<ClassInstance>(pool, stats),
+                                                      std::move(instance));
+        if (CycleCollector* collector = CycleCollector::Current()) {
+            collector->Track(*holder.TryAs<ClassInstance>());
+        }
+        return holder;
+    }
+
+    // Свободные блоки пулов, которые поток держит у себя. Блоки связаны через первое слово
+    // блока. Блок в списке потока считается занятым, поэтому пул не удаляется, пока поток не
+    // вернёт ему блоки: при выходе потока или когда место списка займёт другой пул
+    struct ThreadBlocks {
+        struct List {
+            InstancePool* pool;
+            size_t size;
+            void* head;
+            size_t count;
+        };
+
+        // Сколько пулов поток обслуживает одновременно
+        static constexpr size_t LIST_COUNT = 8;
+        // Сколько блоков одного пула держит поток. Лишняя половина возвращается в пул
+        static constexpr size_t MAX_BLOCKS = 64;
+
+        ThreadBlocks() = default;
+        ThreadBlocks(const ThreadBlocks&) = delete;
+        ThreadBlocks& operator=(const ThreadBlocks&) = delete;
+
+        // Возвращает блоки всех пулов при выходе потока
+        ~ThreadBlocks() {
+            for (List& list : lists) {
+                Flush(list);
+            }
+            finished = true;
+        }
+
+        static List& ListFor(const InstancePool& pool) noexcept {
+            return lists[(reinterpret_cast<uintptr_t>(&pool) >> 4) % LIST_COUNT];
+        }
+
+        static void*& Next(void* block) noexcept {
+            return *static_cast<void**>(block);
+        }
+
+        // Достаёт блок из списка потока. Возвращает nullptr, если список пуст
+        static void* Pop(InstancePool& pool, size_t size) noexcept {
+            if (finished) {
+                return nullptr;
+            }
+            List& list = ListFor(pool);
+            if (list.pool != &pool || list.size != size || list.count == 0) {
+                return nullptr;
+            }
+            void* block = list.head;
+            list.head = Next(block);
+            --list.count;
+            return block;
+        }
+
+        // Кладёт блок в список потока. Возвращает false, если блок нужно вернуть в пул
+        static bool Push(InstancePool& pool, void* block, size_t size) noexcept {
+            if (finished || pool.orphaned_.load(memory_order_relaxed)) {
+                return false;
+            }
+            List& list = Claim(pool, size);
+            if (list.count == MAX_BLOCKS) {
+                void* tail = list.head;
+                for (size_t i = 1; i < MAX_BLOCKS / 2; ++i) {
+                    tail = Next(tail);
+                }
+                void* head = list.head;
+                list.head = Next(tail);
+                Next(tail) = nullptr;
+                list.count -= MAX_BLOCKS / 2;
+                pool.ReturnBlocks(head, MAX_BLOCKS / 2);
+            }
+            Next(block) = list.head;
+            list.head = block;
+            ++list.count;
+            return true;
+        }
+
+        // Добавляет в список потока count блоков, взятых из пула
+        static void Refill(InstancePool& pool, size_t size, void* head, size_t count) noexcept {
+            List& list = Claim(pool, size);
+            while (head != nullptr) {
+                void* next = Next(head);
+                Next(head) = list.head;
+                list.head = head;
+                head = next;
+            }
+            list.count += count;
+        }
+
+        // Возвращает в pool блоки из списка текущего потока
+        static void Flush(const InstancePool& pool) noexcept {
+            if (!finished && ListFor(pool).pool == &pool) {
+                Flush(ListFor(pool));
+            }
+        }
+
+    private:
+        // Закрепляет список за pool, вернув блоки прежнего пула
+        static List& Claim(InstancePool& pool, size_t size) noexcept {
+            List& list = ListFor(pool);
+            if (list.pool != &pool || list.size != size) {
+                // Списки возвращаются в пулы деструктором при выходе потока
+                static thread_local ThreadBlocks owner;
+                Flush(list);
+                list.pool = &pool;
+                list.size = size;
+            }
+            return list;
+        }
+
+        static void Flush(List& list) noexcept {
+            if (list.pool != nullptr) {
+                list.pool->ReturnBlocks(list.head, list.count);
+                list = List{};
+            }
+        }
+
+        static thread_local List lists[LIST_COUNT];
+        static thread_local bool finished;
+    };
+
+    thread_local ThreadBlocks::List ThreadBlocks::lists[ThreadBlocks::LIST_COUNT] = {};
+    thread_local bool ThreadBlocks::finished = false;
+
+    void* InstancePool::Allocate(size_t size) {
+        if (void* block = ThreadBlocks::Pop(*this, size)) {
+            return block;
+        }
+        live_count_.fetch_add(1, memory_order_relaxed);
+        void* block = nullptr;
+        // Вместе с блоком поток забирает в свой список часть свободных блоков пула
+        void* extra = nullptr;
+        size_t extra_count = 0;
+        {
+            lock_guard guard(mutex_);
+            if (block_size_ == 0) {
+                block_size_ = size;
+                free_.reserve(MAX_FREE_BLOCKS);
+            }
+            if (size == block_size_ && !free_.empty()) {
+                block = free_.back();
+                free_.pop_back();
+                while (extra_count < ThreadBlocks::MAX_BLOCKS / 2 && !free_.empty()) {
+                    ThreadBlocks::Next(free_.back()) = extra;
+                    extra = free_.back();
+                    free_.pop_back();
+                    ++extra_count;
+                }
+            }
+        }
+        if (extra_count != 0) {
+            live_count_.fetch_add(extra_count, memory_order_relaxed);
+            ThreadBlocks::Refill(*this, size, extra, extra_count);
+        }
+        if (block != nullptr) {
+            return block;
+        }
+        try {
+            return ::operator new(size);
+        } catch (...) {
+            Release();
+            throw;
+        }
+    }
+
+    void InstancePool::Deallocate(void* block, size_t size) noexcept {
+        if (ThreadBlocks::Push(*this, block, size)) {
+            return;
+        }
+        bool pooled = false;
+        {
+            lock_guard guard(mutex_);
+            if (size == block_size_ && free_.size() < MAX_FREE_BLOCKS) {
+                free_.push_back(block);
+                pooled = true;
+            }
+        }
+        if (!pooled) {
+            ::operator delete(block);
+        }
+        Release();
+    }
+
+    void InstancePool::ReturnBlocks(void* head, size_t count) noexcept {
+        {
+            lock_guard guard(mutex_);
+            while (head != nullptr && free_.size() < MAX_FREE_BLOCKS) {
+                free_.push_back(head);
+                head = ThreadBlocks::Next(head);
+            }
+        }
+        while (head != nullptr) {
+            void* next = ThreadBlocks::Next(head);
+            ::operator delete(head);
+            head = next;
+        }
+        if (count != 0) {
+            Release(count);
+        }
+    }
+
+    void InstancePool::Orphan() noexcept {
+        orphaned_.store(true, memory_order_relaxed);
+        ThreadBlocks::Flush(*this);
+        Release();
+    }
+
+    void InstancePool::Release(size_t count) noexcept {
+        if (live_count_.fetch_sub(count, memory_order_acq_rel) == count) {
+            delete this;
+        }
+    }
+
+    InstancePool::~InstancePool() {
+        for (void* block : free_) {
+            ::operator delete(block);
+        }
+    }
+
     void ObjectHolder::AssertIsValid() const {
-        assert(data_ != nullptr);
+        assert(Get() != nullptr);
     }
 
     ObjectHolder ObjectHolder::Share(Object& object) {
-        // Возвращаем не владеющий shared_ptr (его deleter ничего не делает)
-        return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+        return ObjectHolder(Data(Reference(&object, false)));
     }
 
     ObjectHolder ObjectHolder::None() {
@@ -37,50 +349,178 @@ namespace runtime {
         return Get();
     }
 
-    Object* ObjectHolder::Get() const {
-        return data_.get();
+    void PrintValue(const ObjectHolder& value, Context& context) {
+        OutputBuffer* buffer = context.GetOutputBuffer();
+        if (buffer == nullptr) {
+            if (value) {
+                value->Print(context.GetOutputStream(), context);
+            } else {
+                context.GetOutputStream() << "None"sv;
+            }
+            return;
+        }
+        if (const auto* number = value.TryAs<Number>()) {
+            buffer->WriteNumber(number->GetValue());
+        } else if (const auto* str = value.TryAs<String>()) {
+            str->WriteTo(*buffer);
+        } else if (const auto* boolean = value.TryAs<Bool>()) {
+            buffer->Write(boolean->GetValue() ? "True"sv : "False"sv);
+        } else if (value) {
+            value->Print(buffer->Stream(), context);
+        } else {
+            buffer->Write("None"sv);
+        }
+    }
+
+    void PrintChar(char c, Context& context) {
+        if (OutputBuffer* buffer = context.GetOutputBuffer()) {
+            buffer->Put(c);
+        } else {
+            context.GetOutputStream() << c;
+        }
     }
 
-    ObjectHolder::operator bool() const {
-        return Get() != nullptr;
+    void AppendString(const ObjectHolder& value, std::string& out, Context& context) {
+        if (value) {
+            value->AppendTo(out, context);
+        } else {
+            out += "None"sv;
+        }
     }
 
     bool IsTrue(const ObjectHolder& object) {
-        if (!object) {
+        const Object* value = object.Get();
+        if (value == nullptr) {
             return false;
         }
-        auto boolean = object.TryAs<Bool>();
-        if (boolean != nullptr) {
-            return boolean->GetValue();
+        switch (value->GetKind()) {
+            case Object::Kind::Bool:
+                return static_cast<const Bool*>(value)->GetValue();
+            case Object::Kind::Number:
+                return static_cast<const Number*>(value)->GetValue() != 0;
+            case Object::Kind::String:
+                return static_cast<const String*>(value)->Size() != 0;
+            default:
+                return false;
         }
+    }
 
-        auto number = object.TryAs<Number>();
-        if (number != nullptr) {
-            return number->GetValue();
+    ClassInstance::ClassInstance(const Class& cls)
+            : Object(Kind::ClassInstance)
+            , cls_(cls)
+            , shape_(&cls.GetRootShape())
+            , stats_(MemoryStats::Current()) {
+        values_.reserve(cls.GetInstancePool().GetFieldCountHint());
+        if (stats_ != nullptr && values_.HeapBytes() != 0) {
+            stats_->AllocateFields(values_.HeapBytes());
         }
+    }
 
-        auto str = object.TryAs<String>();
-        if (str != nullptr) {
-            return !str->GetValue().empty();
+    ClassInstance::~ClassInstance() {
+        if (collector_ != nullptr) {
+            collector_->Untrack(*this);
+        }
+        // Цепочка экземпляров (self.next = other) может быть очень длинной, поэтому
+        // экземпляры, которыми больше никто не владеет, освобождаются без рекурсии: их поля
+        // разбираются до того, как будет освобождена последняя ссылка на них
+        std::vector<ObjectHolder> pending;
+        auto detach = [&pending](ClassInstance& instance) {
+            for (ObjectHolder& field : instance.values_) {
+                const ClassInstance* target = OwnedInstance(field);
+                if (target != nullptr && target->GetRefCount() == 1) {
+                    pending.push_back(std::move(field));
+                }
+            }
+        };
+        detach(*this);
+        while (!pending.empty()) {
+            ObjectHolder instance = std::move(pending.back());
+            pending.pop_back();
+            detach(*instance.TryAs<ClassInstance>());
+        }
+        if (stats_ != nullptr && values_.HeapBytes() != 0) {
+            stats_->FreeFields(values_.HeapBytes());
         }
+    }
 
-        return false;
+    ClassInstance::Values::Values(Values&& other) noexcept
+            : heap_(other.heap_)
+            , size_(other.size_)
+            , capacity_(other.capacity_) {
+        if (heap_ == nullptr) {
+            ObjectHolder* source = other.Inline();
+            for (size_t i = 0; i < size_; ++i) {
+                new (inline_ + i * sizeof(ObjectHolder)) ObjectHolder(std::move(source[i]));
+                source[i].~ObjectHolder();
+            }
+        }
+        other.heap_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = INLINE_SIZE;
     }
 
-    ClassInstance::ClassInstance(const Class& cls)
-            : cls_(cls) {
+    ClassInstance::Values::~Values() {
+        ObjectHolder* data = Data();
+        for (size_t i = 0; i < size_; ++i) {
+            data[i].~ObjectHolder();
+        }
+        if (heap_ != nullptr) {
+            ::operator delete(heap_);
+        }
+    }
+
+    void ClassInstance::Values::reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        auto* heap = static_cast<ObjectHolder*>(::operator new(capacity * sizeof(ObjectHolder)));
+        ObjectHolder* data = Data();
+        for (size_t i = 0; i < size_; ++i) {
+            new (heap + i) ObjectHolder(std::move(data[i]));
+            data[i].~ObjectHolder();
+        }
+        if (heap_ != nullptr) {
+            ::operator delete(heap_);
+        }
+        heap_ = heap;
+        capacity_ = capacity;
+    }
+
+    ObjectHolder& ClassInstance::Values::emplace_back(ObjectHolder value) {
+        if (size_ == capacity_) {
+            reserve(capacity_ * 2);
+        }
+        ObjectHolder* field = new (Data() + size_) ObjectHolder(std::move(value));
+        ++size_;
+        return *field;
+    }
+
+    void Object::AppendTo(std::string& out, Context& context) {
+        std::ostringstream os;
+        Print(os, context);
+        out += os.str();
+    }
+
+    void ClassInstance::AppendTo(std::string& out, Context& context) {
+        const Method* str_method = cls_.GetSpecialMethod(SpecialMethod::Str);
+        if (str_method != nullptr && str_method->formal_params.empty()) {
+            AppendString(Call(*str_method, {}, context), out, context);
+        } else {
+            Object::AppendTo(out, context);
+        }
     }
 
     void ClassInstance::Print(std::ostream& os, Context& context) {
         std::vector<ObjectHolder> actual_args;
-        if (HasMethod("__str__"s, 0)) {
-            Call("__str__"s, actual_args, context)->Print(os, context);
+        const Method* str_method = cls_.GetSpecialMethod(SpecialMethod::Str);
+        if (str_method != nullptr && str_method->formal_params.empty()) {
+            Call(*str_method, actual_args, context)->Print(os, context);
         } else {
             os << this;
         }
     }
 
-    bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
+    bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
         auto found_method = cls_.GetMethod(method);
         if (found_method == nullptr) {
             return false;
@@ -88,88 +528,491 @@ namespace runtime {
         return found_method->formal_params.size() == argument_count;
     }
 
-    Closure& ClassInstance::Fields() {
-        return fields_;
+    FieldMap<ClassInstance> ClassInstance::Fields() {
+        return FieldMap<ClassInstance>(*this);
+    }
+
+    FieldMap<const ClassInstance> ClassInstance::Fields() const {
+        return FieldMap<const ClassInstance>(*this);
+    }
+
+    ObjectHolder& ClassInstance::AddField(const Shape& shape, ObjectHolder value) {
+        assert(shape.Size() == values_.size() + 1);
+        shape_ = &shape;
+        cls_.GetInstancePool().UpdateFieldCountHint(shape.Size());
+        if (stats_ != nullptr) {
+            const size_t heap_bytes = values_.HeapBytes();
+            ObjectHolder& field = values_.emplace_back(std::move(value));
+            if (values_.HeapBytes() != heap_bytes) {
+                stats_->AllocateFields(values_.HeapBytes() - heap_bytes);
+            }
+            return field;
+        }
+        return values_.emplace_back(std::move(value));
+    }
+
+    size_t Shape::Find(Symbol name) const {
+        auto found = indices_.find(name);
+        return found != indices_.end() ? found->second : NO_FIELD;
+    }
+
+    const Shape& Shape::AddField(Symbol name) const {
+        std::lock_guard lock(transitions_mutex_);
+        auto& next = transitions_[name];
+        if (next == nullptr) {
+            auto shape = std::make_unique<Shape>();
+            shape->names_ = names_;
+            shape->names_.push_back(name);
+            shape->indices_ = indices_;
+            shape->indices_.emplace(name, names_.size());
+            shape->parent_ = this;
+            next = std::move(shape);
+        }
+        return *next;
+    }
+
+    FieldCache::FieldCache(const FieldCache& other)
+        : index_(other.index_.load(std::memory_order_relaxed))
+        , next_(other.next_.load(std::memory_order_acquire)) {
     }
 
-    const Closure& ClassInstance::Fields() const {
-        return fields_;
+    FieldCache& FieldCache::operator=(const FieldCache& other) {
+        index_.store(other.index_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        next_.store(other.next_.load(std::memory_order_acquire), std::memory_order_release);
+        return *this;
     }
 
-    ObjectHolder ClassInstance::Call(const std::string& method,
+    ObjectHolder& FieldCache::Assign(ClassInstance& instance, Symbol name,
+                                     ObjectHolder value) {
+        const Shape& shape = instance.GetShape();
+        const size_t index = Index(shape, name);
+        if (index != Shape::NO_FIELD) {
+            return instance.FieldAt(index) = std::move(value);
+        }
+        // Переход годится, только если он сделан из той же формы, а значит, по тому же имени
+        const Shape* next = next_.load(std::memory_order_acquire);
+        if (next == nullptr || next->GetParent() != &shape || next->GetNames().back() != name) {
+            next = &shape.AddField(name);
+            next_.store(next, std::memory_order_release);
+        }
+        return instance.AddField(*next, std::move(value));
+    }
+
+    ObjectHolder ClassInstance::Self() {
+        // Объектом, которым ObjectHolder уже владеет, можно владеть и через новую ссылку
+        return ObjectHolder(ObjectHolder::Data(ObjectHolder::Reference(this, GetRefCount() != 0)));
+    }
+
+    ClassInstance* ClassInstance::OwnedInstance(const ObjectHolder& holder) {
+        const auto* reference = std::get_if<ObjectHolder::Reference>(&holder.data_);
+        if (reference == nullptr || !reference->IsOwning()
+            || reference->Get()->GetKind() != Kind::ClassInstance) {
+            return nullptr;
+        }
+        return static_cast<ClassInstance*>(reference->Get());
+    }
+
+    const Class& ClassInstance::GetClass() const {
+        return cls_;
+    }
+
+    ValueStack::ValueStack() {
+        slots_.reserve(CAPACITY);
+    }
+
+    ValueStack& ValueStack::ForCurrentThread() {
+        thread_local ValueStack stack;
+        return stack;
+    }
+
+    StackFrame::StackFrame(ValueStack& stack, size_t size)
+            : stack_(stack)
+            , frame_(nullptr, size) {
+        const size_t top = stack.top_ + size;
+        if (top > ValueStack::CAPACITY) {
+            throw runtime_error("Stack overflow"s);
+        }
+        // Ёмкость зарезервирована заранее, поэтому resize не перемещает слоты активных кадров
+        if (top > stack.slots_.size()) {
+            stack.slots_.resize(top);
+        }
+        frame_ = Frame(stack.slots_.data() + stack.top_, size);
+        stack.top_ = top;
+    }
+
+    StackFrame::~StackFrame() {
+        for (size_t i = 0; i < frame_.Size(); ++i) {
+            frame_[i].reset();
+        }
+        stack_.top_ -= frame_.Size();
+    }
+
+    namespace {
+        // Делает кадр текущим на время выполнения тела метода
+        class FrameScope {
+        public:
+            FrameScope(Context& context, const Frame* frame)
+                : context_(context)
+                , outer_(context.SetFrame(frame)) {
+            }
+
+            FrameScope(const FrameScope&) = delete;
+            FrameScope& operator=(const FrameScope&) = delete;
+
+            ~FrameScope() {
+                context_.SetFrame(outer_);
+            }
+
+        private:
+            Context& context_;
+            const Frame* outer_;
+        };
+
+        ObjectHolder ExecuteBody(const Method& method, Closure& closure, const Frame* frame,
+                                 Context& context) {
+            FrameScope scope(context, frame);
+            auto result = method.body->Execute(closure, context);
+            // Тело, не обёрнутое в MethodBody, тоже может выполнить return
+            if (context.IsReturning()) {
+                return context.TakeReturnValue();
+            }
+            return result;
+        }
+    }
+
+    ObjectHolder ClassInstance::Call(Symbol method,
                                      const std::vector<ObjectHolder>& actual_args,
                                      Context& context) {
-        if (!HasMethod(method, actual_args.size())) {
-            throw runtime_error("There is no method " + method + "in the class " + cls_.GetName());
+        const Method* found_method = cls_.GetMethod(method);
+        if (found_method == nullptr || found_method->formal_params.size() != actual_args.size()) {
+            throw runtime_error("There is no method " + method.Str() + "in the class " + cls_.GetName());
+        }
+        return Call(*found_method, actual_args, context);
+    }
+
+    ObjectHolder ClassInstance::Call(const Method& method,
+                                     const std::vector<ObjectHolder>& actual_args,
+                                     Context& context) {
+        if (Profiler* profiler = context.GetProfiler(); profiler != nullptr) {
+            Profiler::Scope scope(*profiler, cls_, method);
+            return Invoke(method, actual_args, context);
+        }
+        return Invoke(method, actual_args, context);
+    }
+
+    ObjectHolder ClassInstance::Call(const Method& method, const Frame& frame, Context& context) {
+        if (Profiler* profiler = context.GetProfiler(); profiler != nullptr) {
+            Profiler::Scope scope(*profiler, cls_, method);
+            return Invoke(method, frame, context);
+        }
+        return Invoke(method, frame, context);
+    }
+
+    ObjectHolder ClassInstance::Invoke(const Method& method,
+                                       const std::vector<ObjectHolder>& actual_args,
+                                       Context& context) {
+        if (method.frame_size != 0) {
+            StackFrame frame(ValueStack::ForCurrentThread(), method.frame_size);
+            frame[0] = Self();
+            for (size_t i = 0; i < actual_args.size(); ++i) {
+                frame[i + 1] = actual_args[i];
+            }
+            return Invoke(method, frame.Get(), context);
+        }
+        if (MemoryStats* stats = MemoryStats::Current(); stats != nullptr) {
+            stats->AddClosure();
         }
-        auto found_method = cls_.GetMethod(method);
         Closure closure;
-        closure.emplace("self", ObjectHolder::Share(*this));
-        for (size_t i = 0; i < found_method->formal_params.size(); ++i) {
-            closure.emplace(found_method->formal_params[i], actual_args[i]);
+        closure.emplace(SELF_NAME, Self());
+        for (size_t i = 0; i < method.formal_params.size(); ++i) {
+            closure.emplace(method.formal_params[i], actual_args[i]);
+        }
+        return ExecuteBody(method, closure, nullptr, context);
+    }
+
+    ObjectHolder ClassInstance::Invoke(const Method& method, const Frame& frame,
+                                       Context& context) {
+        if (MemoryStats* stats = MemoryStats::Current(); stats != nullptr) {
+            stats->AddFrame();
         }
-        return found_method->body->Execute(closure, context);
+        Closure closure;
+        return ExecuteBody(method, closure, &frame, context);
+    }
+
+    namespace {
+        std::atomic<std::uint32_t> next_class_id{1};
     }
 
     Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
-            : name_(std::move(name))
+            : Object(Kind::Class)
+            , name_(std::move(name))
             , methods_(std::move(methods))
-            , parent_(parent) {
-        auto lambda = [](const Method& lhs, const Method& rhs) {
-            return lhs.name < rhs.name;
-        };
-        std::sort(methods.begin(), methods.end(), lambda);
+            , parent_(parent)
+            , id_(next_class_id.fetch_add(1, std::memory_order_relaxed)) {
+        if (parent_ != nullptr) {
+            method_table_ = parent_->method_table_;
+            method_slots_ = parent_->method_slots_;
+        }
+        // Обход с конца оставляет в таблице первый из одноимённых методов класса
+        for (auto it = methods_.rbegin(); it != methods_.rend(); ++it) {
+            auto [found, inserted] = method_table_.try_emplace(
+                it->name, static_cast<std::uint32_t>(method_slots_.size()));
+            if (inserted) {
+                method_slots_.push_back(&*it);
+            } else {
+                method_slots_[found->second] = &*it;
+            }
+        }
+        for (size_t i = 0; i < SPECIAL_METHOD_COUNT; ++i) {
+            special_methods_[i] = GetMethod(SPECIAL_METHOD_NAMES[i]);
+        }
     }
 
-    const Method* Class::GetMethod(const std::string& name) const {
-        auto lambda = [name](const Method& lhs) {
-            return lhs.name == name;
-        };
+    std::uint32_t Class::FindMethodSlot(Symbol name) const {
+        auto found = method_table_.find(name);
+        return found != method_table_.end() ? found->second : NO_METHOD;
+    }
 
-        auto found_in_class = std::find_if(methods_.begin(), methods_.end(), lambda);
-        if (found_in_class != methods_.end()) {
-            return &(*found_in_class);
-        }
+    const Method* Class::GetMethod(Symbol name) const {
+        return GetMethodAt(FindMethodSlot(name));
+    }
 
-        if (parent_ == nullptr) {
-            return nullptr;
-        }
+    MethodCache::MethodCache(const MethodCache& other) {
+        *this = other;
+    }
 
-        auto found_in_parents = std::find_if(parent_->methods_.begin(), parent_->methods_.end(), lambda);
-        if (found_in_parents != parent_->methods_.end()) {
-            return &(*found_in_parents);
+    MethodCache& MethodCache::operator=(const MethodCache& other) {
+        for (size_t i = 0; i < SIZE; ++i) {
+            entries_[i].store(other.entries_[i].load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
         }
-        return nullptr;
+        next_.store(other.next_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    const Method* MethodCache::Update(const Class& cls, Symbol name) {
+        const std::uint32_t slot = cls.FindMethodSlot(name);
+        // Гонка за номер записи безопасна: в худшем случае одна из записей перезаписывается
+        const std::uint8_t next = next_.load(std::memory_order_relaxed);
+        next_.store(static_cast<std::uint8_t>((next + 1) % SIZE), std::memory_order_relaxed);
+        entries_[next].store(static_cast<std::uint64_t>(cls.GetId()) << 32 | slot,
+                             std::memory_order_relaxed);
+        return cls.GetMethodAt(slot);
     }
 
     [[nodiscard]] const std::string& Class::GetName() const {
         return name_;
     }
 
+    std::vector<Method>& Class::Methods() {
+        return methods_;
+    }
+
+    const std::vector<Method>& Class::Methods() const {
+        return methods_;
+    }
+
     void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
         os << "Class " << name_;
     }
 
+    void Class::AppendTo(std::string& out, [[maybe_unused]] Context& context) {
+        out += "Class "sv;
+        out += name_;
+    }
+
+    // Часть верёвки: лист с готовой строкой либо конкатенация двух частей
+    struct String::Piece {
+        explicit Piece(std::string leaf)
+            : value(std::move(leaf))
+            , size(value.size()) {
+            Account();
+        }
+
+        Piece(std::shared_ptr<Piece> lhs, std::shared_ptr<Piece> rhs)
+            : left(std::move(lhs))
+            , right(std::move(rhs))
+            , size(left->size + right->size) {
+            Account();
+        }
+
+        Piece(const Piece&) = delete;
+        Piece& operator=(const Piece&) = delete;
+
+        // Верёвка, собранная в цикле, может быть очень глубокой, поэтому части, которыми
+        // больше никто не владеет, освобождаются без рекурсии
+        ~Piece() {
+            std::vector<std::shared_ptr<Piece>> pending;
+            auto detach = [&pending](std::shared_ptr<Piece>& child) {
+                if (child != nullptr && child.use_count() == 1) {
+                    pending.push_back(std::move(child));
+                }
+            };
+            detach(left);
+            detach(right);
+            while (!pending.empty()) {
+                auto piece = std::move(pending.back());
+                pending.pop_back();
+                detach(piece->left);
+                detach(piece->right);
+            }
+            if (stats != nullptr) {
+                stats->FreeString(Bytes());
+            }
+        }
+
+        [[nodiscard]] bool IsLeaf() const {
+            return left == nullptr;
+        }
+
+        // Значение листа
+        std::string value;
+        std::shared_ptr<Piece> left;
+        std::shared_ptr<Piece> right;
+        std::size_t size = 0;
+        // Счётчики, в которых учтена часть
+        MemoryStats* stats = nullptr;
+
+    private:
+        // Возвращает память части вместе с символами, не поместившимися внутрь std::string
+        [[nodiscard]] std::size_t Bytes() const {
+            static const std::size_t inline_capacity = std::string().capacity();
+            return sizeof(Piece) + (value.capacity() > inline_capacity ? value.capacity() + 1 : 0);
+        }
+
+        void Account() {
+            stats = MemoryStats::Current();
+            if (stats != nullptr) {
+                stats->AllocateString(Bytes());
+            }
+        }
+    };
+
+    namespace {
+        // Строки не длиннее этой всегда хранятся одним листом
+        constexpr size_t SHORT_STRING_SIZE = 64;
+
+        // Вызывает action для значений листьев верёвки root слева направо
+        template <typename Piece, typename Action>
+        void ForEachLeaf(const Piece& root, Action action) {
+            std::vector<const Piece*> stack{&root};
+            while (!stack.empty()) {
+                const Piece* piece = stack.back();
+                stack.pop_back();
+                if (piece->IsLeaf()) {
+                    action(piece->value);
+                } else {
+                    stack.push_back(piece->right.get());
+                    stack.push_back(piece->left.get());
+                }
+            }
+        }
+    }
+
+    String::String(std::string value)
+        : Object(Kind::String)
+        , piece_(std::make_shared<Piece>(std::move(value))) {
+    }
+
+    String::String(std::shared_ptr<Piece> piece)
+        : Object(Kind::String)
+        , piece_(std::move(piece)) {
+    }
+
+    String String::Concat(const String& lhs, const String& rhs) {
+        const Piece& left = *lhs.piece_;
+        const Piece& right = *rhs.piece_;
+        if (right.size == 0) {
+            return lhs;
+        }
+        if (left.size == 0) {
+            return rhs;
+        }
+        if (left.size + right.size <= SHORT_STRING_SIZE) {
+            return String(lhs.GetValue() + rhs.GetValue());
+        }
+        // Короткий правый операнд дописывается к короткому последнему листу левого,
+        // так что s = s + 'x' добавляет новую часть лишь раз в SHORT_STRING_SIZE символов
+        if (!left.IsLeaf() && left.right->IsLeaf()
+            && left.right->size + right.size <= SHORT_STRING_SIZE) {
+            auto last = std::make_shared<Piece>(left.right->value + rhs.GetValue());
+            return String(std::make_shared<Piece>(left.left, std::move(last)));
+        }
+        return String(std::make_shared<Piece>(lhs.piece_, rhs.piece_));
+    }
+
+    const std::string& String::GetValue() const {
+        if (!piece_->IsLeaf()) {
+            std::string value;
+            value.reserve(piece_->size);
+            ForEachLeaf(*piece_, [&value](const std::string& part) {
+                value += part;
+            });
+            piece_ = std::make_shared<Piece>(std::move(value));
+        }
+        return piece_->value;
+    }
+
+    size_t String::Size() const {
+        return piece_->size;
+    }
+
+    void String::Print(std::ostream& os, [[maybe_unused]] Context& context) {
+        ForEachLeaf(*piece_, [&os](const std::string& part) {
+            os.write(part.data(), static_cast<std::streamsize>(part.size()));
+        });
+    }
+
+    void String::WriteTo(OutputBuffer& buffer) const {
+        ForEachLeaf(*piece_, [&buffer](const std::string& part) {
+            buffer.Write(part);
+        });
+    }
+
+    void String::AppendTo(std::string& out, [[maybe_unused]] Context& context) {
+        out.reserve(out.size() + piece_->size);
+        ForEachLeaf(*piece_, [&out](const std::string& part) {
+            out += part;
+        });
+    }
+
     void Bool::Print(std::ostream& os, [[maybe_unused]] Context& context) {
         os << (GetValue() ? "True"sv : "False"sv);
     }
 
+    void Bool::AppendTo(std::string& out, [[maybe_unused]] Context& context) {
+        out += GetValue() ? "True"sv : "False"sv;
+    }
+
     namespace {
+        // Вид объекта, общий для lhs и rhs, либо Other, если объекты разных видов или пусты
+        Object::Kind CommonKind(const Object* lhs, const Object* rhs) {
+            if (lhs == nullptr || rhs == nullptr || lhs->GetKind() != rhs->GetKind()) {
+                return Object::Kind::Other;
+            }
+            return lhs->GetKind();
+        }
+
         template <typename T>
-        bool TypeChecking(const ObjectHolder& lhs, const ObjectHolder& rhs) {
-            auto lhs_t = lhs.TryAs<T>();
-            auto rhs_t = rhs.TryAs<T>();
-            return lhs_t != nullptr && rhs_t != nullptr;
+        bool EqualImpl(const Object* lhs, const Object* rhs) {
+            return static_cast<const T*>(lhs)->GetValue() == static_cast<const T*>(rhs)->GetValue();
         }
 
         template <typename T>
-        bool EqualImpl(const ObjectHolder& lhs, const ObjectHolder& rhs) {
-            return lhs.TryAs<T>()->GetValue() == rhs.TryAs<T>()->GetValue();
+        bool LessImpl(const Object* lhs, const Object* rhs) {
+            return static_cast<const T*>(lhs)->GetValue() < static_cast<const T*>(rhs)->GetValue();
         }
 
+        // Трёхстороннее сравнение значений объектов типа T
         template <typename T>
-        bool LessImpl(const ObjectHolder& lhs, const ObjectHolder& rhs) {
-            return lhs.TryAs<T>()->GetValue() < rhs.TryAs<T>()->GetValue();
+        int OrderImpl(const Object* lhs, const Object* rhs) {
+            const auto& lhs_value = static_cast<const T*>(lhs)->GetValue();
+            const auto& rhs_value = static_cast<const T*>(rhs)->GetValue();
+            if constexpr (std::is_same_v<T, String>) {
+                return lhs_value.compare(rhs_value);
+            } else {
+                return static_cast<int>(rhs_value < lhs_value) - static_cast<int>(lhs_value < rhs_value);
+            }
         }
 
     }
@@ -179,21 +1022,20 @@ namespace runtime {
             return true;
         }
 
-        if (TypeChecking<Bool>(lhs, rhs)) {
-            return EqualImpl<Bool>(lhs, rhs);
-        }
-
-        if (TypeChecking<Number>(lhs, rhs)) {
-            return EqualImpl<Number>(lhs, rhs);
-        }
-
-        if (TypeChecking<String>(lhs, rhs)) {
-            return EqualImpl<String>(lhs, rhs);
+        switch (CommonKind(lhs.Get(), rhs.Get())) {
+            case Object::Kind::Bool:
+                return EqualImpl<Bool>(lhs.Get(), rhs.Get());
+            case Object::Kind::Number:
+                return EqualImpl<Number>(lhs.Get(), rhs.Get());
+            case Object::Kind::String:
+                return EqualImpl<String>(lhs.Get(), rhs.Get());
+            default:
+                break;
         }
 
         auto lhs_instance = lhs.TryAs<ClassInstance>();
         if (lhs_instance != nullptr) {
-            const auto result = lhs_instance->Call("__eq__"s, {rhs}, context);
+            const auto result = CallSpecial(*lhs_instance, SpecialMethod::Eq, rhs, context);
             return result.TryAs<Bool>()->GetValue();
         }
 
@@ -205,41 +1047,70 @@ namespace runtime {
             throw std::runtime_error("Cannot compare objects for less"s);
         }
 
-        if (TypeChecking<Bool>(lhs, rhs)) {
-            return LessImpl<Bool>(lhs, rhs);
-        }
-
-        if (TypeChecking<Number>(lhs, rhs)) {
-            return LessImpl<Number>(lhs, rhs);
-        }
-
-        if (TypeChecking<String>(lhs, rhs)) {
-            return LessImpl<String>(lhs, rhs);
+        switch (CommonKind(lhs.Get(), rhs.Get())) {
+            case Object::Kind::Bool:
+                return LessImpl<Bool>(lhs.Get(), rhs.Get());
+            case Object::Kind::Number:
+                return LessImpl<Number>(lhs.Get(), rhs.Get());
+            case Object::Kind::String:
+                return LessImpl<String>(lhs.Get(), rhs.Get());
+            default:
+                break;
         }
 
         auto lhs_instance = lhs.TryAs<ClassInstance>();
         if (lhs_instance != nullptr) {
-            const auto result = lhs_instance->Call("__lt__"s, {rhs}, context);
+            const auto result = CallSpecial(*lhs_instance, SpecialMethod::Lt, rhs, context);
             return static_cast<bool>(result.TryAs<Bool>()->GetValue());
         }
 
         throw std::runtime_error("Cannot compare objects for less"s);
     }
 
+    bool Compare(Comparator op, const ObjectHolder& lhs, const ObjectHolder& rhs,
+                 Context& context) {
+        switch (CommonKind(lhs.Get(), rhs.Get())) {
+            case Object::Kind::Bool:
+                return ApplyComparator(op, OrderImpl<Bool>(lhs.Get(), rhs.Get()));
+            case Object::Kind::Number:
+                return ApplyComparator(op, OrderImpl<Number>(lhs.Get(), rhs.Get()));
+            case Object::Kind::String:
+                return ApplyComparator(op, OrderImpl<String>(lhs.Get(), rhs.Get()));
+            default:
+                break;
+        }
+
+        switch (op) {
+            case Comparator::Equal:
+                return Equal(lhs, rhs, context);
+            case Comparator::NotEqual:
+                return !Equal(lhs, rhs, context);
+            case Comparator::Less:
+                return Less(lhs, rhs, context);
+            case Comparator::Greater:
+                return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
+            case Comparator::LessOrEqual:
+                return Less(lhs, rhs, context) || Equal(lhs, rhs, context);
+            case Comparator::GreaterOrEqual:
+                return !Less(lhs, rhs, context);
+        }
+        return false;
+    }
+
     bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Equal(lhs, rhs, context);
+        return Compare(Comparator::NotEqual, lhs, rhs, context);
     }
 
     bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
+        return Compare(Comparator::Greater, lhs, rhs, context);
     }
 
     bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return Less(lhs, rhs, context) || Equal(lhs, rhs, context);
+        return Compare(Comparator::LessOrEqual, lhs, rhs, context);
     }
 
     bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Less(lhs, rhs, context);
+        return Compare(Comparator::GreaterOrEqual, lhs, rhs, context);
     }
 
 }  // namespace runtime
\ No newline at end of file
@@ -1,43 +1,316 @@
 #pragma once
 
+#include "memory_stats.h"
+#include "output.h"
+#include "symbol.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace runtime {
 
-// Контекст исполнения инструкций Mython
-class Context {
-public:
-    // Возвращает поток вывода для команд print
-    virtual std::ostream& GetOutputStream() = 0;
+class Context;
+class Class;
+class ClassInstance;
+class CycleCollector;
+class Profiler;
 
-protected:
-    ~Context() = default;
-};
+// Счётчик владеющих ссылок на объект. В однопоточной сборке (MYTHON_SINGLE_THREADED) он
+// меняется без атомарных операций
+#ifdef MYTHON_SINGLE_THREADED
+using RefCount = std::uint32_t;
+#else
+using RefCount = std::atomic<std::uint32_t>;
+#endif
 
-// Базовый класс для всех объектов языка Mython
+// Базовый класс для всех объектов языка Mython.
+// Объект в куче хранит число владеющих ссылок ObjectHolder на себя и уничтожается вместе
+// с последней из них
 class Object {
 public:
+    // Вид объекта. Позволяет проверить тип встроенных объектов без dynamic_cast.
+    // Объекты остальных типов имеют вид Other
+    enum class Kind : uint8_t {
+        Other,
+        Number,
+        String,
+        Bool,
+        Class,
+        ClassInstance,
+    };
+
     virtual ~Object() = default;
     // выводит в os своё представление в виде строки
     virtual void Print(std::ostream& os, Context& context) = 0;
+
+    // Дописывает в out то же представление, что выводит Print. По умолчанию выводит объект
+    // через Print во временный поток; встроенные объекты пишут в out напрямую
+    virtual void AppendTo(std::string& out, Context& context);
+
+    [[nodiscard]] Kind GetKind() const {
+        return kind_;
+    }
+
+    // Возвращает число владеющих ссылок на объект. У объекта, которым ObjectHolder не владеет
+    // (например, лежащего на стеке), оно равно 0
+    [[nodiscard]] std::uint32_t GetRefCount() const noexcept {
+#ifdef MYTHON_SINGLE_THREADED
+        return refs_;
+#else
+        return refs_.load(std::memory_order_relaxed);
+#endif
+    }
+
+protected:
+    explicit Object(Kind kind = Kind::Other)
+        : kind_(kind) {
+    }
+
+    // Копия объекта - новый объект, у которого ещё нет владельцев
+    Object(const Object& other) noexcept
+        : kind_(other.kind_) {
+    }
+
+    Object& operator=(const Object& /*other*/) noexcept {
+        return *this;
+    }
+
+private:
+    friend class ObjectHolder;
+
+    void AddRef() noexcept {
+#ifdef MYTHON_SINGLE_THREADED
+        ++refs_;
+#else
+        refs_.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+    void Release() noexcept {
+#ifdef MYTHON_SINGLE_THREADED
+        if (--refs_ == 0) {
+            Destroy();
+        }
+#else
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy();
+        }
+#endif
+    }
+
+    // Уничтожает объект, когда освобождена последняя владеющая ссылка на него.
+    // Объекты, созданные ObjectHolder::Own, возвращают память своему распределителю
+    virtual void Destroy() noexcept {
+        delete this;
+    }
+
+    Kind kind_;
+    RefCount refs_{0};
+};
+
+// Объект типа T в куче, созданный ObjectHolder::Own. Память выделена распределителем Allocator
+// и возвращается ему, когда освобождена последняя владеющая ссылка на объект.
+// Распределитель хранится в самом объекте, поэтому отдельного управляющего блока нет
+template <typename T, typename Allocator>
+class Owned final : public T, private Allocator {
+public:
+    template <typename... Args>
+    explicit Owned(const Allocator& allocator, Args&&... args)
+        : T(std::forward<Args>(args)...)
+        , Allocator(allocator) {
+    }
+
+private:
+    using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Owned>;
+
+    void Destroy() noexcept override {
+        BlockAllocator allocator(static_cast<const Allocator&>(*this));
+        this->~Owned();
+        allocator.deallocate(this, 1);
+    }
+};
+
+// Объект-значение, хранящий значение типа T
+template <typename T>
+class ValueObject : public Object {
+public:
+    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Object(ValueKind())
+        , value_(v) {
+    }
+
+    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
+        if constexpr (std::is_same_v<T, int>) {
+            NumberChars chars;
+            const std::string_view text = FormatNumber(value_, chars);
+            os.write(text.data(), static_cast<std::streamsize>(text.size()));
+        } else {
+            os << value_;
+        }
+    }
+
+    void AppendTo(std::string& out, Context& context) override {
+        if constexpr (std::is_same_v<T, int>) {
+            NumberChars chars;
+            out += FormatNumber(value_, chars);
+        } else {
+            Object::AppendTo(out, context);
+        }
+    }
+
+    [[nodiscard]] const T& GetValue() const {
+        return value_;
+    }
+
+protected:
+    ValueObject(T v, Kind kind)
+        : Object(kind)
+        , value_(v) {
+    }
+
+private:
+    static constexpr Kind ValueKind() {
+        if constexpr (std::is_same_v<T, int>) {
+            return Kind::Number;
+        } else {
+            return Kind::Other;
+        }
+    }
+
+    T value_;
 };
 
-// Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
+// Строковое значение. Конкатенация не копирует символы операндов: результат ссылается
+// на их части (верёвка, rope) и склеивается в одну строку лишь при первом вызове GetValue.
+// Части неизменяемы и разделяются между строками, поэтому цепочка s = s + x линейна
+class String : public Object {
+public:
+    String(std::string value);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+    // Возвращает конкатенацию lhs и rhs. Короткие части копируются сразу, чтобы верёвка
+    // не вырождалась в цепочку из отдельных символов
+    [[nodiscard]] static String Concat(const String& lhs, const String& rhs);
+
+    // Возвращает значение строки, при необходимости склеивая её части
+    [[nodiscard]] const std::string& GetValue() const;
+
+    // Возвращает длину строки, не склеивая её части
+    [[nodiscard]] std::size_t Size() const;
+
+    // Выводит части строки по порядку, не склеивая их
+    void Print(std::ostream& os, Context& context) override;
+
+    // Дописывает части строки в buffer, не склеивая их
+    void WriteTo(OutputBuffer& buffer) const;
+
+    void AppendTo(std::string& out, Context& context) override;
+
+private:
+    struct Piece;
+
+    explicit String(std::shared_ptr<Piece> piece);
+
+    // Корень верёвки. После склеивания GetValue заменяет его листом с готовой строкой
+    mutable std::shared_ptr<Piece> piece_;
+};
+
+// Числовое значение
+using Number = ValueObject<int>;
+
+// Логическое значение
+class Bool : public ValueObject<bool> {
+public:
+    Bool(bool v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ValueObject(v, Kind::Bool) {
+    }
+
+    void Print(std::ostream& os, Context& context) override;
+    void AppendTo(std::string& out, Context& context) override;
+};
+
+// Вид объектов типа T либо Object::Kind::Other, если тип T проверяется через dynamic_cast
+template <typename T>
+inline constexpr Object::Kind KIND_OF = Object::Kind::Other;
+template <>
+inline constexpr Object::Kind KIND_OF<Number> = Object::Kind::Number;
+template <>
+inline constexpr Object::Kind KIND_OF<String> = Object::Kind::String;
+template <>
+inline constexpr Object::Kind KIND_OF<Bool> = Object::Kind::Bool;
+template <>
+inline constexpr Object::Kind KIND_OF<Class> = Object::Kind::Class;
+template <>
+inline constexpr Object::Kind KIND_OF<ClassInstance> = Object::Kind::ClassInstance;
+
+static_assert(static_cast<std::size_t>(Object::Kind::ClassInstance) + 1 == OBJECT_KIND_COUNT);
+
+// Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе.
+// Числа и логические значения хранятся внутри ObjectHolder без выделения памяти в куче,
+// остальные объекты - в куче со встроенным счётчиком ссылок (см. Object).
+// Не владеющая ссылка не меняет счётчик и ничего не выделяет
 class ObjectHolder {
 public:
     // Создаёт пустое значение
     ObjectHolder() = default;
 
+    ObjectHolder(const ObjectHolder&) = default;
+
+    // Значение копируется до освобождения прежнего, поэтому other может принадлежать объекту,
+    // который освобождается вместе с прежним значением
+    ObjectHolder& operator=(const ObjectHolder& other) {
+        if (this != &other) {
+            *this = ObjectHolder(other);
+        }
+        return *this;
+    }
+
+    // После перемещения исходный ObjectHolder пуст, в том числе для чисел и логических значений
+    ObjectHolder(ObjectHolder&& other) noexcept
+        : data_(std::exchange(other.data_, Data{})) {
+    }
+
+    ObjectHolder& operator=(ObjectHolder&& other) noexcept {
+        data_ = std::exchange(other.data_, Data{});
+        return *this;
+    }
+
     // Возвращает ObjectHolder, владеющий объектом типа T
     // Тип T - конкретный класс-наследник Object.
-    // object копируется или перемещается в кучу
+    // Number и Bool копируются внутрь ObjectHolder, остальные объекты - в кучу
+    // Созданный объект учитывается в MemoryStats::Current(), если они заданы
     template <typename T>
     [[nodiscard]] static ObjectHolder Own(T&& object) {
-        return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+        using Type = std::decay_t<T>;
+        MemoryStats* stats = MemoryStats::Current();
+        constexpr auto kind = static_cast<std::size_t>(KIND_OF<Type>);
+        if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+            if (stats != nullptr) {
+                stats->AddValue(kind);
+            }
+            return ObjectHolder(Data(std::in_place_type<Type>, std::forward<T>(object)));
+        } else if constexpr (std::is_same_v<Type, ClassInstance>) {
+            return OwnInstance(Type(std::forward<T>(object)), stats);
+        } else {
+            if (stats != nullptr) {
+                return Allocate<Type>(CountingAllocator<Type>(*stats, kind),
+                                      std::forward<T>(object));
+            }
+            return Allocate<Type>(std::allocator<Type>(), std::forward<T>(object));
+        }
     }
 
     // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
@@ -51,139 +324,917 @@ public:
 
     Object* operator->() const;
 
-    [[nodiscard]] Object* Get() const;
+    // Возвращает указатель на хранимый объект либо nullptr для None.
+    // Указатель на число или логическое значение действителен, пока жив и не изменён
+    // этот ObjectHolder
+    [[nodiscard]] Object* Get() const {
+        switch (data_.index()) {
+            case NUMBER_INDEX:
+                return std::get_if<Number>(&data_);
+            case BOOL_INDEX:
+                return std::get_if<Bool>(&data_);
+            default:
+                return std::get_if<Reference>(&data_)->Get();
+        }
+    }
 
     // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
     // объект данного типа
     template <typename T>
     [[nodiscard]] T* TryAs() const {
-        return dynamic_cast<T*>(this->Get());
+        using Type = std::remove_cv_t<T>;
+        if constexpr (KIND_OF<Type> != Object::Kind::Other) {
+            if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+                if (auto* value = std::get_if<Type>(&data_)) {
+                    return value;
+                }
+            }
+            // Вид объекта совпадает с KIND_OF<Type> только у Type и его наследников
+            Object* object = HeapObject();
+            return object != nullptr && object->GetKind() == KIND_OF<Type>
+                       ? static_cast<T*>(object)
+                       : nullptr;
+        } else {
+            return dynamic_cast<T*>(this->Get());
+        }
     }
 
     // Возвращает true, если ObjectHolder не пуст
-    explicit operator bool() const;
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
 
 private:
-    explicit ObjectHolder(std::shared_ptr<Object> data);
+    // Экземпляр класса создаёт владеющую ссылку на себя
+    friend class ClassInstance;
+
+    // Ссылка на объект в куче. Владеющая ссылка учитывается в счётчике ссылок объекта
+    class Reference {
+    public:
+        Reference() noexcept
+            : object_(nullptr)
+            , owning_(false) {
+        }
+
+        Reference(Object* object, bool owning) noexcept
+            : object_(object)
+            , owning_(owning) {
+            if (owning_) {
+                object_->AddRef();
+            }
+        }
+
+        Reference(const Reference& other) noexcept
+            : Reference(other.object_, other.owning_) {
+        }
+
+        Reference(Reference&& other) noexcept
+            : object_(std::exchange(other.object_, nullptr))
+            , owning_(std::exchange(other.owning_, false)) {
+        }
+
+        Reference& operator=(Reference other) noexcept {
+            std::swap(object_, other.object_);
+            std::swap(owning_, other.owning_);
+            return *this;
+        }
+
+        ~Reference() {
+            if (owning_) {
+                object_->Release();
+            }
+        }
+
+        [[nodiscard]] Object* Get() const {
+            return object_;
+        }
+
+        [[nodiscard]] bool IsOwning() const {
+            return owning_;
+        }
+
+    private:
+        Object* object_;
+        bool owning_;
+    };
+
+    // Порядок альтернатив соответствует константам *_INDEX
+    using Data = std::variant<Reference, Number, Bool>;
+    static constexpr std::size_t NUMBER_INDEX = 1;
+    static constexpr std::size_t BOOL_INDEX = 2;
+
+    explicit ObjectHolder(Data data);
     void AssertIsValid() const;
 
-    std::shared_ptr<Object> data_;
+    // Размещает объект типа T, созданный из args, распределителем allocator
+    // и возвращает владеющую ссылку на него
+    template <typename T, typename Allocator, typename... Args>
+    [[nodiscard]] static ObjectHolder Allocate(const Allocator& allocator, Args&&... args) {
+        using Block = Owned<T, Allocator>;
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Block> block_allocator(
+            allocator);
+        Block* block = block_allocator.allocate(1);
+        try {
+            ::new (static_cast<void*>(block)) Block(allocator, std::forward<Args>(args)...);
+        } catch (...) {
+            block_allocator.deallocate(block, 1);
+            throw;
+        }
+        return ObjectHolder(Data(Reference(block, true)));
+    }
+
+    // Размещает экземпляр в пуле его класса
+    [[nodiscard]] static ObjectHolder OwnInstance(ClassInstance&& instance, MemoryStats* stats);
+
+    [[nodiscard]] Object* HeapObject() const {
+        auto* reference = std::get_if<Reference>(&data_);
+        return reference != nullptr ? reference->Get() : nullptr;
+    }
+
+    // mutable: константный ObjectHolder, как и указатель, даёт изменяемый доступ к объекту
+    mutable Data data_;
 };
 
-// Объект-значение, хранящий значение типа T
-template <typename T>
-class ValueObject : public Object {
+// Кадр вызова метода, прошедшего разрешение имён при разборе.
+// self, параметры и локальные переменные метода лежат в слотах с назначенными им индексами.
+// Пустой слот соответствует переменной, которой ещё не присвоено значение.
+// Кадр не владеет слотами: они лежат в стеке ValueStack и принадлежат StackFrame
+class Frame {
 public:
-    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : value_(v) {
+    Frame(std::optional<ObjectHolder>* slots, std::size_t size)
+        : slots_(slots)
+        , size_(size) {
     }
 
-    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
-        os << value_;
+    [[nodiscard]] std::optional<ObjectHolder>& operator[](std::size_t index) const {
+        return slots_[index];
     }
 
-    [[nodiscard]] const T& GetValue() const {
-        return value_;
+    [[nodiscard]] std::size_t Size() const {
+        return size_;
     }
 
 private:
-    T value_;
+    std::optional<ObjectHolder>* slots_;
+    std::size_t size_;
+};
+
+// Стек слотов кадров потока. Кадры всех активных вызовов методов дерева разбора лежат в нём
+// подряд, поэтому вызов не выделяет память. Стек не перераспределяется, и кадры не перемещаются
+// при вложенных вызовах. У каждого потока свой стек
+class ValueStack {
+public:
+    // Наибольшее число слотов всех активных кадров
+    static constexpr std::size_t CAPACITY = std::size_t{1} << 18;
+
+    ValueStack();
+
+    ValueStack(const ValueStack&) = delete;
+    ValueStack& operator=(const ValueStack&) = delete;
+
+    // Возвращает стек текущего потока
+    [[nodiscard]] static ValueStack& ForCurrentThread();
+
+private:
+    friend class StackFrame;
+
+    std::vector<std::optional<ObjectHolder>> slots_;
+    std::size_t top_ = 0;
+};
+
+// Кадр из size пустых слотов на вершине стека stack на время своего существования.
+// При уничтожении слоты очищаются. Кадры освобождаются в порядке, обратном созданию.
+// Если стек переполнен, конструктор выбрасывает runtime_error
+class StackFrame {
+public:
+    StackFrame(ValueStack& stack, std::size_t size);
+
+    StackFrame(const StackFrame&) = delete;
+    StackFrame& operator=(const StackFrame&) = delete;
+
+    ~StackFrame();
+
+    [[nodiscard]] const Frame& Get() const {
+        return frame_;
+    }
+
+    [[nodiscard]] std::optional<ObjectHolder>& operator[](std::size_t index) const {
+        return frame_[index];
+    }
+
+private:
+    ValueStack& stack_;
+    Frame frame_;
+};
+
+// Контекст исполнения инструкций Mython
+class Context {
+public:
+    // Возвращает поток вывода для команд print
+    virtual std::ostream& GetOutputStream() = 0;
+
+    // Возвращает буфер вывода либо nullptr, если команды print пишут прямо в GetOutputStream.
+    // Поток GetOutputStream контекста с буфером пишет в тот же буфер
+    [[nodiscard]] OutputBuffer* GetOutputBuffer() const {
+        return output_buffer_;
+    }
+
+    // Запоминает результат инструкции return. Пока он не забран методом TakeReturnValue,
+    // составные инструкции прекращают выполнение, и управление возвращается к телу метода
+    void SetReturnValue(ObjectHolder value) {
+        return_value_ = std::move(value);
+        is_returning_ = true;
+    }
+
+    // Возвращает true, если выполняется инструкция return
+    [[nodiscard]] bool IsReturning() const {
+        return is_returning_;
+    }
+
+    // Возвращает результат инструкции return и сбрасывает признак её выполнения
+    ObjectHolder TakeReturnValue() {
+        is_returning_ = false;
+        return std::move(return_value_);
+    }
+
+    // Возвращает кадр выполняемого метода либо nullptr, если переменные хранятся в Closure
+    [[nodiscard]] const Frame* GetFrame() const {
+        return frame_;
+    }
+
+    // Делает frame текущим кадром и возвращает предыдущий
+    const Frame* SetFrame(const Frame* frame) {
+        return std::exchange(frame_, frame);
+    }
+
+    // Возвращает счётчики памяти выполнения либо nullptr, если память не учитывается
+    [[nodiscard]] const MemoryStats* GetMemoryStats() const {
+        return memory_stats_;
+    }
+
+    // Сообщает контексту счётчики, в которых учитывается выполнение. Сам учёт включает
+    // область MemoryScope этих счётчиков
+    void SetMemoryStats(const MemoryStats* stats) {
+        memory_stats_ = stats;
+    }
+
+    // Возвращает профилировщик выполнения либо nullptr, если профилирование выключено
+    [[nodiscard]] Profiler* GetProfiler() const {
+        return profiler_;
+    }
+
+    // Включает профилирование в profiler, который должен жить не меньше контекста.
+    // nullptr выключает профилирование
+    void SetProfiler(Profiler* profiler) {
+        profiler_ = profiler;
+    }
+
+protected:
+    ~Context() = default;
+
+    // Направляет вывод команд print в buffer, который должен жить не меньше контекста
+    void SetOutputBuffer(OutputBuffer* buffer) {
+        output_buffer_ = buffer;
+    }
+
+private:
+    ObjectHolder return_value_;
+    bool is_returning_ = false;
+    const Frame* frame_ = nullptr;
+    OutputBuffer* output_buffer_ = nullptr;
+    Profiler* profiler_ = nullptr;
+    const MemoryStats* memory_stats_ = nullptr;
 };
 
 // Таблица символов, связывающая имя объекта с его значением
-using Closure = std::unordered_map<std::string, ObjectHolder>;
+using Closure = std::unordered_map<Symbol, ObjectHolder>;
 
 // Проверяет, содержится ли в object значение, приводимое к True
 // Для 0, False, None, и пустых строк возвращается false, в остальных случаях - true
 bool IsTrue(const ObjectHolder& object);
 
+// Выводит value так, как его выводит команда print, в буфер вывода контекста, а если буфера
+// нет - в его поток вывода. Числа, строки и логические значения выводятся без участия ostream
+void PrintValue(const ObjectHolder& value, Context& context);
+
+// Выводит символ c (разделитель либо перевод строки) командой print
+void PrintChar(char c, Context& context);
+
+// Дописывает в out строковое представление value, которое возвращает str(value):
+// None для пустого значения
+void AppendString(const ObjectHolder& value, std::string& out, Context& context);
+
 // Интерфейс для выполнения действий над объектами Mython
 class Executable {
 public:
     virtual ~Executable() = default;
+
+    // Пока действует runtime::ArenaScope, объекты размещаются в его арене (см. arena.h)
+    static void* operator new(std::size_t size);
+    static void operator delete(void* pointer) noexcept;
+
     // Выполняет действие над объектами внутри closure, используя context
     // Возвращает результирующее значение либо None
     virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
 };
 
-// Строковое значение
-using String = ValueObject<std::string>;
-// Числовое значение
-using Number = ValueObject<int>;
-
-// Логическое значение
-class Bool : public ValueObject<bool> {
-public:
-    using ValueObject<bool>::ValueObject;
-
-    void Print(std::ostream& os, Context& context) override;
-};
-
 // Метод класса
 struct Method {
     // Имя метода
-    std::string name;
+    Symbol name;
     // Имена формальных параметров метода
-    std::vector<std::string> formal_params;
+    std::vector<Symbol> formal_params;
     // Тело метода
     std::unique_ptr<Executable> body;
+    // Число слотов кадра: self, параметры и локальные переменные.
+    // 0 - имена в теле не разрешены, и переменные метода передаются через Closure
+    std::size_t frame_size = 0;
+};
+
+// Методы с особым смыслом, которые интерпретатор вызывает сам
+enum class SpecialMethod : uint8_t {
+    Init,  // __init__
+    Str,   // __str__
+    Eq,    // __eq__
+    Lt,    // __lt__
+    Add,   // __add__
+};
+
+inline constexpr std::size_t SPECIAL_METHOD_COUNT = 5;
+
+// Форма экземпляра класса - упорядоченный набор имён его полей.
+// Экземпляры, получившие одни и те же поля в одном порядке, имеют общую форму и хранят
+// значения полей в векторе по назначенным формой индексам.
+// Формы образуют дерево переходов: добавление поля переводит экземпляр в дочернюю форму.
+// Созданная форма не меняется, кроме таблицы переходов, которая защищена мьютексом
+class Shape {
+public:
+    // Индекс отсутствующего поля
+    static constexpr std::size_t NO_FIELD = static_cast<std::size_t>(-1);
+
+    Shape() = default;
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+    // Возвращает индекс поля name либо NO_FIELD
+    [[nodiscard]] std::size_t Find(Symbol name) const;
+
+    // Возвращает форму, получающуюся добавлением поля name.
+    // Поля name в форме быть не должно. Повторный вызов возвращает ту же форму
+    [[nodiscard]] const Shape& AddField(Symbol name) const;
+
+    // Возвращает имена полей в порядке их индексов
+    [[nodiscard]] const std::vector<Symbol>& GetNames() const {
+        return names_;
+    }
+
+    [[nodiscard]] std::size_t Size() const {
+        return names_.size();
+    }
+
+    // Возвращает форму, из которой получена данная, либо nullptr для корневой формы
+    [[nodiscard]] const Shape* GetParent() const {
+        return parent_;
+    }
+
+private:
+    std::vector<Symbol> names_;
+    std::unordered_map<Symbol, std::size_t> indices_;
+    const Shape* parent_ = nullptr;
+    // Дочерние формы по имени добавляемого поля
+    mutable std::mutex transitions_mutex_;
+    mutable std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions_;
+};
+
+// Пул блоков памяти для экземпляров одного класса. Блок освобождённого экземпляра попадает
+// в список свободных и достаётся следующему экземпляру, минуя общий распределитель памяти.
+// Пул разделяется всеми потоками, выполняющими программу, и живёт, пока жив его класс
+// или хотя бы один экземпляр, память которого выделена в пуле.
+// Каждый поток держит перед общим списком свой небольшой список свободных блоков, поэтому
+// создание и освобождение экземпляров обычно обходится без блокировки. Блоки в списке потока
+// считаются занятыми, пока поток не вернёт их в пул
+class InstancePool {
+public:
+    InstancePool() = default;
+    InstancePool(const InstancePool&) = delete;
+    InstancePool& operator=(const InstancePool&) = delete;
+
+    // Выделяет блок размера size. Все блоки пула должны быть одного размера
+    void* Allocate(std::size_t size);
+    // Возвращает блок, выделенный Allocate, в список свободных
+    void Deallocate(void* block, std::size_t size) noexcept;
+
+    // Возвращает наибольшее число полей, которое было у экземпляров класса.
+    // Новые экземпляры сразу резервируют столько полей
+    [[nodiscard]] std::size_t GetFieldCountHint() const {
+        return field_count_hint_.load(std::memory_order_relaxed);
+    }
+
+    // Учитывает, что у экземпляра стало field_count полей
+    void UpdateFieldCountHint(std::size_t field_count) {
+        if (field_count > field_count_hint_.load(std::memory_order_relaxed)) {
+            field_count_hint_.store(field_count, std::memory_order_relaxed);
+        }
+    }
+
+    // Освобождает пул от имени класса, как только будет освобождён последний блок
+    struct Releaser {
+        void operator()(InstancePool* pool) const noexcept {
+            pool->Orphan();
+        }
+    };
+
+private:
+    friend struct ThreadBlocks;
+
+    // В однопоточной сборке общий список свободных блоков не блокируется
+#ifdef MYTHON_SINGLE_THREADED
+    struct Mutex {
+        void lock() noexcept {
+        }
+        void unlock() noexcept {
+        }
+    };
+#else
+    using Mutex = std::mutex;
+#endif
+
+    ~InstancePool();
+    // Отмечает, что класс уничтожен, и освобождает пул от его имени. Блоки экземпляров,
+    // переживших класс, больше не задерживаются в списках потоков
+    void Orphan() noexcept;
+    // Освобождает count занятых блоков
+    void Release(std::size_t count = 1) noexcept;
+    // Принимает count блоков списка потока, связанных через первое слово блока
+    void ReturnBlocks(void* head, std::size_t count) noexcept;
+
+    // Сколько свободных блоков хранить. Остальные возвращаются в общий распределитель
+    static constexpr std::size_t MAX_FREE_BLOCKS = 256;
+
+    Mutex mutex_;
+    std::vector<void*> free_;
+    std::size_t block_size_ = 0;
+    // Выделенные блоки и класс-владелец. Блоки освобождаются в разных потоках
+    std::atomic<std::size_t> live_count_ = 1;
+    std::atomic<std::size_t> field_count_hint_ = 0;
+    std::atomic<bool> orphaned_ = false;
 };
 
 // Класс
 class Class : public Object {
 public:
+    // Номер отсутствующего метода
+    static constexpr std::uint32_t NO_METHOD = static_cast<std::uint32_t>(-1);
+
     // Создаёт класс с именем name и набором методов methods, унаследованный от класса parent
     // Если parent равен nullptr, то создаётся базовый класс
     explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
 
     // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-    [[nodiscard]] const Method* GetMethod(const std::string& name) const;
+    // ни в самом классе, ни в его предках. Метод ищется одним обращением к таблице методов,
+    // построенной в конструкторе. Указатель действителен, пока жив класс
+    [[nodiscard]] const Method* GetMethod(Symbol name) const;
+
+    // Возвращает номер метода name в таблице методов класса либо NO_METHOD
+    [[nodiscard]] std::uint32_t FindMethodSlot(Symbol name) const;
+
+    // Возвращает метод с номером slot, полученным от FindMethodSlot, либо nullptr для NO_METHOD
+    [[nodiscard]] const Method* GetMethodAt(std::uint32_t slot) const {
+        return slot != NO_METHOD ? method_slots_[slot] : nullptr;
+    }
+
+    // Возвращает номер класса, уникальный среди всех классов процесса (начиная с 1)
+    [[nodiscard]] std::uint32_t GetId() const {
+        return id_;
+    }
+
+    // Возвращает метод special, найденный в конструкторе, либо nullptr
+    [[nodiscard]] const Method* GetSpecialMethod(SpecialMethod special) const {
+        return special_methods_[static_cast<std::size_t>(special)];
+    }
+
+    // Возвращает форму экземпляров класса, ещё не получивших ни одного поля
+    [[nodiscard]] const Shape& GetRootShape() const {
+        return *root_shape_;
+    }
+
+    // Возвращает пул памяти экземпляров класса
+    [[nodiscard]] InstancePool& GetInstancePool() const {
+        return *instance_pool_;
+    }
 
     // Возвращает имя класса
     [[nodiscard]] const std::string& GetName() const;
 
+    // Возвращает родительский класс либо nullptr для базового класса
+    [[nodiscard]] const Class* GetParent() const {
+        return parent_;
+    }
+
+    // Возвращает собственные методы класса (без методов родителя).
+    // Менять можно только сами методы, но не их количество: на них ссылается таблица методов
+    [[nodiscard]] std::vector<Method>& Methods();
+    [[nodiscard]] const std::vector<Method>& Methods() const;
+
     // Выводит в os строку "Class <имя класса>", например "Class cat"
     void Print(std::ostream& os, Context& context) override;
+    void AppendTo(std::string& out, Context& context) override;
 
 private:
     std::string name_;
     std::vector<Method> methods_;
     const Class* parent_;
+    std::uint32_t id_;
+    // Номера методов класса и всех его предков по именам. Метод класса скрывает одноимённый
+    // метод предка независимо от числа параметров
+    std::unordered_map<Symbol, std::uint32_t> method_table_;
+    std::vector<const Method*> method_slots_;
+    std::array<const Method*, SPECIAL_METHOD_COUNT> special_methods_{};
+    // Формы экземпляров и пул остаются на месте при перемещении класса
+    std::unique_ptr<Shape> root_shape_ = std::make_unique<Shape>();
+    std::unique_ptr<InstancePool, InstancePool::Releaser> instance_pool_{new InstancePool};
 };
 
-// Экземпляр класса
+// Кэш поиска метода в точке вызова. Запоминает методы, найденные для нескольких последних
+// классов получателя; попадание проверяется сравнением номера класса.
+// Каждая запись - одно атомарное слово из номера класса и номера метода в его таблице,
+// поэтому кэш можно разделять между потоками: запись не бывает видна наполовину.
+// Классы должны жить дольше кэша, как и узлы программы, которые на них ссылаются
+class MethodCache {
+public:
+    MethodCache() = default;
+    MethodCache(const MethodCache& other);
+    MethodCache& operator=(const MethodCache& other);
+
+    // Возвращает метод name класса cls либо nullptr, если такого метода нет
+    const Method* Lookup(const Class& cls, Symbol name) {
+        const std::uint64_t key = static_cast<std::uint64_t>(cls.GetId()) << 32;
+        for (const auto& entry : entries_) {
+            const std::uint64_t value = entry.load(std::memory_order_relaxed);
+            if ((value & CLASS_MASK) == key) {
+                return cls.GetMethodAt(static_cast<std::uint32_t>(value));
+            }
+        }
+        return Update(cls, name);
+    }
+
+private:
+    const Method* Update(const Class& cls, Symbol name);
+
+    static constexpr std::uint64_t CLASS_MASK = ~static_cast<std::uint64_t>(0) << 32;
+    static constexpr std::size_t SIZE = 4;
+    // 0 - пустая запись: номера классов начинаются с 1
+    std::array<std::atomic<std::uint64_t>, SIZE> entries_{};
+    std::atomic<std::uint8_t> next_ = 0;
+};
+
+// Поля экземпляра класса в виде словаря "имя - значение".
+// Поддерживает основные операции unordered_map: find, at, operator[], count, обход.
+// Добавление поля делает недействительными ранее полученные итераторы end()
+template <typename Instance>
+class FieldMap {
+    using Holder = std::conditional_t<std::is_const_v<Instance>, const ObjectHolder, ObjectHolder>;
+
+public:
+    struct Field {
+        const Symbol& first;
+        Holder& second;
+    };
+
+    class Iterator {
+    public:
+        struct Arrow {
+            Field field;
+            const Field* operator->() const {
+                return &field;
+            }
+        };
+
+        Iterator(Instance* instance, std::size_t index)
+            : instance_(instance)
+            , index_(index) {
+        }
+
+        Field operator*() const {
+            return {instance_->GetShape().GetNames()[index_], instance_->FieldAt(index_)};
+        }
+
+        Arrow operator->() const {
+            return {**this};
+        }
+
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return instance_ == other.instance_ && index_ == other.index_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Instance* instance_;
+        std::size_t index_;
+    };
+
+    explicit FieldMap(Instance& instance)
+        : instance_(&instance) {
+    }
+
+    [[nodiscard]] Iterator begin() const {
+        return {instance_, 0};
+    }
+
+    [[nodiscard]] Iterator end() const {
+        return {instance_, size()};
+    }
+
+    [[nodiscard]] Iterator find(Symbol name) const {
+        const std::size_t index = instance_->GetShape().Find(name);
+        return index != Shape::NO_FIELD ? Iterator{instance_, index} : end();
+    }
+
+    [[nodiscard]] std::size_t count(Symbol name) const {
+        return instance_->GetShape().Find(name) != Shape::NO_FIELD ? 1 : 0;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return instance_->GetShape().Size();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    // Возвращает значение поля name. Если поля нет, выбрасывает std::out_of_range
+    Holder& at(Symbol name) const {
+        const std::size_t index = instance_->GetShape().Find(name);
+        if (index == Shape::NO_FIELD) {
+            throw std::out_of_range("No field " + name.Str());
+        }
+        return instance_->FieldAt(index);
+    }
+
+    // Возвращает значение поля name, добавляя поле со значением None, если его нет
+    template <typename I = Instance, typename = std::enable_if_t<!std::is_const_v<I>>>
+    ObjectHolder& operator[](Symbol name) const {
+        const Shape& shape = instance_->GetShape();
+        const std::size_t index = shape.Find(name);
+        if (index != Shape::NO_FIELD) {
+            return instance_->FieldAt(index);
+        }
+        return instance_->AddField(shape.AddField(name), ObjectHolder::None());
+    }
+
+private:
+    Instance* instance_;
+};
+
+// Экземпляр класса. Экземпляр, которым владеет ObjectHolder, передаёт методам владеющую
+// ссылку self, поэтому объект, сохранённый методом в другом объекте, не исчезнет раньше него
 class ClassInstance : public Object {
 public:
     explicit ClassInstance(const Class& cls);
 
+    ClassInstance(ClassInstance&& other) noexcept = default;
+    ClassInstance& operator=(ClassInstance&&) = delete;
+
+    // Учитывает освобождение массива полей и перестаёт учитываться сборщиком циклов
+    ~ClassInstance() override;
+
     /*
      * Если у объекта есть метод __str__, выводит в os результат, возвращённый этим методом.
      * В противном случае в os выводится адрес объекта.
      */
     void Print(std::ostream& os, Context& context) override;
 
+    // Дописывает в out результат метода __str__, не создавая промежуточного потока
+    void AppendTo(std::string& out, Context& context) override;
+
     /*
      * Вызывает у объекта метод method, передавая ему actual_args параметров.
      * Параметр context задаёт контекст для выполнения метода.
      * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
      * runtime_error
      */
-    ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+    ObjectHolder Call(Symbol method, const std::vector<ObjectHolder>& actual_args,
+                      Context& context);
+
+    // Вызывает у объекта найденный заранее метод method его класса.
+    // Число actual_args должно совпадать с числом формальных параметров метода
+    ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
                       Context& context);
 
+    // Вызывает у объекта метод method, прошедший разрешение имён, в уже заполненном кадре
+    // frame из method.frame_size слотов: слот 0 содержит self, а следующие - параметры.
+    // Аргументы не копируются, а переходят в кадр вместе с его слотами
+    ObjectHolder Call(const Method& method, const Frame& frame, Context& context);
+
     // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-    [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+    [[nodiscard]] bool HasMethod(Symbol method, size_t argument_count) const;
+
+    // Возвращает словарь полей объекта
+    [[nodiscard]] FieldMap<ClassInstance> Fields();
+    // Возвращает словарь полей объекта, доступный только для чтения
+    [[nodiscard]] FieldMap<const ClassInstance> Fields() const;
 
-    // Возвращает ссылку на Closure, содержащий поля объекта
-    [[nodiscard]] Closure& Fields();
-    // Возвращает константную ссылку на Closure, содержащую поля объекта
-    [[nodiscard]] const Closure& Fields() const;
+    // Возвращает класс, экземпляром которого является объект
+    [[nodiscard]] const Class& GetClass() const;
+
+    // Возвращает форму объекта, задающую индексы его полей
+    [[nodiscard]] const Shape& GetShape() const {
+        return *shape_;
+    }
+
+    // Возвращает поле с индексом index в форме объекта
+    [[nodiscard]] ObjectHolder& FieldAt(std::size_t index) {
+        return values_[index];
+    }
+
+    [[nodiscard]] const ObjectHolder& FieldAt(std::size_t index) const {
+        return values_[index];
+    }
+
+    // Переводит объект в форму shape, полученную из текущей добавлением одного поля,
+    // и записывает в это поле value. Возвращает ссылку на новое поле
+    ObjectHolder& AddField(const Shape& shape, ObjectHolder value);
+
+    // Возвращает владеющую ссылку на объект, если им владеет ObjectHolder, иначе - не владеющую
+    [[nodiscard]] ObjectHolder Self();
 
 private:
+    friend class CycleCollector;
+
+    ObjectHolder Invoke(const Method& method, const std::vector<ObjectHolder>& actual_args,
+                        Context& context);
+    ObjectHolder Invoke(const Method& method, const Frame& frame, Context& context);
+
+    // Возвращает экземпляр, которым владеет holder, либо nullptr, если holder хранит
+    // значение другого типа или не владеет экземпляром
+    [[nodiscard]] static ClassInstance* OwnedInstance(const ObjectHolder& holder);
+
+    // Массив полей. Первые INLINE_SIZE полей лежат в самом экземпляре, то есть в блоке пула
+    // класса, и только более длинный массив выделяется в куче
+    class Values {
+    public:
+        static constexpr std::size_t INLINE_SIZE = 4;
+
+        Values() noexcept = default;
+        Values(Values&& other) noexcept;
+        Values(const Values&) = delete;
+        Values& operator=(const Values&) = delete;
+        Values& operator=(Values&&) = delete;
+        ~Values();
+
+        [[nodiscard]] ObjectHolder& operator[](std::size_t index) {
+            return Data()[index];
+        }
+
+        [[nodiscard]] const ObjectHolder& operator[](std::size_t index) const {
+            return Data()[index];
+        }
+
+        [[nodiscard]] ObjectHolder* begin() {
+            return Data();
+        }
+
+        [[nodiscard]] ObjectHolder* end() {
+            return Data() + size_;
+        }
+
+        [[nodiscard]] const ObjectHolder* begin() const {
+            return Data();
+        }
+
+        [[nodiscard]] const ObjectHolder* end() const {
+            return Data() + size_;
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return size_;
+        }
+
+        // Возвращает размер массива в куче, 0 - поля лежат в экземпляре
+        [[nodiscard]] std::size_t HeapBytes() const {
+            return heap_ != nullptr ? capacity_ * sizeof(ObjectHolder) : 0;
+        }
+
+        void reserve(std::size_t capacity);
+        ObjectHolder& emplace_back(ObjectHolder value);
+
+    private:
+        [[nodiscard]] ObjectHolder* Inline() {
+            return std::launder(reinterpret_cast<ObjectHolder*>(inline_));
+        }
+
+        [[nodiscard]] const ObjectHolder* Inline() const {
+            return std::launder(reinterpret_cast<const ObjectHolder*>(inline_));
+        }
+
+        [[nodiscard]] ObjectHolder* Data() {
+            return heap_ != nullptr ? heap_ : Inline();
+        }
+
+        [[nodiscard]] const ObjectHolder* Data() const {
+            return heap_ != nullptr ? heap_ : Inline();
+        }
+
+        ObjectHolder* heap_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t capacity_ = INLINE_SIZE;
+        alignas(ObjectHolder) std::byte inline_[INLINE_SIZE * sizeof(ObjectHolder)];
+    };
+
     const Class& cls_;
-    Closure fields_;
+    const Shape* shape_;
+    Values values_;
+    // Счётчики, в которых учитывается массив полей
+    MemoryStats* stats_;
+    // Сборщик циклов, учитывающий объект, номер объекта в его поколении и номер в
+    // просматриваемом множестве, увеличенный на единицу (0 - объект не просматривается)
+    CycleCollector* collector_ = nullptr;
+    uint32_t gc_index_ = 0;
+    uint32_t gc_scan_ = 0;
+};
+
+// Кэш доступа к полю в одной точке программы. Запоминает индекс поля и форму, в которую
+// объект переходит при добавлении поля. Запомненный индекс проверяется по имени поля в форме
+// объекта, а переход - по исходной форме, поэтому кэш можно разделять между потоками
+class FieldCache {
+public:
+    FieldCache() = default;
+    FieldCache(const FieldCache& other);
+    FieldCache& operator=(const FieldCache& other);
+
+    // Возвращает поле name объекта instance либо nullptr, если такого поля нет
+    ObjectHolder* Find(ClassInstance& instance, Symbol name) {
+        const std::size_t index = Index(instance.GetShape(), name);
+        return index != Shape::NO_FIELD ? &instance.FieldAt(index) : nullptr;
+    }
+
+    // Присваивает полю name объекта instance значение value, добавляя поле при его отсутствии
+    ObjectHolder& Assign(ClassInstance& instance, Symbol name, ObjectHolder value);
+
+private:
+    std::size_t Index(const Shape& shape, Symbol name) {
+        const std::size_t cached = index_.load(std::memory_order_relaxed);
+        if (cached < shape.Size() && shape.GetNames()[cached] == name) {
+            return cached;
+        }
+        const std::size_t index = shape.Find(name);
+        if (index != Shape::NO_FIELD) {
+            index_.store(index, std::memory_order_relaxed);
+        }
+        return index;
+    }
+
+    std::atomic<std::size_t> index_ = Shape::NO_FIELD;
+    std::atomic<const Shape*> next_ = nullptr;
+};
+
+// Операция сравнения
+enum class Comparator : uint8_t {
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessOrEqual,
+    GreaterOrEqual,
 };
 
+// Возвращает результат операции op по итогу трёхстороннего сравнения order:
+// отрицательное значение - меньше, 0 - равно, положительное - больше
+inline bool ApplyComparator(Comparator op, int order) {
+    switch (op) {
+        case Comparator::Equal:
+            return order == 0;
+        case Comparator::NotEqual:
+            return order != 0;
+        case Comparator::Less:
+            return order < 0;
+        case Comparator::Greater:
+            return order > 0;
+        case Comparator::LessOrEqual:
+            return order <= 0;
+        case Comparator::GreaterOrEqual:
+            return order >= 0;
+    }
+    return false;
+}
+
+/*
+ * Сравнивает lhs и rhs операцией op.
+ * Числа, строки и значения Bool сравниваются за один проход трёхсторонним сравнением.
+ * Для остальных объектов op выражается через Equal и Less: Greater - !Less && !Equal,
+ * LessOrEqual - Less || Equal, причём Equal вызывается, только если результат Less
+ * не определяет ответ
+ */
+bool Compare(Comparator op, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+
 /*
  * Возвращает true, если lhs и rhs содержат одинаковые числа, строки или значения типа Bool.
  * Если lhs - объект с методом __eq__, функция возвращает результат вызова lhs.__eq__(rhs),
@@ -205,9 +1256,9 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 // Возвращает значение, противоположное Equal(lhs, rhs, context)
 bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-// Возвращает значение lhs>rhs, используя функции Equal и Less
+// Возвращает значение lhs>rhs, см. Compare
 bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
-// Возвращает значение lhs<=rhs, используя функции Equal и Less
+// Возвращает значение lhs<=rhs, см. Compare
 bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 // Возвращает значение, противоположное Less(lhs, rhs, context)
 bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
@@ -222,19 +1273,27 @@ struct DummyContext : Context {
     std::ostringstream output;
 };
 
-// Простой контекст, в нём вывод происходит в поток output, переданный в конструктор
+// Простой контекст. Вывод накапливается в буфере и передаётся в поток output, переданный
+// в конструктор, согласно политике policy. Остаток буфера выводится в деструкторе
 class SimpleContext : public runtime::Context {
 public:
-    explicit SimpleContext(std::ostream& output)
-        : output_(output) {
+    explicit SimpleContext(std::ostream& output,
+                           OutputBuffer::FlushPolicy policy = OutputBuffer::FlushPolicy::Chunked)
+        : buffer_(output, policy) {
+        SetOutputBuffer(&buffer_);
     }
 
     std::ostream& GetOutputStream() override {
-        return output_;
+        return buffer_.Stream();
+    }
+
+    // Передаёт накопленный вывод в output
+    void Flush() {
+        buffer_.Flush();
     }
 
 private:
-    std::ostream& output_;
+    OutputBuffer buffer_;
 };
 
 }  // namespace runtime
\ No newline at end of file
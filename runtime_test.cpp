@@ -1,7 +1,10 @@
+#include "memory_stats.h"
 #include "runtime.h"
 #include "test_runner_p.h"
 
 #include <functional>
+#include <limits>
+#include <thread>
 
 using namespace std;
 
@@ -19,7 +22,8 @@ public:
     }
 
     Logger(const Logger& rhs)
-        : id_(rhs.id_)  //
+        : Object(rhs)
+        , id_(rhs.id_)  //
     {
         ++instance_count;
     }
@@ -161,6 +165,311 @@ void TestMethodInvocation() {
     ASSERT_THROWS(child_inst.Call("test"s, {ObjectHolder::None()}, context), runtime_error);
 }
 
+void TestMethodTable() {
+    DummyContext context;
+    auto make_method = [](string name, vector<Symbol> params, int result) {
+        auto body = [result](Closure& /*closure*/, Context& /*context*/) {
+            return ObjectHolder::Own(Number{result});
+        };
+        return Method{std::move(name), std::move(params), make_unique<TestMethodBody>(body)};
+    };
+
+    vector<Method> base_methods;
+    base_methods.push_back(make_method("base_only"s, {}, 1));
+    base_methods.push_back(make_method("f"s, {"a"s, "b"s}, 2));
+    base_methods.push_back(make_method("g"s, {}, 3));
+    Class base("Base"s, std::move(base_methods), nullptr);
+
+    vector<Method> middle_methods;
+    middle_methods.push_back(make_method("f"s, {"a"s}, 4));
+    middle_methods.push_back(make_method("f"s, {}, 5));
+    Class middle("Middle"s, std::move(middle_methods), &base);
+
+    vector<Method> leaf_methods;
+    leaf_methods.push_back(make_method("g"s, {}, 6));
+    Class leaf("Leaf"s, std::move(leaf_methods), &middle);
+
+    ClassInstance instance(leaf);
+    auto call = [&](const string& name, size_t argument_count) {
+        vector<ObjectHolder> args(argument_count, ObjectHolder::Own(Number{0}));
+        return instance.Call(name, args, context).TryAs<Number>()->GetValue();
+    };
+
+    // Метод прародителя доступен через всю цепочку наследования
+    ASSERT(instance.HasMethod("base_only"s, 0U));
+    ASSERT_EQUAL(call("base_only"s, 0), 1);
+    // Первый из одноимённых методов Middle скрывает метод Base с другим числом параметров
+    ASSERT(instance.HasMethod("f"s, 1U));
+    ASSERT(!instance.HasMethod("f"s, 0U));
+    ASSERT(!instance.HasMethod("f"s, 2U));
+    ASSERT_EQUAL(call("f"s, 1), 4);
+    ASSERT_THROWS(call("f"s, 2), runtime_error);
+    ASSERT_EQUAL(call("g"s, 0), 6);
+    ASSERT(leaf.GetMethod("base_only"s) == base.GetMethod("base_only"s));
+    ASSERT(leaf.GetMethod("missing"s) == nullptr);
+
+    const Method* g = leaf.GetMethod("g"s);
+    ASSERT(g != nullptr);
+    ASSERT(instance.Call(*g, {}, context).TryAs<Number>()->GetValue() == 6);
+}
+
+void TestShapes() {
+    Class cls("Point"s, {}, nullptr);
+    ClassInstance first(cls);
+    ClassInstance second(cls);
+    ASSERT(&first.GetShape() == &cls.GetRootShape());
+    ASSERT(first.Fields().empty());
+
+    first.Fields()["x"s] = ObjectHolder::Own(Number{1});
+    first.Fields()["y"s] = ObjectHolder::Own(Number{2});
+    second.Fields()["x"s] = ObjectHolder::Own(Number{3});
+    ASSERT(&first.GetShape() != &second.GetShape());
+    second.Fields()["y"s] = ObjectHolder::Own(Number{4});
+    // Одинаковый порядок добавления полей даёт общую форму
+    ASSERT(&first.GetShape() == &second.GetShape());
+    ASSERT_EQUAL(first.GetShape().Find("y"s), 1U);
+    ASSERT_EQUAL(first.GetShape().Find("z"s), Shape::NO_FIELD);
+
+    ClassInstance reversed(cls);
+    reversed.Fields()["y"s] = ObjectHolder::None();
+    reversed.Fields()["x"s] = ObjectHolder::None();
+    ASSERT(&reversed.GetShape() != &first.GetShape());
+
+    // Перезапись поля не меняет форму
+    first.Fields()["x"s] = ObjectHolder::Own(Number{10});
+    ASSERT(&first.GetShape() == &second.GetShape());
+    ASSERT_EQUAL(first.Fields().at("x"s).TryAs<Number>()->GetValue(), 10);
+    ASSERT_EQUAL(second.Fields().at("x"s).TryAs<Number>()->GetValue(), 3);
+    ASSERT_THROWS(first.Fields().at("z"s), out_of_range);
+    ASSERT_EQUAL(first.Fields().count("y"s), 1U);
+    ASSERT_EQUAL(first.Fields().size(), 2U);
+
+    vector<string> names;
+    int sum = 0;
+    const ClassInstance& const_first = first;
+    for (auto field : const_first.Fields()) {
+        names.push_back(field.first.Str());
+        sum += field.second.TryAs<Number>()->GetValue();
+    }
+    ASSERT_EQUAL(names, (vector{"x"s, "y"s}));
+    ASSERT_EQUAL(sum, 12);
+    auto found = const_first.Fields().find("y"s);
+    ASSERT(found != const_first.Fields().end());
+    ASSERT_EQUAL(found->first, "y"s);
+
+    FieldCache cache;
+    ClassInstance third(cls);
+    ASSERT(cache.Find(third, "x"s) == nullptr);
+    cache.Assign(third, "x"s, ObjectHolder::Own(Number{5}));
+    ASSERT_EQUAL(third.Fields().at("x"s).TryAs<Number>()->GetValue(), 5);
+    ASSERT(cache.Find(first, "x"s) == &first.FieldAt(0));
+    cache.Assign(first, "x"s, ObjectHolder::Own(Number{6}));
+    ASSERT_EQUAL(first.Fields().at("x"s).TryAs<Number>()->GetValue(), 6);
+}
+
+void TestInstancePool() {
+    const Object* first_address = nullptr;
+    ObjectHolder survivor;
+    {
+        Class cls("Point"s, {}, nullptr);
+        {
+            auto first = ObjectHolder::Own(ClassInstance(cls));
+            first.TryAs<ClassInstance>()->Fields()["x"s] = ObjectHolder::Own(Number{1});
+            first.TryAs<ClassInstance>()->Fields()["y"s] = ObjectHolder::Own(Number{2});
+            first_address = first.Get();
+            auto second = ObjectHolder::Own(ClassInstance(cls));
+            ASSERT(second.Get() != first_address);
+        }
+        // Последний освобождённый блок достаётся следующему экземпляру
+        auto reused = ObjectHolder::Own(ClassInstance(cls));
+        ASSERT(reused.Get() == first_address);
+        ASSERT_EQUAL(cls.GetInstancePool().GetFieldCountHint(), 2U);
+
+        // Немногие поля лежат в самом экземпляре и не занимают памяти в куче
+        MemoryStats stats;
+        {
+            MemoryScope scope(&stats);
+            auto instance = ObjectHolder::Own(ClassInstance(cls));
+            auto fields = instance.TryAs<ClassInstance>()->Fields();
+            fields["x"s] = ObjectHolder::None();
+            fields["y"s] = ObjectHolder::None();
+            ASSERT_EQUAL(stats.GetUsage().field_bytes.current, 0U);
+        }
+
+        // Экземпляры с множеством полей сразу резервируют место под известное число полей
+        const vector<string> names = {"a"s, "b"s, "c"s, "d"s, "e"s, "f"s};
+        {
+            auto instance = ObjectHolder::Own(ClassInstance(cls));
+            for (const string& name : names) {
+                instance.TryAs<ClassInstance>()->Fields()[name] = ObjectHolder::Own(Number{1});
+            }
+            ASSERT_EQUAL(cls.GetInstancePool().GetFieldCountHint(), names.size());
+        }
+        {
+            MemoryScope scope(&stats);
+            auto instance = ObjectHolder::Own(ClassInstance(cls));
+            ASSERT_EQUAL(stats.GetUsage().field_bytes.current, names.size() * sizeof(ObjectHolder));
+            for (const string& name : names) {
+                instance.TryAs<ClassInstance>()->Fields()[name] = ObjectHolder::Own(Number{1});
+            }
+            ASSERT_EQUAL(stats.GetUsage().field_bytes.current, names.size() * sizeof(ObjectHolder));
+            ASSERT_EQUAL(instance.TryAs<ClassInstance>()->Fields()["e"s].TryAs<Number>()->GetValue(),
+                         1);
+        }
+        ASSERT_EQUAL(stats.GetUsage().field_bytes.current, 0U);
+
+        survivor = ObjectHolder::Own(ClassInstance(cls));
+    }
+    // Пул живёт, пока не освобождён последний экземпляр, даже если класс уже уничтожен
+    survivor = ObjectHolder::None();
+}
+
+void TestInstancePoolThreads() {
+    constexpr auto CLASS_INSTANCE = static_cast<size_t>(Object::Kind::ClassInstance);
+    MemoryStats stats;
+    vector<ObjectHolder> survivors;
+    {
+        Class cls("Point"s, {}, nullptr);
+        vector<ObjectHolder> instances;
+        thread([&] {
+            MemoryScope scope(&stats);
+            for (int i = 0; i < 1000; ++i) {
+                auto instance = ObjectHolder::Own(ClassInstance(cls));
+                instance.TryAs<ClassInstance>()->Fields()["x"s] = ObjectHolder::Own(Number{i});
+                instances.push_back(std::move(instance));
+            }
+        }).join();
+        // Блоки, освобождённые в другом потоке, возвращаются в пул при выходе потока
+        thread([&] {
+            instances.resize(10);
+        }).join();
+        ASSERT_EQUAL(stats.GetUsage().objects[CLASS_INSTANCE].live.current, 10U);
+        {
+            MemoryScope scope(&stats);
+            for (int i = 0; i < 1000; ++i) {
+                instances.push_back(ObjectHolder::Own(ClassInstance(cls)));
+            }
+        }
+        survivors.assign(instances.begin(), instances.begin() + 10);
+        ASSERT_EQUAL(survivors[9].TryAs<ClassInstance>()->Fields()["x"s].TryAs<Number>()->GetValue(),
+                     9);
+    }
+    // Экземпляры, пережившие класс, освобождаются в другом потоке вместе с пулом
+    thread([&] {
+        survivors.clear();
+    }).join();
+    ASSERT_EQUAL(stats.GetUsage().objects[CLASS_INSTANCE].live.current, 0U);
+}
+
+void TestValueStack() {
+    ValueStack stack;
+    const auto value = ObjectHolder::Own(String("value"s));
+    {
+        StackFrame outer(stack, 3);
+        outer[0] = value;
+        ASSERT_EQUAL(outer.Get().Size(), 3U);
+        ASSERT(!outer[1].has_value());
+        {
+            // Вложенный кадр лежит сразу за внешним
+            StackFrame inner(stack, 2);
+            ASSERT(&inner[0] == &outer[2] + 1);
+            inner[1] = value;
+        }
+        StackFrame reused(stack, 2);
+        ASSERT(&reused[0] == &outer[2] + 1);
+        ASSERT(!reused[1].has_value());
+        ASSERT(outer[0]->TryAs<String>() == value.TryAs<String>());
+    }
+    // Слоты освобождённых кадров не удерживают значения
+    StackFrame first(stack, 1);
+    ASSERT(!first[0].has_value());
+
+    ASSERT_THROWS(StackFrame(stack, ValueStack::CAPACITY), runtime_error);
+    StackFrame after_overflow(stack, 1);
+    ASSERT(&after_overflow[0] == &first[0] + 1);
+}
+
+void TestKinds() {
+    ASSERT(Number(1).GetKind() == Object::Kind::Number);
+    ASSERT(String("s"s).GetKind() == Object::Kind::String);
+    ASSERT(Bool(true).GetKind() == Object::Kind::Bool);
+    ASSERT(ValueObject<bool>(true).GetKind() == Object::Kind::Other);
+    ASSERT(Logger().GetKind() == Object::Kind::Other);
+
+    Class cls("Test"s, {}, nullptr);
+    ASSERT(cls.GetKind() == Object::Kind::Class);
+    ClassInstance instance(cls);
+    ASSERT(instance.GetKind() == Object::Kind::ClassInstance);
+
+    auto holder = ObjectHolder::Share(instance);
+    ASSERT(holder.TryAs<ClassInstance>() == &instance);
+    ASSERT(holder.TryAs<const ClassInstance>() == &instance);
+    ASSERT(holder.TryAs<Class>() == nullptr);
+    ASSERT(holder.TryAs<Number>() == nullptr);
+    ASSERT(holder.TryAs<Logger>() == nullptr);
+
+    auto string = ObjectHolder::Own(String("text"s));
+    ASSERT_EQUAL(string.TryAs<String>()->GetValue(), "text"s);
+    ASSERT(string.TryAs<ClassInstance>() == nullptr);
+
+    auto logger = ObjectHolder::Own(Logger(5));
+    ASSERT(logger.TryAs<Logger>() != nullptr);
+    ASSERT(logger.TryAs<Number>() == nullptr);
+    ASSERT(logger.TryAs<ClassInstance>() == nullptr);
+}
+
+void TestStringConcat() {
+    DummyContext context;
+    const String hello = "Hello, "s;
+    const String world = "world"s;
+    ASSERT_EQUAL(String::Concat(hello, world).GetValue(), "Hello, world"s);
+    ASSERT_EQUAL(String::Concat(String(""s), world).GetValue(), "world"s);
+
+    // Длинная цепочка s = s + x не копирует накопленную строку
+    const string short_piece = "0123456789"s;
+    const string long_piece(100, 'x');
+    String text = ""s;
+    string expected;
+    for (int i = 0; i < 100000; ++i) {
+        const string& piece = i % 7 == 0 ? long_piece : short_piece;
+        text = String::Concat(text, String(piece));
+        expected += piece;
+    }
+    const String prefix = text;
+    text = String::Concat(text, world);
+    ASSERT_EQUAL(text.Size(), expected.size() + world.Size());
+
+    // Вывод обходит части, не склеивая их
+    text.Print(context.output, context);
+    ASSERT_EQUAL(context.output.str(), expected + "world"s);
+    ASSERT_EQUAL(text.GetValue(), expected + "world"s);
+    // Операнды конкатенации не меняются
+    ASSERT_EQUAL(prefix.GetValue(), expected);
+    ASSERT(IsTrue(ObjectHolder::Own(String::Concat(prefix, world))));
+    ASSERT(!IsTrue(ObjectHolder::Own(String(""s))));
+}
+
+void TestSymbols() {
+    const Symbol x = "x"s;
+    ASSERT(x == Symbol("x"sv));
+    ASSERT(x != Symbol("y"));
+    ASSERT_EQUAL(x.Id(), Symbol(string("x")).Id());
+    ASSERT_EQUAL(x.Str(), "x"s);
+    ASSERT_EQUAL(Symbol().Id(), 0U);
+    ASSERT(Symbol().Str().empty());
+
+    // Имена, собранные во время выполнения, интернируются в те же символы
+    string name = "x_"s;
+    name += "long"s;
+    ASSERT(Symbol(name) == Symbol("x_long"s));
+    ASSERT(&Symbol(name).Str() == &Symbol("x_long"s).Str());
+
+    Closure closure;
+    closure["x"s] = ObjectHolder::Own(Number{1});
+    ASSERT_EQUAL(closure.count(x), 1U);
+    ASSERT_EQUAL(closure.at(x).TryAs<Number>()->GetValue(), 1);
+}
+
 void TestNonowning() {
     ASSERT_EQUAL(Logger::instance_count, 0);
     Logger logger(784);
@@ -199,6 +508,67 @@ void TestOwning() {
     ASSERT_EQUAL(context.output.str(), "312"sv);
 }
 
+void TestRefCount() {
+    ASSERT_EQUAL(Logger::instance_count, 0);
+    {
+        Logger logger;
+        // Не владеющие ссылки не меняют счётчик
+        auto shared = ObjectHolder::Share(logger);
+        ObjectHolder copy = shared;
+        ASSERT_EQUAL(logger.GetRefCount(), 0U);
+    }
+    {
+        auto one = ObjectHolder::Own(Logger(1));
+        ASSERT_EQUAL(one->GetRefCount(), 1U);
+        ObjectHolder two = one;
+        ObjectHolder three;
+        three = two;
+        ASSERT_EQUAL(one->GetRefCount(), 3U);
+        auto borrowed = ObjectHolder::Share(*one);
+        ASSERT_EQUAL(one->GetRefCount(), 3U);
+        two = ObjectHolder::None();
+        three = std::move(one);
+        ASSERT_EQUAL(three->GetRefCount(), 1U);
+        ASSERT_EQUAL(Logger::instance_count, 1);
+        three = ObjectHolder::Own(Number(1));
+        ASSERT_EQUAL(Logger::instance_count, 0);
+    }
+
+    // Экземпляр, которым родитель владеет через собственное поле, переживает присваивание
+    // этого поля владеющей переменной
+    Class cls("Node"s, {}, nullptr);
+    auto node = ObjectHolder::Own(ClassInstance(cls));
+    node.TryAs<ClassInstance>()->Fields()["value"s] = ObjectHolder::Own(String("kept"s));
+    node = node.TryAs<ClassInstance>()->Fields().at("value"s);
+    ASSERT_EQUAL(node.TryAs<String>()->GetValue(), "kept"s);
+    ASSERT_EQUAL(node->GetRefCount(), 1U);
+
+    // Экземпляр не на куче даёт не владеющую ссылку на себя
+    ClassInstance local(cls);
+    ASSERT_EQUAL(local.Self().Get(), &local);
+    ASSERT_EQUAL(local.GetRefCount(), 0U);
+    auto owned = ObjectHolder::Own(ClassInstance(cls));
+    ObjectHolder self = owned.TryAs<ClassInstance>()->Self();
+    ASSERT_EQUAL(owned->GetRefCount(), 2U);
+}
+
+void TestLongChain() {
+    // Цепочка экземпляров освобождается без рекурсии по полям
+    Class cls("Node"s, {}, nullptr);
+    MemoryStats stats;
+    MemoryScope accounting(&stats);
+    auto head = ObjectHolder::Own(ClassInstance(cls));
+    for (int i = 1; i < 1'000'000; ++i) {
+        auto node = ObjectHolder::Own(ClassInstance(cls));
+        node.TryAs<ClassInstance>()->Fields()["next"s] = std::move(head);
+        head = std::move(node);
+    }
+    const auto kind = static_cast<size_t>(Object::Kind::ClassInstance);
+    ASSERT_EQUAL(stats.GetUsage().objects[kind].live.current, 1'000'000U);
+    head = ObjectHolder::None();
+    ASSERT_EQUAL(stats.GetUsage().objects[kind].live.current, 0U);
+}
+
 void TestMove() {
     {
         ASSERT_EQUAL(Logger::instance_count, 0);
@@ -223,24 +593,181 @@ void TestMove() {
     }
 }
 
+void TestInlineValues() {
+    Number number(42);
+    auto shared = ObjectHolder::Share(number);
+    ASSERT(shared.Get() == &number);
+    ASSERT(shared.TryAs<Number>() == &number);
+
+    auto one = ObjectHolder::Own(Number(7));
+    ASSERT(one);
+    ASSERT_EQUAL(one.TryAs<Number>()->GetValue(), 7);
+    ASSERT(one.TryAs<Bool>() == nullptr);
+    ASSERT(one.TryAs<String>() == nullptr);
+    ASSERT(one.Get() == one.TryAs<Number>());
+
+    ObjectHolder copy = one;
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 7);
+    ASSERT(copy.Get() != one.Get());
+
+    ObjectHolder moved = std::move(one);
+    ASSERT_EQUAL(moved.TryAs<Number>()->GetValue(), 7);
+    ASSERT(!one);  // NOLINT
+
+    auto flag = ObjectHolder::Own(Bool(false));
+    ASSERT(flag);
+    ASSERT(!IsTrue(flag));
+    ASSERT(flag.TryAs<ValueObject<bool>>() != nullptr);
+
+    DummyContext context;
+    ASSERT(Equal(moved, ObjectHolder::Own(Number(7)), context));
+    ASSERT(Less(flag, ObjectHolder::Own(Bool(true)), context));
+    flag->Print(context.output, context);
+    ASSERT_EQUAL(context.output.str(), "False"sv);
+}
+
 void TestNullptr() {
     ObjectHolder oh;
     ASSERT(!oh);
     ASSERT(!oh.Get());
 }
 
+void TestOutputBuffer() {
+    NumberChars chars;
+    ASSERT_EQUAL(FormatNumber(0, chars), "0"sv);
+    ASSERT_EQUAL(FormatNumber(-42, chars), "-42"sv);
+    ASSERT_EQUAL(FormatNumber(numeric_limits<int>::min(), chars),
+                 to_string(numeric_limits<int>::min()));
+
+    ostringstream sink;
+    {
+        OutputBuffer buffer(sink, OutputBuffer::FlushPolicy::Chunked, 8);
+        buffer.Write("abc"sv);
+        buffer.Put(' ');
+        buffer.WriteNumber(-7);
+        ASSERT(sink.str().empty());
+        ASSERT_EQUAL(buffer.Pending(), 6U);
+        // Порция передаётся в sink, как только буфер заполнен
+        buffer.Write("xyz"sv);
+        ASSERT_EQUAL(sink.str(), "abc -7xyz"s);
+        ASSERT_EQUAL(buffer.Pending(), 0U);
+        buffer.Stream() << 1.5 << '!';
+        ASSERT_EQUAL(buffer.Pending(), 4U);
+    }
+    ASSERT_EQUAL(sink.str(), "abc -7xyz1.5!"s);
+
+    ostringstream lines;
+    OutputBuffer line_buffer(lines, OutputBuffer::FlushPolicy::Line);
+    line_buffer.Write("no newline"sv);
+    ASSERT(lines.str().empty());
+    line_buffer.Put('\n');
+    ASSERT_EQUAL(lines.str(), "no newline\n"s);
+    line_buffer.Write("a\nb"sv);
+    ASSERT_EQUAL(lines.str(), "no newline\na\nb"s);
+
+    ostringstream at_exit;
+    OutputBuffer exit_buffer(at_exit, OutputBuffer::FlushPolicy::AtExit, 1);
+    exit_buffer.Write("kept\n"sv);
+    ASSERT(at_exit.str().empty());
+    exit_buffer.Flush();
+    ASSERT_EQUAL(at_exit.str(), "kept\n"s);
+}
+
+void TestBufferedContext() {
+    ostringstream sink;
+    {
+        SimpleContext context(sink, OutputBuffer::FlushPolicy::AtExit);
+        ASSERT(context.GetOutputBuffer() != nullptr);
+        PrintValue(ObjectHolder::Own(Number{-12}), context);
+        PrintChar(' ', context);
+        PrintValue(ObjectHolder::Own(String::Concat(String("ab"s), String("cd"s))), context);
+        PrintChar(' ', context);
+        PrintValue(ObjectHolder::Own(Bool{true}), context);
+        PrintChar(' ', context);
+        PrintValue(ObjectHolder::None(), context);
+        PrintChar(' ', context);
+        // Объект без быстрого пути пишет через поток в тот же буфер
+        PrintValue(ObjectHolder::Own(Logger(5)), context);
+        PrintChar('\n', context);
+        ASSERT(sink.str().empty());
+        context.Flush();
+        ASSERT_EQUAL(sink.str(), "-12 abcd True None 5\n"s);
+        PrintValue(ObjectHolder::Own(Number{1}), context);
+    }
+    ASSERT_EQUAL(sink.str(), "-12 abcd True None 5\n1"s);
+
+    // Контекст без буфера пишет прямо в поток вывода
+    DummyContext dummy;
+    ASSERT(dummy.GetOutputBuffer() == nullptr);
+    PrintValue(ObjectHolder::Own(Number{3}), dummy);
+    PrintChar('\n', dummy);
+    ASSERT_EQUAL(dummy.output.str(), "3\n"s);
+}
+
+void TestAppendTo() {
+    DummyContext context;
+    // Строковое представление совпадает с выводом Print
+    auto printed = [&context](const ObjectHolder& value) {
+        ostringstream os;
+        value->Print(os, context);
+        return os.str();
+    };
+    auto appended = [&context](const ObjectHolder& value) {
+        string out = "<"s;
+        AppendString(value, out, context);
+        return out;
+    };
+
+    const auto number = ObjectHolder::Own(Number{-1024});
+    ASSERT_EQUAL(appended(number), "<-1024"s);
+    ASSERT_EQUAL(appended(ObjectHolder::Own(Bool{false})), "<False"s);
+    ASSERT_EQUAL(appended(ObjectHolder::None()), "<None"s);
+    const auto rope = ObjectHolder::Own(String::Concat(String(string(70, 'a')), String("b"s)));
+    ASSERT_EQUAL(appended(rope), "<"s + printed(rope));
+    ASSERT_EQUAL(appended(ObjectHolder::Own(Logger(9))), "<9"s);
+
+    vector<Method> methods;
+    methods.push_back(Method{"__str__"s, {}, make_unique<TestMethodBody>([](Closure&, Context&) {
+                                 return ObjectHolder::Own(String("text"s));
+                             })});
+    const auto with_str = make_shared<Class>("WithStr"s, std::move(methods), nullptr);
+    const auto plain = make_shared<Class>("Plain"s, vector<Method>{}, nullptr);
+    ASSERT_EQUAL(appended(ObjectHolder::Share(*with_str)), "<Class WithStr"s);
+
+    const auto instance = ObjectHolder::Own(ClassInstance(*with_str));
+    ASSERT_EQUAL(appended(instance), "<text"s);
+    ASSERT_EQUAL(printed(instance), "text"s);
+    // Без __str__ выводится адрес объекта
+    const auto plain_instance = ObjectHolder::Own(ClassInstance(*plain));
+    ASSERT_EQUAL(appended(plain_instance), "<"s + printed(plain_instance));
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestNumber);
     RUN_TEST(tr, runtime::TestString);
     RUN_TEST(tr, runtime::TestMethodInvocation);
+    RUN_TEST(tr, runtime::TestMethodTable);
+    RUN_TEST(tr, runtime::TestShapes);
+    RUN_TEST(tr, runtime::TestInstancePool);
+    RUN_TEST(tr, runtime::TestInstancePoolThreads);
+    RUN_TEST(tr, runtime::TestValueStack);
+    RUN_TEST(tr, runtime::TestKinds);
+    RUN_TEST(tr, runtime::TestSymbols);
+    RUN_TEST(tr, runtime::TestStringConcat);
+    RUN_TEST(tr, runtime::TestOutputBuffer);
+    RUN_TEST(tr, runtime::TestBufferedContext);
+    RUN_TEST(tr, runtime::TestAppendTo);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestNonowning);
     RUN_TEST(tr, runtime::TestOwning);
+    RUN_TEST(tr, runtime::TestRefCount);
+    RUN_TEST(tr, runtime::TestLongChain);
     RUN_TEST(tr, runtime::TestMove);
+    RUN_TEST(tr, runtime::TestInlineValues);
     RUN_TEST(tr, runtime::TestNullptr);
 }
 
@@ -13,44 +13,83 @@ namespace ast {
     using runtime::ObjectHolder;
 
     namespace {
-        const string ADD_METHOD = "__add__"s;
-        const string INIT_METHOD = "__init__"s;
-    }  // namespace
+        // Возвращает указатели на оба операнда, если они имеют тип T, иначе пару nullptr
+        template <typename T>
+        pair<T*, T*> Operands(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+            T* l = lhs.TryAs<T>();
+            T* r = rhs.TryAs<T>();
+            if (l == nullptr || r == nullptr) {
+                return {nullptr, nullptr};
+            }
+            return {l, r};
+        }
+
+        // Вариант специализации, подходящий для операндов lhs и rhs
+        Quickening::Variant VariantOf(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+            if (Operands<runtime::Number>(lhs, rhs).first != nullptr) {
+                return Quickening::Variant::Numbers;
+            }
+            if (Operands<runtime::String>(lhs, rhs).first != nullptr) {
+                return Quickening::Variant::Strings;
+            }
+            return Quickening::Variant::Generic;
+        }
+    }
 
+    VariableValue::VariableValue(runtime::Symbol var_name)
+        : dotted_ids_(std::vector{var_name})
+        , slot_(NO_SLOT) {
+    }
 
-    VariableValue::VariableValue(const std::string& var_name)
-        : dotted_ids_(std::vector{var_name}) {
+    VariableValue::VariableValue(std::vector<runtime::Symbol> dotted_ids, size_t slot)
+        : dotted_ids_(std::move(dotted_ids))
+        , slot_(slot)
+        , field_caches_(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1) {
     }
 
-    VariableValue::VariableValue(std::vector<std::string> dotted_ids)
-        : dotted_ids_(std::move(dotted_ids)) {
+    VariableValue::VariableValue(const std::vector<std::string>& dotted_ids, size_t slot)
+        : VariableValue(std::vector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end()), slot) {
     }
 
-    ObjectHolder VariableValue::Execute(Closure& closure, [[maybe_unused]] Context& context) {
-        auto found = closure.find(dotted_ids_.front());
-        if (found == closure.end()) {
-            throw std::runtime_error("Not find variable");
-        }
-        if (dotted_ids_.size() == 1) {
-            return found->second;
+    ObjectHolder VariableValue::Execute(Closure& closure, Context& context) {
+        const ObjectHolder* value = nullptr;
+        if (slot_ != NO_SLOT) {
+            const auto& slot = (*context.GetFrame())[slot_];
+            if (!slot) {
+                throw std::runtime_error("Not find variable");
+            }
+            value = &*slot;
+        } else {
+            auto found = closure.find(dotted_ids_.front());
+            if (found == closure.end()) {
+                throw std::runtime_error("Not find variable");
+            }
+            value = &found->second;
         }
         for (size_t i = 1; i < dotted_ids_.size(); ++i) {
-            auto instance = found->second.TryAs<runtime::ClassInstance>();
-            Closure& fields = instance->Fields();
-            found = fields.find(dotted_ids_[i]);
-            if (found == fields.end()) {
+            auto instance = value->TryAs<runtime::ClassInstance>();
+            if (instance == nullptr) {
+                throw std::runtime_error("Object is not a class instance"s);
+            }
+            value = field_caches_[i - 1].Find(*instance, dotted_ids_[i]);
+            if (value == nullptr) {
                 throw std::runtime_error("Not find variable");
             }
         }
-        return found->second;
+        return *value;
     }
 
-    Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
-        : var_(std::move(var))
-        , rv_(std::move(rv)) {
+    Assignment::Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv, size_t slot)
+        : var_(var)
+        , rv_(std::move(rv))
+        , slot_(slot) {
     }
 
     ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
+        if (slot_ != NO_SLOT) {
+            auto value = rv_->Execute(closure, context);
+            return *((*context.GetFrame())[slot_] = std::move(value));
+        }
         auto found = closure.find(var_);
         if (found != closure.end()) {
             return found->second = rv_->Execute(closure, context);
@@ -59,24 +98,22 @@ namespace ast {
         return new_var->second;
     }
 
-    FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
+    FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name,
                                      std::unique_ptr<Statement> rv)
          : object_(std::move(object))
-         , field_name_(std::move(field_name))
+         , field_name_(field_name)
          , rv_(std::move(rv)) {
     }
 
     ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
         auto ex = object_.Execute(closure, context);
         auto instance = ex.TryAs<runtime::ClassInstance>();
-
-        Closure& fields = instance->Fields();
-        auto found_field = fields.find(field_name_);
-        if (found_field != fields.end()) {
-            return found_field->second = rv_->Execute(closure, context);
+        if (instance == nullptr) {
+            throw std::runtime_error("Object is not a class instance"s);
         }
-        auto [new_field, _] = fields.emplace(field_name_, rv_->Execute(closure, context));
-        return new_field->second;
+        // Правая часть может сама добавить поля объекту, поэтому вычисляется до поиска поля
+        auto value = rv_->Execute(closure, context);
+        return cache_.Assign(*instance, field_name_, std::move(value));
     }
 
     Print::Print(unique_ptr<Statement> argument)
@@ -94,68 +131,93 @@ namespace ast {
     }
 
     ObjectHolder Print::Execute(Closure& closure, Context& context) {
-        ostream& out = context.GetOutputStream();
-        if (args_.empty()) {
-            out << '\n';
-            return {};
-        }
-        for (size_t i = 0; i < args_.size() - 1; ++i) {
-            auto obj = args_[i]->Execute(closure, context);
-            if (obj) {
-                obj->Print(out, context);
-            } else {
-                out << "None"s;
+        for (size_t i = 0; i < args_.size(); ++i) {
+            if (i != 0) {
+                runtime::PrintChar(' ', context);
             }
-            out << ' ';
+            runtime::PrintValue(args_[i]->Execute(closure, context), context);
         }
-        auto obj = args_.back()->Execute(closure, context);
-        if (obj) {
-            obj->Print(out, context);
-        } else {
-            out << "None"s;
-        }
-        out << '\n';
+        runtime::PrintChar('\n', context);
         return {};
     }
 
     ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-        stringstream strm;
         auto obj = argument_->Execute(closure, context);
-        if (obj) {
-            obj->Print(strm, context);
-        } else {
-            strm << "None";
+        // Копия строки разделяет с ней части верёвки, так что str(s) их не склеивает
+        if (const auto* str = obj.TryAs<runtime::String>()) {
+            return runtime::ObjectHolder::Own(runtime::String(*str));
         }
-        auto str = strm.str();
-        return runtime::ObjectHolder::Own(std::move(runtime::String(strm.str())));
+        // Короткий текст, например запись числа, помещается во внутренний буфер std::string
+        // и переносится в результат без выделения памяти
+        std::string text;
+        runtime::AppendString(obj, text, context);
+        return runtime::ObjectHolder::Own(runtime::String(std::move(text)));
     }
 
-    MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
+    MethodCall::MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                            std::vector<std::unique_ptr<Statement>> args)
        : object_(std::move(object))
-       , method_(std::move(method))
+       , method_(method)
        , args_(std::move(args)) {
     }
 
     ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
         auto obj = object_->Execute(closure, context);
         auto instance = obj.TryAs<runtime::ClassInstance>();
+        if (instance == nullptr) {
+            throw std::runtime_error("Object is not a class instance"s);
+        }
+
+        const runtime::Method* method = cache_.Lookup(instance->GetClass(), method_);
+        if (method != nullptr && method->frame_size != 0
+            && method->formal_params.size() == args_.size()) {
+            // Аргументы вычисляются прямо в слоты кадра вызываемого метода
+            runtime::StackFrame frame(runtime::ValueStack::ForCurrentThread(),
+                                      method->frame_size);
+            for (size_t i = 0; i < args_.size(); ++i) {
+                frame[i + 1] = args_[i]->Execute(closure, context);
+            }
+            frame[0] = std::move(obj);
+            return instance->Call(*method, frame.Get(), context);
+        }
 
         vector<ObjectHolder> actual_args;
+        actual_args.reserve(args_.size());
         for (const auto& arg : args_) {
-            auto temp_obj = arg->Execute(closure, context);
-            actual_args.push_back(temp_obj);
+            actual_args.push_back(arg->Execute(closure, context));
         }
-        return instance->Call(method_, actual_args, context);
+        if (method == nullptr || method->formal_params.size() != actual_args.size()) {
+            // Выбрасывает исключение об отсутствии метода
+            return instance->Call(method_, actual_args, context);
+        }
+        return instance->Call(*method, actual_args, context);
     }
 
     ObjectHolder Add::Execute(Closure& closure, Context& context) {
         auto lhs = lhs_->Execute(closure, context);
         auto rhs = rhs_->Execute(closure, context);
 
+        switch (quickening_.Get()) {
+            case Quickening::Variant::Numbers:
+                if (const auto [l, r] = Operands<runtime::Number>(lhs, rhs); l != nullptr) {
+                    return ObjectHolder::Own(runtime::Number{l->GetValue() + r->GetValue()});
+                }
+                quickening_.Deoptimize();
+                break;
+            case Quickening::Variant::Strings:
+                if (const auto [l, r] = Operands<runtime::String>(lhs, rhs); l != nullptr) {
+                    return ObjectHolder::Own(runtime::String::Concat(*l, *r));
+                }
+                quickening_.Deoptimize();
+                break;
+            default:
+                break;
+        }
+
         auto lhs_number = lhs.TryAs<runtime::Number>();
         auto rhs_number = rhs.TryAs<runtime::Number>();
         if (lhs_number != nullptr && rhs_number != nullptr) {
+            quickening_.Observe(Quickening::Variant::Numbers);
             int number = lhs_number->GetValue() + rhs_number->GetValue();
             return runtime::ObjectHolder::Own(runtime::Number{number});
         }
@@ -163,14 +225,19 @@ namespace ast {
         auto lhs_string = lhs.TryAs<runtime::String>();
         auto rhs_string = rhs.TryAs<runtime::String>();
         if (lhs_string != nullptr && rhs_string != nullptr) {
-            string str = lhs_string->GetValue() + rhs_string->GetValue();
-            return runtime::ObjectHolder::Own(runtime::String{std::move(str)});
+            quickening_.Observe(Quickening::Variant::Strings);
+            return runtime::ObjectHolder::Own(runtime::String::Concat(*lhs_string, *rhs_string));
         }
 
+        quickening_.Observe(Quickening::Variant::Generic);
         auto lhs_instance = lhs.TryAs<runtime::ClassInstance>();
-        if (lhs_instance != nullptr && lhs_instance->HasMethod(ADD_METHOD, 1)) {
-            std::vector<ObjectHolder> actual_args = { rhs };
-            return lhs_instance->Call(ADD_METHOD, actual_args, context);
+        if (lhs_instance != nullptr) {
+            const runtime::Method* method =
+                lhs_instance->GetClass().GetSpecialMethod(runtime::SpecialMethod::Add);
+            if (method != nullptr && method->formal_params.size() == 1) {
+                std::vector<ObjectHolder> actual_args = { rhs };
+                return lhs_instance->Call(*method, actual_args, context);
+            }
         }
 
         throw std::runtime_error("No __add__ method"s);
@@ -222,16 +289,14 @@ namespace ast {
     }
 
     ObjectHolder Or::Execute(Closure& closure, Context& context) {
-        auto lhs = lhs_->Execute(closure, context);
-        auto rhs = rhs_->Execute(closure, context);
-        bool result = (runtime::IsTrue(lhs) || runtime::IsTrue(rhs));
+        bool result = runtime::IsTrue(lhs_->Execute(closure, context))
+                      || runtime::IsTrue(rhs_->Execute(closure, context));
         return runtime::ObjectHolder::Own(runtime::Bool{result});
     }
 
     ObjectHolder And::Execute(Closure& closure, Context& context) {
-        auto lhs = lhs_->Execute(closure, context);
-        auto rhs = rhs_->Execute(closure, context);
-        bool result = (runtime::IsTrue(lhs) && runtime::IsTrue(rhs));
+        bool result = runtime::IsTrue(lhs_->Execute(closure, context))
+                      && runtime::IsTrue(rhs_->Execute(closure, context));
         return runtime::ObjectHolder::Own(runtime::Bool{result});
     }
 
@@ -244,6 +309,9 @@ namespace ast {
     ObjectHolder Compound::Execute(Closure& closure, Context& context) {
         for (const auto& stmt : statements_) {
             stmt->Execute(closure, context);
+            if (context.IsReturning()) {
+                break;
+            }
         }
         return {};
     }
@@ -253,26 +321,25 @@ namespace ast {
     }
 
     ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
-        try {
-            body_->Execute(closure, context);
-            return runtime::ObjectHolder::None();
-        } catch (runtime::ObjectHolder& obj) {
-            return obj;
+        body_->Execute(closure, context);
+        if (context.IsReturning()) {
+            return context.TakeReturnValue();
         }
+        return runtime::ObjectHolder::None();
     }
 
     ObjectHolder Return::Execute(Closure& closure, Context& context) {
-        throw statement_->Execute(closure, context);
+        context.SetReturnValue(statement_->Execute(closure, context));
+        return {};
     }
 
     ClassDefinition::ClassDefinition(ObjectHolder cls)
-        : cls_(std::move(cls)) {
+        : cls_(std::move(cls))
+        , name_(cls_.TryAs<const runtime::Class>()->GetName()) {
     }
 
     ObjectHolder ClassDefinition::Execute(Closure& closure, [[maybe_unused]] Context& context) {
-        const auto obj_cls = cls_.TryAs<const runtime::Class>();
-        std::string name = obj_cls->GetName();
-        const auto [it, _] = closure.emplace(name, cls_);
+        const auto [it, _] = closure.emplace(name_, cls_);
         return it->second;
     }
 
@@ -293,38 +360,82 @@ namespace ast {
         }
     }
 
-    Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
+    Comparison::Comparison(runtime::Comparator cmp, unique_ptr<Statement> lhs,
+                           unique_ptr<Statement> rhs)
         : BinaryOperation(std::move(lhs), std::move(rhs))
-        , cmp_(std::move(cmp)) {
+        , cmp_(cmp) {
     }
 
     ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
         auto lhs = lhs_->Execute(closure, context);
         auto rhs = rhs_->Execute(closure, context);
-        bool result = cmp_(lhs, rhs, context);
+
+        switch (quickening_.Get()) {
+            case Quickening::Variant::Numbers:
+                if (const auto [l, r] = Operands<runtime::Number>(lhs, rhs); l != nullptr) {
+                    const int order = static_cast<int>(r->GetValue() < l->GetValue())
+                                      - static_cast<int>(l->GetValue() < r->GetValue());
+                    return ObjectHolder::Own(runtime::Bool{runtime::ApplyComparator(cmp_, order)});
+                }
+                quickening_.Deoptimize();
+                break;
+            case Quickening::Variant::Strings:
+                if (const auto [l, r] = Operands<runtime::String>(lhs, rhs); l != nullptr) {
+                    const int order = l->GetValue().compare(r->GetValue());
+                    return ObjectHolder::Own(runtime::Bool{runtime::ApplyComparator(cmp_, order)});
+                }
+                quickening_.Deoptimize();
+                break;
+            case Quickening::Variant::Unspecialized:
+                quickening_.Observe(VariantOf(lhs, rhs));
+                break;
+            default:
+                break;
+        }
+
+        bool result = runtime::Compare(cmp_, lhs, rhs, context);
         return runtime::ObjectHolder::Own(runtime::Bool{result});
     }
 
     NewInstance::NewInstance(const runtime::Class& cls)
-        : instance_(cls) {
+        : class_(cls) {
     }
 
     NewInstance::NewInstance(const runtime::Class& cls, std::vector<std::unique_ptr<Statement>> args)
-        : instance_(cls)
+        : class_(cls)
         , args_(std::move(args)) {
     }
 
-
     ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
+        const runtime::Method* init = class_.GetSpecialMethod(runtime::SpecialMethod::Init);
+        if (init != nullptr && init->frame_size != 0
+            && init->formal_params.size() == args_.size()) {
+            // Аргументы вычисляются прямо в слоты кадра __init__
+            runtime::StackFrame frame(runtime::ValueStack::ForCurrentThread(), init->frame_size);
+            for (size_t i = 0; i < args_.size(); ++i) {
+                frame[i + 1] = args_[i]->Execute(closure, context);
+            }
+            auto instance = ObjectHolder::Own(runtime::ClassInstance(class_));
+            frame[0] = instance;
+            instance.TryAs<runtime::ClassInstance>()->Call(*init, frame.Get(), context);
+            return instance;
+        }
+
         std::vector<ObjectHolder> actual_args;
+        actual_args.reserve(args_.size());
         for (const auto& arg : args_) {
             actual_args.push_back(arg->Execute(closure, context));
-
         }
-        if (instance_.HasMethod(INIT_METHOD, actual_args.size())) {
-            instance_.Call(INIT_METHOD, actual_args, context);
+        return Construct(actual_args, context);
+    }
+
+    ObjectHolder NewInstance::Construct(const std::vector<ObjectHolder>& actual_args, Context& context) {
+        auto instance = ObjectHolder::Own(runtime::ClassInstance(class_));
+        const runtime::Method* init = class_.GetSpecialMethod(runtime::SpecialMethod::Init);
+        if (init != nullptr && init->formal_params.size() == actual_args.size()) {
+            instance.TryAs<runtime::ClassInstance>()->Call(*init, actual_args, context);
         }
-        return ObjectHolder::Share(instance_);
+        return instance;
     }
 
 }  // namespace ast
\ No newline at end of file
@@ -2,70 +2,156 @@
 
 #include "runtime.h"
 
-#include <functional>
+#include <atomic>
+#include <optional>
 #include <variant>
 
 namespace ast {
 
 using Statement = runtime::Executable;
 
+// Методы Mutable* узлов дают доступ к дочерним узлам для преобразований дерева (см. optimizer.h)
+
 // Выражение, возвращающее значение типа T,
 // используется как основа для создания констант
 template <typename T>
 class ValueStatement : public Statement {
+    // Числа и логические значения дешевле скопировать внутрь ObjectHolder
+    static constexpr bool INLINE = std::is_same_v<T, runtime::Number>
+                                   || std::is_same_v<T, runtime::Bool>;
+
 public:
     explicit ValueStatement(T v)
-        : value_(std::move(v)) {
+        : value_(MakeValue(std::move(v))) {
     }
 
     runtime::ObjectHolder Execute([[maybe_unused]] runtime::Closure& closure,
                                   [[maybe_unused]] runtime::Context& context) override {
-        return runtime::ObjectHolder::Share(value_);
+        if constexpr (INLINE) {
+            return runtime::ObjectHolder::Own(T(value_));
+        } else {
+            return value_;
+        }
+    }
+
+    [[nodiscard]] const T& GetValue() const {
+        if constexpr (INLINE) {
+            return value_;
+        } else {
+            return *value_.template TryAs<T>();
+        }
     }
 
 private:
-    T value_;
+    static auto MakeValue(T v) {
+        if constexpr (INLINE) {
+            return v;
+        } else {
+            // Константа разделяется всеми выполнениями программы, поэтому верёвка склеивается
+            // заранее: иначе её бы лениво изменял GetValue, возможно в нескольких потоках сразу
+            static_cast<void>(v.GetValue());
+            // Значение отдаётся владеющими ссылками и может пережить программу, например в
+            // переменных интерактивного сеанса, поэтому в счётчиках памяти выполнения
+            // оно не учитывается
+            runtime::MemoryScope untracked(nullptr);
+            return runtime::ObjectHolder::Own(std::move(v));
+        }
+    }
+
+    std::conditional_t<INLINE, T, runtime::ObjectHolder> value_;
 };
 
 using NumericConst = ValueStatement<runtime::Number>;
 using StringConst = ValueStatement<runtime::String>;
 using BoolConst = ValueStatement<runtime::Bool>;
 
-// Вычисляет значение переменной либо цепочки вызовов полей объектов id1.id2.id3
+// Слот не назначен: переменная ищется в Closure по имени
+inline constexpr std::size_t NO_SLOT = static_cast<std::size_t>(-1);
+
+// Вычисляет значение переменной либо цепочки вызовов полей объектов id1.id2.id3.
+// Если первому имени назначен слот, переменная берётся из текущего кадра контекста
 class VariableValue : public Statement {
 public:
-    explicit VariableValue(const std::string& var_name);
-    explicit VariableValue(std::vector<std::string> dotted_ids);
+    explicit VariableValue(runtime::Symbol var_name);
+    explicit VariableValue(std::vector<runtime::Symbol> dotted_ids, std::size_t slot = NO_SLOT);
+    explicit VariableValue(const std::vector<std::string>& dotted_ids, std::size_t slot = NO_SLOT);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const std::vector<runtime::Symbol>& GetDottedIds() const {
+        return dotted_ids_;
+    }
+
+    [[nodiscard]] std::size_t GetSlot() const {
+        return slot_;
+    }
+
 private:
-    std::vector<std::string> dotted_ids_;
+    std::vector<runtime::Symbol> dotted_ids_;
+    std::size_t slot_;
+    // Кэши доступа к полям id2, id3, ...
+    std::vector<runtime::FieldCache> field_caches_;
 };
 
-// Присваивает переменной, имя которой задано в параметре var, значение выражения rv
+// Присваивает переменной, имя которой задано в параметре var, значение выражения rv.
+// Если переменной назначен слот, значение записывается в текущий кадр контекста
 class Assignment : public Statement {
 public:
-    Assignment(std::string var, std::unique_ptr<Statement> rv);
+    Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv, std::size_t slot = NO_SLOT);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] runtime::Symbol GetVarName() const {
+        return var_;
+    }
+
+    [[nodiscard]] const Statement& GetRightValue() const {
+        return *rv_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableRightValue() {
+        return rv_;
+    }
+
+    [[nodiscard]] std::size_t GetSlot() const {
+        return slot_;
+    }
+
 private:
-    std::string var_;
+    runtime::Symbol var_;
     std::unique_ptr<Statement> rv_;
+    std::size_t slot_;
 };
 
 // Присваивает полю object.field_name значение выражения rv
 class FieldAssignment : public Statement {
 public:
-    FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+    FieldAssignment(VariableValue object, runtime::Symbol field_name,
+                    std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const VariableValue& GetObject() const {
+        return object_;
+    }
+
+    [[nodiscard]] runtime::Symbol GetFieldName() const {
+        return field_name_;
+    }
+
+    [[nodiscard]] const Statement& GetRightValue() const {
+        return *rv_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableRightValue() {
+        return rv_;
+    }
+
 private:
     VariableValue object_;
-    std::string field_name_;
+    runtime::Symbol field_name_;
     std::unique_ptr<Statement> rv_;
+    runtime::FieldCache cache_;
 };
 
 // Значение None
@@ -93,6 +179,14 @@ public:
     // context.GetOutputStream()
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+        return args_;
+    }
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs() {
+        return args_;
+    }
+
 private:
     std::vector<std::unique_ptr<Statement>> args_;
     std::optional<std::string> name_arg_;
@@ -101,16 +195,36 @@ private:
 // Вызывает метод object.method со списком параметров args
 class MethodCall : public Statement {
 public:
-    MethodCall(std::unique_ptr<Statement> object, std::string method,
+    MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                std::vector<std::unique_ptr<Statement>> args);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const Statement& GetObject() const {
+        return *object_;
+    }
+
+    [[nodiscard]] runtime::Symbol GetMethodName() const {
+        return method_;
+    }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+        return args_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableObject() {
+        return object_;
+    }
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs() {
+        return args_;
+    }
+
 private:
     std::unique_ptr<Statement> object_;
-    std::string method_;
+    runtime::Symbol method_;
     std::vector<std::unique_ptr<Statement>> args_;
-
+    runtime::MethodCache cache_;
 };
 
 // Создаёт новый экземпляр класса class_, передавая его конструктору набор параметров args
@@ -121,8 +235,25 @@ public:
     // Возвращает объект, содержащий значение типа ClassInstance
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Создаёт новый экземпляр по уже вычисленным аргументам: вызывает __init__, если он
+    // принимает actual_args.size() параметров
+    runtime::ObjectHolder Construct(const std::vector<runtime::ObjectHolder>& actual_args,
+                                    runtime::Context& context);
+
+    [[nodiscard]] const runtime::Class& GetClass() const {
+        return class_;
+    }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+        return args_;
+    }
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs() {
+        return args_;
+    }
+
 private:
-    runtime::ClassInstance instance_;
+    const runtime::Class& class_;
     std::vector<std::unique_ptr<Statement>> args_;
 };
 
@@ -133,6 +264,14 @@ public:
         : argument_(std::move(argument)) {
     }
 
+    [[nodiscard]] const Statement& GetArgument() const {
+        return *argument_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableArgument() {
+        return argument_;
+    }
+
 protected:
     std::unique_ptr<Statement> argument_;
 };
@@ -152,11 +291,76 @@ public:
         , rhs_(std::move(rhs)) {
     }
 
+    [[nodiscard]] const Statement& GetLhs() const {
+        return *lhs_;
+    }
+
+    [[nodiscard]] const Statement& GetRhs() const {
+        return *rhs_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableLhs() {
+        return lhs_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableRhs() {
+        return rhs_;
+    }
+
 protected:
     std::unique_ptr<Statement> lhs_;
     std::unique_ptr<Statement> rhs_;
 };
 
+// Специализация узла по видам операндов (quickening).
+// Неспециализированный узел выполняет общий вариант операции и считает вычисления подряд,
+// в которых оба операнда - числа (или оба - строки). После THRESHOLD таких вычислений
+// узел переключается на вариант для этих видов: проверку видов и операцию над значениями.
+// Если проверка не прошла, узел навсегда возвращается к общему варианту.
+// Состояние хранится в атомарных байтах с нестрогим порядком: при одновременном выполнении
+// узла в нескольких потоках счётчик может сбиться, но каждый вариант остаётся корректным
+class Quickening {
+public:
+    enum class Variant : uint8_t {
+        Unspecialized,
+        Numbers,
+        Strings,
+        Generic,
+    };
+
+    static constexpr uint8_t THRESHOLD = 8;
+
+    [[nodiscard]] Variant Get() const {
+        return variant_.load(std::memory_order_relaxed);
+    }
+
+    // Учитывает виды операндов, с которыми общий вариант был выполнен очередной раз
+    void Observe(Variant operands) {
+        if (Get() != Variant::Unspecialized) {
+            return;
+        }
+        uint8_t count = count_.load(std::memory_order_relaxed);
+        if (operands != observed_.load(std::memory_order_relaxed)) {
+            observed_.store(operands, std::memory_order_relaxed);
+            count = 0;
+        }
+        count_.store(++count, std::memory_order_relaxed);
+        if (operands != Variant::Generic && count == THRESHOLD) {
+            variant_.store(operands, std::memory_order_relaxed);
+        }
+    }
+
+    // Вызывается, когда операнды не прошли проверку специализированного варианта
+    void Deoptimize() {
+        variant_.store(Variant::Generic, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<Variant> variant_ = Variant::Unspecialized;
+    std::atomic<Variant> observed_ = Variant::Unspecialized;
+    std::atomic<uint8_t> count_ = 0;
+};
+
 // Возвращает результат операции + над аргументами lhs и rhs
 class Add : public BinaryOperation {
 public:
@@ -168,6 +372,13 @@ public:
     //  объект1 + объект2, если у объект1 - пользовательский класс с методом _add__(rhs)
     // В противном случае при вычислении выбрасывается runtime_error
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] Quickening::Variant GetVariant() const {
+        return quickening_.Get();
+    }
+
+private:
+    Quickening quickening_;
 };
 
 // Возвращает результат вычитания аргументов lhs и rhs
@@ -245,9 +456,18 @@ public:
         AddStatementInVector(std::move(stmt));
     }
 
-    // Последовательно выполняет добавленные инструкции. Возвращает None
+    // Последовательно выполняет добавленные инструкции. Возвращает None.
+    // Выполнение прерывается, если одна из инструкций выполнила return
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetStatements() const {
+        return statements_;
+    }
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableStatements() {
+        return statements_;
+    }
+
 private:
     template <typename T0, typename... Ts>
     void AddStatementInVector(T0&& v0, Ts&&... vs) {
@@ -269,6 +489,14 @@ public:
     // В противном случае возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const Statement& GetBody() const {
+        return *body_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableBody() {
+        return body_;
+    }
+
 private:
     std::unique_ptr<Statement> body_;
 };
@@ -281,9 +509,18 @@ public:
     }
 
     // Останавливает выполнение текущего метода. Метод возвращает результат вычисления statement,
-    // переданного в конструктор
+    // переданного в конструктор. Результат передаётся через context.SetReturnValue, без
+    // исключений. Вне метода return завершает выполнение программы
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const Statement& GetStatement() const {
+        return *statement_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableStatement() {
+        return statement_;
+    }
+
 private:
     std::unique_ptr<Statement> statement_;
 };
@@ -298,8 +535,13 @@ public:
     // конструктор
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const runtime::ObjectHolder& GetClass() const {
+        return cls_;
+    }
+
 private:
     runtime::ObjectHolder cls_;
+    runtime::Symbol name_;
 };
 // Инструкция if <condition> <if_body> else <else_body>
 class IfElse : public Statement {
@@ -310,6 +552,31 @@ public:
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] const Statement& GetCondition() const {
+        return *condition_;
+    }
+
+    [[nodiscard]] const Statement& GetIfBody() const {
+        return *if_body_;
+    }
+
+    // Возвращает nullptr, если ветка else отсутствует
+    [[nodiscard]] const Statement* GetElseBody() const {
+        return else_body_.get();
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableCondition() {
+        return condition_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableIfBody() {
+        return if_body_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableElseBody() {
+        return else_body_;
+    }
+
 private:
     std::unique_ptr<Statement> condition_;
     std::unique_ptr<Statement> if_body_;
@@ -319,18 +586,25 @@ private:
 // Операция сравнения
 class Comparison : public BinaryOperation {
 public:
-    // Comparator задаёт функцию, выполняющую сравнение значений аргументов
-    using Comparator = std::function<bool(const runtime::ObjectHolder&,
-                                          const runtime::ObjectHolder&, runtime::Context&)>;
+    Comparison(runtime::Comparator cmp, std::unique_ptr<Statement> lhs,
+               std::unique_ptr<Statement> rhs);
 
-    Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
-
-    // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
-    // приведённый к типу runtime::Bool
+    // Вычисляет значение выражений lhs и rhs и возвращает результат их сравнения операцией
+    // cmp (см. runtime::Compare), приведённый к типу runtime::Bool.
+    // Как и Add, узел специализируется для сравнения чисел или строк
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    [[nodiscard]] runtime::Comparator GetComparator() const {
+        return cmp_;
+    }
+
+    [[nodiscard]] Quickening::Variant GetVariant() const {
+        return quickening_.Get();
+    }
+
 private:
-    Comparator cmp_;
+    runtime::Comparator cmp_;
+    Quickening quickening_;
 };
 
 }  // namespace ast
\ No newline at end of file
@@ -63,6 +63,12 @@ void TestStringConst() {
     ASSERT_EQUAL(os.str(), "Hello!"s);
 
     ASSERT(context.output.str().empty());
+
+    // Значение константы переживает её узел
+    auto node = make_unique<StringConst>(runtime::String("kept"s));
+    ObjectHolder kept = node->Execute(empty, context);
+    node.reset();
+    ASSERT_EQUAL(kept.TryAs<runtime::String>()->GetValue(), "kept"s);
 }
 
 void TestVariable() {
@@ -308,6 +314,31 @@ void TestCompound() {
     ASSERT(context.output.str().empty());
 }
 
+void TestReturn() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    auto body = make_unique<Compound>();
+    body->AddStatement(make_unique<Assignment>("x"s, make_unique<NumericConst>(1)));
+    auto if_body = make_unique<Compound>();
+    if_body->AddStatement(make_unique<Return>(make_unique<VariableValue>("x"s)));
+    if_body->AddStatement(make_unique<Print>(make_unique<StringConst>("after return"s)));
+    body->AddStatement(
+        make_unique<IfElse>(make_unique<BoolConst>(true), std::move(if_body), nullptr));
+    body->AddStatement(make_unique<Assignment>("x"s, make_unique<NumericConst>(2)));
+
+    MethodBody method_body(std::move(body));
+    auto result = method_body.Execute(closure, context);
+    ASSERT_OBJECT_VALUE_EQUAL(result, 1);
+    ASSERT_OBJECT_VALUE_EQUAL(closure.at("x"s), 1);
+    ASSERT(!context.IsReturning());
+    ASSERT(context.output.str().empty());
+
+    MethodBody no_return(make_unique<Assignment>("y"s, make_unique<NumericConst>(3)));
+    ASSERT(!no_return.Execute(closure, context));
+    ASSERT(!context.IsReturning());
+}
+
 void TestFields() {
     runtime::DummyContext context;
 
@@ -370,6 +401,43 @@ void TestBaseClass() {
     ASSERT(!cls.GetMethod("AsString"s));
 }
 
+void TestPolymorphicMethodCall() {
+    // Классов больше, чем записей в кэше точки вызова
+    vector<unique_ptr<runtime::Class>> classes;
+    for (int i = 0; i < 6; ++i) {
+        vector<runtime::Method> methods;
+        methods.push_back({"id"s, {}, make_unique<NumericConst>(i)});
+        if (i % 2 == 0) {
+            methods.push_back({"__str__"s, {}, make_unique<StringConst>("even"s)});
+        }
+        classes.push_back(make_unique<runtime::Class>("C"s + to_string(i), move(methods), nullptr));
+    }
+    vector<runtime::ClassInstance> instances;
+    instances.reserve(classes.size());
+    for (const auto& cls : classes) {
+        instances.emplace_back(*cls);
+    }
+
+    runtime::DummyContext context;
+    MethodCall call(make_unique<VariableValue>("x"s), "id"s, {});
+    MethodCall missing(make_unique<VariableValue>("x"s), "missing"s, {});
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < instances.size(); ++i) {
+            Closure closure = {{"x"s, ObjectHolder::Share(instances[i])}};
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), static_cast<int>(i));
+            ASSERT_THROWS(missing.Execute(closure, context), runtime_error);
+        }
+    }
+
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number{1})}};
+    ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+
+    ASSERT(classes[0]->GetSpecialMethod(runtime::SpecialMethod::Str) != nullptr);
+    ASSERT(classes[1]->GetSpecialMethod(runtime::SpecialMethod::Str) == nullptr);
+    ASSERT(classes[0]->GetSpecialMethod(runtime::SpecialMethod::Init) == nullptr);
+    ASSERT_OBJECT_VALUE_EQUAL(ObjectHolder::Share(instances[2]), "even"s);
+}
+
 void TestInheritance() {
     vector<runtime::Method> methods;
     methods.push_back({"GetValue"s, {}, make_unique<VariableValue>(vector{"self"s, "value"s})});
@@ -452,6 +520,103 @@ void TestNot() {
     test_not(false);
 }
 
+void TestQuickening() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    Add sum(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    Comparison less(runtime::Comparator::Less, make_unique<VariableValue>("x"s),
+                    make_unique<VariableValue>("y"s));
+    closure["x"s] = ObjectHolder::Own(runtime::Number{2});
+    closure["y"s] = ObjectHolder::Own(runtime::Number{3});
+    for (int i = 0; i < Quickening::THRESHOLD; ++i) {
+        ASSERT(sum.GetVariant() == Quickening::Variant::Unspecialized);
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+        ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "True"s);
+    }
+    ASSERT(sum.GetVariant() == Quickening::Variant::Numbers);
+    ASSERT(less.GetVariant() == Quickening::Variant::Numbers);
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "True"s);
+
+    // Операнды другого вида возвращают узел к общему варианту
+    closure["x"s] = ObjectHolder::Own(runtime::String{"b"s});
+    closure["y"s] = ObjectHolder::Own(runtime::String{"a"s});
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "ba"s);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "False"s);
+    ASSERT(sum.GetVariant() == Quickening::Variant::Generic);
+    ASSERT(less.GetVariant() == Quickening::Variant::Generic);
+    closure["y"s] = ObjectHolder::Own(runtime::Number{1});
+    ASSERT_THROWS(sum.Execute(closure, context), std::runtime_error);
+    ASSERT_THROWS(less.Execute(closure, context), std::runtime_error);
+
+    ASSERT(context.output.str().empty());
+}
+
+void TestNewInstance() {
+    runtime::Class cls("Point"s, {}, nullptr);
+    runtime::MemoryStats stats;
+    constexpr auto INSTANCE = static_cast<size_t>(runtime::Object::Kind::ClassInstance);
+    ObjectHolder first;
+    {
+        runtime::MemoryScope scope(&stats);
+        runtime::DummyContext context;
+        Closure closure;
+        auto node = make_unique<NewInstance>(cls);
+        first = node->Execute(closure, context);
+        ObjectHolder second = node->Execute(closure, context);
+        // Каждое выполнение создаёт свой экземпляр, которым владеет результат
+        ASSERT(first.Get() != second.Get());
+        first.TryAs<runtime::ClassInstance>()->Fields()["x"s] =
+            ObjectHolder::Own(runtime::Number{1});
+        ASSERT(second.TryAs<runtime::ClassInstance>()->Fields().empty());
+        ASSERT_EQUAL(stats.GetUsage().objects[INSTANCE].live.current, 2U);
+    }
+    // Экземпляр освобождается вместе с последней ссылкой на него, а не с узлом
+    ASSERT_EQUAL(stats.GetUsage().objects[INSTANCE].live.current, 1U);
+    ASSERT_EQUAL(first.TryAs<runtime::ClassInstance>()->Fields().size(), 1U);
+    first = ObjectHolder::None();
+    ASSERT_EQUAL(stats.GetUsage().objects[INSTANCE].live.current, 0U);
+}
+
+void TestComparison() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    auto compare = [&](runtime::Comparator cmp, auto lhs, auto rhs) {
+        Comparison comparison(cmp, make_unique<StringConst>(lhs), make_unique<StringConst>(rhs));
+        return runtime::IsTrue(comparison.Execute(closure, context));
+    };
+    ASSERT(compare(runtime::Comparator::Greater, "b"s, "a"s));
+    ASSERT(!compare(runtime::Comparator::Greater, "a"s, "a"s));
+    ASSERT(compare(runtime::Comparator::LessOrEqual, "a"s, "a"s));
+    ASSERT(compare(runtime::Comparator::GreaterOrEqual, "ab"s, "a"s));
+    ASSERT(compare(runtime::Comparator::NotEqual, "ab"s, "a"s));
+
+    // Каждый специальный метод вызывается не более одного раза
+    auto make_method = [](const string& name, bool result) {
+        auto body = make_unique<Compound>();
+        body->AddStatement(make_unique<Print>(make_unique<StringConst>(name)));
+        body->AddStatement(make_unique<Return>(make_unique<BoolConst>(result)));
+        return runtime::Method{name, {"other"s}, make_unique<MethodBody>(std::move(body))};
+    };
+    vector<runtime::Method> methods;
+    methods.push_back(make_method("__lt__"s, false));
+    methods.push_back(make_method("__eq__"s, false));
+    runtime::Class cls("Probe"s, std::move(methods), nullptr);
+
+    Comparison greater(runtime::Comparator::Greater, make_unique<NewInstance>(cls),
+                       make_unique<NumericConst>(1));
+    ASSERT(runtime::IsTrue(greater.Execute(closure, context)));
+    ASSERT_EQUAL(context.output.str(), "__lt__\n__eq__\n"s);
+
+    context.output.str({});
+    Comparison greater_or_equal(runtime::Comparator::GreaterOrEqual,
+                                make_unique<NewInstance>(cls), make_unique<NumericConst>(1));
+    ASSERT(runtime::IsTrue(greater_or_equal.Execute(closure, context)));
+    ASSERT_EQUAL(context.output.str(), "__lt__\n"s);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -469,12 +634,17 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
     RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
     RUN_TEST(tr, ast::TestCompound);
+    RUN_TEST(tr, ast::TestReturn);
     RUN_TEST(tr, ast::TestFields);
     RUN_TEST(tr, ast::TestBaseClass);
+    RUN_TEST(tr, ast::TestPolymorphicMethodCall);
     RUN_TEST(tr, ast::TestInheritance);
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestQuickening);
+    RUN_TEST(tr, ast::TestComparison);
+    RUN_TEST(tr, ast::TestNewInstance);
 }
 
 }  // namespace ast
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "symbol.h"
+
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace runtime {
+
+    struct Symbol::Entry {
+        string name;
+        uint32_t id;
+    };
+
+    namespace {
+        class SymbolTable {
+        public:
+            using Entry = Symbol::Entry;
+
+            static SymbolTable& Instance() {
+                static SymbolTable table;
+                return table;
+            }
+
+            // Записи таблицы не освобождаются, поэтому найденные записи можно запоминать
+            // в таблице потока и не захватывать общую блокировку при повторном обращении
+            const Entry* Intern(string_view name) {
+                thread_local unordered_map<string_view, const Entry*> local_index;
+                if (auto it = local_index.find(name); it != local_index.end()) {
+                    return it->second;
+                }
+                const Entry* entry = InternShared(name);
+                local_index.emplace(entry->name, entry);
+                return entry;
+            }
+
+            [[nodiscard]] const Entry* Empty() const {
+                return empty_;
+            }
+
+        private:
+            SymbolTable()
+                : empty_(InternShared({})) {
+            }
+
+            const Entry* InternShared(string_view name) {
+                lock_guard lock(mutex_);
+                if (auto it = index_.find(name); it != index_.end()) {
+                    return it->second;
+                }
+                // Записи deque не перемещаются, поэтому ключ индекса может ссылаться на имя записи
+                const auto id = static_cast<uint32_t>(entries_.size());
+                const Entry& entry = entries_.emplace_back(Entry{string(name), id});
+                index_.emplace(entry.name, &entry);
+                return &entry;
+            }
+
+            mutex mutex_;
+            deque<Entry> entries_;
+            unordered_map<string_view, const Entry*> index_;
+            const Entry* empty_;
+        };
+    }
+
+    Symbol::Symbol() noexcept
+        : entry_(SymbolTable::Instance().Empty()) {
+    }
+
+    Symbol::Symbol(string_view name)
+        : entry_(SymbolTable::Instance().Intern(name)) {
+    }
+
+    Symbol::Symbol(const string& name)
+        : Symbol(string_view(name)) {
+    }
+
+    Symbol::Symbol(const char* name)
+        : Symbol(string_view(name)) {
+    }
+
+    const string& Symbol::Str() const noexcept {
+        return entry_->name;
+    }
+
+    uint32_t Symbol::Id() const noexcept {
+        return entry_->id;
+    }
+
+    ostream& operator<<(ostream& os, Symbol symbol) {
+        return os << symbol.Str();
+    }
+
+}  // namespace runtime
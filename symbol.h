@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+    // Имя, интернированное в глобальной таблице символов. Каждое различное имя хранится
+    // в таблице один раз, а символ - лишь указатель на запись таблицы, поэтому символы
+    // сравниваются и хешируются за O(1) без обращения к символам строки.
+    // Записи таблицы не освобождаются до завершения программы. Таблица потокобезопасна
+    class Symbol {
+    public:
+        // Запись таблицы символов
+        struct Entry;
+
+        // Пустое имя
+        Symbol() noexcept;
+
+        // Интернирует name. Конструкторы неявные, чтобы имена можно было передавать туда,
+        // где ожидается символ, например при обращении к Closure
+        Symbol(std::string_view name);  // NOLINT(google-explicit-constructor)
+        Symbol(const std::string& name);  // NOLINT(google-explicit-constructor)
+        Symbol(const char* name);  // NOLINT(google-explicit-constructor)
+
+        // Возвращает имя символа. Ссылка действительна до завершения программы
+        [[nodiscard]] const std::string& Str() const noexcept;
+
+        // Возвращает номер символа. Номера выдаются подряд начиная с 0 (пустое имя)
+        [[nodiscard]] std::uint32_t Id() const noexcept;
+
+        friend bool operator==(Symbol lhs, Symbol rhs) noexcept {
+            return lhs.entry_ == rhs.entry_;
+        }
+
+        friend bool operator!=(Symbol lhs, Symbol rhs) noexcept {
+            return lhs.entry_ != rhs.entry_;
+        }
+
+    private:
+        const Entry* entry_;
+    };
+
+    std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+}  // namespace runtime
+
+namespace std {
+
+    template <>
+    struct hash<runtime::Symbol> {
+        size_t operator()(runtime::Symbol symbol) const noexcept {
+            return symbol.Id();
+        }
+    };
+
+}  // namespace std
@@ -0,0 +1,475 @@
+#include "vm.h"
+
+#include "profiler.h"
+#include "statement.h"
+
+#include <sstream>
+
+using namespace std;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BYTECODE_COMPUTED_GOTO
+#endif
+
+namespace bytecode {
+
+    using runtime::Closure;
+    using runtime::Context;
+    using runtime::ObjectHolder;
+
+    namespace {
+        // Стек регистров не перераспределяется, поэтому указатели на регистры кадра остаются
+        // действительными при вложенных вызовах
+        constexpr size_t STACK_CAPACITY = 1U << 18;
+
+        const runtime::Symbol SELF_NAME = "self"s;
+
+        // Значение ещё не присвоенной локальной переменной
+        class Unbound : public runtime::Object {
+        public:
+            void Print([[maybe_unused]] ostream& os, [[maybe_unused]] Context& context) override {
+            }
+        };
+
+        // Очищает регистры кадра при выходе из функции, в том числе по исключению
+        class FrameGuard {
+        public:
+            FrameGuard(ObjectHolder* registers, size_t count, size_t& top, size_t new_top)
+                : registers_(registers)
+                , count_(count)
+                , top_(top)
+                , saved_top_(top) {
+                top_ = new_top;
+            }
+
+            FrameGuard(const FrameGuard&) = delete;
+            FrameGuard& operator=(const FrameGuard&) = delete;
+
+            ~FrameGuard() {
+                for (size_t i = 0; i < count_; ++i) {
+                    registers_[i] = ObjectHolder::None();
+                }
+                top_ = saved_top_;
+            }
+
+        private:
+            ObjectHolder* registers_;
+            size_t count_;
+            size_t& top_;
+            size_t saved_top_;
+        };
+
+        ObjectHolder AddValues(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+            auto lhs_number = lhs.TryAs<runtime::Number>();
+            auto rhs_number = rhs.TryAs<runtime::Number>();
+            if (lhs_number != nullptr && rhs_number != nullptr) {
+                return ObjectHolder::Own(runtime::Number{lhs_number->GetValue() + rhs_number->GetValue()});
+            }
+
+            auto lhs_string = lhs.TryAs<runtime::String>();
+            auto rhs_string = rhs.TryAs<runtime::String>();
+            if (lhs_string != nullptr && rhs_string != nullptr) {
+                return ObjectHolder::Own(runtime::String::Concat(*lhs_string, *rhs_string));
+            }
+
+            auto lhs_instance = lhs.TryAs<runtime::ClassInstance>();
+            if (lhs_instance != nullptr) {
+                const runtime::Method* method =
+                    lhs_instance->GetClass().GetSpecialMethod(runtime::SpecialMethod::Add);
+                if (method != nullptr && method->formal_params.size() == 1) {
+                    return lhs_instance->Call(*method, {rhs}, context);
+                }
+            }
+
+            throw runtime_error("No __add__ method"s);
+        }
+
+        pair<int, int> NumberOperands(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+            auto lhs_number = lhs.TryAs<runtime::Number>();
+            auto rhs_number = rhs.TryAs<runtime::Number>();
+            if (lhs_number == nullptr || rhs_number == nullptr) {
+                throw runtime_error("lhs or rhs not Number"s);
+            }
+            return {lhs_number->GetValue(), rhs_number->GetValue()};
+        }
+
+        runtime::ClassInstance& AsInstance(const ObjectHolder& object) {
+            auto instance = object.TryAs<runtime::ClassInstance>();
+            if (instance == nullptr) {
+                throw runtime_error("Object is not a class instance"s);
+            }
+            return *instance;
+        }
+
+        // Метка живёт, пока жив поток, поэтому не учитывается в счётчиках памяти выполнения,
+        // при котором машина создана
+        ObjectHolder MakeUnbound() {
+            runtime::MemoryScope unaccounted(nullptr);
+            return ObjectHolder::Own(Unbound{});
+        }
+    }  // namespace
+
+    Machine::Machine()
+        : unbound_(MakeUnbound())
+        , true_(ObjectHolder::Own(runtime::Bool{true}))
+        , false_(ObjectHolder::Own(runtime::Bool{false})) {
+        stack_.reserve(STACK_CAPACITY);
+    }
+
+    Machine& Machine::ForCurrentThread() {
+        thread_local Machine machine;
+        return machine;
+    }
+
+    size_t Machine::Top() const {
+        return top_;
+    }
+
+    ObjectHolder& Machine::Register(size_t index) {
+        return stack_[index];
+    }
+
+    void Machine::Reserve(size_t size) {
+        if (size > STACK_CAPACITY) {
+            throw runtime_error("Stack overflow"s);
+        }
+        if (size > stack_.size()) {
+            stack_.resize(size);
+        }
+    }
+
+    const ObjectHolder& Machine::GetUnbound() const {
+        return unbound_;
+    }
+
+    ObjectHolder Machine::Run(const Function& function, size_t base, Closure* globals,
+                              Context& context) {
+        Reserve(base + function.register_count);
+        ObjectHolder* const regs = stack_.data() + base;
+        for (uint16_t reg : function.unbound_registers) {
+            regs[reg] = unbound_;
+        }
+        return Resume(function, base, 0, globals, context);
+    }
+
+    ObjectHolder Machine::Resume(const Function& function, size_t base, size_t start,
+                                 Closure* globals, Context& context) {
+        Reserve(base + function.register_count);
+        ObjectHolder* const regs = stack_.data() + base;
+        FrameGuard guard(regs, function.register_count, top_, base + function.register_count);
+
+        const Instruction* const code = function.code.data();
+        const Instruction* ip = code + start;
+        const ObjectHolder* const constants = function.constants.data();
+        const runtime::Symbol* const names = function.names.data();
+
+        auto as_bool = [this](bool value) -> const ObjectHolder& {
+            return value ? true_ : false_;
+        };
+
+        // Вычисляемый goto не вызывает деструкторы локальных объектов блока, из которого
+        // выполняется переход. Поэтому объекты с деструкторами объявляются во вложенных блоках,
+        // которые заканчиваются до NEXT()
+#ifdef BYTECODE_COMPUTED_GOTO
+        static void* const DISPATCH_TABLE[OPCODE_COUNT] = {
+#define BYTECODE_OPCODE_LABEL(name) &&op_##name,
+            BYTECODE_OPCODES(BYTECODE_OPCODE_LABEL)
+#undef BYTECODE_OPCODE_LABEL
+        };
+#define DISPATCH() goto* DISPATCH_TABLE[static_cast<size_t>(ip->op)]
+#define CASE(name) op_##name:
+#define NEXT() \
+    ++ip;      \
+    DISPATCH()
+        DISPATCH();
+#else
+#define CASE(name) case OpCode::name:
+#define NEXT() \
+    ++ip;      \
+    continue
+        for (;;) {
+            switch (ip->op) {
+#endif
+        CASE(LoadConst) {
+            regs[ip->a] = constants[ip->BC()];
+            NEXT();
+        }
+        CASE(LoadNone) {
+            regs[ip->a] = ObjectHolder::None();
+            NEXT();
+        }
+        CASE(Move) {
+            regs[ip->a] = regs[ip->b];
+            NEXT();
+        }
+        CASE(LoadGlobal) {
+            auto found = globals->find(names[ip->b]);
+            if (found == globals->end()) {
+                throw runtime_error("Not find variable"s);
+            }
+            regs[ip->a] = found->second;
+            NEXT();
+        }
+        CASE(StoreGlobal) {
+            (*globals)[names[ip->b]] = regs[ip->a];
+            NEXT();
+        }
+        CASE(DefineGlobal) {
+            globals->emplace(names[ip->b], regs[ip->a]);
+            NEXT();
+        }
+        CASE(DefineLocal) {
+            if (regs[ip->a].Get() == unbound_.Get()) {
+                regs[ip->a] = regs[ip->b];
+            }
+            NEXT();
+        }
+        CASE(CheckBound) {
+            if (regs[ip->a].Get() == unbound_.Get()) {
+                throw runtime_error("Not find variable"s);
+            }
+            NEXT();
+        }
+        CASE(GetField) {
+            const ObjectHolder* field =
+                function.field_caches[ip->c].Find(AsInstance(regs[ip->b]), names[ip->c]);
+            if (field == nullptr) {
+                throw runtime_error("Not find variable"s);
+            }
+            {
+                // Копия нужна до присваивания: r[a] может быть единственным владельцем объекта
+                ObjectHolder value = *field;
+                regs[ip->a] = std::move(value);
+            }
+            NEXT();
+        }
+        CASE(SetField) {
+            function.field_caches[ip->b].Assign(AsInstance(regs[ip->a]), names[ip->b], regs[ip->c]);
+            NEXT();
+        }
+        CASE(Add) {
+            regs[ip->a] = AddValues(regs[ip->b], regs[ip->c], context);
+            NEXT();
+        }
+        CASE(Sub) {
+            const auto [lhs, rhs] = NumberOperands(regs[ip->b], regs[ip->c]);
+            regs[ip->a] = ObjectHolder::Own(runtime::Number{lhs - rhs});
+            NEXT();
+        }
+        CASE(Mult) {
+            const auto [lhs, rhs] = NumberOperands(regs[ip->b], regs[ip->c]);
+            regs[ip->a] = ObjectHolder::Own(runtime::Number{lhs * rhs});
+            NEXT();
+        }
+        CASE(Div) {
+            const auto [lhs, rhs] = NumberOperands(regs[ip->b], regs[ip->c]);
+            if (rhs == 0) {
+                throw runtime_error("Division by zero"s);
+            }
+            regs[ip->a] = ObjectHolder::Own(runtime::Number{lhs / rhs});
+            NEXT();
+        }
+        CASE(ToBool) {
+            regs[ip->a] = as_bool(runtime::IsTrue(regs[ip->b]));
+            NEXT();
+        }
+        CASE(Not) {
+            regs[ip->a] = as_bool(!runtime::IsTrue(regs[ip->b]));
+            NEXT();
+        }
+        CASE(Equal) {
+            regs[ip->a] = as_bool(runtime::Equal(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(NotEqual) {
+            regs[ip->a] = as_bool(runtime::NotEqual(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(Less) {
+            regs[ip->a] = as_bool(runtime::Less(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(Greater) {
+            regs[ip->a] = as_bool(runtime::Greater(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(LessOrEqual) {
+            regs[ip->a] = as_bool(runtime::LessOrEqual(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(GreaterOrEqual) {
+            regs[ip->a] = as_bool(runtime::GreaterOrEqual(regs[ip->b], regs[ip->c], context));
+            NEXT();
+        }
+        CASE(Stringify) {
+            if (const auto* str = regs[ip->b].TryAs<runtime::String>()) {
+                regs[ip->a] = ObjectHolder::Own(runtime::String(*str));
+            } else {
+                string text;
+                runtime::AppendString(regs[ip->b], text, context);
+                regs[ip->a] = ObjectHolder::Own(runtime::String(std::move(text)));
+            }
+            NEXT();
+        }
+        CASE(Print) {
+            runtime::PrintValue(regs[ip->a], context);
+            runtime::PrintChar(ip->b != 0 ? '\n' : ' ', context);
+            NEXT();
+        }
+        CASE(PrintNewline) {
+            runtime::PrintChar('\n', context);
+            NEXT();
+        }
+        CASE(Call) {
+            runtime::ClassInstance& instance = AsInstance(regs[ip->a]);
+            const runtime::Symbol method_name = names[ip->b];
+            const size_t argument_count = ip->c;
+            const runtime::Method* method =
+                function.method_caches[ip->b].Lookup(instance.GetClass(), method_name);
+            if (method == nullptr || method->formal_params.size() != argument_count) {
+                throw runtime_error("There is no method " + method_name.Str() + "in the class "
+                                    + instance.GetClass().GetName());
+            }
+            const auto* compiled = dynamic_cast<const CompiledMethod*>(method->body.get());
+            if (compiled != nullptr) {
+                // Кадр вызываемого метода начинается с регистра получателя
+                ObjectHolder result;
+                if (runtime::Profiler* profiler = context.GetProfiler(); profiler != nullptr) {
+                    runtime::Profiler::Scope scope(*profiler, instance.GetClass(), *method);
+                    result = Run(compiled->GetFunction(), base + ip->a, nullptr, context);
+                } else {
+                    result = compiled->Invoke(*this, base + ip->a, context);
+                }
+                regs[ip->a] = std::move(result);
+            } else {
+                vector<ObjectHolder> actual_args(regs + ip->a + 1, regs + ip->a + 1 + argument_count);
+                ObjectHolder result = instance.Call(*method, actual_args, context);
+                regs[ip->a] = std::move(result);
+            }
+            NEXT();
+        }
+        CASE(NewInstance) {
+            const runtime::Class& cls = function.new_instances[ip->b]->GetClass();
+            ObjectHolder instance = ObjectHolder::Own(runtime::ClassInstance(cls));
+            const runtime::Method* init = cls.GetSpecialMethod(runtime::SpecialMethod::Init);
+            if (init != nullptr && init->formal_params.size() == ip->c) {
+                const auto* compiled = dynamic_cast<const CompiledMethod*>(init->body.get());
+                if (compiled != nullptr) {
+                    // Аргументы уже лежат за регистром a, поэтому кадр __init__ собирается
+                    // на месте: в регистр a кладётся новый экземпляр
+                    regs[ip->a] = instance;
+                    if (runtime::Profiler* profiler = context.GetProfiler(); profiler != nullptr) {
+                        runtime::Profiler::Scope scope(*profiler, cls, *init);
+                        Run(compiled->GetFunction(), base + ip->a, nullptr, context);
+                    } else {
+                        compiled->Invoke(*this, base + ip->a, context);
+                    }
+                } else {
+                    vector<ObjectHolder> actual_args(regs + ip->a + 1, regs + ip->a + 1 + ip->c);
+                    instance.TryAs<runtime::ClassInstance>()->Call(*init, actual_args, context);
+                }
+            }
+            regs[ip->a] = std::move(instance);
+            NEXT();
+        }
+        CASE(Native) {
+            regs[ip->a] = function.natives[ip->b]->Execute(*globals, context);
+            NEXT();
+        }
+        CASE(Jump) {
+            ip = code + ip->BC();
+            DISPATCH();
+        }
+        CASE(JumpIfFalse) {
+            if (!runtime::IsTrue(regs[ip->a])) {
+                ip = code + ip->BC();
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(JumpIfTrue) {
+            if (runtime::IsTrue(regs[ip->a])) {
+                ip = code + ip->BC();
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(Return) {
+            return regs[ip->a];
+        }
+        CASE(ReturnNone) {
+            return ObjectHolder::None();
+        }
+#ifndef BYTECODE_COMPUTED_GOTO
+            }
+        }
+#endif
+#undef CASE
+#undef NEXT
+#undef DISPATCH
+    }
+
+    CompiledMethod::CompiledMethod(unique_ptr<runtime::Executable> source,
+                                   unique_ptr<Function> function,
+                                   vector<runtime::Symbol> formal_params,
+                                   uint32_t jit_threshold)
+        : source_(std::move(source))
+        , function_(std::move(function))
+        , formal_params_(std::move(formal_params))
+        , jit_(jit_threshold) {
+    }
+
+    ObjectHolder CompiledMethod::Execute(Closure& closure, Context& context) {
+        Machine& machine = Machine::ForCurrentThread();
+        const size_t base = machine.Top();
+        machine.Reserve(base + function_->register_count);
+        // Методу, прошедшему разрешение имён, ClassInstance::Call передаёт self и параметры
+        // в слотах 0..n кадра. Кадр больше не нужен, поэтому значения переносятся в регистры
+        if (const runtime::Frame* frame = context.GetFrame()) {
+            for (size_t i = 0; i <= formal_params_.size(); ++i) {
+                machine.Register(base + i) = std::move(*(*frame)[i]);
+            }
+        } else {
+            machine.Register(base) = closure.at(SELF_NAME);
+            for (size_t i = 0; i < formal_params_.size(); ++i) {
+                machine.Register(base + i + 1) = closure.at(formal_params_[i]);
+            }
+        }
+        return Invoke(machine, base, context);
+    }
+
+    ObjectHolder CompiledMethod::Invoke(Machine& machine, size_t base, Context& context) const {
+        if (ObjectHolder result; jit_.TryRun(*this, machine, base, context, result)) {
+            return result;
+        }
+        return machine.Run(*function_, base, nullptr, context);
+    }
+
+    const Function& CompiledMethod::GetFunction() const {
+        return *function_;
+    }
+
+    const runtime::Executable& CompiledMethod::GetSource() const {
+        return *source_;
+    }
+
+    jit::MethodState& CompiledMethod::GetJitState() const {
+        return jit_;
+    }
+
+    CompiledProgram::CompiledProgram(unique_ptr<runtime::Executable> source,
+                                     unique_ptr<Function> function)
+        : source_(std::move(source))
+        , function_(std::move(function)) {
+    }
+
+    ObjectHolder CompiledProgram::Execute(Closure& closure, Context& context) {
+        Machine& machine = Machine::ForCurrentThread();
+        return machine.Run(*function_, machine.Top(), &closure, context);
+    }
+
+    const Function& CompiledProgram::GetFunction() const {
+        return *function_;
+    }
+
+}  // namespace bytecode
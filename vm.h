@@ -0,0 +1,101 @@
+#pragma once
+
+#include "bytecode.h"
+#include "jit.h"
+#include "runtime.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+    // Регистровая машина, исполняющая байт-код.
+    // Кадры всех активных вызовов лежат в одном непрерывном стеке регистров.
+    // У каждого потока своя машина, а скомпилированный код от машины не зависит,
+    // поэтому одну программу можно выполнять в нескольких потоках одновременно
+    class Machine {
+    public:
+        Machine();
+
+        // Возвращает машину текущего потока
+        [[nodiscard]] static Machine& ForCurrentThread();
+
+        // Выполняет function в кадре, начинающемся с регистра base.
+        // Регистры self и параметров (0..param_count) должны быть заполнены заранее.
+        // globals - переменные программы верхнего уровня, в методах равен nullptr
+        runtime::ObjectHolder Run(const Function& function, size_t base, runtime::Closure* globals,
+                                  runtime::Context& context);
+
+        // Продолжает выполнение function с инструкции ip. Все регистры кадра, включая
+        // не присвоенные локальные переменные, должны быть заполнены заранее.
+        // Так машинный код передаёт выполнение интерпретатору при деоптимизации
+        runtime::ObjectHolder Resume(const Function& function, size_t base, size_t ip,
+                                     runtime::Closure* globals, runtime::Context& context);
+
+        // Возвращает номер первого свободного регистра стека
+        [[nodiscard]] size_t Top() const;
+
+        // Возвращает регистр стека с номером index. Стек должен вмещать index + 1 регистров
+        [[nodiscard]] runtime::ObjectHolder& Register(size_t index);
+
+        // Убеждается, что стек вмещает size регистров
+        void Reserve(size_t size);
+
+        // Возвращает значение регистра локальной переменной, которой ещё ничего не присвоено
+        [[nodiscard]] const runtime::ObjectHolder& GetUnbound() const;
+
+    private:
+        std::vector<runtime::ObjectHolder> stack_;
+        size_t top_ = 0;
+        runtime::ObjectHolder unbound_;
+        runtime::ObjectHolder true_;
+        runtime::ObjectHolder false_;
+    };
+
+    // Тело метода, скомпилированное в байт-код.
+    // Заменяет исходное тело в runtime::Method и владеет им.
+    // После jit_threshold вызовов метод компилируется в машинный код (см. jit.h)
+    class CompiledMethod : public runtime::Executable {
+    public:
+        CompiledMethod(std::unique_ptr<runtime::Executable> source,
+                       std::unique_ptr<Function> function,
+                       std::vector<runtime::Symbol> formal_params,
+                       std::uint32_t jit_threshold = jit::DEFAULT_THRESHOLD);
+
+        // Вызов через ClassInstance::Call: self и параметры берутся из closure
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+        // Выполняет метод в кадре base машины, регистры self и параметров заполнены.
+        // Метод исполняет машинный код, если он готов, иначе интерпретатор
+        runtime::ObjectHolder Invoke(Machine& machine, size_t base,
+                                     runtime::Context& context) const;
+
+        [[nodiscard]] const Function& GetFunction() const;
+        [[nodiscard]] const runtime::Executable& GetSource() const;
+        [[nodiscard]] jit::MethodState& GetJitState() const;
+
+    private:
+        std::unique_ptr<runtime::Executable> source_;
+        std::unique_ptr<Function> function_;
+        std::vector<runtime::Symbol> formal_params_;
+        mutable jit::MethodState jit_;
+    };
+
+    // Программа, скомпилированная в байт-код. Владеет исходным деревом разбора
+    class CompiledProgram : public runtime::Executable {
+    public:
+        CompiledProgram(std::unique_ptr<runtime::Executable> source,
+                        std::unique_ptr<Function> function);
+
+        // Выполняет программу, храня её переменные в closure
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+        [[nodiscard]] const Function& GetFunction() const;
+
+    private:
+        std::unique_ptr<runtime::Executable> source_;
+        std::unique_ptr<Function> function_;
+    };
+
+}  // namespace bytecode
@@ -0,0 +1,410 @@
+#include "compiler.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+using namespace std;
+
+namespace bytecode {
+
+using runtime::Closure;
+using runtime::ObjectHolder;
+
+namespace {
+
+string RunProgram(const string& program, bool compiled) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    auto tree = ParseProgram(lexer);
+    if (compiled) {
+        tree = Compile(std::move(tree));
+    }
+
+    runtime::DummyContext context;
+    Closure closure;
+    tree->Execute(closure, context);
+    return context.output.str();
+}
+
+// Проверяет, что обход дерева и байт-код дают одинаковый вывод, равный expected
+void AssertSameOutput(const string& program, const string& expected) {
+    ASSERT_EQUAL(RunProgram(program, false), expected);
+    ASSERT_EQUAL(RunProgram(program, true), expected);
+}
+
+// Проверяет, что обе реализации выбрасывают runtime_error
+void AssertBothThrow(const string& program) {
+    ASSERT_THROWS(RunProgram(program, false), std::runtime_error);
+    ASSERT_THROWS(RunProgram(program, true), std::runtime_error);
+}
+
+void TestGlobals() {
+    AssertSameOutput(R"(
+x = 4
+y = x * 2 + 1
+z = "hello, " + "world"
+print x, y, z, None, True
+x = z
+print x, str(y) + str(None)
+print
+print not x, x and False, 0 or y
+)",
+                     "4 9 hello, world None True\nhello, world 9None\n\nFalse False True\n");
+}
+
+void TestShortCircuit() {
+    AssertSameOutput(R"(
+class Probe:
+  def __init__():
+    self.calls = 0
+
+  def hit(result):
+    self.calls = self.calls + 1
+    return result
+
+  def both(a, b):
+    b = a and b
+    return b
+
+p = Probe()
+x = None
+print x != None and x.missing(), True or x.missing()
+print p.hit(False) and p.hit(True), p.hit(True) or p.hit(False), p.calls
+print p.both(0, 5), p.both(3, 0), p.both(3, 5)
+)",
+                     "False True\nFalse True 2\nFalse False True\n");
+}
+
+void TestConditions() {
+    AssertSameOutput(R"(
+x = 4
+y = 5
+if x > y:
+  print "x > y"
+else:
+  print "x <= y"
+if x >= 4:
+  if y <= 4:
+    print "y <= 4"
+  else:
+    print "y > 4"
+if x != y and not x == y:
+  print 'differ'
+)",
+                     "x <= y\ny > 4\ndiffer\n");
+}
+
+void TestMethodsAndRecursion() {
+    AssertSameOutput(R"(
+class GCD:
+  def __init__():
+    self.call_count = 0
+
+  def calc(a, b):
+    self.call_count = self.call_count + 1
+    if a < b:
+      return self.calc(b, a)
+    if b == 0:
+      return a
+    return self.calc(a - b, b)
+
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+x = GCD()
+print x.calc(510510, 18629977)
+print x.calc(22, 17)
+print x.call_count
+f = Fib()
+print f.calc(15)
+)",
+                     "17\n1\n115\n610\n");
+}
+
+void TestLocals() {
+    AssertSameOutput(R"(
+class Calc:
+  def sum(a, b):
+    result = a
+    result = result + b
+    return result
+
+  def pick(flag):
+    if flag:
+      value = 'then'
+    else:
+      value = 'else'
+    return value
+
+  def swap(a, b):
+    t = a
+    a = b
+    b = t
+    return str(a) + str(b)
+
+c = Calc()
+print c.sum(2, 3), c.pick(True), c.pick(0), c.swap(1, 2)
+)",
+                     "5 then else 21\n");
+}
+
+void TestUnboundLocal() {
+    const string program = R"(
+class Lazy:
+  def get(flag):
+    if flag:
+      value = 1
+    return value
+
+x = Lazy()
+print x.get(True)
+print x.get(False)
+)";
+    AssertBothThrow(program);
+    ASSERT_THROWS(RunProgram("print undefined"s, true), std::runtime_error);
+}
+
+void TestDunderMethods() {
+    AssertSameOutput(R"(
+class Value:
+  def __init__(v):
+    self.v = v
+
+  def __str__():
+    return 'Value(' + str(self.v) + ')'
+
+  def __eq__(other):
+    return self.v == other.v
+
+  def __lt__(other):
+    return self.v < other.v
+
+  def __add__(other):
+    return self.v + other.v
+
+a = Value(1)
+b = Value(2)
+print a, b
+print a == b, a != b, a < b, a > b, a <= b, a >= b
+print a + b
+)",
+                     "Value(1) Value(2)\nFalse True True False True False\n3\n");
+}
+
+void TestInheritance() {
+    AssertSameOutput(R"--(
+class Shape:
+  def __str__():
+    return "Shape"
+
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Square(Rect):
+  def __str__():
+    return "Square(" + str(self.w) + ")"
+
+s = Shape()
+r = Rect(2, 3)
+q = Square(4, 4)
+print s, r.area(), q, q.area()
+)--",
+                     "Shape 6 Square(4) 16\n");
+}
+
+void TestFieldChains() {
+    AssertSameOutput(R"(
+class Node:
+  def __init__(value):
+    self.value = value
+    self.next = None
+
+  def link(other):
+    self.next = other
+    return self
+
+list = Node(1)
+second = Node(2)
+third = Node(3)
+second.link(third)
+list.link(second)
+print list.value, list.next.value, list.next.next.value, list.next.next.next
+list.next.next.value = 30
+print list.next.next.value
+)",
+                     "1 2 3 None\n30\n");
+}
+
+void TestPrintOrderWithSideEffects() {
+    AssertSameOutput(R"(
+class Atom:
+  def __str__():
+    print 'inner'
+    return 'atom'
+
+  def get():
+    print 'get'
+    return 1
+
+a = Atom()
+print a, a.get(), a
+)",
+                     "inner\natom get\n1 inner\natom\n");
+}
+
+void TestRuntimeErrors() {
+    AssertBothThrow("print 1 / 0\n"s);
+    AssertBothThrow("print 1 + 'a'\n"s);
+    AssertBothThrow("print 'a' - 'b'\n"s);
+    AssertBothThrow(R"(
+class A:
+  def f(x):
+    return x
+
+a = A()
+a.f()
+)");
+}
+
+void TestMethodsAreCompiled() {
+    istringstream is(R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def norm():
+    return self.x * self.x + self.y * self.y
+
+p = Point(3, 4)
+print p.norm()
+)");
+    parse::Lexer lexer(is);
+    auto program = Compile(ParseProgram(lexer));
+
+    runtime::DummyContext context;
+    Closure closure;
+    program->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "25\n"s);
+
+    const auto* cls = closure.at("Point"s).TryAs<runtime::Class>();
+    ASSERT(cls != nullptr);
+    for (const auto& method : cls->Methods()) {
+        ASSERT(dynamic_cast<const CompiledMethod*>(method.body.get()) != nullptr);
+    }
+
+    const auto* norm = dynamic_cast<const CompiledMethod*>(cls->GetMethod("norm"s)->body.get());
+    ostringstream listing;
+    Disassemble(listing, norm->GetFunction());
+    ASSERT(listing.str().find("Mult"s) != string::npos);
+    ASSERT(listing.str().find("GetField"s) != string::npos);
+}
+
+// Инструкция, неизвестная компилятору
+class Answer : public runtime::Executable {
+public:
+    ObjectHolder Execute([[maybe_unused]] Closure& closure,
+                         [[maybe_unused]] runtime::Context& context) override {
+        return ObjectHolder::Own(runtime::Number{42});
+    }
+};
+
+void TestUnknownStatementsFallBack() {
+    vector<runtime::Method> methods;
+    methods.push_back(
+        {"answer"s, {}, make_unique<ast::MethodBody>(make_unique<ast::Return>(make_unique<Answer>()))});
+    methods.push_back({"twice"s,
+                       {"x"s},
+                       make_unique<ast::Add>(make_unique<ast::VariableValue>("x"s),
+                                             make_unique<ast::VariableValue>("x"s))});
+    auto cls = ObjectHolder::Own(runtime::Class{"Box"s, std::move(methods), nullptr});
+    const auto& box = *cls.TryAs<runtime::Class>();
+
+    auto program = make_unique<ast::Compound>();
+    program->AddStatement(make_unique<ast::ClassDefinition>(cls));
+    program->AddStatement(make_unique<ast::Assignment>("b"s, make_unique<ast::NewInstance>(box)));
+    program->AddStatement(make_unique<ast::Assignment>("x"s, make_unique<Answer>()));
+
+    vector<unique_ptr<ast::Statement>> args;
+    args.push_back(make_unique<ast::VariableValue>("x"s));
+    args.push_back(make_unique<ast::MethodCall>(make_unique<ast::VariableValue>("b"s), "answer"s,
+                                                vector<unique_ptr<ast::Statement>>{}));
+    vector<unique_ptr<ast::Statement>> twice_args;
+    twice_args.push_back(make_unique<ast::NumericConst>(21));
+    args.push_back(make_unique<ast::MethodCall>(make_unique<ast::VariableValue>("b"s), "twice"s,
+                                                std::move(twice_args)));
+    program->AddStatement(make_unique<ast::Print>(std::move(args)));
+
+    auto compiled = Compile(std::move(program));
+    // Метод с неизвестной инструкцией остаётся исполняться обходом дерева
+    ASSERT(dynamic_cast<const CompiledMethod*>(box.GetMethod("answer"s)->body.get()) == nullptr);
+    ASSERT(dynamic_cast<const CompiledMethod*>(box.GetMethod("twice"s)->body.get()) != nullptr);
+
+    runtime::DummyContext context;
+    Closure closure;
+    compiled->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "42 42 42\n"s);
+}
+
+void TestStatementValues() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    auto cpd = make_unique<ast::Compound>(
+        make_unique<ast::Assignment>("x"s, make_unique<ast::StringConst>("one"s)),
+        make_unique<ast::Assignment>("y"s, make_unique<ast::NumericConst>(2)),
+        make_unique<ast::Assignment>("z"s, make_unique<ast::VariableValue>("x"s)));
+    auto result = Compile(std::move(cpd))->Execute(closure, context);
+    ASSERT(!result);
+    ASSERT_EQUAL(closure.at("x"s).TryAs<runtime::String>()->GetValue(), "one"s);
+    ASSERT_EQUAL(closure.at("y"s).TryAs<runtime::Number>()->GetValue(), 2);
+    ASSERT_EQUAL(closure.at("z"s).TryAs<runtime::String>()->GetValue(), "one"s);
+
+    auto sum = Compile(make_unique<ast::Add>(make_unique<ast::VariableValue>("y"s),
+                                             make_unique<ast::NumericConst>(40)))
+                   ->Execute(closure, context);
+    ASSERT_EQUAL(sum.TryAs<runtime::Number>()->GetValue(), 42);
+
+    vector<runtime::Method> methods;
+    methods.push_back({"__str__"s, {}, make_unique<ast::NumericConst>(842)});
+    runtime::Class cls("BoxedValue"s, std::move(methods), nullptr);
+    auto str = Compile(make_unique<ast::Stringify>(make_unique<ast::NewInstance>(cls)))
+                   ->Execute(closure, context);
+    ASSERT_EQUAL(str.TryAs<runtime::String>()->GetValue(), "842"s);
+
+    ASSERT(context.output.str().empty());
+}
+
+}  // namespace
+
+void RunVmTests(TestRunner& tr) {
+    RUN_TEST(tr, bytecode::TestGlobals);
+    RUN_TEST(tr, bytecode::TestConditions);
+    RUN_TEST(tr, bytecode::TestShortCircuit);
+    RUN_TEST(tr, bytecode::TestMethodsAndRecursion);
+    RUN_TEST(tr, bytecode::TestLocals);
+    RUN_TEST(tr, bytecode::TestUnboundLocal);
+    RUN_TEST(tr, bytecode::TestDunderMethods);
+    RUN_TEST(tr, bytecode::TestInheritance);
+    RUN_TEST(tr, bytecode::TestFieldChains);
+    RUN_TEST(tr, bytecode::TestPrintOrderWithSideEffects);
+    RUN_TEST(tr, bytecode::TestRuntimeErrors);
+    RUN_TEST(tr, bytecode::TestMethodsAreCompiled);
+    RUN_TEST(tr, bytecode::TestUnknownStatementsFallBack);
+    RUN_TEST(tr, bytecode::TestStatementValues);
+}
+
+}  // namespace bytecode